@@ -0,0 +1,72 @@
+#include "g_log.h"
+#include "analytics_clock.h"
+
+
+void init_analytics_clock(AnalyticsClock *clock, int cam_idx, GstClockTime period)
+{
+  clock->cam_idx = cam_idx;
+  clock->period = period;
+  clock->next_tick = GST_CLOCK_TIME_NONE;
+  clock->ticks = 0;
+  clock->frames = 0;
+  clock->tick_frames = 0;
+  clock->inferred_frames = 0;
+  clock->tick_inferred_frames = 0;
+  clock->reset_pending = 0;
+}
+
+
+// Restart the tick from the next buffer, safe to call while the probe is running
+void reset_analytics_clock(AnalyticsClock *clock)
+{
+  g_atomic_int_set(&clock->reset_pending, 1);
+}
+
+
+// Count one frame with its PTS, inferred when nvinfer ran on it (bInferDone).
+// Returns TRUE when this frame closes a tick, tick_frames and tick_inferred_frames then describe it
+gboolean advance_analytics_clock(AnalyticsClock *clock, GstClockTime pts, gboolean inferred)
+{
+  if (!GST_CLOCK_TIME_IS_VALID(pts))
+    pts = (GstClockTime)g_get_monotonic_time() * GST_USECOND;     //no timestamp, fall back to wall time
+
+  if (g_atomic_int_get(&clock->reset_pending)) {
+    g_atomic_int_set(&clock->reset_pending, 0);
+    clock->next_tick = GST_CLOCK_TIME_NONE;
+  }
+
+  if (!GST_CLOCK_TIME_IS_VALID(clock->next_tick)) {
+    clock->next_tick = pts + clock->period;
+    clock->frames = 1;
+    clock->inferred_frames = inferred ? 1 : 0;
+    return FALSE;
+  }
+
+  clock->frames++;
+  clock->inferred_frames += inferred ? 1 : 0;
+  if (pts + clock->period < clock->next_tick) {                     //PTS went backwards (seek, source restart)
+    glog_trace("cam_idx=%d PTS went back, resync analytics clock\n", clock->cam_idx);
+    clock->next_tick = pts + clock->period;
+    clock->frames = 1;
+    clock->inferred_frames = inferred ? 1 : 0;
+    return FALSE;
+  }
+  if (pts < clock->next_tick)
+    return FALSE;
+
+  if (pts >= clock->next_tick + (ANALYTICS_MAX_GAP_TICKS * clock->period)) {
+    glog_trace("cam_idx=%d PTS gap %" GST_TIME_FORMAT ", resync analytics clock\n", clock->cam_idx, GST_TIME_ARGS(pts - clock->next_tick));
+    clock->next_tick = pts + clock->period;
+  }
+  else {
+    clock->next_tick += clock->period;
+  }
+  clock->ticks++;
+  clock->tick_frames = clock->frames;
+  clock->tick_inferred_frames = clock->inferred_frames;
+  clock->frames = 0;
+  clock->inferred_frames = 0;
+
+  return TRUE;
+}
+
@@ -0,0 +1,27 @@
+#ifndef __ANALYTICS_CLOCK_H__
+#define __ANALYTICS_CLOCK_H__
+
+#include <gst/gst.h>
+
+#define ANALYTICS_TICK_PERIOD     GST_SECOND      //period of the per-second analytics work
+#define ANALYTICS_MAX_GAP_TICKS   4               //a larger PTS jump is taken as a discontinuity and resyncs the clock
+
+// Per-camera clock driven by buffer PTS, independent of the source fps
+typedef struct {
+  int cam_idx;
+  GstClockTime period;
+  GstClockTime next_tick;   // PTS that closes the current tick, GST_CLOCK_TIME_NONE until the first buffer
+  guint64 ticks;            // completed ticks
+  int frames;               // frames counted in the current tick
+  int tick_frames;          // frames of the last completed tick
+  int inferred_frames;      // frames of the current tick nvinfer ran on, the others carry tracker output
+  int tick_inferred_frames; // inferred frames of the last completed tick
+  gint reset_pending;       // set by reset_analytics_clock() from any thread
+} AnalyticsClock;
+
+
+void init_analytics_clock(AnalyticsClock *clock, int cam_idx, GstClockTime period);
+void reset_analytics_clock(AnalyticsClock *clock);
+gboolean advance_analytics_clock(AnalyticsClock *clock, GstClockTime pts, gboolean inferred);
+
+#endif
@@ -0,0 +1,896 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "g_log.h"
+#include "analytics_core.h"
+#include "thermal_projection.h"               //get_bbox_iou()
+
+
+int g_num_cams = 0;                         //cameras with analysis state, set by init_analytics_core()
+ObjStore *obj_store = NULL;                 //g_num_cams entries
+static AnalyticsState *g_analytics_state = NULL;
+static AnalyticsEventFunc g_event_func = NULL;
+
+
+// Send the events of trigger_notification() to func instead of the notifier, e.g. to count them in a replay
+void set_analytics_event_func(AnalyticsEventFunc func)
+{
+  g_event_func = func;
+}
+
+
+// Function to initialize the AvgCalculator for each object
+void init_calculator(int cam_idx, int obj_id) 
+{
+    AvgCalculator* calculator = &OBJ_INFO(cam_idx, obj_id, temp_avg_calculator);
+
+    calculator->index = 0;
+    calculator->count = 0;
+    calculator->sum = 0;
+
+    // Initialize buffer values to zero
+    for (int i = 0; i < BUFFER_SIZE; i++) {
+        calculator->buffer[i] = 0;
+    }
+}
+
+// Function to add a new value for an object and calculate the avg
+void add_value_and_calculate_avg(AnalyticsState *state, int obj_id, int new_value) 
+{
+    int cam_idx = state->cam_idx;
+
+    // Get reference to the AvgCalculator of the object
+    AvgCalculator* calculator = &OBJ_INFO(cam_idx, obj_id, temp_avg_calculator);
+
+    // Remove the oldest value from the sum if the buffer is full
+    if (calculator->count == BUFFER_SIZE) {
+        calculator->sum -= calculator->buffer[calculator->index];
+    }
+
+    // Add the new value to the buffer and the sum
+    calculator->buffer[calculator->index] = new_value;
+    calculator->sum += new_value;
+
+    // Move the index forward in a circular manner
+    calculator->index = (calculator->index + 1) % BUFFER_SIZE;
+
+    // Update the count
+    if (calculator->count < BUFFER_SIZE) {
+        calculator->count++;
+    }
+
+    // Calculate and update the avg of the object, corrected here once rather than by a pass over the objects each tick
+    OBJ_INFO(cam_idx, obj_id, bbox_temp) = round((float)calculator->sum / (float)calculator->count) + state->setting.temp_correction;
+}
+
+double my_sqrt(double num) 
+{
+  if (num < 0) {
+      printf("Error: Negative input. Square root of negative numbers is not defined in real numbers.\n");
+      return -1.0;
+  }
+  if (num == 0 || num == 1) {
+      return num;
+  }
+
+  double guess = num / 2.0; // Initial guess
+  double epsilon = 1e-6;    // Precision threshold
+
+  while ((guess * guess - num) > epsilon || (num - guess * guess) > epsilon) {
+      guess = (guess + num / guess) / 2.0; // Newton-Raphson formula
+  }
+
+  return guess;
+}
+
+double calculate_sqrt(double width, double height) 
+{
+  return my_sqrt((width * width) + (height * height));
+}
+
+
+// Count one frame of the object for the detection rule of its class
+void gather_event(const EventRule *rule, int obj_id, int cam_idx)
+{
+  if (obj_id < 0 || rule == NULL)
+    return;
+  OBJ_INFO(cam_idx, obj_id, detected_frame_count)++;
+}
+
+void init_opt_flow(AnalyticsState *state, int obj_id, int is_total)
+{
+  int cam_idx = state->cam_idx;
+
+  if (state->setting.opt_flow_apply == 0) {
+    return;
+  }
+
+  OBJ_INFO(cam_idx, obj_id, opt_flow_check_count) = 0;
+  OBJ_INFO(cam_idx, obj_id, move_size_avg) = 0.0;
+  OBJ_INFO(cam_idx, obj_id, do_opt_flow) = 0;
+  if (is_total) {
+    OBJ_INFO(cam_idx, obj_id, opt_flow_detected_count) = 0;
+    OBJ_INFO(cam_idx, obj_id, prev_x) = 0;
+    OBJ_INFO(cam_idx, obj_id, prev_y) = 0;
+    OBJ_INFO(cam_idx, obj_id, prev_width) = 0;
+    OBJ_INFO(cam_idx, obj_id, prev_height) = 0;
+    OBJ_INFO(cam_idx, obj_id, x) = 0;
+    OBJ_INFO(cam_idx, obj_id, y) = 0;
+    OBJ_INFO(cam_idx, obj_id, width) = 0;
+    OBJ_INFO(cam_idx, obj_id, height) = 0;
+  }
+}
+
+
+#if RESNET_50
+void check_heat_count(int cam_idx, int obj_id)
+{
+  glog_trace("[%d][%d].heat_count=%d\n", cam_idx, obj_id, OBJ_INFO(cam_idx, obj_id, heat_count));
+  if (OBJ_INFO(cam_idx, obj_id, heat_count) < HEAT_COUNT_THRESHOLD) {
+    OBJ_INFO(cam_idx, obj_id, notification_flag) = 0;
+  }
+  OBJ_INFO(cam_idx, obj_id, heat_count) = 0;
+}
+#endif
+
+
+static gboolean is_rule_cooling_down(const EventRule *rule, int cam_idx, int obj_id)
+{
+  int last_event_tick = OBJ_INFO(cam_idx, obj_id, last_event_tick);
+
+  return rule->cooldown > 0 && last_event_tick >= 0 && obj_store[cam_idx].tick - last_event_tick < rule->cooldown;
+}
+
+// Duration of the detection rule of the object's class, one history bit per tick set when the object was
+// detected in almost every frame of it. Flags the rule for notification once its duration is reached
+static void check_detection_rule(AnalyticsState *state, int obj_id, int min_frames)
+{
+  int cam_idx = state->cam_idx;
+  const EventRuleTable *rules = &state->rules;
+
+  if (OBJ_INFO(cam_idx, obj_id, detected_frame_count) >= min_frames) {    //if detection continued one second
+    int rule_idx = rules->class_rule[OBJ_INFO(cam_idx, obj_id, class_id)];
+    const EventRule *rule = (rule_idx != EVENT_RULE_NONE) ? &rules->rules[rule_idx] : NULL;
+
+    //class changed to one without rule in the last frame : a miss
+    OBJ_INFO(cam_idx, obj_id, event_history) = push_event_history(OBJ_INFO(cam_idx, obj_id, event_history), rule != NULL);
+    if (rule && is_event_rule_met(rule, OBJ_INFO(cam_idx, obj_id, event_history))) {          //if duration lasted more than designated time
+      OBJ_INFO(cam_idx, obj_id, event_history) = 0;
+      if (!is_rule_cooling_down(rule, cam_idx, obj_id))
+        OBJ_INFO(cam_idx, obj_id, notification_flag) = rule_idx + 1;                          //send notification later
+#if RESNET_50
+      if (state->setting.resnet50_apply && rule->predicate == RULE_PREDICATE_HEAT_VOTE) {
+        check_heat_count(cam_idx, obj_id);          //LJH, if heat count is zero, notification is cancelled
+      }
+#endif
+      glog_trace("[%d][%d].rule=%s\n", cam_idx, obj_id, rule->name);
+    }
+
+    if (state->setting.opt_flow_apply) {
+      if (rule && rule->predicate == RULE_PREDICATE_MOTION) {                   //if the rule needs motion do optical flow analysis
+        OBJ_INFO(cam_idx, obj_id, do_opt_flow) = 1;                             //if detected frame count lasted equal or more than one second then do optical flow analysis
+      }
+      else {
+        init_opt_flow(state, obj_id, 0);
+      }
+    }
+  }
+  else {                        //if detection not continued for one second
+    OBJ_INFO(cam_idx, obj_id, event_history) = push_event_history(OBJ_INFO(cam_idx, obj_id, event_history), 0);
+    init_opt_flow(state, obj_id, 1);
+  }
+  OBJ_INFO(cam_idx, obj_id, detected_frame_count) = 0;
+}
+
+int get_opt_flow_result(int cam_idx, int obj_id)
+{
+  glog_trace("[%d][%d].confi=%.2f opt_flow_detected_count ==> %d\n", cam_idx, obj_id, OBJ_INFO(cam_idx, obj_id, confidence), OBJ_INFO(cam_idx, obj_id, opt_flow_detected_count));
+  if (OBJ_INFO(cam_idx, obj_id, opt_flow_detected_count) >= THRESHOLD_OVER_OPTICAL_FLOW_COUNT)
+    return 1;
+  return 0;
+}
+
+// Notify the rule flagged on the object unless its predicate says otherwise
+static void notify_event(AnalyticsState *state, int obj_id)
+{
+  int cam_idx = state->cam_idx;
+  const EventRule *rule = &state->rules.rules[OBJ_INFO(cam_idx, obj_id, notification_flag) - 1];
+
+  OBJ_INFO(cam_idx, obj_id, notification_flag) = 0;
+  glog_trace("[15SEC] notification_flag==1,cam_idx=%d,obj_id=%d,rule=%s,preset_index=%d\n", cam_idx, obj_id, rule->name, state->setting.preset_index);
+#if OPTICAL_FLOW_INCLUDE           
+  if (state->setting.opt_flow_apply && rule->predicate == RULE_PREDICATE_MOTION) {
+    int result = get_opt_flow_result(cam_idx, obj_id);
+    glog_trace("[15SEC] get_opt_flow_result(cam_idx=%d,obj_id=%d) ==> %d\n", cam_idx, obj_id, result);
+    init_opt_flow(state, obj_id, 1);
+    if (result == 0)
+      return;
+  }
+#endif
+  if (g_event_func)
+    g_event_func(cam_idx, obj_id, rule->event_id);
+  glog_trace("[[[NOTIFICATION]]] [%d][%d].confi=%.2f,source_cam_idx=%d,event_id=%d\n", cam_idx, obj_id, OBJ_INFO(cam_idx, obj_id, confidence), state->setting.source_cam_idx, rule->event_id);
+  OBJ_INFO(cam_idx, obj_id, last_event_tick) = obj_store[cam_idx].tick;
+}
+
+
+#if OPTICAL_FLOW_INCLUDE
+double update_average(double previous_average, int count, double new_value) 
+{
+    return ((previous_average * (count - 1)) + new_value) / count;
+}
+
+int get_correction_value(double diagonal)
+{
+    int corr_value = 0;  // Initialize to a default value
+
+    // If diagonal is less than or equal to SMALL_BBOX_DIAGONAL, calculate the correction value
+    if (diagonal <= SMALL_BBOX_DIAGONAL) {
+        corr_value = (int)(((SMALL_BBOX_DIAGONAL - diagonal) / 10) + 1);
+    }
+
+    return corr_value;
+}
+
+int get_move_distance(int cam_idx, int obj_id)
+{
+  if (OBJ_INFO(cam_idx, obj_id, prev_x) == 0 || OBJ_INFO(cam_idx, obj_id, prev_y) == 0)
+    return 0;
+
+  int x_dist = abs(OBJ_INFO(cam_idx, obj_id, prev_x) - OBJ_INFO(cam_idx, obj_id, x));
+  int y_dist = abs(OBJ_INFO(cam_idx, obj_id, prev_y) - OBJ_INFO(cam_idx, obj_id, y));
+
+  return (int)calculate_sqrt((double)x_dist, (double)y_dist);
+}
+
+int get_rect_size_change(int cam_idx, int obj_id)
+{
+  if (OBJ_INFO(cam_idx, obj_id, prev_width) == 0 || OBJ_INFO(cam_idx, obj_id, prev_height) == 0)
+    return 0;
+
+  int width_change = abs(OBJ_INFO(cam_idx, obj_id, prev_width) - OBJ_INFO(cam_idx, obj_id, width));
+  int height_change = abs(OBJ_INFO(cam_idx, obj_id, prev_height) - OBJ_INFO(cam_idx, obj_id, height));
+
+  return (int)calculate_sqrt((double)width_change, (double)height_change);
+}
+
+void set_prev_xy(int cam_idx, int obj_id)
+{
+  OBJ_INFO(cam_idx, obj_id, prev_x) = OBJ_INFO(cam_idx, obj_id, x);
+  OBJ_INFO(cam_idx, obj_id, prev_y) = OBJ_INFO(cam_idx, obj_id, y);
+}
+
+void set_prev_rect_size(int cam_idx, int obj_id)
+{
+  OBJ_INFO(cam_idx, obj_id, prev_width) = OBJ_INFO(cam_idx, obj_id, width);
+  OBJ_INFO(cam_idx, obj_id, prev_height) = OBJ_INFO(cam_idx, obj_id, height);
+}
+
+// Accumulate the average flow inside the object bbox sampled by the probe on the tick frame, once
+// check_detection_rule() flagged the object
+void process_opt_flow(int cam_idx, int obj_id, float move_size_avg)
+{
+  if (!OBJ_INFO(cam_idx, obj_id, do_opt_flow) || move_size_avg == ANALYTICS_NO_VALUE)
+    return;
+
+  // glog_trace("move_size_avg=%lf\n", move_size_avg);
+  OBJ_INFO(cam_idx, obj_id, opt_flow_check_count)++;
+  OBJ_INFO(cam_idx, obj_id, move_size_avg) = update_average(OBJ_INFO(cam_idx, obj_id, move_size_avg), 
+                                            OBJ_INFO(cam_idx, obj_id, opt_flow_check_count), move_size_avg);
+  // glog_trace("[%d][%d].opt_flow_check_count=%d, move_size_avg=%lf diag=%.1f\n", 
+  //     cam_idx, obj_id, OBJ_INFO(cam_idx, obj_id, opt_flow_check_count), OBJ_INFO(cam_idx, obj_id, move_size_avg),
+  //     OBJ_INFO(cam_idx, obj_id, diagonal));
+}
+
+// Decide whether the accumulated flow of the last tick is over the threshold, called per tick
+void check_opt_flow_verdict(AnalyticsState *state, int obj_id)
+{
+  int cam_idx = state->cam_idx;
+  double diagonal = OBJ_INFO(cam_idx, obj_id, diagonal);
+  int corr_value = 0;
+  int bbox_move = 0, rect_size_change = 0;
+
+  bbox_move = get_move_distance(cam_idx, obj_id);
+  rect_size_change = get_rect_size_change(cam_idx, obj_id);
+  set_prev_xy(cam_idx, obj_id);
+  set_prev_rect_size(cam_idx, obj_id);
+
+  if (OBJ_INFO(cam_idx, obj_id, move_size_avg) > 0) {
+    glog_trace("[SEC] [%d][%d].move_size_avg=%.1f,confi=%.2f,diag=%.1f\n", cam_idx, obj_id, 
+          OBJ_INFO(cam_idx, obj_id, move_size_avg), OBJ_INFO(cam_idx, obj_id, confidence), diagonal);
+  }
+
+  if (bbox_move < THRESHOLD_BBOX_MOVE && rect_size_change < THRESHOLD_RECT_SIZE_CHANGE && state->setting.ptz_move_speed == 0) {
+    corr_value = get_correction_value(diagonal);                //LJH, when rectangle is small the move size tend to increase
+    if (cam_idx == RGB_CAM) {                                   //LJH, RGB optical flow is more sensitive
+      corr_value += 9;
+    }
+    if (OBJ_INFO(cam_idx, obj_id, move_size_avg) > (state->setting.opt_flow_threshold + corr_value)) {
+      OBJ_INFO(cam_idx, obj_id, opt_flow_detected_count)++;
+      glog_trace("[%d][%d].opt_flow_detected_count ==> %d\n", cam_idx, obj_id, OBJ_INFO(cam_idx, obj_id, opt_flow_detected_count));
+    }
+  }
+  else {
+    glog_trace("[SEC] bbox_move=%d,rect_size_change=%d,move_speed=%d\n", bbox_move, rect_size_change, state->setting.ptz_move_speed);
+  }
+  init_opt_flow(state, obj_id, 0);
+}
+#endif
+
+
+// Worker : update the bbox of one object from its record
+void set_obj_rect(int cam_idx, int obj_id, ObjRecord *obj)
+{
+  OBJ_INFO(cam_idx, obj_id, x) =         obj->x;
+  OBJ_INFO(cam_idx, obj_id, y) =         obj->y;
+  OBJ_INFO(cam_idx, obj_id, width) =     obj->width;
+  OBJ_INFO(cam_idx, obj_id, height) =    obj->height;
+  
+  OBJ_INFO(cam_idx, obj_id, center_x) = OBJ_INFO(cam_idx, obj_id, x) + (OBJ_INFO(cam_idx, obj_id, width)/2);
+  OBJ_INFO(cam_idx, obj_id, center_y) = OBJ_INFO(cam_idx, obj_id, y) + (OBJ_INFO(cam_idx, obj_id, height)/2);
+
+  OBJ_INFO(cam_idx, obj_id, diagonal) =  calculate_sqrt((double)OBJ_INFO(cam_idx, obj_id, width), (double)OBJ_INFO(cam_idx, obj_id, height));
+}
+
+// Worker : start keeping state for a slot the probe handed out
+void add_live_obj(int cam_idx, int obj_id)
+{
+  ObjStore *store = &obj_store[cam_idx];
+
+  if (store->live_pos[obj_id] >= 0)
+    return;
+  store->live_pos[obj_id] = store->live_count;
+  store->live[store->live_count++] = obj_id;
+}
+
+// Worker : forget a slot the probe released, the last live entry is swapped into its place
+void remove_live_obj(int cam_idx, int obj_id)
+{
+  ObjStore *store = &obj_store[cam_idx];
+  int pos = store->live_pos[obj_id];
+
+  if (pos < 0)
+    return;
+  int last = store->live[--store->live_count];
+  store->live[pos] = last;
+  store->live_pos[last] = pos;
+  store->live_pos[obj_id] = -1;
+}
+
+// Reset every column of one object, the slot is handed to a new tracker id next
+void clear_obj_info(int cam_idx, int obj_id)
+{
+  ObjStore *store = &obj_store[cam_idx];
+
+  store->x[obj_id] = store->y[obj_id] = store->width[obj_id] = store->height[obj_id] = 0;
+  store->confidence[obj_id] = 0.0;
+  store->class_id[obj_id] = CLASS_NORMAL_COW;
+  store->detected_frame_count[obj_id] = 0;
+  store->diagonal[obj_id] = 0.0;
+  store->do_opt_flow[obj_id] = 0;
+  store->flow_sample[obj_id] = ANALYTICS_NO_VALUE;
+
+  store->event_history[obj_id] = 0;
+  store->temp_history[obj_id] = 0;
+  store->notification_flag[obj_id] = 0;
+  store->bbox_temp[obj_id] = 0;
+  store->last_event_tick[obj_id] = -1;
+  store->heat_count[obj_id] = 0;
+
+  store->center_x[obj_id] = store->center_y[obj_id] = 0;
+  store->prev_x[obj_id] = store->prev_y[obj_id] = store->prev_width[obj_id] = store->prev_height[obj_id] = 0;
+  store->move_size_avg[obj_id] = 0.0;
+  store->opt_flow_check_count[obj_id] = 0;
+  store->opt_flow_detected_count[obj_id] = 0;
+  store->tick_center_x[obj_id] = store->tick_center_y[obj_id] = -1;
+  init_calculator(cam_idx, obj_id);
+}
+
+
+#if THERMAL_TEMP_INCLUDE
+void init_temp_avg(AnalyticsState *state)
+{
+  state->objs_temp_avg = 0;
+  state->objs_count = 0; 
+  state->objs_temp_total = 0;
+}
+
+void get_temp_total(AnalyticsState *state, int obj_id) 
+{
+  if (OBJ_INFO(THERMAL_CAM, obj_id, bbox_temp) < state->setting.threshold_under_temp)
+    return;
+
+  state->objs_temp_total += OBJ_INFO(THERMAL_CAM, obj_id, bbox_temp); 
+  state->objs_count++;
+}
+
+void get_temp_avg(AnalyticsState *state) 
+{
+  if (state->objs_count == 0 || state->objs_temp_total == 0) {
+    state->objs_temp_avg = 0;
+    return;
+  }
+
+  state->objs_temp_avg = state->objs_temp_total / state->objs_count; 
+  // glog_trace("objs_temp_total=%d objs_count=%d objs_temp_avg=%d\n", state->objs_temp_total, state->objs_count, state->objs_temp_avg);
+}
+#endif
+
+
+#if TEMP_NOTI
+// Seconds the object stayed over the average temperature of the objects by temp_diff_threshold, one history
+// bit per temperature pass. Flags the over temp rule once its duration is reached
+static void check_temp_rule(AnalyticsState *state, int obj_id)
+{
+  const EventRule *rule = &state->rules.rules[(int)state->rules.temp_rule];
+  int hot = OBJ_INFO(THERMAL_CAM, obj_id, bbox_temp) >= state->setting.threshold_under_temp &&
+            OBJ_INFO(THERMAL_CAM, obj_id, bbox_temp) > (state->objs_temp_avg + state->setting.temp_diff_threshold) &&
+            (rule->class_id == EVENT_RULE_ANY_CLASS || get_class_event_rule(&state->rules, OBJ_INFO(THERMAL_CAM, obj_id, class_id), 
+                                                                            OBJ_INFO(THERMAL_CAM, obj_id, confidence)) != NULL);
+
+  OBJ_INFO(THERMAL_CAM, obj_id, temp_history) = push_event_history(OBJ_INFO(THERMAL_CAM, obj_id, temp_history), hot);
+  if (!hot)
+    return;
+
+  glog_trace("objs_temp_avg=%d obj_id=%d bbox_temp=%d temp_count=%d\n", state->objs_temp_avg, obj_id, OBJ_INFO(THERMAL_CAM, obj_id, bbox_temp), 
+    __builtin_popcountll(OBJ_INFO(THERMAL_CAM, obj_id, temp_history) & rule->window_mask));
+  if (is_event_rule_met(rule, OBJ_INFO(THERMAL_CAM, obj_id, temp_history))) {   //if duration lasted more than designated time
+    OBJ_INFO(THERMAL_CAM, obj_id, temp_history) = 0;
+    if (!is_rule_cooling_down(rule, THERMAL_CAM, obj_id)) {
+      OBJ_INFO(THERMAL_CAM, obj_id, notification_flag) = state->rules.temp_rule + 1;        //send notification later
+      glog_trace("objs_temp_avg=%d obj_id=%d notification_flag=1\n", state->objs_temp_avg, obj_id);
+    }
+    else {
+      glog_trace("[THERMAL_CAM][%d].last_event_tick=%d is within the cooldown=%d of %s\n", obj_id, OBJ_INFO(THERMAL_CAM, obj_id, last_event_tick), rule->cooldown, rule->name);
+    }
+  }
+}
+#endif
+
+
+void simulate_get_temp_avg(AnalyticsState *state)
+{
+    for (int i = 0; i < NUM_OBJS; i++)
+      OBJ_INFO(THERMAL_CAM, i, bbox_temp) = 0;
+
+    OBJ_INFO(THERMAL_CAM, 1, bbox_temp) = 20;
+    OBJ_INFO(THERMAL_CAM, 2, bbox_temp) = 21;
+    OBJ_INFO(THERMAL_CAM, 3, bbox_temp) = 38;
+    
+    state->objs_temp_avg = 0;
+    state->objs_temp_avg += OBJ_INFO(THERMAL_CAM, 1, bbox_temp);
+    state->objs_temp_avg += OBJ_INFO(THERMAL_CAM, 2, bbox_temp);
+    state->objs_temp_avg += OBJ_INFO(THERMAL_CAM, 3, bbox_temp);
+
+    state->objs_temp_avg /= 3;
+    state->objs_count = 3;
+    // glog_trace("simulate objs_temp_avg=%d\n", state->objs_temp_avg);
+}
+
+#if THERMAL_TEMP_INCLUDE
+// Worker : temperature pass of the tick, over the objects of the thermal frame that closed it
+void update_objs_temp(AnalyticsState *state)
+{
+  ObjStore *store = &obj_store[THERMAL_CAM];
+  int over_under = 0;
+
+#if TEMP_NOTI
+  init_temp_avg(state);
+#endif
+  for (int i = 0; i < store->live_count; i++) {
+    int obj_id = store->live[i];
+    if (store->last_seen[obj_id] != store->tick)          //not in the tick frame, the probe did not sample it
+      continue;
+    if (OBJ_INFO(THERMAL_CAM, obj_id, bbox_temp) > state->setting.threshold_under_temp)
+      over_under = 1;
+  }
+  if (!over_under)
+    return;
+
+#if TEMP_NOTI
+  for (int i = 0; i < store->live_count; i++) {
+    int obj_id = store->live[i];
+    if (store->last_seen[obj_id] == store->tick && OBJ_INFO(THERMAL_CAM, obj_id, bbox_temp) > state->setting.threshold_under_temp)
+      get_temp_total(state, obj_id);          //get temperature total before getting average
+  }
+#endif
+}
+#endif
+
+
+// Worker : rules of the source camera in one pass over its live objects, each object is checked against the
+// detection rule of its class and the over temp rule, then the rule it flagged is notified
+static void check_event_rules(AnalyticsState *state)
+{
+  int cam_idx = state->cam_idx;
+  ObjStore *store = &obj_store[cam_idx];
+  int min_frames = MAX(state->tick_inferred_frames - 1, 1);
+  int check_detection = state->tick_inferred_frames > 0;     //a tick without inference has nothing to count, the histories hold
+  int check_temp = 0, temp_counting = 0, pending = 0;
+
+#if TEMP_NOTI
+  if (state->setting.temp_apply && cam_idx == THERMAL_CAM) {
+    get_temp_avg(state);                        //get average temperature for objects in the screen
+    check_temp = state->rules.temp_rule != EVENT_RULE_NONE &&
+                 state->objs_temp_avg >= state->setting.threshold_under_temp && state->objs_count > 0;
+  }
+#endif
+
+  for (int i = 0; i < store->live_count; i++) {
+    int obj_id = store->live[i];
+
+    if (check_detection)
+      check_detection_rule(state, obj_id, min_frames);
+    int rule_idx = state->rules.class_rule[OBJ_INFO(cam_idx, obj_id, class_id)];
+    if (rule_idx != EVENT_RULE_NONE && is_event_history_live(&state->rules.rules[rule_idx], OBJ_INFO(cam_idx, obj_id, event_history)) &&
+        !is_rule_cooling_down(&state->rules.rules[rule_idx], cam_idx, obj_id))
+      pending++;                                //being counted toward an event, the interval controller keeps nv_interval
+#if TEMP_NOTI
+    if (check_temp) {
+      check_temp_rule(state, obj_id);
+      if (is_event_history_live(&state->rules.rules[(int)state->rules.temp_rule], OBJ_INFO(cam_idx, obj_id, temp_history))) {
+        temp_counting = 1;
+        pending++;
+      }
+    }
+#endif
+#if OPTICAL_FLOW_INCLUDE
+    if (state->setting.opt_flow_apply && OBJ_INFO(cam_idx, obj_id, do_opt_flow)) {
+      if (store->last_seen[obj_id] == store->tick)                    //sampled by the probe on the tick frame
+        process_opt_flow(cam_idx, obj_id, OBJ_INFO(cam_idx, obj_id, flow_sample));
+      check_opt_flow_verdict(state, obj_id);
+    }
+#endif
+    if (OBJ_INFO(cam_idx, obj_id, notification_flag))
+      notify_event(state, obj_id);
+  }
+  state->pending_objs = pending;
+
+#if TEMP_NOTI
+  if (state->setting.temp_apply && cam_idx == THERMAL_CAM) {
+    init_temp_avg(state);
+    g_atomic_int_set(&state->do_temp_display, temp_counting);        //if over temp state is being counted for notification
+  }
+#endif
+}
+
+// Worker : objects of the tick that appeared or whose bbox center moved over motion_threshold since the last tick
+static void count_moving_objs(AnalyticsState *state)
+{
+  ObjStore *store = &obj_store[state->cam_idx];
+  int threshold = state->setting.motion_threshold;
+  int moving = 0;
+
+  for (int i = 0; i < store->live_count; i++) {
+    int obj_id = store->live[i];
+    if (store->last_seen[obj_id] != store->tick)
+      continue;
+    int dx = store->center_x[obj_id] - store->tick_center_x[obj_id];
+    int dy = store->center_y[obj_id] - store->tick_center_y[obj_id];
+    if (store->tick_center_x[obj_id] < 0 || dx * dx + dy * dy > threshold * threshold)
+      moving++;
+    store->tick_center_x[obj_id] = store->center_x[obj_id];
+    store->tick_center_y[obj_id] = store->center_y[obj_id];
+  }
+  state->moving_objs = moving;
+}
+
+// Worker : event state of the objects seen last, kept for the preset the view is leaving before every object is dropped
+static void save_preset_memory(AnalyticsState *state)
+{
+  int cam_idx = state->cam_idx;
+  ObjStore *store = &obj_store[cam_idx];
+  int preset = state->setting.preset_index;
+
+  if (state->setting.preset_memory_time <= 0 || preset < 0 || preset >= ANALYTICS_MAX_PRESETS)
+    return;
+  //no object came back since the last reset (PTZ still moving, analysis switched off again) : the memory
+  //of that reset is the one to keep, the objects seen meanwhile are tracker leftovers of the move
+  if (state->restore_waiting)
+    return;
+
+  PresetMemory *memory = &state->preset_memory[preset];
+  memory->tick = store->tick;
+  memory->num_objs = 0;
+  for (int i = 0; i < store->live_count && memory->num_objs < PRESET_MEMORY_OBJS; i++) {
+    int obj_id = store->live[i];
+    if (store->tick - store->last_seen[obj_id] > PRESET_MEMORY_SEEN_TICKS)        //already gone from the view
+      continue;
+    RememberedObj *obj = &memory->objs[memory->num_objs];
+    obj->x = store->x[obj_id];
+    obj->y = store->y[obj_id];
+    obj->width = store->width[obj_id];
+    obj->height = store->height[obj_id];
+    obj->class_id = store->class_id[obj_id];
+    obj->confidence = store->confidence[obj_id];
+    obj->event_history = store->event_history[obj_id];
+    obj->temp_history = store->temp_history[obj_id];
+    obj->last_event_tick = store->last_event_tick[obj_id];
+    obj->heat_count = store->heat_count[obj_id];
+    obj->opt_flow_detected_count = store->opt_flow_detected_count[obj_id];
+    obj->bbox_temp = store->bbox_temp[obj_id];
+    obj->temp_avg_calculator = store->temp_avg_calculator[obj_id];
+    memory->claimed[memory->num_objs++] = 0;
+  }
+  glog_trace("cam_idx=%d preset=%d remembers %d objs\n", cam_idx, preset, memory->num_objs);
+}
+
+// Worker : first objects after a reset, the memory of the current preset is matched for the next ticks unless it is too old
+static void start_preset_restore(AnalyticsState *state)
+{
+  ObjStore *store = &obj_store[state->cam_idx];
+  int preset = state->setting.preset_index;
+
+  state->restore_waiting = 0;
+  if (preset < 0 || preset >= ANALYTICS_MAX_PRESETS || state->preset_memory[preset].num_objs == 0)
+    return;
+  if (store->tick - state->preset_memory[preset].tick > state->setting.preset_memory_time) {
+    glog_trace("cam_idx=%d preset=%d memory of %d objs is %d sec old, dropped\n", state->cam_idx, preset,
+      state->preset_memory[preset].num_objs, store->tick - state->preset_memory[preset].tick);
+    state->preset_memory[preset].num_objs = 0;
+    return;
+  }
+  state->restore_preset = preset;
+  state->restore_until = store->tick + PRESET_MEMORY_MATCH_TICKS;
+}
+
+// Worker : matching window over, remembered objects nobody took left the pen or stayed hidden
+static void end_preset_restore(AnalyticsState *state)
+{
+  PresetMemory *memory = &state->preset_memory[state->restore_preset];
+  int claimed = 0;
+
+  for (int i = 0; i < memory->num_objs; i++)
+    claimed += memory->claimed[i];
+  glog_trace("cam_idx=%d preset=%d restored %d of %d objs\n", state->cam_idx, state->restore_preset, claimed, memory->num_objs);
+  memory->num_objs = 0;
+  state->restore_preset = -1;
+}
+
+// Worker : a new object takes the state of the remembered object its bbox overlaps most
+static void restore_preset_obj(AnalyticsState *state, int obj_id)
+{
+  int cam_idx = state->cam_idx;
+  ObjStore *store = &obj_store[cam_idx];
+  PresetMemory *memory = &state->preset_memory[state->restore_preset];
+  double best_iou = PRESET_MEMORY_MIN_IOU;
+  int best = -1;
+
+  for (int i = 0; i < memory->num_objs; i++) {
+    if (memory->claimed[i])
+      continue;
+    RememberedObj *obj = &memory->objs[i];
+    double iou = get_bbox_iou(obj->x, obj->y, obj->width, obj->height,
+                              store->x[obj_id], store->y[obj_id], store->width[obj_id], store->height[obj_id]);
+    if (iou >= best_iou) {
+      best_iou = iou;
+      best = i;
+    }
+  }
+  if (best < 0)
+    return;
+
+  RememberedObj *obj = &memory->objs[best];
+  memory->claimed[best] = 1;
+  store->class_id[obj_id] = obj->class_id;
+  store->confidence[obj_id] = obj->confidence;
+  store->event_history[obj_id] = obj->event_history;
+  store->temp_history[obj_id] = obj->temp_history;
+  store->last_event_tick[obj_id] = obj->last_event_tick;
+  store->heat_count[obj_id] = obj->heat_count;
+  store->opt_flow_detected_count[obj_id] = obj->opt_flow_detected_count;
+  store->bbox_temp[obj_id] = obj->bbox_temp;
+  store->temp_avg_calculator[obj_id] = obj->temp_avg_calculator;
+}
+
+// Worker : per-second work of one camera, after the record of the frame that closed the tick
+static void on_analytics_tick(AnalyticsState *state)
+{
+  int cam_idx = state->cam_idx;
+
+  count_moving_objs(state);
+  state->pending_objs = 0;
+
+#if THERMAL_TEMP_INCLUDE
+  if (state->setting.temp_apply && cam_idx == THERMAL_CAM) {
+    update_objs_temp(state);
+  }
+#endif
+  if (cam_idx == state->setting.source_cam_idx) {              //if cam index is identifical to the set source cam
+    check_event_rules(state);
+  }
+
+  obj_store[cam_idx].tick++;
+  if (state->restore_preset >= 0 && obj_store[cam_idx].tick >= state->restore_until)
+    end_preset_restore(state);
+}
+
+// Worker : fold one object of a frame record into the object state. Class, confidence and the classifier
+// vote only come from inferred frames, the tracker repeats the last ones in between
+void process_obj_record(AnalyticsState *state, ObjRecord *obj, int inferred)
+{
+  int cam_idx = state->cam_idx;
+  int obj_id = obj->slot;
+  int appeared = obj_store[cam_idx].live_pos[obj_id] < 0;
+
+  add_live_obj(cam_idx, obj_id);
+  obj_store[cam_idx].last_seen[obj_id] = obj_store[cam_idx].tick;
+  obj_store[cam_idx].generation[obj_id] = obj->generation;
+  set_obj_rect(cam_idx, obj_id, obj);
+  if (appeared && state->restore_preset >= 0)
+    restore_preset_obj(state, obj_id);
+  OBJ_INFO(cam_idx, obj_id, flow_sample) = obj->flow;
+#if THERMAL_TEMP_INCLUDE
+  if (obj->temp != ANALYTICS_NO_VALUE)
+    add_value_and_calculate_avg(state, obj_id, (int)obj->temp);
+#endif
+  if (!inferred)
+    return;
+
+  OBJ_INFO(cam_idx, obj_id, class_id) = obj->class_id;
+  OBJ_INFO(cam_idx, obj_id, confidence) = obj->confidence;
+#if RESNET_50
+  if (obj->heat_vote)
+    OBJ_INFO(cam_idx, obj_id, heat_count)++;
+#endif
+  if (cam_idx == state->setting.source_cam_idx) {            //if cam index is identifical to the set source cam
+#if !TRACK_PERSON_INCLUDE
+    gather_event(get_class_event_rule(&state->rules, obj->class_id, obj->confidence), obj_id, cam_idx);
+#endif
+  }
+}
+
+// Worker : one frame of the camera, in the order the probe saw it
+void process_frame_record(AnalyticsState *state, FrameRecord *rec)
+{
+  int cam_idx = state->cam_idx;
+  ObjStore *store = &obj_store[cam_idx];
+
+  refresh_event_rules(&state->rules);             //rules swapped by set_event_rules() apply from this record on
+  if (rec->reset) {                               //the probe dropped every slot, so does the worker
+    if (state->restore_preset >= 0)
+      end_preset_restore(state);
+    save_preset_memory(state);                    //the view is leaving its preset, or analysis is switched off there
+    state->restore_waiting = 1;
+    while (store->live_count > 0) {
+      int obj_id = store->live[store->live_count - 1];
+      remove_live_obj(cam_idx, obj_id);
+      clear_obj_info(cam_idx, obj_id);
+    }
+  }
+
+  if (state->restore_waiting && rec->num_objs > 0 && state->setting.ptz_move_speed == 0)
+    start_preset_restore(state);
+  for (int i = 0; i < rec->num_objs; i++) {
+    process_obj_record(state, &rec->objs[i], rec->inferred);
+  }
+#if TEMP_NOTI_TEST
+  simulate_get_temp_avg(state);                       //LJH, for simulation
+#endif
+
+  if (rec->tick) {
+    state->tick_inferred_frames = rec->tick_inferred_frames;
+    on_analytics_tick(state);
+  }
+
+  for (int i = 0; i < rec->num_expired; i++) {      //after the tick so the last second still counts
+    remove_live_obj(cam_idx, rec->expired[i]);
+    clear_obj_info(cam_idx, rec->expired[i]);
+  }
+}
+
+
+// Object state of num_cams cameras, every camera starts empty
+void init_analytics_core(int num_cams)
+{
+  g_num_cams = num_cams;
+  obj_store = g_new0(ObjStore, num_cams);
+  g_analytics_state = g_new0(AnalyticsState, num_cams);
+  for (int i = 0; i < num_cams; i++) {
+    g_analytics_state[i].cam_idx = i;
+    g_analytics_state[i].preset_memory = g_new0(PresetMemory, ANALYTICS_MAX_PRESETS);
+    g_analytics_state[i].restore_preset = -1;
+    init_event_rules(&g_analytics_state[i].rules);
+    refresh_event_rules(&g_analytics_state[i].rules);
+    for (int obj_id = 0; obj_id < NUM_OBJS; obj_id++) {
+      obj_store[i].live_pos[obj_id] = -1;
+      clear_obj_info(i, obj_id);
+    }
+  }
+}
+
+
+void free_analytics_core()
+{
+  for (int i = 0; g_analytics_state && i < g_num_cams; i++)
+    g_free(g_analytics_state[i].preset_memory);
+  g_clear_pointer(&g_analytics_state, g_free);
+  g_clear_pointer(&obj_store, g_free);
+  g_num_cams = 0;
+}
+
+
+AnalyticsState *get_analytics_state(int cam_idx)
+{
+  if (g_analytics_state == NULL || cam_idx < 0 || cam_idx >= g_num_cams)
+    return NULL;
+  return &g_analytics_state[cam_idx];
+}
+
+
+#ifdef TEST_ANALYTICS_CORE
+// Preset memory over PTZ patrol resets : resets in a row and objects seen during the move keep the memory
+#include <stdio.h>
+#include "test_check.h"
+
+static void make_record(FrameRecord *rec, int reset, int num_objs, int x)
+{
+  memset(rec, 0, sizeof(*rec));
+  rec->reset = reset;
+  rec->inferred = 1;
+  rec->num_objs = num_objs;
+  for (int i = 0; i < num_objs; i++) {
+    ObjRecord *obj = &rec->objs[i];
+    obj->slot = (short)i;
+    obj->class_id = CLASS_NORMAL_COW;
+    obj->confidence = 0.9f;
+    obj->x = (short)(x + i * 100);
+    obj->y = 200;
+    obj->width = 80;
+    obj->height = 60;
+    obj->temp = ANALYTICS_NO_VALUE;
+    obj->flow = ANALYTICS_NO_VALUE;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  FrameRecord *rec = g_new0(FrameRecord, 1);
+  AnalyticsState *state;
+  PresetMemory *memory;
+  int failed = 0;
+
+  init_analytics_core(1);
+  state = get_analytics_state(0);
+  state->setting.preset_memory_time = PRESET_MEMORY_TIME_DEFAULT;
+  state->setting.preset_index = 2;
+  memory = &state->preset_memory[2];
+
+  //5 objects at preset 2 with some heat history, then the view leaves
+  make_record(rec, 0, 5, 100);
+  process_frame_record(state, rec);
+  obj_store[0].heat_count[3] = 7;
+  make_record(rec, 1, 0, 0);
+  process_frame_record(state, rec);
+  failed += check(memory->num_objs == 5 && memory->objs[3].heat_count == 7, "objects of the preset remembered");
+
+  //analysis switched off again before any object came back
+  process_frame_record(state, rec);
+  failed += check(memory->num_objs == 5 && memory->objs[3].heat_count == 7, "second reset keeps the memory");
+
+  //tracker leftovers while the PTZ still moves, then stopped at the same preset
+  state->setting.ptz_move_speed = 1;
+  make_record(rec, 0, 1, 900);
+  process_frame_record(state, rec);
+  make_record(rec, 1, 0, 0);
+  process_frame_record(state, rec);
+  failed += check(memory->num_objs == 5, "objects seen during the move do not replace the memory");
+
+  //back at the preset, the object at the same place gets its state again
+  state->setting.ptz_move_speed = 0;
+  make_record(rec, 0, 5, 100);
+  process_frame_record(state, rec);
+  failed += check(!state->restore_waiting && obj_store[0].heat_count[3] == 7, "state restored on the next visit");
+
+  //a reset after the objects came back remembers them again
+  make_record(rec, 1, 0, 0);
+  process_frame_record(state, rec);
+  failed += check(memory->num_objs == 5, "next departure saved");
+
+  free_analytics_core();
+  g_free(rec);
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+
+  return failed ? 1 : 0;
+}
+#endif
@@ -0,0 +1,182 @@
+#ifndef __ANALYTICS_CORE_H__
+#define __ANALYTICS_CORE_H__
+
+// Event, temperature, optical flow and correction logic of the analytics, fed with FrameRecord.
+// Only glib here : no GStreamer or DeepStream header, nvds_process.c is the adapter that fills the records
+// from the pipeline, analytics_replay and the benchmarks fill them from a trace or synthetic frames.
+#include <glib.h>
+#include "global_define.h"
+#include "analytics_ring.h"
+#include "event_rule.h"
+
+#define NUM_OBJS                              MAX_OBJ_SLOTS
+#define BUFFER_SIZE                           4
+#define SMALL_BBOX_DIAGONAL                   (160.0)
+
+#define THRESHOLD_OVER_OPTICAL_FLOW_COUNT     2
+#define THRESHOLD_BBOX_MOVE                   30
+#define THRESHOLD_RECT_SIZE_CHANGE            30
+#define THRESHOLD_UNDER_TEMP_DEFAULT          15
+#define THRESHOLD_UPPER_TEMP_DEFAULT          50
+#define THRESHOLD_NORMAL                      (0.2)
+#define HEAT_COUNT_THRESHOLD                  1
+
+#define TEMP_EVENT_TIME_GAP        300
+
+#define ANALYTICS_MAX_PRESETS                 12          //MAX_PTZ_PRESET of ptz_control.h, checked in nvds_process.c
+#define PRESET_MEMORY_OBJS                    64          //objects remembered per preset and camera
+#define PRESET_MEMORY_TIME_DEFAULT            600         //sec a preset remembers its objects, "preset_memory_time"
+#define PRESET_MEMORY_SEEN_TICKS              3           //only objects seen in the last ticks before leaving are remembered
+#define PRESET_MEMORY_MATCH_TICKS             3           //ticks after coming back during which new objects are matched
+#define PRESET_MEMORY_MIN_IOU                 (0.3)       //bbox overlap for a new object to take a remembered one
+
+// Index of the camera in config.json ("video0", "video1", ...), g_config.device_cnt cameras in total.
+// Cameras after THERMAL_CAM are additional RGB cameras.
+typedef enum {
+	RGB_CAM = 0,
+	THERMAL_CAM,
+} CameraDevice;
+
+
+// Structure to calculate the avg of the last 10 values
+typedef struct {
+  int buffer[BUFFER_SIZE];  // Circular buffer to store the last 10 values
+  int index;                // Current index where the next value will be inserted
+  int count;                // Number of values added (up to 10)
+  int sum;                  // Sum of the values in the buffer
+} AvgCalculator;
+
+
+// Event state of one object when the view left its preset, restored onto the object that shows up in
+// the same place when the view comes back, so the durations go on instead of starting from zero
+typedef struct {
+  int x, y, width, height;
+  int class_id;
+  float confidence;
+  EventHistory event_history;
+  EventHistory temp_history;
+  int last_event_tick;
+  int heat_count;
+  int opt_flow_detected_count;
+  int bbox_temp;
+  AvgCalculator temp_avg_calculator;
+} RememberedObj;
+
+// Objects of one camera at one preset
+typedef struct {
+  int tick;                 // worker tick the view left the preset
+  int num_objs;             // 0 when nothing is remembered
+  unsigned char claimed[PRESET_MEMORY_OBJS];
+  RememberedObj objs[PRESET_MEMORY_OBJS];
+} PresetMemory;
+
+
+// Object state of one camera, one column per field indexed by the slot of obj_slot_map.
+// Columns are grouped by how often they are touched so a scan only pulls the bytes it reads.
+// Written by the camera's analytics worker only, the probe reads the display columns.
+typedef struct {
+  // per frame : bbox, detection and display state
+  int x[NUM_OBJS];
+  int y[NUM_OBJS];
+  int width[NUM_OBJS];
+  int height[NUM_OBJS];
+  float confidence[NUM_OBJS];
+  int class_id[NUM_OBJS];
+  int detected_frame_count[NUM_OBJS];
+  double diagonal[NUM_OBJS];
+  unsigned char do_opt_flow[NUM_OBJS];
+  float flow_sample[NUM_OBJS];     // flow of the last record, ANALYTICS_NO_VALUE unless it was a tick frame
+
+  // per tick : event and temperature passes
+  EventHistory event_history[NUM_OBJS];        // ticks the object counted for the detection rule of its class
+  EventHistory temp_history[NUM_OBJS];         // temperature passes the object was hot, over temp rule
+  unsigned char notification_flag[NUM_OBJS];   // index + 1 of the rule to notify, 0 when none
+  int bbox_temp[NUM_OBJS];                     // smoothed, temp_correction included
+  int last_event_tick[NUM_OBJS];   // tick of the last notification, -1 when none (cooldown of the rules)
+  int heat_count[NUM_OBJS];
+
+  // cold : optical flow history and temperature smoothing
+  int center_x[NUM_OBJS];
+  int center_y[NUM_OBJS];
+  int prev_x[NUM_OBJS];
+  int prev_y[NUM_OBJS];
+  int prev_width[NUM_OBJS];
+  int prev_height[NUM_OBJS];
+  double move_size_avg[NUM_OBJS];
+  int opt_flow_check_count[NUM_OBJS];
+  int opt_flow_detected_count[NUM_OBJS];
+  AvgCalculator temp_avg_calculator[NUM_OBJS];
+  int tick_center_x[NUM_OBJS];    // bbox center at the last tick the object was seen, -1 before
+  int tick_center_y[NUM_OBJS];
+
+  // worker bookkeeping : the probe owns obj_slot_map, the worker keeps its own list of slots with state
+  int live[NUM_OBJS];             // slots holding an object, unordered
+  int live_pos[NUM_OBJS];         // index in live[], -1 when the slot is empty
+  int live_count;
+  int last_seen[NUM_OBJS];        // worker tick of the last record carrying the object
+  guint16 generation[NUM_OBJS];   // slot generation of the probe in the last record carrying the object
+  int tick;                       // ticks processed by the worker
+} ObjStore;
+
+// Field of one object, usable as an lvalue
+#define OBJ_INFO(cam, id, field)              (obj_store[cam].field[id])
+// Handle of an object of the worker, for the notifier and the probe
+#define OBJ_INFO_HANDLE(cam, id)              make_obj_handle(id, obj_store[cam].generation[id])
+
+
+// Settings read by the analytics, a copy of the DeviceSetting fields and PTZ state they depend on.
+// Every camera has its own copy in its AnalyticsState, refreshed by the thread running that camera's records
+// before each one, the core never reads g_setting.
+typedef struct {
+  int temp_apply;
+  int opt_flow_apply;
+  int resnet50_apply;
+  int opt_flow_threshold;
+  int temp_diff_threshold;
+  int temp_correction;
+  int threshold_under_temp;
+  int threshold_upper_temp;
+  int source_cam_idx;       // camera whose events are notified
+  int ptz_move_speed;       // PTZ is moving, bbox motion is not an optical flow verdict
+  int preset_index;
+  int motion_threshold;     // pixels of bbox center motion in one tick that make the scene active (nv_interval_max)
+  int preset_memory_time;   // sec the objects of a preset are kept for the next visit, 0 never
+} AnalyticsSetting;
+
+// Analytics state of one camera besides its ObjStore, only touched by the thread running its records
+typedef struct {
+  int cam_idx;
+  AnalyticsSetting setting; // filled by the owner of the camera before each record, read by the core only
+  int tick_inferred_frames; // frames of the tick nvinfer ran on, the detections the rules can count
+  int objs_temp_avg;        // average temperature of the objects over the under threshold
+  int objs_temp_total;
+  int objs_count;
+  gint do_temp_display;     // over temp state is being counted for notification, read by the probe
+  int moving_objs;          // objects of the last tick that appeared or moved over motion_threshold
+  int pending_objs;         // objects of the last tick counting toward an event
+  EventRuleTable rules;     // copy of the published rules, refreshed before each record
+  PresetMemory *preset_memory;        // ANALYTICS_MAX_PRESETS entries, saved when the objects are reset
+  int restore_waiting;      // objects were reset, the first ones to come back pick the preset to restore
+  int restore_preset;       // preset whose objects new objects are matched to, -1 when none
+  int restore_until;        // tick the matching ends and the rest of the memory is dropped
+} AnalyticsState;
+
+
+// Receiver of the events raised by trigger_notification()
+typedef void (*AnalyticsEventFunc)(int cam_idx, int obj_id, int class_id);
+
+
+extern int g_num_cams;
+extern ObjStore *obj_store;
+
+void init_analytics_core(int num_cams);
+void free_analytics_core();
+AnalyticsState *get_analytics_state(int cam_idx);
+void set_analytics_event_func(AnalyticsEventFunc func);
+void process_frame_record(AnalyticsState *state, FrameRecord *rec);
+void clear_obj_info(int cam_idx, int obj_id);
+void init_calculator(int cam_idx, int obj_id);
+void add_value_and_calculate_avg(AnalyticsState *state, int obj_id, int new_value);
+double calculate_sqrt(double width, double height);
+
+#endif
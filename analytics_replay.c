@@ -0,0 +1,198 @@
+// Offline replay of analytics traces through the analytics core, no pipeline or GPU involved.
+// A trace is written by each camera's analytics worker when "analytics_trace_path" is set in config.json.
+// Records go to process_frame_record() in order, so ticks, temperature and optical flow verdicts and
+// notifications happen exactly as in the live run for the thresholds given here.
+// --rules takes the event rules of a device setting json, e.g. to try a rule table before deploying it.
+//
+//   analytics_replay [options] trace...
+//
+// Prints one "event" line per notification with --events, then one "key=value" summary line per trace.
+// avg_interval is the mean nvinfer interval the controller would have set for the --nv_interval* options,
+// the detections themselves stay the ones of the interval the trace was recorded with.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "g_log.h"
+#include "analytics_core.h"
+#include "analytics_trace.h"
+#include "infer_interval.h"
+
+#define REPLAY_SECOND             G_GUINT64_CONSTANT(1000000000)    //pts are GstClockTime, in ns
+#define REPLAY_NO_PTS             G_MAXUINT64                       //GST_CLOCK_TIME_NONE
+#define REPLAY_MAX_CAMS           8                                 //MAX_DEVICE_CNT of config.h
+
+static gboolean g_verbose = FALSE;
+static gboolean g_print_events = FALSE;
+static guint64 g_record_pts;
+static int g_events[MAX_EVENT_ID + 1];
+static AnalyticsSetting g_replay_setting;      //copied into the state of the replayed camera
+static InferIntervalConfig g_interval_config = { 0, 0, INFER_INTERVAL_HOLD_DEFAULT };    //nv_interval, nv_interval_max
+
+
+static void on_event(int cam_idx, int obj_id, int class_id)
+{
+  if (class_id >= 0 && class_id <= MAX_EVENT_ID)
+    g_events[class_id]++;
+  if (g_print_events)
+    printf("event cam_idx=%d pts=%.3f obj_id=%d class_id=%d\n", cam_idx, (double)g_record_pts / REPLAY_SECOND, obj_id, class_id);
+}
+
+
+static int replay_trace(const char *file_name)
+{
+  AnalyticsTrace *trace = open_trace_reader(file_name);
+  FrameRecord *rec = g_new0(FrameRecord, 1);
+  guint64 first_pts = REPLAY_NO_PTS, last_pts = 0;
+  struct timespec start, end;
+  guint64 frames = 0, ticks = 0;
+  int source_cam, ret = 0;
+
+  if (trace == NULL) {
+    g_free(rec);
+    return -1;
+  }
+  int cam_idx = trace->header.cam_idx;
+  if (cam_idx < 0 || cam_idx >= REPLAY_MAX_CAMS) {
+    fprintf(stderr, "%s: bad cam_idx=%d\n", file_name, cam_idx);
+    close_trace(trace);
+    g_free(rec);
+    return -1;
+  }
+
+  init_analytics_core(cam_idx + 1);
+  memset(g_events, 0, sizeof(g_events));
+  AnalyticsState *state = get_analytics_state(cam_idx);
+  state->setting = g_replay_setting;
+  InferInterval infer_interval;                 //what the nvinfer interval controller would have chosen, the trace keeps its own
+  guint64 interval_sum = 0;
+  init_infer_interval(&infer_interval, g_interval_config.min_interval);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while ((ret = read_trace_record(trace, rec, &source_cam)) > 0) {
+    state->setting.source_cam_idx = source_cam ? cam_idx : -1;
+    g_record_pts = rec->pts;
+    if (rec->pts != REPLAY_NO_PTS) {
+      if (first_pts == REPLAY_NO_PTS)
+        first_pts = rec->pts;
+      last_pts = rec->pts;
+    }
+    process_frame_record(state, rec);
+    frames++;
+    if (rec->tick) {
+      ticks++;
+      interval_sum += update_infer_interval(&infer_interval, &g_interval_config, state->moving_objs > 0 || state->pending_objs > 0,
+                                            state->setting.ptz_move_speed > 0);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  int other_events = 0;                         //event ids of the rules added by --rules
+  for (int i = CLASS_OVER_TEMP + 1; i <= MAX_EVENT_ID; i++)
+    other_events += g_events[i];
+
+  double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  double span = (first_pts != REPLAY_NO_PTS) ? (double)(last_pts - first_pts) / REPLAY_SECOND : 0.0;
+  printf("trace=%s cam_idx=%d records=%" G_GUINT64_FORMAT " ticks=%" G_GUINT64_FORMAT " span_sec=%.1f replay_sec=%.3f speedup=%.0f "
+         "heat=%d flip=%d labor_sign=%d over_temp=%d other=%d avg_interval=%.1f%s\n",
+         file_name, cam_idx, frames, ticks, span, elapsed, elapsed > 0.0 ? span / elapsed : 0.0,
+         g_events[CLASS_HEAT_COW], g_events[CLASS_FLIP_COW], g_events[CLASS_LABOR_SIGN_COW], g_events[CLASS_OVER_TEMP], other_events,
+         ticks ? (double)interval_sum / ticks : 0.0, ret < 0 ? " truncated=1" : "");
+
+  free_analytics_core();
+  close_trace(trace);
+  g_free(rec);
+
+  return ret < 0 ? -1 : 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int heat_threshold = 80, flip_threshold = 80, labor_sign_threshold = 80;
+  int heat_time = 15, flip_time = 15, labor_sign_time = 15, over_temp_time = 15;
+  char *rules_file = NULL;
+  int failed = 0;
+  GError *error = NULL;
+  AnalyticsSetting *setting = &g_replay_setting;
+
+  setting->temp_apply = 1;
+  setting->opt_flow_apply = 1;
+  setting->resnet50_apply = 0;
+  setting->opt_flow_threshold = 0;
+  setting->temp_diff_threshold = 7;
+  setting->temp_correction = 0;
+  setting->threshold_upper_temp = THRESHOLD_UPPER_TEMP_DEFAULT;
+  setting->threshold_under_temp = THRESHOLD_UNDER_TEMP_DEFAULT;
+  setting->source_cam_idx = -1;
+  setting->ptz_move_speed = 0;
+  setting->preset_index = 0;
+  setting->motion_threshold = INFER_MOTION_THRESHOLD_DEFAULT;
+  setting->preset_memory_time = PRESET_MEMORY_TIME_DEFAULT;
+
+  //option names follow the keys of the device setting json
+  GOptionEntry entries[] = {
+    {"heat_threshold", 0, 0, G_OPTION_ARG_INT, &heat_threshold, "heat confidence threshold (%)", "N"},
+    {"flip_threshold", 0, 0, G_OPTION_ARG_INT, &flip_threshold, "flip confidence threshold (%)", "N"},
+    {"labor_sign_threshold", 0, 0, G_OPTION_ARG_INT, &labor_sign_threshold, "labor sign confidence threshold (%)", "N"},
+    {"heat_time", 0, 0, G_OPTION_ARG_INT, &heat_time, "heat event duration (sec)", "N"},
+    {"flip_time", 0, 0, G_OPTION_ARG_INT, &flip_time, "flip event duration (sec)", "N"},
+    {"labor_sign_time", 0, 0, G_OPTION_ARG_INT, &labor_sign_time, "labor sign event duration (sec)", "N"},
+    {"temp_apply", 0, 0, G_OPTION_ARG_INT, &setting->temp_apply, "temperature analysis on/off", "0|1"},
+    {"opt_flow_apply", 0, 0, G_OPTION_ARG_INT, &setting->opt_flow_apply, "optical flow check of flip on/off", "0|1"},
+    {"resnet50_apply", 0, 0, G_OPTION_ARG_INT, &setting->resnet50_apply, "secondary heat classifier on/off", "0|1"},
+    {"opt_flow_threshold", 0, 0, G_OPTION_ARG_INT, &setting->opt_flow_threshold, "optical flow threshold", "N"},
+    {"temp_diff_threshold", 0, 0, G_OPTION_ARG_INT, &setting->temp_diff_threshold, "over temp margin above the average", "N"},
+    {"over_temp_time", 0, 0, G_OPTION_ARG_INT, &over_temp_time, "over temp duration (sec)", "N"},
+    {"temp_correction", 0, 0, G_OPTION_ARG_INT, &setting->temp_correction, "temperature correction", "N"},
+    {"threshold_under_temp", 0, 0, G_OPTION_ARG_INT, &setting->threshold_under_temp, "lowest object temperature", "N"},
+    {"threshold_upper_temp", 0, 0, G_OPTION_ARG_INT, &setting->threshold_upper_temp, "highest object temperature", "N"},
+    {"nv_interval", 0, 0, G_OPTION_ARG_INT, &g_interval_config.min_interval, "nvinfer interval of an active scene", "N"},
+    {"nv_interval_max", 0, 0, G_OPTION_ARG_INT, &g_interval_config.max_interval, "nvinfer interval of a static scene, for avg_interval", "N"},
+    {"nv_interval_hold", 0, 0, G_OPTION_ARG_INT, &g_interval_config.hold_ticks, "quiet ticks before the interval is stretched", "N"},
+    {"nv_motion_threshold", 0, 0, G_OPTION_ARG_INT, &setting->motion_threshold, "pixels an object moves in a tick to be active", "N"},
+    {"preset_memory_time", 0, 0, G_OPTION_ARG_INT, &setting->preset_memory_time, "sec objects are kept over an analysis off/on, 0 never", "N"},
+    {"rules", 'r', 0, G_OPTION_ARG_STRING, &rules_file, "device setting json whose event_rules replace the rules above", "FILE"},
+    {"events", 'e', 0, G_OPTION_ARG_NONE, &g_print_events, "print every notification", NULL},
+    {"verbose", 'v', 0, G_OPTION_ARG_NONE, &g_verbose, "print the analytics trace logs", NULL},
+    {NULL}
+  };
+  GOptionContext *context = g_option_context_new("trace...");
+  g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error) || argc < 2) {
+    fprintf(stderr, "%s\n", error ? error->message : "no trace given");
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return 1;
+  }
+  g_option_context_free(context);
+  set_glog_level(g_verbose ? GLOG_TRACE : GLOG_ERROR);     //analytics traces only with --verbose
+
+  EventRuleTable rules;
+  init_event_rules(&rules);
+  if (!set_class_event_rule(&rules, CLASS_HEAT_COW, heat_threshold, heat_time) ||
+      !set_class_event_rule(&rules, CLASS_FLIP_COW, flip_threshold, flip_time) ||
+      !set_class_event_rule(&rules, CLASS_LABOR_SIGN_COW, labor_sign_threshold, labor_sign_time) ||
+      !set_class_event_rule(&rules, CLASS_OVER_TEMP, 0, over_temp_time)) {
+    fprintf(stderr, "event time over %d seconds\n", EVENT_HISTORY_BITS);
+    g_free(rules_file);
+    return 1;
+  }
+  if (rules_file && !load_event_rules_file(rules_file, &rules)) {
+    fprintf(stderr, "%s: bad event_rules\n", rules_file);
+    g_free(rules_file);
+    return 1;
+  }
+  g_free(rules_file);
+  log_event_rules(&rules);
+  set_event_rules(&rules);
+  set_analytics_event_func(on_event);
+
+  for (int i = 1; i < argc; i++) {
+    if (replay_trace(argv[i]) != 0)
+      failed++;
+  }
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+#include <string.h>
+#include "g_log.h"
+#include "analytics_ring.h"
+
+
+gboolean init_analytics_ring(AnalyticsRing *ring, int depth)
+{
+  guint size = 1;
+
+  if (depth < 2)
+    depth = 2;
+  if (depth > ANALYTICS_RING_MAX_DEPTH)
+    depth = ANALYTICS_RING_MAX_DEPTH;
+  while (size < (guint)depth)
+    size <<= 1;
+
+  memset(ring, 0, sizeof(*ring));
+  ring->records = g_new0(FrameRecord, size);
+  ring->mask = size - 1;
+  if (sem_init(&ring->ready, 0, 0) != 0) {
+    glog_error("sem_init failed\n");
+    g_clear_pointer(&ring->records, g_free);
+    return FALSE;
+  }
+  glog_trace("analytics ring depth=%u record=%zu bytes\n", size, sizeof(FrameRecord));
+
+  return TRUE;
+}
+
+
+void free_analytics_ring(AnalyticsRing *ring)
+{
+  if (ring->records == NULL)
+    return;
+  sem_destroy(&ring->ready);
+  g_clear_pointer(&ring->records, g_free);
+}
+
+
+// Producer : record to fill for this frame, NULL when the consumer is a full ring behind
+FrameRecord *get_ring_write_record(AnalyticsRing *ring)
+{
+  guint head = (guint)ring->head;                         //only written by this thread
+  guint fill = head - (guint)g_atomic_int_get(&ring->tail);
+
+  if (ring->records == NULL)                              //ring failed to initialize, the camera runs without analytics
+    return NULL;
+  if (fill > ring->mask) {
+    g_atomic_int_inc(&ring->overflow);
+    return NULL;
+  }
+  if ((gint)fill + 1 > ring->high_water)
+    g_atomic_int_set(&ring->high_water, (gint)fill + 1);
+
+  return &ring->records[head & ring->mask];
+}
+
+
+// Producer : publish the record returned by get_ring_write_record()
+void commit_ring_write(AnalyticsRing *ring)
+{
+  g_atomic_int_set(&ring->head, (gint)((guint)ring->head + 1));       //record contents are visible before the new head
+  sem_post(&ring->ready);
+}
+
+
+// Consumer : sleep until a record is committed. NULL when woken by wake_ring_reader() with nothing to read
+FrameRecord *wait_ring_read_record(AnalyticsRing *ring)
+{
+  guint tail;
+
+  while (sem_wait(&ring->ready) != 0)
+    ;                                                     //EINTR
+  tail = (guint)ring->tail;                               //only written by this thread
+  if (tail == (guint)g_atomic_int_get(&ring->head))
+    return NULL;
+
+  return &ring->records[tail & ring->mask];
+}
+
+
+// Consumer : hand the record returned by wait_ring_read_record() back to the producer
+void release_ring_read(AnalyticsRing *ring)
+{
+  g_atomic_int_set(&ring->tail, (gint)((guint)ring->tail + 1));
+}
+
+
+void wake_ring_reader(AnalyticsRing *ring)
+{
+  sem_post(&ring->ready);
+}
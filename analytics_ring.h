@@ -0,0 +1,68 @@
+#ifndef __ANALYTICS_RING_H__
+#define __ANALYTICS_RING_H__
+
+#include <glib.h>
+#include <semaphore.h>
+#include "obj_slot_map.h"
+
+#define ANALYTICS_RING_DEPTH      64              //default frames in flight per camera, "analytics_ring_depth" in config.json
+#define ANALYTICS_RING_MAX_DEPTH  1024
+#define ANALYTICS_RECORD_OBJS     128             //objects kept per frame, the rest are counted as truncated
+#define ANALYTICS_NO_VALUE        (-1.0f)         //temp/flow of an object that was not sampled in this frame
+
+// One object of one frame, copied out of NvDsObjectMeta by the probe
+typedef struct {
+  short slot;               // obj_store column, from the probe's obj_slot_map
+  short class_id;
+  float confidence;
+  short x, y, width, height;
+  float temp;               // bbox temperature on thermal tick frames, ANALYTICS_NO_VALUE otherwise
+  float flow;               // average flow magnitude when requested, ANALYTICS_NO_VALUE otherwise
+  unsigned char heat_vote;  // secondary classifier confirmed heat (RESNET_50)
+  guint16 generation;       // of the slot in the probe's obj_slot_map, see get_obj_record_handle()
+} ObjRecord;
+
+// Everything the analytics worker needs from one frame, the metadata itself never leaves the probe
+typedef struct {
+  guint64 pts;              // GstClockTime of the buffer
+  unsigned char tick;       // frame closed an analytics tick
+  unsigned char reset;      // probe reinitialized its slot map, drop every object state first
+  unsigned char inferred;   // nvinfer ran on the frame, otherwise class and confidence are tracker-propagated
+  int tick_frames;          // frames of the closed tick
+  int tick_inferred_frames; // inferred frames of the closed tick
+  int num_objs;
+  int num_expired;
+  ObjRecord objs[ANALYTICS_RECORD_OBJS];
+  short expired[MAX_OBJ_SLOTS];       // slots released by the probe at this tick
+} FrameRecord;
+
+// Lock-free single producer (pad probe) / single consumer (analytics worker) ring of FrameRecord.
+// The producer never waits, a frame that finds the ring full is dropped and counted.
+typedef struct {
+  FrameRecord *records;
+  guint mask;               // depth - 1, depth is a power of two
+  gint head;                // next record to write, only advanced by the producer
+  gint tail;                // next record to read, only advanced by the consumer
+  gint overflow;            // frames dropped because the ring was full
+  gint truncated;           // objects dropped because a frame had more than ANALYTICS_RECORD_OBJS
+  gint high_water;          // highest fill level seen by the producer
+  sem_t ready;              // one post per committed record, the consumer sleeps on it
+} AnalyticsRing;
+
+
+// Handle of the object, the same as the probe's get_obj_handle() when it took the object
+static inline ObjHandle get_obj_record_handle(const ObjRecord *obj)
+{
+  return make_obj_handle(obj->slot, obj->generation);
+}
+
+
+gboolean init_analytics_ring(AnalyticsRing *ring, int depth);
+void free_analytics_ring(AnalyticsRing *ring);
+FrameRecord *get_ring_write_record(AnalyticsRing *ring);
+void commit_ring_write(AnalyticsRing *ring);
+FrameRecord *wait_ring_read_record(AnalyticsRing *ring);
+void release_ring_read(AnalyticsRing *ring);
+void wake_ring_reader(AnalyticsRing *ring);
+
+#endif
@@ -0,0 +1,149 @@
+#include <string.h>
+#include <time.h>
+#include "g_log.h"
+#include "analytics_trace.h"
+
+
+// Create <dir>/analytics_<cam_idx>_<YYYYmmdd_HHMMSS>.trace, NULL on error
+AnalyticsTrace *open_trace_writer(const char *dir, int cam_idx)
+{
+  char file_name[256], str_time[32];
+  time_t now = time(NULL);
+  struct tm tm_now;
+
+  localtime_r(&now, &tm_now);
+  strftime(str_time, sizeof(str_time), "%Y%m%d_%H%M%S", &tm_now);
+  snprintf(file_name, sizeof(file_name), "%s/analytics_%d_%s.trace", dir, cam_idx, str_time);
+
+  AnalyticsTrace *trace = g_new0(AnalyticsTrace, 1);
+  trace->fp = fopen(file_name, "wb");
+  if (trace->fp == NULL) {
+    glog_error("Fail open trace %s\n", file_name);
+    g_free(trace);
+    return NULL;
+  }
+  trace->buf = g_malloc(ANALYTICS_TRACE_BUF_SIZE);
+  setvbuf(trace->fp, trace->buf, _IOFBF, ANALYTICS_TRACE_BUF_SIZE);
+
+  trace->header.magic = ANALYTICS_TRACE_MAGIC;
+  trace->header.version = ANALYTICS_TRACE_VERSION;
+  trace->header.cam_idx = cam_idx;
+  trace->header.obj_record_size = sizeof(ObjRecord);
+  trace->header.start_time = g_get_real_time();
+  if (fwrite(&trace->header, sizeof(trace->header), 1, trace->fp) != 1)
+    trace->failed = 1;
+  trace->bytes = sizeof(trace->header);
+  glog_trace("analytics trace %s\n", file_name);
+
+  return trace;
+}
+
+
+// Append one frame record. Frames without objects that change nothing are skipped, the tick carries their count
+gboolean write_trace_record(AnalyticsTrace *trace, FrameRecord *rec, int source_cam)
+{
+  TraceRecordHeader header;
+
+  if (trace->failed)
+    return FALSE;
+  if (rec->num_objs == 0 && rec->num_expired == 0 && !rec->tick && !rec->reset)
+    return TRUE;
+
+  memset(&header, 0, sizeof(header));
+  header.pts = rec->pts;
+  header.tick_frames = rec->tick_frames;
+  header.num_objs = rec->num_objs;
+  header.num_expired = rec->num_expired;
+  header.tick = rec->tick;
+  header.reset = rec->reset;
+  header.source_cam = source_cam ? 1 : 0;
+  header.inferred = rec->inferred;
+  header.tick_inferred_frames = rec->tick_inferred_frames;
+
+  if (fwrite(&header, sizeof(header), 1, trace->fp) != 1 ||
+      fwrite(rec->objs, sizeof(ObjRecord), rec->num_objs, trace->fp) != (size_t)rec->num_objs ||
+      fwrite(rec->expired, sizeof(rec->expired[0]), rec->num_expired, trace->fp) != (size_t)rec->num_expired) {
+    glog_error("trace cam_idx=%d write failed after %" G_GUINT64_FORMAT " records, tracing stopped\n", trace->header.cam_idx, trace->records);
+    trace->failed = 1;
+    return FALSE;
+  }
+  trace->records++;
+  trace->bytes += sizeof(header) + sizeof(ObjRecord) * rec->num_objs + sizeof(rec->expired[0]) * rec->num_expired;
+
+  return TRUE;
+}
+
+
+AnalyticsTrace *open_trace_reader(const char *file_name)
+{
+  AnalyticsTrace *trace = g_new0(AnalyticsTrace, 1);
+
+  trace->fp = fopen(file_name, "rb");
+  if (trace->fp == NULL) {
+    glog_error("Fail open trace %s\n", file_name);
+    g_free(trace);
+    return NULL;
+  }
+  if (fread(&trace->header, sizeof(trace->header), 1, trace->fp) != 1 ||
+      trace->header.magic != ANALYTICS_TRACE_MAGIC || trace->header.version < 1 || trace->header.version > ANALYTICS_TRACE_VERSION ||
+      trace->header.obj_record_size != sizeof(ObjRecord)) {
+    glog_error("%s is not an analytics trace of this build, version 1 to %d\n", file_name, ANALYTICS_TRACE_VERSION);
+    close_trace(trace);
+    return NULL;
+  }
+
+  return trace;
+}
+
+
+// Read the next frame record. Returns 1 on success, 0 at the end of the trace, -1 on a truncated or corrupt record
+int read_trace_record(AnalyticsTrace *trace, FrameRecord *rec, int *source_cam)
+{
+  TraceRecordHeader header;
+
+  if (fread(&header, sizeof(header), 1, trace->fp) != 1)
+    return 0;
+  if (header.num_objs < 0 || header.num_objs > ANALYTICS_RECORD_OBJS || header.num_expired < 0 || header.num_expired > MAX_OBJ_SLOTS)
+    return -1;
+
+  rec->pts = header.pts;
+  rec->tick_frames = header.tick_frames;
+  rec->num_objs = header.num_objs;
+  rec->num_expired = header.num_expired;
+  rec->tick = header.tick;
+  rec->reset = header.reset;
+  rec->inferred = header.inferred;
+  rec->tick_inferred_frames = header.tick_inferred_frames;
+  if (trace->header.version == 1) {           //written before the inferred flag, analytics ran on every frame
+    rec->inferred = 1;
+    rec->tick_inferred_frames = header.tick_frames;
+  }
+  *source_cam = header.source_cam;
+  if (fread(rec->objs, sizeof(ObjRecord), rec->num_objs, trace->fp) != (size_t)rec->num_objs ||
+      fread(rec->expired, sizeof(rec->expired[0]), rec->num_expired, trace->fp) != (size_t)rec->num_expired)
+    return -1;
+  for (int i = 0; i < rec->num_objs; i++) {
+    if (rec->objs[i].slot < 0 || rec->objs[i].slot >= MAX_OBJ_SLOTS)
+      return -1;
+    if (trace->header.version < 3)            //padding of the writer
+      rec->objs[i].generation = 0;
+  }
+  for (int i = 0; i < rec->num_expired; i++) {
+    if (rec->expired[i] < 0 || rec->expired[i] >= MAX_OBJ_SLOTS)
+      return -1;
+  }
+  trace->records++;
+
+  return 1;
+}
+
+
+void close_trace(AnalyticsTrace *trace)
+{
+  if (trace == NULL)
+    return;
+  if (trace->fp)
+    fclose(trace->fp);
+  g_free(trace->buf);
+  g_free(trace);
+}
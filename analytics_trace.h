@@ -0,0 +1,51 @@
+#ifndef __ANALYTICS_TRACE_H__
+#define __ANALYTICS_TRACE_H__
+
+#include <stdio.h>
+#include <glib.h>
+#include "analytics_ring.h"
+
+#define ANALYTICS_TRACE_MAGIC     0x43525441      //"ATRC"
+#define ANALYTICS_TRACE_VERSION   3               //1 : no inferred flag, every frame was taken as inferred, 2 : no slot generation
+#define ANALYTICS_TRACE_BUF_SIZE  (256 * 1024)    //stdio buffer of a writer, one write() every few seconds of records
+
+// Start of a trace file, one file per camera
+typedef struct {
+  guint32 magic;
+  guint32 version;
+  gint32 cam_idx;
+  guint32 obj_record_size;  // sizeof(ObjRecord) of the writer, records are stored as they are in memory
+  gint64 start_time;        // wall clock of the writer at open, g_get_real_time()
+} TraceHeader;
+
+// One frame, followed by num_objs ObjRecord and num_expired slots (gint16)
+typedef struct {
+  guint64 pts;
+  gint32 tick_frames;
+  gint16 num_objs;
+  gint16 num_expired;
+  guint8 tick;
+  guint8 reset;
+  guint8 source_cam;        // camera was g_source_cam_idx when the worker took the record
+  guint8 inferred;          // version 2, 0 in version 1
+  gint32 tick_inferred_frames;      // version 2, padding left at 0 in version 1
+} TraceRecordHeader;
+
+// Trace file of one camera, opened for writing by its analytics worker or for reading by analytics_replay
+typedef struct {
+  FILE *fp;
+  char *buf;                // stdio buffer of a writer
+  TraceHeader header;
+  guint64 records;
+  guint64 bytes;
+  int failed;               // write error seen, the writer stops
+} AnalyticsTrace;
+
+
+AnalyticsTrace *open_trace_writer(const char *dir, int cam_idx);
+gboolean write_trace_record(AnalyticsTrace *trace, FrameRecord *rec, int source_cam);
+AnalyticsTrace *open_trace_reader(const char *file_name);
+int read_trace_record(AnalyticsTrace *trace, FrameRecord *rec, int *source_cam);
+void close_trace(AnalyticsTrace *trace);
+
+#endif
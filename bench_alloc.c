@@ -0,0 +1,41 @@
+#include <stdlib.h>
+
+#include "bench_alloc.h"
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static int g_counting;
+static AllocCount g_count;
+
+void *malloc(size_t size)                   { if (g_counting) g_count.alloc_calls++; return __libc_malloc(size); }
+void *calloc(size_t nmemb, size_t size)     { if (g_counting) g_count.alloc_calls++; return __libc_calloc(nmemb, size); }
+void *realloc(void *ptr, size_t size)       { if (g_counting) g_count.alloc_calls++; return __libc_realloc(ptr, size); }
+void free(void *ptr)                        { if (g_counting && ptr) g_count.free_calls++; __libc_free(ptr); }
+
+
+void reset_alloc_count()
+{
+  g_count.alloc_calls = 0;
+  g_count.free_calls = 0;
+}
+
+
+void start_alloc_count()
+{
+  g_counting = 1;
+}
+
+
+void stop_alloc_count()
+{
+  g_counting = 0;
+}
+
+
+void get_alloc_count(AllocCount *count)
+{
+  *count = g_count;
+}
@@ -0,0 +1,17 @@
+#ifndef __BENCH_ALLOC_H__
+#define __BENCH_ALLOC_H__
+
+// Allocator calls of the benches, counted by wrapping the glibc malloc family (malloc, calloc, realloc, free).
+// Linking bench_alloc.c replaces the allocator of the whole program, only the calls between
+// start_alloc_count() and stop_alloc_count() are counted, whichever thread makes them.
+typedef struct {
+  long alloc_calls;     // malloc, calloc and realloc
+  long free_calls;      // free of a non NULL pointer
+} AllocCount;
+
+void reset_alloc_count();
+void start_alloc_count();
+void stop_alloc_count();
+void get_alloc_count(AllocCount *count);
+
+#endif
@@ -0,0 +1,511 @@
+// Per-stage cost of the analytics path on synthetic frames, no pipeline or GPU involved.
+// Every frame replays the probe work of nvds_process.c on one camera, then hands the record to the analytics core :
+//   record     slot lookup and ObjRecord copy per object, slot expiry on tick frames (get_obj_slot, add_obj_record)
+//   flow       flow grid integral and bbox average of the flip objects, tick frames only (sample_objs_flow)
+//   temp       thermal surface integral and bbox temperature per object, tick frames only (sample_objs_temp)
+//   core       process_frame_record() of a frame without tick (bbox update, temperature smoothing)
+//   core_tick  process_frame_record() of a tick frame (temperature average, event rules, process_opt_flow and verdicts)
+//   label      OSD temperature label per object (temp_display_text)
+//   total      all of the above for the frame
+//
+//   bench_analytics [options]
+//
+// Prints one "key=value" line per object count and stage. ns_per_frame is the stage time spread over every frame,
+// p50/p99/max are over the frames that ran the stage. Allocator calls are counted by bench_alloc.c.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "g_log.h"
+#include "bench_alloc.h"
+#include "analytics_core.h"
+#include "temp_integral.h"
+#include "flow_integral.h"
+#include "osd_label.h"
+#include "infer_interval.h"
+
+#define BENCH_FPS                 15              //nominal source fps of the barn cameras
+#define BENCH_WARMUP_FRAMES       (BENCH_FPS * 2) //not measured, integrals and labels reach their size first
+#define BENCH_BACKGROUND_TEMP     20              //°C of the barn floor on the synthetic thermal surface
+#define BENCH_MAX_OBJ_COUNTS      16
+
+enum {
+  STAGE_RECORD = 0,
+  STAGE_FLOW,
+  STAGE_TEMP,
+  STAGE_CORE,
+  STAGE_CORE_TICK,
+  STAGE_LABEL,
+  STAGE_TOTAL,
+  NUM_STAGES
+};
+
+static const char *stage_names[NUM_STAGES] = { "record", "flow", "temp", "core", "core_tick", "label", "total" };
+
+typedef struct {
+  gint64 *samples;          // ns of every frame that ran the stage
+  int calls;
+  gint64 total_ns;
+  long allocs;
+  long frees;
+} BenchStage;
+
+// One synthetic object, moves around the frame and keeps its tracker id
+typedef struct {
+  guint64 object_id;
+  int x, y, width, height;
+  int dx, dy;
+  int class_id;
+  float confidence;
+  int temp;                 // °C painted into the thermal surface
+  char *display_text;       // label the tracker attaches to the object meta, renewed every frame
+} BenchObj;
+
+typedef struct {
+  int frames;
+  int width;                // frame and thermal surface size, the flow grid is OPT_FLOW_GRID_SIZE times smaller
+  int height;
+  int pixel_size;           // bytes per pixel of the thermal surface, 4(RGBA) 3(RGB) or 1(luma)
+  int bbox_min;
+  int bbox_max;
+  int flip_ratio;           // % of the objects detected as flip, they go through optical flow
+  int interval;             // nv_interval : frames nvinfer skips between two inferred frames
+  int cam_idx;
+  guint seed;
+} BenchConfig;
+
+static BenchConfig g_bench = {
+  .frames = BENCH_FPS * 60,
+  .width = 1280,
+  .height = 720,
+  .pixel_size = 4,
+  .bbox_min = 60,
+  .bbox_max = 240,
+  .flip_ratio = 25,
+  .cam_idx = THERMAL_CAM,
+  .seed = 1,
+};
+static gboolean g_verbose = FALSE;
+static AnalyticsSetting g_bench_setting;      //copied into the state of the benched camera
+
+
+static inline gint64 get_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (gint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static void begin_stage()
+{
+  reset_alloc_count();
+  start_alloc_count();
+}
+
+
+static gint64 end_stage(BenchStage *stage, gint64 start, int measured)
+{
+  gint64 ns = get_ns() - start;
+  AllocCount count;
+
+  stop_alloc_count();
+  get_alloc_count(&count);
+  if (measured) {
+    stage->samples[stage->calls++] = ns;
+    stage->total_ns += ns;
+    stage->allocs += count.alloc_calls;
+    stage->frees += count.free_calls;
+  }
+  return ns;
+}
+
+
+static int compare_ns(const void *a, const void *b)
+{
+  gint64 x = *(const gint64 *)a, y = *(const gint64 *)b;
+
+  return (x > y) - (x < y);
+}
+
+
+// Pixel of temperature temp in the white hot palette, every format reads it back through the same LUT entry
+static unsigned char get_white_hot_level(int temp)
+{
+  return (unsigned char)CLAMP((temp - TEMP_LUT_MIN) * 255 / (TEMP_LUT_MAX - TEMP_LUT_MIN), 0, 255);
+}
+
+
+static void fill_rect(unsigned char *surface, int pitch, int pixel_size, int x, int y, int width, int height, unsigned char level)
+{
+  for (int row = MAX(y, 0); row < MIN(y + height, g_bench.height); row++) {
+    unsigned char *p = surface + (row * pitch) + (MAX(x, 0) * pixel_size);
+    int count = (MIN(x + width, g_bench.width) - MAX(x, 0)) * pixel_size;
+    if (count > 0)
+      memset(p, level, count);
+  }
+}
+
+
+// Thermal surface of a tick frame : floor at BENCH_BACKGROUND_TEMP and one warm rectangle per object
+static void paint_thermal_surface(unsigned char *surface, int pitch, BenchObj *objs, int num_objs)
+{
+  fill_rect(surface, pitch, g_bench.pixel_size, 0, 0, g_bench.width, g_bench.height, get_white_hot_level(BENCH_BACKGROUND_TEMP));
+  for (int n = 0; n < num_objs; n++) {
+    BenchObj *obj = &objs[n];
+    fill_rect(surface, pitch, g_bench.pixel_size, obj->x + obj->width / 4, obj->y + obj->height / 4,
+              obj->width / 2, obj->height / 2, get_white_hot_level(obj->temp));
+  }
+}
+
+
+// Flow grid with sensor noise, objects move over it
+static void fill_flow_grid(FlowVector *grid, int rows, int cols)
+{
+  for (int i = 0; i < rows * cols; i++) {
+    grid[i].flowx = (short)(g_random_int_range(-8, 9));
+    grid[i].flowy = (short)(g_random_int_range(-8, 9));
+  }
+}
+
+
+static void init_objs(BenchObj *objs, int num_objs)
+{
+  for (int n = 0; n < num_objs; n++) {
+    BenchObj *obj = &objs[n];
+    obj->object_id = 1000 + n;
+    obj->width = g_random_int_range(g_bench.bbox_min, g_bench.bbox_max + 1);
+    obj->height = g_random_int_range(g_bench.bbox_min, g_bench.bbox_max + 1);
+    obj->x = g_random_int_range(0, MAX(g_bench.width - obj->width, 1));
+    obj->y = g_random_int_range(0, MAX(g_bench.height - obj->height, 1));
+    obj->dx = g_random_int_range(-2, 3);
+    obj->dy = g_random_int_range(-2, 3);
+    if (g_random_int_range(0, 100) < g_bench.flip_ratio)
+      obj->class_id = CLASS_FLIP_COW;
+    else
+      obj->class_id = (n % 8 == 1) ? CLASS_HEAT_COW : CLASS_NORMAL_COW;
+    obj->confidence = 0.9f;
+    obj->temp = 30 + (n % 10);
+    obj->display_text = NULL;
+  }
+}
+
+
+static void move_objs(BenchObj *objs, int num_objs)
+{
+  for (int n = 0; n < num_objs; n++) {
+    BenchObj *obj = &objs[n];
+    if (obj->x + obj->dx < 0 || obj->x + obj->width + obj->dx > g_bench.width)
+      obj->dx = -obj->dx;
+    if (obj->y + obj->dy < 0 || obj->y + obj->height + obj->dy > g_bench.height)
+      obj->dy = -obj->dy;
+    obj->x += obj->dx;
+    obj->y += obj->dy;
+    g_free(obj->display_text);
+    obj->display_text = g_strdup_printf("%s %.2f\n", obj->class_id == CLASS_FLIP_COW ? "flip" : "cow", obj->confidence);
+  }
+}
+
+
+// Same work as get_obj_slot() and add_obj_record() per object, then expire_obj_slots() on tick frames
+static void record_objs(ObjSlotMap *map, FrameRecord *rec, BenchObj *objs, int num_objs, int *slots, int tick)
+{
+  rec->num_objs = 0;
+  rec->num_expired = 0;
+  for (int n = 0; n < num_objs; n++) {
+    BenchObj *src = &objs[n];
+    int slot = acquire_obj_slot(map, src->object_id);
+    slots[n] = slot;
+    if (slot < 0 || rec->num_objs >= ANALYTICS_RECORD_OBJS)
+      continue;
+    ObjRecord *obj = &rec->objs[rec->num_objs++];
+    obj->slot = (short)slot;
+    obj->generation = map->slots[slot].generation;
+    obj->class_id = (short)src->class_id;
+    obj->confidence = src->confidence;
+    obj->x = (short)src->x;
+    obj->y = (short)src->y;
+    obj->width = (short)src->width;
+    obj->height = (short)src->height;
+    obj->temp = ANALYTICS_NO_VALUE;
+    obj->flow = ANALYTICS_NO_VALUE;
+    obj->heat_vote = 0;
+  }
+
+  if (!tick)
+    return;
+  map->tick++;
+  for (int i = map->active_count - 1; i >= 0; i--) {
+    int obj_id = map->active[i];
+    if (map->tick - map->slots[obj_id].last_tick > OBJ_SLOT_EXPIRE_SEC) {
+      release_obj_slot(map, obj_id);
+      rec->expired[rec->num_expired++] = (short)obj_id;
+    }
+  }
+}
+
+
+// Same work as sample_objs_flow()
+static void sample_flow(FlowIntegral *fi, const FlowVector *grid, int rows, int cols, const EventRuleTable *rules, FrameRecord *rec)
+{
+  int built = 0;
+
+  for (int i = 0; i < rec->num_objs; i++) {
+    ObjRecord *obj = &rec->objs[i];
+    const EventRule *rule = get_class_event_rule(rules, obj->class_id, obj->confidence);
+    if (rule == NULL || rule->predicate != RULE_PREDICATE_MOTION)
+      continue;
+    if (!built) {
+      build_flow_integral(fi, grid, rows, cols);
+      built = 1;
+    }
+    if (!fi->valid)
+      return;
+
+    int count = 0;
+    double move_size_avg = get_flow_integral_avg(fi, obj->x, obj->y, obj->width, obj->height, &count);
+    if (count > 0)
+      obj->flow = (float)move_size_avg;
+  }
+}
+
+
+// Same work as sample_objs_temp() once the surface is mapped
+static void sample_temp(TempIntegral *ti, const ThermalPixels *px, FrameRecord *rec)
+{
+  build_temp_integral(ti, px, g_bench_setting.threshold_under_temp, g_bench_setting.threshold_upper_temp);
+  for (int i = 0; i < rec->num_objs; i++) {
+    ObjRecord *obj = &rec->objs[i];
+    int count = 0;
+    float temp_avg = get_integral_temp_avg(ti, obj->x, obj->y, obj->width, obj->height, &count);
+    if (count > 0)
+      obj->temp = temp_avg;
+  }
+}
+
+
+// Same work as temp_display_text() for every object of the thermal camera
+static void update_labels(OsdLabel *labels, BenchObj *objs, int num_objs, int *slots, int cam_idx)
+{
+  for (int n = 0; n < num_objs; n++) {
+    int obj_id = slots[n];
+    if (obj_id < 0)
+      continue;
+    OsdLabel *label = &labels[obj_id];
+    update_temp_label(label, objs[n].display_text, OBJ_INFO(cam_idx, obj_id, bbox_temp));
+    set_osd_text(&objs[n].display_text, label->text);
+  }
+}
+
+
+static void print_stages(int num_objs, BenchStage *stages, int frames)
+{
+  for (int s = 0; s < NUM_STAGES; s++) {
+    BenchStage *stage = &stages[s];
+    gint64 p50 = 0, p99 = 0, max = 0;
+    if (stage->calls > 0) {
+      qsort(stage->samples, stage->calls, sizeof(gint64), compare_ns);
+      p50 = stage->samples[stage->calls / 2];
+      p99 = stage->samples[MIN((stage->calls * 99) / 100, stage->calls - 1)];
+      max = stage->samples[stage->calls - 1];
+    }
+    printf("objs=%d stage=%s calls=%d ns_per_frame=%.1f p50_ns=%" G_GINT64_FORMAT " p99_ns=%" G_GINT64_FORMAT
+           " max_ns=%" G_GINT64_FORMAT " allocs_per_frame=%.3f frees_per_frame=%.3f\n",
+           num_objs, stage_names[s], stage->calls, (double)stage->total_ns / frames, p50, p99, max,
+           (double)stage->allocs / frames, (double)stage->frees / frames);
+  }
+}
+
+
+static void run(int num_objs)
+{
+  int cam_idx = g_bench.cam_idx;
+  int rows = g_bench.height / OPT_FLOW_GRID_SIZE, cols = g_bench.width / OPT_FLOW_GRID_SIZE;
+  int pitch = g_bench.width * g_bench.pixel_size;
+  BenchObj *objs = g_new0(BenchObj, num_objs);
+  int *slots = g_new0(int, num_objs);
+  ObjSlotMap *map = g_new0(ObjSlotMap, 1);
+  FrameRecord *rec = g_new0(FrameRecord, 1);
+  OsdLabel *labels = g_new0(OsdLabel, NUM_OBJS);
+  FlowVector *grid = g_new(FlowVector, rows * cols);
+  unsigned char *surface = g_malloc(pitch * g_bench.height);
+  ThermalPixels px = { surface, g_bench.width, g_bench.height, pitch, g_bench.pixel_size, 0 };
+  FlowIntegral fi;
+  TempIntegral ti;
+  BenchStage stages[NUM_STAGES];
+  int inferred_frames = 0;
+
+  memset(&fi, 0, sizeof(fi));
+  memset(&ti, 0, sizeof(ti));
+  memset(stages, 0, sizeof(stages));
+  for (int s = 0; s < NUM_STAGES; s++)
+    stages[s].samples = g_new(gint64, g_bench.frames);
+
+  g_random_set_seed(g_bench.seed);
+  init_analytics_core(cam_idx + 1);
+  AnalyticsState *state = get_analytics_state(cam_idx);
+  state->setting = g_bench_setting;
+  init_obj_slot_map(map);
+  for (int i = 0; i < NUM_OBJS; i++)
+    init_osd_label(&labels[i]);
+  init_objs(objs, num_objs);
+  fill_flow_grid(grid, rows, cols);
+
+  for (int frame = 0; frame < BENCH_WARMUP_FRAMES + g_bench.frames; frame++) {
+    int measured = frame >= BENCH_WARMUP_FRAMES;
+    int tick = (frame % BENCH_FPS) == (BENCH_FPS - 1);
+    int inferred = (frame % (g_bench.interval + 1)) == 0;
+    gint64 start, total = 0;
+
+    inferred_frames += inferred;
+
+    move_objs(objs, num_objs);                    //tracker output of the frame, not measured
+    if (tick && cam_idx == THERMAL_CAM)
+      paint_thermal_surface(surface, pitch, objs, num_objs);
+
+    begin_stage();
+    start = get_ns();
+    record_objs(map, rec, objs, num_objs, slots, tick);
+    rec->tick = tick;
+    rec->tick_frames = BENCH_FPS;
+    rec->tick_inferred_frames = inferred_frames;
+    rec->inferred = inferred;
+    rec->reset = 0;
+    if (tick)
+      inferred_frames = 0;
+    rec->pts = (guint64)frame * G_GUINT64_CONSTANT(1000000000) / BENCH_FPS;
+    total += end_stage(&stages[STAGE_RECORD], start, measured);
+
+    if (tick && cam_idx == state->setting.source_cam_idx) {
+      begin_stage();
+      start = get_ns();
+      sample_flow(&fi, grid, rows, cols, &state->rules, rec);
+      total += end_stage(&stages[STAGE_FLOW], start, measured);
+    }
+
+    if (tick && cam_idx == THERMAL_CAM) {
+      begin_stage();
+      start = get_ns();
+      sample_temp(&ti, &px, rec);
+      total += end_stage(&stages[STAGE_TEMP], start, measured);
+    }
+
+    begin_stage();
+    start = get_ns();
+    process_frame_record(state, rec);
+    total += end_stage(&stages[tick ? STAGE_CORE_TICK : STAGE_CORE], start, measured);
+
+    if (cam_idx == THERMAL_CAM) {
+      begin_stage();
+      start = get_ns();
+      update_labels(labels, objs, num_objs, slots, cam_idx);
+      total += end_stage(&stages[STAGE_LABEL], start, measured);
+    }
+
+    if (measured) {
+      stages[STAGE_TOTAL].samples[stages[STAGE_TOTAL].calls++] = total;
+      stages[STAGE_TOTAL].total_ns += total;
+    }
+  }
+  for (int s = 0; s < STAGE_TOTAL; s++) {
+    stages[STAGE_TOTAL].allocs += stages[s].allocs;
+    stages[STAGE_TOTAL].frees += stages[s].frees;
+  }
+
+  print_stages(num_objs, stages, g_bench.frames);
+
+  for (int s = 0; s < NUM_STAGES; s++)
+    g_free(stages[s].samples);
+  for (int n = 0; n < num_objs; n++)
+    g_free(objs[n].display_text);
+  free_temp_integral(&ti);
+  free_flow_integral(&fi);
+  free_analytics_core();
+  g_free(surface);
+  g_free(grid);
+  g_free(labels);
+  g_free(rec);
+  g_free(map);
+  g_free(slots);
+  g_free(objs);
+}
+
+
+int main(int argc, char *argv[])
+{
+  char *obj_counts = NULL;
+  int num_counts = 0, counts[BENCH_MAX_OBJ_COUNTS];
+  GError *error = NULL;
+
+  GOptionEntry entries[] = {
+    {"frames", 'f', 0, G_OPTION_ARG_INT, &g_bench.frames, "measured frames per object count", "N"},
+    {"objs", 'n', 0, G_OPTION_ARG_STRING, &obj_counts, "object counts per frame (default 8,32,64,128)", "N,N,..."},
+    {"width", 0, 0, G_OPTION_ARG_INT, &g_bench.width, "frame width, the flow grid is 4 times smaller", "N"},
+    {"height", 0, 0, G_OPTION_ARG_INT, &g_bench.height, "frame height", "N"},
+    {"pixel_size", 0, 0, G_OPTION_ARG_INT, &g_bench.pixel_size, "bytes per pixel of the thermal surface", "4|3|1"},
+    {"bbox_min", 0, 0, G_OPTION_ARG_INT, &g_bench.bbox_min, "smallest bbox side", "N"},
+    {"bbox_max", 0, 0, G_OPTION_ARG_INT, &g_bench.bbox_max, "largest bbox side", "N"},
+    {"flip_ratio", 0, 0, G_OPTION_ARG_INT, &g_bench.flip_ratio, "objects detected as flip (%)", "N"},
+    {"interval", 0, 0, G_OPTION_ARG_INT, &g_bench.interval, "nv_interval, frames in between carry tracker output only", "N"},
+    {"cam_idx", 0, 0, G_OPTION_ARG_INT, &g_bench.cam_idx, "camera, 1 is thermal (temp and label stages)", "N"},
+    {"seed", 0, 0, G_OPTION_ARG_INT, &g_bench.seed, "seed of the synthetic scene", "N"},
+    {"verbose", 'v', 0, G_OPTION_ARG_NONE, &g_verbose, "print the analytics trace logs", NULL},
+    {NULL}
+  };
+  GOptionContext *context = g_option_context_new("");
+  g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    fprintf(stderr, "%s\n", error->message);
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return 1;
+  }
+  g_option_context_free(context);
+  set_glog_level(g_verbose ? GLOG_TRACE : GLOG_ERROR);     //analytics traces only with --verbose
+
+  char **tokens = g_strsplit(obj_counts ? obj_counts : "8,32,64,128", ",", BENCH_MAX_OBJ_COUNTS);
+  for (int i = 0; tokens[i] && num_counts < BENCH_MAX_OBJ_COUNTS; i++)
+    counts[num_counts++] = atoi(tokens[i]);
+  g_strfreev(tokens);
+  g_free(obj_counts);
+
+  for (int i = 0; i < num_counts; i++) {
+    if (counts[i] < 1 || counts[i] > ANALYTICS_RECORD_OBJS) {
+      fprintf(stderr, "object count %d out of 1..%d\n", counts[i], ANALYTICS_RECORD_OBJS);
+      return 1;
+    }
+  }
+  if (g_bench.frames < 1 || g_bench.width < OPT_FLOW_GRID_SIZE || g_bench.height < OPT_FLOW_GRID_SIZE ||
+      (g_bench.pixel_size != 4 && g_bench.pixel_size != 3 && g_bench.pixel_size != 1) ||
+      g_bench.bbox_min < 1 || g_bench.bbox_max < g_bench.bbox_min || g_bench.cam_idx < 0) {
+    fprintf(stderr, "bad options, see --help\n");
+    return 1;
+  }
+
+  AnalyticsSetting *setting = &g_bench_setting;
+  setting->temp_apply = 1;
+  setting->opt_flow_apply = 1;
+  setting->resnet50_apply = 0;
+  setting->opt_flow_threshold = 0;
+  setting->temp_diff_threshold = 7;
+  setting->temp_correction = 0;
+  setting->threshold_upper_temp = THRESHOLD_UPPER_TEMP_DEFAULT;
+  setting->threshold_under_temp = THRESHOLD_UNDER_TEMP_DEFAULT;
+  setting->source_cam_idx = g_bench.cam_idx;
+  setting->ptz_move_speed = 0;
+  setting->preset_index = 0;
+  setting->motion_threshold = INFER_MOTION_THRESHOLD_DEFAULT;
+  setting->preset_memory_time = PRESET_MEMORY_TIME_DEFAULT;
+  static const int bench_palettes[TEMP_PALETTE_IDS] = { TEMP_PALETTE_WHITE_HOT };   //synthetic frames are white hot, id 0
+  init_temp_palette_lut(0, bench_palettes);
+
+  printf("frames=%d width=%d height=%d pixel_size=%d bbox_min=%d bbox_max=%d flip_ratio=%d cam_idx=%d\n",
+         g_bench.frames, g_bench.width, g_bench.height, g_bench.pixel_size, g_bench.bbox_min, g_bench.bbox_max,
+         g_bench.flip_ratio, g_bench.cam_idx);
+  for (int i = 0; i < num_counts; i++)
+    run(counts[i]);
+
+  return 0;
+}
@@ -73,6 +73,10 @@ int load_config(const char *file_name, WebRTCConfig* config, CurlIinfoType *curl
   if (json_object_has_member (object, "device_cnt")) {
       int value = json_object_get_int_member (object, "device_cnt");
       glog_trace("parse member %s : %d\n", "device_cnt", value);  
+      if (value < 1 || value > MAX_DEVICE_CNT) {
+        glog_error("device_cnt=%d is out of range [1, %d]\n", value, MAX_DEVICE_CNT);
+        return FALSE;
+      }
       config->device_cnt = value;
   } else {
     return FALSE;
@@ -86,8 +90,18 @@ int load_config(const char *file_name, WebRTCConfig* config, CurlIinfoType *curl
     return FALSE;
   }
 
+  if (config->device_cnt * (config->max_stream_cnt + 2) > MAIN_STREAM_PORT_SPACE) {      //see get_udp_port()
+    glog_error("device_cnt=%d with max_stream_cnt=%d does not fit in %d udp ports\n", config->device_cnt, config->max_stream_cnt, MAIN_STREAM_PORT_SPACE);
+    return FALSE;
+  }
+  config->video_src = calloc(config->device_cnt, sizeof(char*));
+  config->video_infer = calloc(config->device_cnt, sizeof(char*));
+  config->video_enc = calloc(config->device_cnt, sizeof(char*));
+  config->video_enc2 = calloc(config->device_cnt, sizeof(char*));
+  config->snapshot_enc = calloc(config->device_cnt, sizeof(char*));
+
   for(int i = 0 ; i < config->device_cnt ; i++){
-    char video_name[6] = "videox";
+    char video_name[7] = "videox";
     video_name[5] = '0' + i;
     if (json_object_has_member (object, video_name)) {
         child = json_object_get_object_member (object, video_name);
@@ -219,6 +233,64 @@ int load_config(const char *file_name, WebRTCConfig* config, CurlIinfoType *curl
     config->http_service_port = 0;
   }
 
+  if (json_object_has_member (object, "analytics_ring_depth")) {
+      int value = json_object_get_int_member(object, "analytics_ring_depth");
+      glog_trace("parse member %s : %d\n", "analytics_ring_depth", value);  
+      config->analytics_ring_depth = value;
+  } else {
+    config->analytics_ring_depth = ANALYTICS_RING_DEPTH;
+  }
+
+  if (json_object_has_member (object, "analytics_trace_path")) {
+      const char* value = json_object_get_string_member(object, "analytics_trace_path");
+      glog_trace("parse member %s : %s\n", "analytics_trace_path", value);  
+      config->analytics_trace_path = strdup(value);
+  } else {
+    config->analytics_trace_path = NULL;
+  }
+
+  if (json_object_has_member (object, "thermal_calibration_path")) {
+      const char* value = json_object_get_string_member(object, "thermal_calibration_path");
+      glog_trace("parse member %s : %s\n", "thermal_calibration_path", value);  
+      config->thermal_calibration_path = strdup(value);
+  } else {
+    config->thermal_calibration_path = NULL;
+  }
+
+  if (json_object_has_member (object, "outbox_path")) {
+      const char* value = json_object_get_string_member(object, "outbox_path");
+      glog_trace("parse member %s : %s\n", "outbox_path", value);  
+      config->outbox_path = strdup(value);
+  } else {
+    config->outbox_path = strdup("outbox");
+  }
+
+  //"thermal_palettes" : ["white_hot", "black_hot", ...], table name of each cam_ctl palette id from '0'
+  for (int i = 0; i < TEMP_PALETTE_IDS; i++)
+    config->thermal_palettes[i] = TEMP_PALETTE_RED_CHANNEL;
+  if (json_object_has_member (object, "thermal_palettes")) {
+      JsonArray *palette_array = json_object_get_array_member(object, "thermal_palettes");
+      guint array_size = MIN(json_array_get_length(palette_array), TEMP_PALETTE_IDS);
+      for (guint i = 0; i < array_size; i++) {
+        const gchar *name = json_array_get_string_element(palette_array, i);
+        int palette = get_temp_palette_by_name(name);
+        if (palette < 0) {
+          glog_error("unknown thermal palette %s for id %d, red channel is used\n", name ? name : "null", i);
+          continue;
+        }
+        glog_trace("parse member %s[%d] : %s\n", "thermal_palettes", i, name);
+        config->thermal_palettes[i] = palette;
+      }
+  }
+
+  if (json_object_has_member (object, "notify_full_snapshot")) {
+      int value = json_object_get_int_member(object, "notify_full_snapshot");
+      glog_trace("parse member %s : %d\n", "notify_full_snapshot", value);  
+      curl_info->full_snapshot = value;
+  } else {
+    curl_info->full_snapshot = 0;
+  }
+
   update_http_service_ip(config);
 
   g_object_unref (reader);
@@ -232,56 +304,48 @@ void free_config(WebRTCConfig* config)
 {
   free(config->camera_id);
   free(config->tty_name);
-  for(int i = 0 ; i < 2 ; i++){
+  for(int i = 0 ; i < config->device_cnt ; i++){
     free(config->video_src[i]);
+    free(config->video_infer[i]);
     free(config->video_enc[i]);
+    free(config->video_enc2[i]);
+    free(config->snapshot_enc[i]);
   }
+  free(config->video_src);
+  free(config->video_infer);
+  free(config->video_enc);
+  free(config->video_enc2);
+  free(config->snapshot_enc);
   free(config->snapshot_path);
   free(config->device_setting_path);
+  free(config->analytics_trace_path);
+  free(config->thermal_calibration_path);
+  free(config->outbox_path);
 }
 
 
-// Callback function to handle the response
-size_t write_callback(void *ptr, size_t size, size_t nmemb, char *data) {
-    strcat(data, ptr);  // Append the response to the data buffer
-    return size * nmemb;
-}
-
 // Function to get the global IP address using ipify API
 char* get_global_ip() 
 {
-    CURL *curl;
-    CURLcode res;
     char *ip = (char*)malloc(100);  // Allocate memory for the IP address
-    ip[0] = '\0';  // Initialize the IP string as empty
-
-    // Initialize curl
-    curl_global_init(CURL_GLOBAL_DEFAULT);
-    curl = curl_easy_init();
-
-    if (curl) {
-        // Set the URL for ipify API
-        curl_easy_setopt(curl, CURLOPT_URL, "https://api.ipify.org?format=text");
+    char *response = NULL;
+    HttpRequest *request;
 
-        // Set the callback function to handle the response
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, ip);
-
-        // Perform the request
-        res = curl_easy_perform(curl);
+    ip[0] = '\0';  // Initialize the IP string as empty
 
-        // Check if the request was successful
-        if (res != CURLE_OK) {
-            fprintf(stderr, "Request failed: %s\n", curl_easy_strerror(res));
-            free(ip);  // Free the allocated memory in case of error
-            ip = NULL;
-        }
+    // Set the URL for ipify API, goes through the shared http client
+    request = new_http_request("https://api.ipify.org?format=text", NULL, NULL);
 
-        // Cleanup
-        curl_easy_cleanup(curl);
+    // Perform the request
+    if (!perform_http_request(&g_http_client, request, NULL, &response)) {
+        fprintf(stderr, "Request failed\n");
+        g_free(response);
+        free(ip);  // Free the allocated memory in case of error
+        return NULL;
     }
 
-    curl_global_cleanup();
+    g_strlcpy(ip, response ? response : "", 100);
+    g_free(response);
     return ip;
 }
 
@@ -3,6 +3,9 @@
 
 #include "curllib.h"
 #include "g_log.h"
+#include "temp_integral.h"
+
+#define MAX_DEVICE_CNT    8         //"video0".."video7", each camera also takes (max_stream_cnt + 2) udp ports per stream
 
 typedef struct 
 {
@@ -15,11 +18,11 @@ typedef struct
   int   stream_base_port;
 
   int   device_cnt;
-  char* video_src[2];
-  char* video_infer[2];
-  char* video_enc[2];
-  char* video_enc2[2];
-  char* snapshot_enc[2];
+  char** video_src;             //per camera, device_cnt entries
+  char** video_infer;
+  char** video_enc;
+  char** video_enc2;
+  char** snapshot_enc;
 
   char* server_ip;
   char* snapshot_path;
@@ -32,9 +35,14 @@ typedef struct
   int   record_enc_index;
 
   char* http_service_ip;
-  int   event_buf_time;
+  int   event_buf_time;               //sec of video kept before an event (pre-event ring), and recorded after it
   int   event_record_enc_index;
   int   http_service_port;            //LJH, 241209
+  int   analytics_ring_depth;         //frames buffered between each probe and its analytics worker
+  char* analytics_trace_path;         //directory of the analytics traces, no tracing when NULL
+  char* thermal_calibration_path;     //RGB -> thermal homography per preset, the thermal nvinfer runs as before when NULL
+  char* outbox_path;                  //directory of the notifications not yet delivered, "outbox" by default
+  int   thermal_palettes[TEMP_PALETTE_IDS];   //temperature table of each cam_ctl palette id, red channel unless named
 } WebRTCConfig;
 
 typedef struct 
@@ -15,10 +15,22 @@ server ip address
 #include "json_utils.h"
 #include "g_log.h"
 
-struct MemoryStruct {
-    char *memory;
-    size_t size;
-};
+#define OUTBOX_POLL_MS            1000            //longest sleep of the sender, new events and answers wake it at once
+
+// One notification on its way, the slot tells the outbox which event the answer is for
+typedef struct {
+  int slot;                               // -1 when sent without outbox
+  OutboxRecord event;
+} NotificationSend;
+
+HttpClient g_http_client;                 //every request of the process goes through its cached connections
+static Outbox g_outbox;
+static pthread_t g_outbox_tid;
+static gint g_outbox_running = 0;
+static GMutex g_outbox_lock;              //static, no init needed
+static GCond g_outbox_cond;
+static gboolean g_outbox_sending = FALSE; //one notification in flight, under g_outbox_lock
+static gint g_token_rejected = 0;         //401 seen, the sender logs in again before the next one
 
 // login
 /*
@@ -64,26 +76,6 @@ static int make_login_json(char *json, char *phone, char *password)
 	return 0;
 }
 
-size_t write_to_memory_callback(void *buffer, size_t size, size_t nmemb, void *userp) {
-
-    size_t realsize = size * nmemb;
-    struct MemoryStruct *mem = (struct MemoryStruct *) userp;
-    char *ptr = (char *) realloc(mem->memory, mem->size + realsize + 1);
-
-    if(!ptr) {
-        printf("not enough memory (realloc returned NULL)\n");
-        return 0;
-    }
-
-    mem->memory = ptr;
-    memcpy(&(mem->memory[mem->size]), buffer, realsize);
-    mem->size += realsize;
-    mem->memory[mem->size] = 0;
-	printf("%s copied %d \n", __func__, (int)mem->size);
-    return realsize;
-}
-
-
 static int login_parser(char *val, CurlIinfoType *j)
 {
 	gJSONObj*  obj = get_json_object(val);
@@ -107,71 +99,43 @@ static int login_parser(char *val, CurlIinfoType *j)
 }
 
 
+// Blocking, the caller needs the token, but the request goes through the shared connection
 int login_request(CurlIinfoType *j)
 {    
 	char url[256];
 	char json[1024];
-    CURL *curl;
-    // CURLcode res;
-    curl = curl_easy_init();
-    struct curl_slist *headers = NULL;
+	HttpRequest *request;
+	long status = 0;
+	char *response = NULL;
 
     printf("%s + \n", __func__);
 
-    // =========================================
-    // METHOD : POST & CALLBACK
-    if(curl) {
-
-        headers = NULL;
-
-        struct MemoryStruct chunk;
-        chunk.memory = (char *) malloc(1);
-        chunk.size = 0;
-
-        // URL
-        memset(url, 0, sizeof(url));
-        make_login_url(url, j);
-        curl_easy_setopt(curl, CURLOPT_URL, url);
-
-        // METHOD
-        curl_easy_setopt(curl, CURLOPT_POST, 1L);
-//        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "POST");
-
-        // HEADERS
-		headers = curl_slist_append(headers, "Accept: application/json");
-		headers = curl_slist_append(headers, "Content-Type: application/json");
-		headers = curl_slist_append(headers, "charset: utf-8");
-		
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-
-        // SSL
-//        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
-//        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 1L);
-
-        // DATA
-        memset(json, 0, sizeof(json));
-        make_login_json(json, j->phone, j->password);
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json);
-        // CALLBACK
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_to_memory_callback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *) &chunk);
-
-        // EXECUTE
-        // res = curl_easy_perform(curl);
-		curl_easy_perform(curl);
-
-        curl_easy_cleanup(curl);
-        curl_slist_free_all(headers);
-#if 1
-		printf("chunk size %d \n", (int)chunk.size);
-        if (chunk.size > 0) {
-            printf("chunk data : %s \n", chunk.memory);
-        }
-#endif
-		login_parser(chunk.memory, j);
-		        
-        free(chunk.memory);
-    }
+    // URL
+    memset(url, 0, sizeof(url));
+    make_login_url(url, j);
+    request = new_http_request(url, NULL, NULL);
+    if (request == NULL)
+        return -1;
+
+    // HEADERS
+	add_http_header(request, "Accept: application/json");
+	add_http_header(request, "Content-Type: application/json");
+	add_http_header(request, "charset: utf-8");
+
+    // DATA, POST
+    memset(json, 0, sizeof(json));
+    make_login_json(json, j->phone, j->password);
+	set_http_body(request, json);
+
+	if (!perform_http_request(&g_http_client, request, &status, &response)) {
+		glog_error("login request failed, status=%ld\n", status);
+		g_free(response);
+		return -1;
+	}
+	printf("status %ld response : %s \n", status, response ? response : "");
+	login_parser(response ? response : "", j);
+
+	g_free(response);
     printf("%s - \n", __func__);
     return 0;
 }
@@ -217,114 +181,231 @@ static int make_notification_url(char *url, CurlIinfoType *j)
 }
 
 
-size_t write_return_data(void *buffer, size_t size, size_t nmemb, void *userp)
+// Http client thread : the outbox keeps the event until the server took it
+static void on_notification_done(HttpRequest *request, gpointer user_data)
 {
-   FILE *fp = fopen("event_result.html", "w+t");
-   fwrite(buffer,  size,  nmemb, fp);
-   fclose(fp);
-   return size * nmemb;
+	NotificationSend *send = (NotificationSend *)user_data;
+	gboolean delivered = FALSE;
+
+	if (request->result == CURLE_OK && request->status >= 200 && request->status < 300) {
+		glog_trace("notification sent in %" G_GINT64_FORMAT "ms, new connections=%ld\n", request->elapsed / 1000, request->new_connects);
+		delivered = TRUE;
+	}
+	else if (request->result == CURLE_OK && request->status == 401) {
+		glog_error("notification refused, token expired\n");
+		g_atomic_int_set(&g_token_rejected, 1);
+	}
+	else if (request->result == CURLE_OK && request->status >= 400 && request->status < 500 && request->status != 408 && request->status != 429) {
+		glog_error("notification given up, status=%ld, %s\n", request->status, request->response ? request->response : "");
+		delivered = TRUE;							//the same form would be refused again
+	}
+	else {
+		glog_error("notification failed, status=%ld, %s, %s\n", request->status, curl_easy_strerror(request->result),
+				   request->response ? request->response : "");
+	}
+
+	if (send->slot >= 0) {
+		ack_outbox_event(&g_outbox, send->slot, send->event.event_id, delivered, g_get_monotonic_time());
+		glog_trace("outbox depth=%d oldest=%ds\n", get_outbox_depth(&g_outbox), get_outbox_oldest_age(&g_outbox, g_get_real_time()));
+	}
+	g_free(send);
+
+	g_mutex_lock(&g_outbox_lock);
+	g_outbox_sending = FALSE;
+	g_cond_signal(&g_outbox_cond);
+	g_mutex_unlock(&g_outbox_lock);
 }
 
 
-void set_snapshot_path(CurlIinfoType *j)
+static void get_snapshot_path(CurlIinfoType *j, const char *video_url, char *path, int len)
 {
 //LJH, j->snapshot_path was set by config
-	if (strstr(j->video_url, "CAM0"))
-		strcat(j->snapshot_path, "/cam0_snapshot.jpg");
-	else if (strstr(j->video_url, "CAM1"))
-		strcat(j->snapshot_path, "/cam1_snapshot.jpg");
+	if (strstr(video_url, "CAM0"))
+		snprintf(path, len, "%s/cam0_snapshot.jpg", j->snapshot_path);
+	else if (strstr(video_url, "CAM1"))
+		snprintf(path, len, "%s/cam1_snapshot.jpg", j->snapshot_path);
+	else
+		path[0] = 0;
 }
 
-int notification_request(char *cam, char *evt, CurlIinfoType *j)
+
+// slot : outbox slot of the event, -1 when it is sent without outbox, its thumbnail is then given in memory.
+// The event goes back to the sender thread through on_notification_done()
+static gboolean send_outbox_event(const OutboxRecord *record, int slot, CurlIinfoType *j,
+								  const unsigned char *thumbnail, int thumbnail_size)
 {
-    CURL *curl;
-    CURLcode res;
+    HttpRequest *request;
+    NotificationSend *send;
+    OutboxRecord *event;
     char url[256];
     char hdr[256];
 
-    curl_mime *form = NULL;
-    curl_mimepart *field = NULL;
-    struct curl_slist *headerlist = NULL;
+	send = g_new(NotificationSend, 1);
+	send->slot = slot;
+	send->event = *record;
+	event = &send->event;
+
+	memset(url, 0, sizeof(url));
+	make_notification_url(url, j);
+	request = new_http_request(url, on_notification_done, send);
+	if (request == NULL) {
+		glog_error("Failed to initialize curl.\n");
+		g_free(send);
+		return FALSE;
+	}
 
-    // 로그인 요청 처리 (토큰이 비어 있으면 로그인)
-    if (j->token[0] == 0)
-        login_request(j);
+	add_http_form_data(request, "camera", event->cam_id);
+	add_http_form_data(request, "notificationCategory", event->evt);
+	//"image" is the object thumbnail, or the full snapshot when there is no thumbnail or it was asked for
+	if (event->snapshot[0])
+		add_http_form_file(request, "image", event->snapshot);
+	if (event->thumbnail[0])
+		add_http_form_file(request, event->snapshot[0] ? "thumbnail" : "image", event->thumbnail);
+	else if (thumbnail && thumbnail_size > 0)
+		add_http_form_buffer(request, event->snapshot[0] ? "thumbnail" : "image", thumbnail, thumbnail_size, "thumbnail.jpg", "image/jpeg");
+	add_http_form_data(request, "video_url", event->video_url);
+	if (event->position[0] != 0)
+		add_http_form_data(request, "position", event->position);
+	glog_trace("evt=%s video_url=%s snapshot=%s thumbnail=%s position=%s\n", event->evt, event->video_url, event->snapshot, event->thumbnail, event->position);
+
+	// Set headers
+	memset(hdr, 0, sizeof(hdr));
+	sprintf(hdr, "Authorization: Token %s", j->token);
+	add_http_header(request, hdr);
+
+	if (!submit_http_request(&g_http_client, request)) {		//the request is freed, not its user data
+		g_free(send);
+		return FALSE;
+	}
 
-    printf("%s cam %s evt %s %s + \n", __func__, cam, evt, j->token);
+	return TRUE;
+}
 
-	curl_global_init(CURL_GLOBAL_ALL);
-	curl = curl_easy_init();
-	if(curl) {
-		form = curl_mime_init(curl);
-	
-		field = curl_mime_addpart(form);
-		if (!field) { glog_error("Failed to add camera part.\n"); goto cleanup; }
-		curl_mime_name(field, "camera");
-		curl_mime_data(field, cam, CURL_ZERO_TERMINATED);
-	
-		field = curl_mime_addpart(form);
-		if (!field) { glog_error("Failed to add notificationCategory part.\n"); goto cleanup; }
-		curl_mime_name(field, "notificationCategory");
-		curl_mime_data(field, evt, CURL_ZERO_TERMINATED);
-		glog_trace("evt=%s\n", evt);
-	
-		set_snapshot_path(j);
-	
-		field = curl_mime_addpart(form);
-		if (!field) { glog_error("Failed to add image part.\n"); goto cleanup; }
-		curl_mime_name(field, "image");
-		curl_mime_filedata(field, j->snapshot_path);
-	
-		field = curl_mime_addpart(form);
-		if (!field) { glog_error("Failed to add video_url part.\n"); goto cleanup; }
-		curl_mime_name(field, "video_url");
-		curl_mime_data(field, j->video_url, strlen(j->video_url));
-		glog_trace("video_url=%s(len=%d), snapshot_path=%s(len=%d)\n",
-				   j->video_url, strlen(j->video_url), j->snapshot_path, strlen(j->snapshot_path));
-	
-		if (j->position[0] != 0) {
-			field = curl_mime_addpart(form);
-			if (!field) { glog_error("Failed to add position part.\n"); goto cleanup; }
-			curl_mime_name(field, "position");
-			curl_mime_data(field, j->position, CURL_ZERO_TERMINATED);
-			glog_trace("position=%s\n", j->position);
-		}
-	
-		// Set headers
-		memset(hdr, 0, sizeof(hdr));
-		sprintf(hdr, "Authorization: Token %s", j->token);
-		headerlist = curl_slist_append(headerlist, hdr);
-	
-		// Set URL and options	
-		memset(url, 0, sizeof(url));
-		make_notification_url(url, j);
-		curl_easy_setopt(curl, CURLOPT_URL, url);
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headerlist);
-		curl_easy_setopt(curl, CURLOPT_MIMEPOST, form);
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_return_data);
-	
-		curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
-		curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 5L);
-	
-		res = curl_easy_perform(curl);
-		if (res != CURLE_OK)
-			glog_error("curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-		usleep(100);
-
-		if (j->position[0] != 0) {
-			memset(j->position, 0, sizeof(j->position));
+
+// Sender thread : one notification in flight at a time, oldest first, the outbox decides when to retry
+static void *run_outbox_sender(void *arg)
+{
+	CurlIinfoType *j = (CurlIinfoType *)arg;
+	OutboxRecord event;
+	int slot;
+
+	g_mutex_lock(&g_outbox_lock);
+	while (g_atomic_int_get(&g_outbox_running)) {
+		if (!g_outbox_sending && (slot = get_outbox_ready(&g_outbox, g_get_monotonic_time(), &event)) >= 0) {
+			g_outbox_sending = TRUE;
+			g_mutex_unlock(&g_outbox_lock);
+
+			// 로그인 요청 처리 (토큰이 비어 있거나 거절되면 로그인)
+			if (j->token[0] == 0 || g_atomic_int_get(&g_token_rejected)) {
+				g_atomic_int_set(&g_token_rejected, 0);
+				login_request(j);
+			}
+			if (!send_outbox_event(&event, slot, j, NULL, 0)) {
+				ack_outbox_event(&g_outbox, slot, event.event_id, FALSE, g_get_monotonic_time());
+				g_mutex_lock(&g_outbox_lock);
+				g_outbox_sending = FALSE;
+				continue;
+			}
+			g_mutex_lock(&g_outbox_lock);
+			continue;
 		}
-		memset(j->video_url, 0, sizeof(j->video_url));
+		g_cond_wait_until(&g_outbox_cond, &g_outbox_lock, g_get_monotonic_time() + OUTBOX_POLL_MS * 1000);
+	}
+	g_mutex_unlock(&g_outbox_lock);
+
+	return 0;
+}
+
+
+// Events go to the outbox first, the sender thread delivers them. Returns as soon as the event is on disk.
+// thumbnail : JPEG of the object, kept with the event. The full snapshot only goes along with j->full_snapshot
+// or when there is no thumbnail
+int notification_request(char *cam, char *evt, CurlIinfoType *j, const unsigned char *thumbnail, int thumbnail_size)
+{
+	OutboxRecord event;
+	char snapshot[512];
+
+    printf("%s cam %s evt %s %s + \n", __func__, cam, evt, j->token);
 
-	cleanup:
-		curl_mime_free(form);
-		if (headerlist) curl_slist_free_all(headerlist);
-		curl_easy_cleanup(curl);
+	memset(&event, 0, sizeof(event));
+	g_strlcpy(event.cam_id, cam, sizeof(event.cam_id));
+	g_strlcpy(event.evt, evt, sizeof(event.evt));
+	g_strlcpy(event.video_url, j->video_url, sizeof(event.video_url));
+	g_strlcpy(event.position, j->position, sizeof(event.position));
+	event.created = g_get_real_time();
+	event.event_id = get_outbox_event_id(j->video_url[0] ? j->video_url : "", evt);
+	if (j->video_url[0] == 0)
+		event.event_id ^= (guint64)event.created;		//no recording to tell two events apart
+	if (thumbnail == NULL)
+		thumbnail_size = 0;
+	snapshot[0] = 0;
+	if (j->full_snapshot || thumbnail_size <= 0)
+		get_snapshot_path(j, j->video_url, snapshot, sizeof(snapshot));
+
+	if (j->position[0] != 0) {
+		memset(j->position, 0, sizeof(j->position));
 	}
-	else {
-		glog_error("Failed to initialize curl.\n");
-        return -1;
-    }
+	memset(j->video_url, 0, sizeof(j->video_url));
+
+	if (!g_atomic_int_get(&g_outbox_running)) {
+		// no outbox, sent once and lost on failure
+		g_strlcpy(event.snapshot, snapshot, sizeof(event.snapshot));
+		if (j->token[0] == 0)
+			login_request(j);
+		return send_outbox_event(&event, -1, j, thumbnail, thumbnail_size) ? 0 : -1;
+	}
+	if (!add_outbox_event(&g_outbox, &event, snapshot, thumbnail, thumbnail_size))
+		return 0;									//already queued
+
+	g_mutex_lock(&g_outbox_lock);
+	g_cond_signal(&g_outbox_cond);
+	g_mutex_unlock(&g_outbox_lock);
 
     return 0;
 }
+
+
+// After load_config(), the events left by the last run are sent first
+gboolean start_notification_outbox(const char *dir, CurlIinfoType *j)
+{
+	if (dir == NULL || !open_outbox(&g_outbox, dir))
+		return FALSE;
+
+	g_outbox_running = 1;
+	if (pthread_create(&g_outbox_tid, NULL, run_outbox_sender, j) != 0) {
+		glog_error("can not start the outbox sender\n");
+		g_outbox_running = 0;
+		close_outbox(&g_outbox);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+void get_notification_backlog(int *depth, int *oldest_age)
+{
+	*depth = get_outbox_depth(&g_outbox);
+	*oldest_age = get_outbox_oldest_age(&g_outbox, g_get_real_time());
+}
+
+
+gboolean init_curl_client()
+{
+	return init_http_client(&g_http_client);
+}
+
+
+// The sender stops first, the notification in flight is acked into the outbox before it is closed
+void free_curl_client()
+{
+	if (g_atomic_int_get(&g_outbox_running)) {
+		g_mutex_lock(&g_outbox_lock);
+		g_atomic_int_set(&g_outbox_running, 0);
+		g_cond_signal(&g_outbox_cond);
+		g_mutex_unlock(&g_outbox_lock);
+		pthread_join(g_outbox_tid, NULL);
+	}
+	free_http_client(&g_http_client);
+	close_outbox(&g_outbox);
+}
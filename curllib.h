@@ -1,6 +1,8 @@
 #ifndef __CURLLIB_H__
 #define __CURLLIB_H__
 
+#include "http_client.h"
+#include "outbox.h"
 
 #ifdef __cplusplus
 extern "C"  //C++
@@ -19,12 +21,19 @@ typedef struct
     char position[30];                  //LJH, 1129
     char server_ip[32];
     int  port;
+    int  full_snapshot;                 //whole frame snapshot sent along the object thumbnail, "notify_full_snapshot" in config.json
 } CurlIinfoType;
 
 int login_request(CurlIinfoType *j);
 int camera_request(CurlIinfoType *j);
 int camera_mac_request(CurlIinfoType *j);
-int notification_request(char *cam, char *evt, CurlIinfoType *j);
+int notification_request(char *cam, char *evt, CurlIinfoType *j, const unsigned char *thumbnail, int thumbnail_size);
+gboolean init_curl_client();
+void free_curl_client();
+gboolean start_notification_outbox(const char *dir, CurlIinfoType *j);
+void get_notification_backlog(int *depth, int *oldest_age);
+
+extern HttpClient g_http_client;
 
 #ifdef __cplusplus
 }
@@ -30,6 +30,8 @@ int main (int argc, char *argv[])
 {
     CurlIinfoType j;
 
+    init_curl_client();
+
     strcpy(j.phone, "01027061463");
     strcpy(j.password, "12341234");
     strcpy(j.server_ip, "52.194.238.184");
@@ -43,7 +45,8 @@ int main (int argc, char *argv[])
 
     strcpy(j.token, "b840c40720168192336a0df4fb1d710cf07d67cd");
     if(login_request(&j) == 0){
-        notification_request("ITC100A-23081012","1", &j);
+        notification_request("ITC100A-23081012","1", &j, NULL, 0);
     }
+    free_curl_client();
 
 }
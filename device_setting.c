@@ -1,6 +1,7 @@
 /* For json config */
 #include <json-glib/json-glib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include "device_setting.h"
 #include <stdio.h>
 #include "g_log.h"
@@ -59,30 +60,67 @@ gboolean load_ranch_setting(const char *file_name, RanchSetting* setting)
 }
 #endif
 
-void display_confid_duration()
+static struct timespec g_setting_mtime;       //device setting file as last loaded or written, see reload_analysis_setting()
+
+static void get_setting_mtime(const char *file_name, struct timespec *mtime)
 {
-  for (int i = CLASS_NORMAL_COW; i < NUM_CLASSES; i++) {
-    switch(i) {
-      case CLASS_NORMAL_COW:
-          glog_trace("CLASS_NORMAL_COW");
-          break;
-      case CLASS_HEAT_COW:
-          glog_trace("CLASS_HEAT_COW");
-          break;
-      case CLASS_FLIP_COW:
-          glog_trace("CLASS_FLIP_COW");
-          break;
-      case CLASS_LABOR_SIGN_COW:
-          glog_trace("CLASS_LABOR_SIGN_COW");
-          break;
-      case CLASS_NORMAL_COW_SITTING:
-          glog_trace("CLASS_NORMAL_COW_SITTING");
-          break;
-    }
-    glog_plain(" threshold:%.2f, duration:%d\n", threshold_confidence[i], threshold_event_duration[i]);
+  struct stat st;
+
+  if (stat(file_name, &st) == 0)
+    *mtime = st.st_mtim;
+  else
+    memset(mtime, 0, sizeof(*mtime));
+}
+
+
+// Legacy time key longer than the rule history : refused, the class keeps the duration of the rules loaded
+// before (the built-in one on the first load). The key itself is left as the user set it, it is not saved back
+static void set_legacy_event_rule(EventRuleTable *rules, const EventRuleTable *previous, int class_id, int confidence, int time)
+{
+  if (set_class_event_rule(rules, class_id, confidence, time))
+    return;
+
+  int rule_idx = (class_id == CLASS_OVER_TEMP) ? previous->temp_rule : previous->class_rule[class_id];
+  int duration = (previous->num_rules > 0 && rule_idx != EVENT_RULE_NONE) ? previous->rules[rule_idx].duration : 0;
+  if (!set_class_event_rule(rules, class_id, confidence, duration))
+    set_class_event_rule(rules, class_id, confidence, 0);
+
+  rule_idx = (class_id == CLASS_OVER_TEMP) ? rules->temp_rule : rules->class_rule[class_id];
+  glog_error("class %d event time %d seconds refused, the rule runs %d seconds\n", class_id, time,
+    rule_idx != EVENT_RULE_NONE ? rules->rules[rule_idx].duration : 0);
+}
+
+
+// Event rules of the setting : the legacy threshold and time keys tune the built-in rules,
+// "event_rules" replaces them all. A wrong "event_rules" keeps the legacy rules
+static void load_event_rules(JsonObject *object, DeviceSetting *setting)
+{
+  EventRuleTable *rules = &setting->event_rules;
+  EventRuleTable *previous = g_new(EventRuleTable, 1);     //num_rules 0 before the first load
+
+  *previous = *rules;
+  init_event_rules(rules);
+  set_class_event_rule(rules, CLASS_NORMAL_COW, setting->normal_threshold, 0);
+  set_legacy_event_rule(rules, previous, CLASS_HEAT_COW, setting->heat_threshold, setting->heat_time);
+  set_legacy_event_rule(rules, previous, CLASS_FLIP_COW, setting->flip_threshold, setting->flip_time);
+  set_legacy_event_rule(rules, previous, CLASS_LABOR_SIGN_COW, setting->labor_sign_threshold, setting->labor_sign_time);
+  set_class_event_rule(rules, CLASS_NORMAL_COW_SITTING, setting->normal_sitting_threshold, 0);
+  set_legacy_event_rule(rules, previous, CLASS_OVER_TEMP, 0, setting->over_temp_time);
+  g_free(previous);
+
+  setting->has_event_rules = 0;
+  if (json_object_has_member(object, "event_rules")) {
+    if (parse_event_rules(json_object_get_array_member(object, "event_rules"), rules))
+      setting->has_event_rules = 1;
+    else
+      glog_error("wrong event_rules, legacy rules are used\n");
   }
+
+  log_event_rules(rules);
+  set_event_rules(rules);
 }
 
+
 gboolean load_device_setting(const char *file_name, DeviceSetting* setting)
 {
    JsonParser *parser;
@@ -213,6 +251,38 @@ gboolean load_device_setting(const char *file_name, DeviceSetting* setting)
       setting->nv_interval = 0;
   } 
 
+  if (json_object_has_member (object, "nv_interval_max")) {
+      int value = json_object_get_int_member (object, "nv_interval_max");
+      glog_trace("parse member %s : %d\n", "nv_interval_max", value);  
+      setting->nv_interval_max = value;
+  } else {
+      setting->nv_interval_max = setting->nv_interval;      //fixed interval
+  } 
+
+  if (json_object_has_member (object, "nv_interval_hold")) {
+      int value = json_object_get_int_member (object, "nv_interval_hold");
+      glog_trace("parse member %s : %d\n", "nv_interval_hold", value);  
+      setting->nv_interval_hold = value;
+  } else {
+      setting->nv_interval_hold = INFER_INTERVAL_HOLD_DEFAULT;
+  } 
+
+  if (json_object_has_member (object, "nv_motion_threshold")) {
+      int value = json_object_get_int_member (object, "nv_motion_threshold");
+      glog_trace("parse member %s : %d\n", "nv_motion_threshold", value);  
+      setting->nv_motion_threshold = value;
+  } else {
+      setting->nv_motion_threshold = INFER_MOTION_THRESHOLD_DEFAULT;
+  } 
+
+  if (json_object_has_member (object, "preset_memory_time")) {
+      int value = json_object_get_int_member (object, "preset_memory_time");
+      glog_trace("parse member %s : %d\n", "preset_memory_time", value);  
+      setting->preset_memory_time = value;
+  } else {
+      setting->preset_memory_time = PRESET_MEMORY_TIME_DEFAULT;
+  } 
+
   if (json_object_has_member (object, "opt_flow_threshold")) {
       int value = json_object_get_int_member (object, "opt_flow_threshold");
       glog_trace("parse member %s : %d\n", "opt_flow_threshold", value);  
@@ -225,7 +295,6 @@ gboolean load_device_setting(const char *file_name, DeviceSetting* setting)
       int value = json_object_get_int_member (object, "heat_threshold");
       glog_trace("parse member %s : %d\n", "heat_threshold", value);  
       setting->heat_threshold = value;
-      threshold_confidence[CLASS_HEAT_COW] = (float)value/(float)100.0;
   } else {
     setting->heat_threshold = 0;
   } 
@@ -234,7 +303,6 @@ gboolean load_device_setting(const char *file_name, DeviceSetting* setting)
       int value = json_object_get_int_member (object, "flip_threshold");
       glog_trace("parse member %s : %d\n", "flip_threshold", value);  
       setting->flip_threshold = value;
-      threshold_confidence[CLASS_FLIP_COW] = (float)value/(float)100.0;
   } else {
     setting->flip_threshold = 0;
   } 
@@ -244,7 +312,6 @@ gboolean load_device_setting(const char *file_name, DeviceSetting* setting)
     int value = json_object_get_int_member (object, "normal_threshold");
     glog_trace("parse member %s : %d\n", "normal_threshold", value);  
     setting->normal_threshold = value;
-    threshold_confidence[CLASS_NORMAL_COW] = (float)value/(float)100.0;
   } else {
     setting->normal_threshold = 0;
   } 
@@ -253,7 +320,6 @@ gboolean load_device_setting(const char *file_name, DeviceSetting* setting)
     int value = json_object_get_int_member (object, "labor_sign_threshold");
     glog_trace("parse member %s : %d\n", "labor_sign_threshold", value);  
     setting->labor_sign_threshold = value;
-    threshold_confidence[CLASS_LABOR_SIGN_COW] = (float)value/(float)100.0;
   } else {
     setting->labor_sign_threshold = 0;
   } 
@@ -262,7 +328,6 @@ gboolean load_device_setting(const char *file_name, DeviceSetting* setting)
     int value = json_object_get_int_member (object, "normal_sitting_threshold");
     glog_trace("parse member %s : %d\n", "normal_sitting_threshold", value);  
     setting->normal_sitting_threshold = value;
-    threshold_confidence[CLASS_NORMAL_COW_SITTING] = (float)value/(float)100.0;
   } else {
     setting->normal_sitting_threshold = 0;
   } 
@@ -317,11 +382,10 @@ gboolean load_device_setting(const char *file_name, DeviceSetting* setting)
     int value = json_object_get_int_member (object, "heat_time");
     glog_trace("parse member %s : %d\n", "heat_time", value);  
     setting->heat_time = value;
-    threshold_event_duration[CLASS_HEAT_COW] = value;
-    glog_trace("threshold_event_duration[%d] : %d\n", CLASS_HEAT_COW, value);  
+    glog_trace("heat_time: %d\n", value);  
   } else {
     setting->heat_time = 15;
-    glog_trace("threshold_event_duration[%d] : %d\n", CLASS_HEAT_COW, setting->heat_time);  
+    glog_trace("heat_time: %d\n", setting->heat_time);  
   } 
 
   if (json_object_has_member (object, "temp_diff_threshold")) {
@@ -393,11 +457,10 @@ gboolean load_device_setting(const char *file_name, DeviceSetting* setting)
     int value = json_object_get_int_member (object, "flip_time");
     glog_trace("parse member %s : %d\n", "flip_time", value);  
     setting->flip_time = value;
-    threshold_event_duration[CLASS_FLIP_COW] = value;
-    glog_trace("threshold_event_duration[%d] : %d\n", CLASS_FLIP_COW, value);  
+    glog_trace("flip_time: %d\n", value);  
   } else {
     setting->flip_time = 15;
-    glog_trace("threshold_event_duration[%d] : %d\n", CLASS_FLIP_COW, setting->flip_time);  
+    glog_trace("flip_time: %d\n", setting->flip_time);  
   } 
 
 
@@ -405,11 +468,10 @@ gboolean load_device_setting(const char *file_name, DeviceSetting* setting)
     int value = json_object_get_int_member (object, "labor_sign_time");
     glog_trace("parse member %s : %d\n", "labor_sign_time", value);  
     setting->labor_sign_time = value;
-    threshold_event_duration[CLASS_LABOR_SIGN_COW] = value;
-    glog_trace("threshold_event_duration[%d] : %d\n", CLASS_LABOR_SIGN_COW, value);  
+    glog_trace("labor_sign_time: %d\n", value);  
   } else {
     setting->labor_sign_time = 15;
-    glog_trace("threshold_event_duration[%d] : %d\n", CLASS_LABOR_SIGN_COW, setting->labor_sign_time);  
+    glog_trace("labor_sign_time: %d\n", setting->labor_sign_time);  
   } 
 
 
@@ -424,10 +486,11 @@ gboolean load_device_setting(const char *file_name, DeviceSetting* setting)
   } 
 
 
+  load_event_rules(object, setting);
+
   g_object_unref (reader);
   g_object_unref(parser);
-
-  display_confid_duration();
+  get_setting_mtime(file_name, &g_setting_mtime);
 
   return TRUE;
 }
@@ -456,6 +519,10 @@ static gchar device_setting_template_string_json[] = "{\n\
 \"enable_event_notify\": %d,\n\
 \"camera_dn_mode\": %d,\n\
 \"nv_interval\": %d,\n\
+\"nv_interval_max\": %d,\n\
+\"nv_interval_hold\": %d,\n\
+\"nv_motion_threshold\": %d,\n\
+\"preset_memory_time\": %d,\n\
 \"opt_flow_threshold\": %d,\n\
 \"opt_flow_apply\": %d,\n\
 \"resnet50_threshold\": %d,\n\
@@ -476,7 +543,7 @@ static gchar device_setting_template_string_json[] = "{\n\
 \"threshold_upper_temp\": %d,\n\
 \"threshold_under_temp\": %d,\n\
 \"temp_apply\": %d,\n\
-\"show_normal_text\": %d\n\
+\"show_normal_text\": %d%s\n\
 }";
 
 
@@ -512,10 +579,16 @@ gboolean update_setting(const char *file_name, DeviceSetting* setting)
       strcat(auto_ptz_code,"\"\n");
   }
     
-  //2. update config
+  //2. event rules, only when the setting had its own
+  gchar *rules = setting->has_event_rules ? format_event_rules(&setting->event_rules) : NULL;
+  gchar *rules_code = rules ? g_strdup_printf(",\n\"event_rules\": %s", rules) : g_strdup("");
+  g_free(rules);
+
+  //3. update config
   FILE *fp = fopen(file_name, "w+t, ccs=UTF-8");
   if(fp == NULL){
     glog_trace("fail open device setting  %s \n", file_name);  
+    g_free(rules_code);
     return FALSE;
   }
 
@@ -531,6 +604,10 @@ gboolean update_setting(const char *file_name, DeviceSetting* setting)
     setting->enable_event_notify, 
     setting->camera_dn_mode, 
     setting->nv_interval, 
+    setting->nv_interval_max, 
+    setting->nv_interval_hold, 
+    setting->nv_motion_threshold, 
+    setting->preset_memory_time, 
     setting->opt_flow_threshold, 
     setting->opt_flow_apply,
     setting->resnet50_threshold, 
@@ -551,15 +628,87 @@ gboolean update_setting(const char *file_name, DeviceSetting* setting)
     setting->threshold_upper_temp,
     setting->threshold_under_temp,
     setting->temp_apply,
-    setting->show_normal_text
+    setting->show_normal_text,
+    rules_code
   );
 
   fclose(fp);
+  g_free(rules_code);
+  get_setting_mtime(file_name, &g_setting_mtime);
 
   return TRUE; 
 }
 
 
+// Analysis keys picked up by reload_analysis_setting(), the others need a restart or come from the control messages
+static const struct {
+  const char *name;
+  glong offset;
+} analysis_keys[] = {
+  {"nv_interval", G_STRUCT_OFFSET(DeviceSetting, nv_interval)},
+  {"nv_interval_max", G_STRUCT_OFFSET(DeviceSetting, nv_interval_max)},
+  {"nv_interval_hold", G_STRUCT_OFFSET(DeviceSetting, nv_interval_hold)},
+  {"nv_motion_threshold", G_STRUCT_OFFSET(DeviceSetting, nv_motion_threshold)},
+  {"preset_memory_time", G_STRUCT_OFFSET(DeviceSetting, preset_memory_time)},
+  {"normal_threshold", G_STRUCT_OFFSET(DeviceSetting, normal_threshold)},
+  {"heat_threshold", G_STRUCT_OFFSET(DeviceSetting, heat_threshold)},
+  {"flip_threshold", G_STRUCT_OFFSET(DeviceSetting, flip_threshold)},
+  {"labor_sign_threshold", G_STRUCT_OFFSET(DeviceSetting, labor_sign_threshold)},
+  {"normal_sitting_threshold", G_STRUCT_OFFSET(DeviceSetting, normal_sitting_threshold)},
+  {"heat_time", G_STRUCT_OFFSET(DeviceSetting, heat_time)},
+  {"flip_time", G_STRUCT_OFFSET(DeviceSetting, flip_time)},
+  {"labor_sign_time", G_STRUCT_OFFSET(DeviceSetting, labor_sign_time)},
+  {"over_temp_time", G_STRUCT_OFFSET(DeviceSetting, over_temp_time)},
+  {"opt_flow_threshold", G_STRUCT_OFFSET(DeviceSetting, opt_flow_threshold)},
+  {"temp_diff_threshold", G_STRUCT_OFFSET(DeviceSetting, temp_diff_threshold)},
+  {"temp_correction", G_STRUCT_OFFSET(DeviceSetting, temp_correction)},
+  {"threshold_upper_temp", G_STRUCT_OFFSET(DeviceSetting, threshold_upper_temp)},
+  {"threshold_under_temp", G_STRUCT_OFFSET(DeviceSetting, threshold_under_temp)},
+};
+
+
+// Reload the thresholds and the event rules when the file changed on disk, the analytics pick them up
+// with their next record. Called every second from the main loop, costs one stat() when nothing changed
+gboolean reload_analysis_setting(const char *file_name, DeviceSetting* setting)
+{
+  struct timespec mtime;
+  JsonParser *parser;
+  GError *error = NULL;
+  JsonNode *root;
+  JsonObject *object;
+
+  get_setting_mtime(file_name, &mtime);
+  if (mtime.tv_sec == g_setting_mtime.tv_sec && mtime.tv_nsec == g_setting_mtime.tv_nsec)
+    return FALSE;
+  g_setting_mtime = mtime;
+
+  parser = json_parser_new();
+  json_parser_load_from_file(parser, file_name, &error);
+  if (error) {
+    glog_error("Unable to parse file '%s': %s\n", file_name, error->message);      //half written, tried again on the next change
+    g_error_free(error);
+    g_object_unref(parser);
+    return FALSE;
+  }
+  root = json_parser_get_root(parser);
+  if (!JSON_NODE_HOLDS_OBJECT(root)) {
+    g_object_unref(parser);
+    return FALSE;
+  }
+
+  object = json_node_get_object(root);
+  for (guint i = 0; i < G_N_ELEMENTS(analysis_keys); i++) {
+    if (json_object_has_member(object, analysis_keys[i].name))
+      G_STRUCT_MEMBER(int, setting, analysis_keys[i].offset) = json_object_get_int_member(object, analysis_keys[i].name);
+  }
+  glog_trace("reload %s\n", file_name);
+  load_event_rules(object, setting);
+  g_object_unref(parser);
+
+  return TRUE;
+}
+
+
 #ifdef TEST_SETTING
 int main(int argc, char *argv[])
 {
@@ -3,6 +3,8 @@
 
 #include "ptz_control.h"
 #include "g_log.h"
+#include "event_rule.h"
+#include "infer_interval.h"
 
 typedef struct 
 {
@@ -23,6 +25,10 @@ typedef struct
   int camera_dn_mode; // 0 => auto, 1 => manual day, 2 => manual night mode
 
   int nv_interval;
+  int nv_interval_max;            // interval on a static scene, nv_interval while objects move (infer_interval.h)
+  int nv_interval_hold;           // quiet seconds before each stretch of the interval
+  int nv_motion_threshold;        // pixels of bbox center motion per second that count as activity
+  int preset_memory_time;         // sec a PTZ preset keeps its objects' event state for the next visit, 0 never
   int opt_flow_threshold;
   int display_temp;
   int temp_diff_threshold;
@@ -45,10 +51,13 @@ typedef struct
   int over_temp_time;
   int temp_correction;
   int show_normal_text;
+  EventRuleTable event_rules;     // legacy keys above or "event_rules", published with set_event_rules()
+  int has_event_rules;            // "event_rules" was in the file, written back by update_setting()
 } DeviceSetting;
 
 gboolean load_device_setting(const char *file_name, DeviceSetting* setting);
 gboolean update_setting(const char *file_name, DeviceSetting* setting);
+gboolean reload_analysis_setting(const char *file_name, DeviceSetting* setting);
 
 #if MINDULE_INCLUDE
 typedef struct 
@@ -59,9 +68,6 @@ typedef struct
 gboolean update_ranch_setting(const char *fname, RanchSetting* setting);
 #endif
 
-extern float threshold_confidence[];
-extern int threshold_event_duration[];
-
 #define RESNET50_THRESHOLD_DEFAULT        6
 
 #endif
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <string.h>
+#include "g_log.h"
+#include "event_queue.h"
+
+
+gboolean init_event_queue(EventQueue *queue, int depth)
+{
+  guint size = 1;
+
+  if (depth < 2)
+    depth = 2;
+  if (depth > EVENT_QUEUE_MAX_DEPTH)
+    depth = EVENT_QUEUE_MAX_DEPTH;
+  while (size < (guint)depth)
+    size <<= 1;
+
+  memset(queue, 0, sizeof(*queue));
+  queue->cells = g_new0(EventQueueCell, size);
+  queue->mask = size - 1;
+  for (guint i = 0; i < size; i++)
+    queue->cells[i].sequence = (gint)i;
+  if (sem_init(&queue->ready, 0, 0) != 0) {
+    glog_error("sem_init failed\n");
+    g_clear_pointer(&queue->cells, g_free);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+void free_event_queue(EventQueue *queue)
+{
+  if (queue->cells == NULL)
+    return;
+  sem_destroy(&queue->ready);
+  g_clear_pointer(&queue->cells, g_free);
+}
+
+
+// Producer : copy the event into the queue and wake the consumer. FALSE when the queue is full, never waits
+gboolean push_event_queue(EventQueue *queue, const NotifyEvent *event)
+{
+  EventQueueCell *cell;
+  guint pos;
+
+  if (queue->cells == NULL)
+    return FALSE;
+
+  pos = (guint)g_atomic_int_get(&queue->head);
+  for (;;) {
+    cell = &queue->cells[pos & queue->mask];
+    gint diff = (gint)((guint)g_atomic_int_get(&cell->sequence) - pos);
+    if (diff == 0) {
+      if (g_atomic_int_compare_and_exchange(&queue->head, (gint)pos, (gint)(pos + 1)))
+        break;                                            //cell is ours
+      pos = (guint)g_atomic_int_get(&queue->head);
+    }
+    else if (diff < 0) {                                  //the consumer has not read the cell of the last lap
+      g_atomic_int_inc(&queue->dropped);
+      return FALSE;
+    }
+    else {                                                //another producer took pos
+      pos = (guint)g_atomic_int_get(&queue->head);
+    }
+  }
+
+  cell->event = *event;
+  cell->event.time = g_get_monotonic_time();
+  g_atomic_int_set(&cell->sequence, (gint)(pos + 1));    //event is visible before the sequence
+  g_atomic_int_inc(&queue->pushed);
+
+  gint fill = (gint)(pos + 1 - (guint)g_atomic_int_get(&queue->tail));
+  gint high_water = g_atomic_int_get(&queue->high_water);
+  while (fill > high_water && !g_atomic_int_compare_and_exchange(&queue->high_water, high_water, fill))
+    high_water = g_atomic_int_get(&queue->high_water);
+  sem_post(&queue->ready);
+
+  return TRUE;
+}
+
+
+// Consumer : sleep until an event is pushed and take it. FALSE when woken by wake_event_queue() with nothing to read
+gboolean pop_event_queue(EventQueue *queue, NotifyEvent *event)
+{
+  guint pos = (guint)queue->tail;                         //only written by this thread
+  EventQueueCell *cell = &queue->cells[pos & queue->mask];
+
+  while (sem_wait(&queue->ready) != 0)
+    ;                                                     //EINTR
+  //producers post in the order they finish, the cell at tail may still be being written by an earlier one
+  while (g_atomic_int_get(&cell->sequence) != (gint)(pos + 1)) {
+    if (pos == (guint)g_atomic_int_get(&queue->head))
+      return FALSE;
+    g_thread_yield();
+  }
+
+  *event = cell->event;
+  g_atomic_int_set(&cell->sequence, (gint)(pos + queue->mask + 1));      //free for the next lap
+  g_atomic_int_set(&queue->tail, (gint)(pos + 1));
+  g_atomic_int_inc(&queue->popped);
+
+  gint64 latency = g_get_monotonic_time() - event->time;
+  queue->latency_total += latency;
+  if (latency > queue->latency_max)
+    queue->latency_max = latency;
+
+  return TRUE;
+}
+
+
+void wake_event_queue(EventQueue *queue)
+{
+  sem_post(&queue->ready);
+}
+
+
+#ifdef TEST_EVENT_QUEUE
+// Producers hammering a small queue : every event is either delivered in the order of its producer or counted as dropped
+#include "test_check.h"
+
+#define TEST_PRODUCERS      4
+#define TEST_EVENTS         100000
+
+static EventQueue test_queue;
+
+static void *produce(void *arg)
+{
+  NotifyEvent event = {GPOINTER_TO_INT(arg), 0, 0};
+
+  for (int i = 0; i < TEST_EVENTS; i++) {
+    event.obj = i;
+    push_event_queue(&test_queue, &event);
+  }
+
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  pthread_t tid[TEST_PRODUCERS];
+  int last[TEST_PRODUCERS];
+  int failed = 0, received = 0, out_of_order = 0;
+  NotifyEvent event;
+
+  failed += check(init_event_queue(&test_queue, 3) && test_queue.mask == 3, "depth rounded up to a power of two");
+  for (int i = 0; i < 4; i++) {
+    event.obj = i;
+    push_event_queue(&test_queue, &event);
+  }
+  failed += check(!push_event_queue(&test_queue, &event) && test_queue.dropped == 1, "push on a full queue dropped");
+  failed += check(pop_event_queue(&test_queue, &event) && event.obj == 0, "first in first out");
+  failed += check(push_event_queue(&test_queue, &event), "push after a pop");
+  free_event_queue(&test_queue);
+
+  init_event_queue(&test_queue, EVENT_QUEUE_MAX_DEPTH);
+  for (int i = 0; i < TEST_PRODUCERS; i++) {
+    last[i] = -1;
+    pthread_create(&tid[i], NULL, produce, GINT_TO_POINTER(i));
+  }
+  while (received + g_atomic_int_get(&test_queue.dropped) < TEST_PRODUCERS * TEST_EVENTS) {
+    if (!pop_event_queue(&test_queue, &event))
+      continue;
+    if ((int)event.obj <= last[event.cam_idx])
+      out_of_order++;
+    last[event.cam_idx] = (int)event.obj;
+    received++;
+  }
+  for (int i = 0; i < TEST_PRODUCERS; i++)
+    pthread_join(tid[i], NULL);
+
+  printf("received=%d dropped=%d high_water=%d latency avg=%" G_GINT64_FORMAT "us max=%" G_GINT64_FORMAT "us\n", received, test_queue.dropped,
+    test_queue.high_water, received ? test_queue.latency_total / received : 0, test_queue.latency_max);
+  failed += check(out_of_order == 0, "events of each producer in order");
+  failed += check(received == test_queue.popped && received == test_queue.pushed, "counters add up");
+  failed += check(test_queue.high_water <= EVENT_QUEUE_MAX_DEPTH, "high water within the depth");
+  wake_event_queue(&test_queue);
+  failed += check(!pop_event_queue(&test_queue, &event), "wake on an empty queue");
+  free_event_queue(&test_queue);
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+
+  return failed ? 1 : 0;
+}
+#endif
@@ -0,0 +1,49 @@
+#ifndef __EVENT_QUEUE_H__
+#define __EVENT_QUEUE_H__
+
+#include <glib.h>
+#include <semaphore.h>
+#include "obj_slot_map.h"
+
+#define EVENT_QUEUE_DEPTH         256             //events waiting for the notifier, each one may take a whole recording
+#define EVENT_QUEUE_MAX_DEPTH     4096
+
+// One event handed to the notifier
+typedef struct {
+  int cam_idx;
+  int class_id;             // event id of the rule, sent to the server
+  ObjHandle obj;            // object of the worker, OBJ_HANDLE_NONE for events without one (socket_comm)
+  gint64 time;              // g_get_monotonic_time() of the push, the notifier measures its latency from it
+  short x, y, width, height;          // bbox of the object when the event was raised
+  guint thumbnail_seq;      // crop requested from the probe, see take_thumbnail(), 0 for none
+} NotifyEvent;
+
+typedef struct {
+  gint sequence;            // position the cell is ready for : pos when free, pos + 1 when written
+  NotifyEvent event;
+} EventQueueCell;
+
+// Bounded multiple producer (analytics workers, socket_comm) / single consumer (notifier) queue.
+// Producers claim a cell with one CAS and never wait, a push that finds the queue full is dropped and counted.
+typedef struct {
+  EventQueueCell *cells;
+  guint mask;               // depth - 1, depth is a power of two
+  gint head;                // next cell to claim, advanced by the producers
+  gint tail;                // next cell to read, only advanced by the consumer
+  gint pushed;              // events queued
+  gint dropped;             // events lost because the queue was full
+  gint high_water;          // highest fill level seen by the producers
+  gint popped;              // events handed to the consumer
+  gint64 latency_total;     // usec between push and pop, summed over popped, consumer only
+  gint64 latency_max;       // consumer only
+  sem_t ready;              // one post per pushed event, the consumer sleeps on it
+} EventQueue;
+
+
+gboolean init_event_queue(EventQueue *queue, int depth);
+void free_event_queue(EventQueue *queue);
+gboolean push_event_queue(EventQueue *queue, const NotifyEvent *event);
+gboolean pop_event_queue(EventQueue *queue, NotifyEvent *event);
+void wake_event_queue(EventQueue *queue);
+
+#endif
@@ -10,6 +10,12 @@
 #include "event_recorder.h"
 #include "device_setting.h"
 #include "video_convert.h"
+#include "pre_event_ring.h"
+
+
+static EventRecorder *g_event_recorders = NULL;
+static int g_num_event_recorders = 0;
+static char g_event_codec[16];
 
 
 int get_udp_port(UDPClientProcess process, CameraDevice device, StreamChoice stream_choice, int stream_index)
@@ -29,32 +35,266 @@ int get_udp_port(UDPClientProcess process, CameraDevice device, StreamChoice str
 }
 
 
-void start_event_buf_process(int cam_idx)
+// RTP depayloader of the encoder tee output, the ring keeps whole access units
+static const char *get_depay_name(const char *codec)
+{
+	if (strstr(codec, "vp8"))
+		return "rtpvp8depay";
+	if (strstr(codec, "264"))
+		return "rtph264depay";
+	return "rtpvp9depay";
+}
+
+
+// Muxer of the clip file and its extension, the access units are written as they were encoded
+static const char *get_clip_muxer(const char *codec, const char **extension)
+{
+	if (strstr(codec, "264")) {
+		*extension = ".mkv";
+		return "h264parse ! matroskamux";
+	}
+	*extension = ".webm";
+	return "webmmux";
+}
+
+
+// Pipeline description of the pre-event ring branch of one camera, it takes the place of the udpsink
+// the event buffer script listened to
+void get_event_ring_branch(const char *tee_name, int cam_idx, const char *codec, char *str, int len)
+{
+	snprintf(str, len, " %s. ! queue ! %s ! fakesink name=event_ring_%d sync=false async=false",
+		tee_name, get_depay_name(codec), cam_idx);
+}
+
+
+static EventRecorder *get_event_recorder(int cam_idx)
+{
+	if (cam_idx < 0 || cam_idx >= g_num_event_recorders || g_event_recorders[cam_idx].pad == NULL)
+		return NULL;
+	return &g_event_recorders[cam_idx];
+}
+
+
+// Under recorder->lock : one access unit into the clip, timestamps from the start of the clip
+static void push_clip_buffer(EventRecorder *recorder, GstBuffer *buf)
+{
+	GstBuffer *copy = gst_buffer_copy(buf);			//metadata only, the memory is shared
+	GstFlowReturn ret;
+
+	if (GST_BUFFER_PTS_IS_VALID(copy))
+		GST_BUFFER_PTS(copy) -= recorder->clip_start;
+	if (GST_BUFFER_DTS_IS_VALID(copy))
+		GST_BUFFER_DTS(copy) = GST_BUFFER_DTS(copy) >= (GstClockTime)recorder->clip_start ? GST_BUFFER_DTS(copy) - recorder->clip_start : GST_CLOCK_TIME_NONE;
+	g_signal_emit_by_name(recorder->src, "push-buffer", copy, &ret);
+	gst_buffer_unref(copy);
+}
+
+
+// Under recorder->lock : no more units, the writer finalizes the file and posts EOS
+static void close_clip(EventRecorder *recorder)
+{
+	GstFlowReturn ret;
+
+	g_signal_emit_by_name(recorder->src, "end-of-stream", &ret);
+	recorder->state = EVENT_CLIP_CLOSING;
+}
+
+
+// Under recorder->lock : writer stopped and released, the camera can record its next event
+static void finish_clip(EventRecorder *recorder, gboolean from_watch)
+{
+	if (recorder->timeout_id) {
+		g_source_remove(recorder->timeout_id);
+		recorder->timeout_id = 0;
+	}
+	if (recorder->bus_watch_id && !from_watch)
+		g_source_remove(recorder->bus_watch_id);
+	recorder->bus_watch_id = 0;
+	gst_element_set_state(recorder->writer, GST_STATE_NULL);
+	g_clear_object(&recorder->src);
+	g_clear_object(&recorder->writer);
+	recorder->state = EVENT_CLIP_IDLE;
+	glog_trace("event clip closed [%s]\n", recorder->location);
+}
+
+
+// Streaming thread of the ring branch : every access unit goes to the ring, and to the clip while one is open
+static GstPadProbeReturn event_ring_probe(GstPad *pad, GstPadProbeInfo *info, gpointer u_data)
 {
-	char cmd[256];
-	int stream_base_port = get_udp_port(EVENT_RECORDER, cam_idx, g_config.event_record_enc_index, 0); 
+	EventRecorder *recorder = (EventRecorder *)u_data;
+	GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+	GstClockTime pts = GST_BUFFER_DTS_OR_PTS(buf);					//decode order, the ring only moves forward
+	gboolean keyframe = !GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT);
+
+	if (!GST_CLOCK_TIME_IS_VALID(pts))
+		return GST_PAD_PROBE_OK;
 
-	sprintf(cmd, "./record_event_buffer.sh %d %d &", g_config.event_buf_time, stream_base_port);
-	glog_trace("cmd=%s\n", cmd);
+	g_mutex_lock(&recorder->lock);
+	push_pre_event_unit(&recorder->ring, (gint64)pts, keyframe, gst_buffer_get_size(buf), gst_buffer_ref(buf));
+	if (recorder->state == EVENT_CLIP_RECORDING) {
+		if ((gint64)pts < recorder->clip_start) {
+			glog_error("cam_idx=%d timestamps went back, event clip closed early\n", recorder->cam_idx);
+			close_clip(recorder);
+		}
+		else {
+			push_clip_buffer(recorder, buf);
+			if ((gint64)pts >= recorder->clip_end)
+				close_clip(recorder);
+		}
+	}
+	g_mutex_unlock(&recorder->lock);
 
-	system(cmd); 
+	return GST_PAD_PROBE_OK;
 }
 
 
-//@@TODO 현재 만약 저장 중일 경우는 call을 할 경우 어떻게 할 것인지... 
-// 현재는 막는 방법으로 한다. 추후에는 port을 여러개 두어 중복으로 동작할 수 있도록 함
+// Main loop : the writer finished the file (EOS) or failed
+static gboolean on_clip_message(GstBus *bus, GstMessage *message, gpointer u_data)
+{
+	EventRecorder *recorder = (EventRecorder *)u_data;
+
+	if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) {
+		GError *error = NULL;
+		gst_message_parse_error(message, &error, NULL);
+		glog_error("event clip [%s] failed : %s\n", recorder->location, error ? error->message : "");
+		g_clear_error(&error);
+	}
+	else if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_EOS) {
+		return G_SOURCE_CONTINUE;
+	}
+
+	g_mutex_lock(&recorder->lock);
+	finish_clip(recorder, TRUE);
+	g_mutex_unlock(&recorder->lock);
+
+	return G_SOURCE_REMOVE;
+}
+
+
+// Main loop : the camera stopped sending before the end of the clip, close what was recorded
+static gboolean on_clip_timeout(gpointer u_data)
+{
+	EventRecorder *recorder = (EventRecorder *)u_data;
+
+	g_mutex_lock(&recorder->lock);
+	recorder->timeout_id = 0;
+	if (recorder->state == EVENT_CLIP_RECORDING) {
+		glog_error("cam_idx=%d no video for the event clip, closed early\n", recorder->cam_idx);
+		close_clip(recorder);
+	}
+	g_mutex_unlock(&recorder->lock);
+
+	return G_SOURCE_REMOVE;
+}
+
+
+// After gst_parse_launch() of the main pipeline : one ring per camera fed by its event_ring_%d branch
+gboolean setup_event_recorder(GstElement *pipeline, int num_cams, const char *codec)
+{
+	g_strlcpy(g_event_codec, codec, sizeof(g_event_codec));
+	g_event_recorders = g_new0(EventRecorder, num_cams);
+	g_num_event_recorders = num_cams;
+
+	for (int cam_idx = 0; cam_idx < num_cams; cam_idx++) {
+		EventRecorder *recorder = &g_event_recorders[cam_idx];
+		char element_name[32];
+		GstElement *sink;
+
+		recorder->cam_idx = cam_idx;
+		g_mutex_init(&recorder->lock);
+		init_pre_event_ring(&recorder->ring, PRE_EVENT_RING_UNITS, PRE_EVENT_RING_MAX_BYTES,
+			(gint64)g_config.event_buf_time * GST_SECOND, (GDestroyNotify)gst_buffer_unref);
+
+		sprintf(element_name, "event_ring_%d", cam_idx);
+		sink = gst_bin_get_by_name(GST_BIN(pipeline), element_name);
+		if (sink == NULL) {
+			glog_error("Fail get %s element, no event clips for cam_idx=%d\n", element_name, cam_idx);
+			continue;
+		}
+		recorder->pad = gst_element_get_static_pad(sink, "sink");
+		recorder->probe_id = gst_pad_add_probe(recorder->pad, GST_PAD_PROBE_TYPE_BUFFER, event_ring_probe, recorder, NULL);
+		gst_object_unref(sink);
+	}
+	glog_trace("pre-event ring %d sec, codec %s\n", g_config.event_buf_time, g_event_codec);
+
+	return TRUE;
+}
+
+
+// Before the main pipeline is released : an open clip is finished so its file stays playable
+void free_event_recorder()
+{
+	for (int cam_idx = 0; cam_idx < g_num_event_recorders; cam_idx++) {
+		EventRecorder *recorder = &g_event_recorders[cam_idx];
+
+		if (recorder->pad) {
+			gst_pad_remove_probe(recorder->pad, recorder->probe_id);
+			g_clear_object(&recorder->pad);
+		}
+		g_mutex_lock(&recorder->lock);
+		if (recorder->writer) {
+			if (recorder->state == EVENT_CLIP_RECORDING)
+				close_clip(recorder);
+			GstBus *bus = gst_element_get_bus(recorder->writer);
+			GstMessage *message = gst_bus_timed_pop_filtered(bus, 2 * GST_SECOND, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+			if (message)
+				gst_message_unref(message);
+			gst_object_unref(bus);
+			finish_clip(recorder, FALSE);
+		}
+		free_pre_event_ring(&recorder->ring);
+		g_mutex_unlock(&recorder->lock);
+		g_mutex_clear(&recorder->lock);
+	}
+	g_clear_pointer(&g_event_recorders, g_free);
+	g_num_event_recorders = 0;
+}
+
+
+// Notifier : an event clip is still being written, on any camera
+int is_event_recording()
+{
+	int recording = 0;
+
+	for (int cam_idx = 0; cam_idx < g_num_event_recorders; cam_idx++) {
+		EventRecorder *recorder = &g_event_recorders[cam_idx];
+		g_mutex_lock(&recorder->lock);
+		recording |= recorder->state != EVENT_CLIP_IDLE;
+		g_mutex_unlock(&recorder->lock);
+	}
+
+	return recording;
+}
+
+
+// The clip starts on the last keyframe event_buf_time before the trigger and ends event_buf_time after it,
+// written from the pre-event ring without encoding. One clip per camera at a time
 int trigger_event_record(int cam_idx, char* http_str_path_out)
 {
-	int pid = check_process(5200 + cam_idx);
-	if(pid != -1){
-		glog_trace("event recording is already running [(5200+cam_idx)=%d] [pid=%d]\n", 5200 + cam_idx, pid);			
+	EventRecorder *recorder = get_event_recorder(cam_idx);
+	if (recorder == NULL) {
+		glog_error("no pre-event ring for cam_idx=%d\n", cam_idx);
+		return FALSE;
+	}
+	g_mutex_lock(&recorder->lock);
+	int state = recorder->state;
+	g_mutex_unlock(&recorder->lock);
+	if (state != EVENT_CLIP_IDLE) {
+		glog_trace("event recording is already running [cam_idx=%d]\n", cam_idx);
 		return FALSE;
 	}
 
 	char str_time[256];
 	char str_file[512];
 	char http_str_path[512];
-	char cmd[1024];
+	char pipeline_str[1024];
+	const char *extension;
+	const char *muxer = get_clip_muxer(g_event_codec, &extension);
+	GError *error = NULL;
+	GstElement *writer;
+	GstElement *src;
+	GstCaps *caps;
+	int start;
 	//1. make path 
 	struct tm *local_time;
 	time_t t;
@@ -75,21 +315,74 @@ int trigger_event_record(int cam_idx, char* http_str_path_out)
 	
 	sprintf (str_time, "EVENT_%04d%02d%02d/CAM%d_%02d%02d%02d", local_time->tm_year + 1900,local_time->tm_mon+1,local_time->tm_mday, 
 		cam_idx, local_time->tm_hour, local_time->tm_min, local_time->tm_sec);
-	sprintf(str_file, "%s/%s.webm", g_config.record_path, str_time);
-	sprintf(http_str_path, "http://%s/data/%s.webm", g_config.http_service_ip, str_time);		
+	sprintf(str_file, "%s/%s%s", g_config.record_path, str_time, extension);
+	sprintf(http_str_path, "http://%s/data/%s%s", g_config.http_service_ip, str_time, extension);		
 
-	sprintf(cmd, "./webrtc_event_recorder --stream_cnt=%d --stream_base_port=%d --codec_name=VP9 --location=%s --duration=%d &",
-		1, 5200 + cam_idx, str_file, g_config.event_buf_time * 2);
-	system(cmd); 
-	glog_trace("cmd=%s\n", cmd);
+	//2. clip writer : the encoded units are only muxed
+	caps = gst_pad_get_current_caps(recorder->pad);
+	if (caps == NULL) {
+		glog_error("no video on the pre-event ring of cam_idx=%d yet\n", cam_idx);
+		return FALSE;
+	}
+	snprintf(pipeline_str, sizeof(pipeline_str), "appsrc name=clip_src format=time ! %s ! filesink location=%s", muxer, str_file);
+	writer = gst_parse_launch(pipeline_str, &error);
+	if (error) {
+		glog_error("Failed to parse launch: %s\n", error->message);
+		g_error_free(error);
+		if (writer)
+			gst_object_unref(writer);
+		gst_caps_unref(caps);
+		return FALSE;
+	}
+	src = gst_bin_get_by_name(GST_BIN(writer), "clip_src");
+	g_object_set(src, "caps", caps, NULL);
+	gst_caps_unref(caps);
+	if (gst_element_set_state(writer, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+		glog_error("Fail start event clip writer [%s]\n", str_file);
+		gst_element_set_state(writer, GST_STATE_NULL);
+		gst_object_unref(src);
+		gst_object_unref(writer);
+		return FALSE;
+	}
+
+	//3. pre-roll from the ring, the probe adds the frames after it under the same lock
+	g_mutex_lock(&recorder->lock);
+	gint64 trigger_pts = get_pre_event_newest(&recorder->ring);
+	start = get_pre_event_start(&recorder->ring, trigger_pts);
+	if (start < 0 || recorder->state != EVENT_CLIP_IDLE) {
+		g_mutex_unlock(&recorder->lock);
+		glog_error("pre-event ring of cam_idx=%d is empty or already recording\n", cam_idx);
+		gst_element_set_state(writer, GST_STATE_NULL);
+		gst_object_unref(src);
+		gst_object_unref(writer);
+		return FALSE;
+	}
+	recorder->writer = writer;
+	recorder->src = src;
+	recorder->clip_start = get_pre_event_unit(&recorder->ring, start)->pts;
+	recorder->clip_end = trigger_pts + (gint64)g_config.event_buf_time * GST_SECOND;
+	g_strlcpy(recorder->location, str_file, sizeof(recorder->location));
+	for (guint i = start; i < recorder->ring.count; i++)
+		push_clip_buffer(recorder, (GstBuffer *)get_pre_event_unit(&recorder->ring, i)->data);
+	recorder->state = EVENT_CLIP_RECORDING;
+	GstBus *bus = gst_element_get_bus(writer);
+	recorder->bus_watch_id = gst_bus_add_watch(bus, on_clip_message, recorder);
+	gst_object_unref(bus);
+	recorder->timeout_id = g_timeout_add_seconds(g_config.event_buf_time + EVENT_CLIP_GRACE_SEC, on_clip_timeout, recorder);
+	glog_trace("event clip [%s] pre-roll %" G_GINT64_FORMAT "ms from %u units, short trims=%" G_GUINT64_FORMAT "\n", str_file, 
+		(trigger_pts - recorder->clip_start) / 1000000, recorder->ring.count - start, recorder->ring.short_trims);
+	g_mutex_unlock(&recorder->lock);
 
 #if VIDEO_FORMAT
-	char str_temp[512];
-	convert_webm_to_mp4((g_config.event_buf_time * 2) + 3, str_file);
-	strcpy(str_temp, str_file);
-	change_extension(str_temp, ".mp4", str_file);
-	strcpy(str_temp, http_str_path);
-	change_extension(str_temp, ".mp4", http_str_path);
+	//video_convert.sh only takes webm, H.264 clips stay .mkv
+	if (strcmp(extension, ".webm") == 0) {
+		char str_temp[512];
+		convert_webm_to_mp4((g_config.event_buf_time * 2) + 3, str_file);
+		strcpy(str_temp, str_file);
+		change_extension(str_temp, ".mp4", str_file);
+		strcpy(str_temp, http_str_path);
+		change_extension(str_temp, ".mp4", http_str_path);
+	}
 #endif	
 
 	glog_trace("generate file[%s], http[%s]\n", str_file, http_str_path);
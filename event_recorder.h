@@ -1,7 +1,10 @@
 #ifndef __EVENT_RECORDER_H__
 #define __EVENT_RECORDER_H__
 
+#include <gst/gst.h>
 #include "device_setting.h"
+#include "analytics_core.h"
+#include "pre_event_ring.h"
 
 typedef enum {
 	SENDER = 0,
@@ -9,20 +12,42 @@ typedef enum {
 	EVENT_RECORDER,
 } UDPClientProcess;
 
-typedef enum {
-	RGB_CAM = 0,
-	THERMAL_CAM,
-	NUM_CAMS,
-} CameraDevice;
-
 typedef enum {
 	MAIN_STREAM = 0,
 	SECOND_STREAM,
 } StreamChoice;
 
 #define MAIN_STREAM_PORT_SPACE 	100
+#define EVENT_CLIP_GRACE_SEC 	5			//a clip still open this long after its end is closed anyway (camera stalled)
 
-void start_event_buf_process(int cam_idx);
+typedef enum {
+	EVENT_CLIP_IDLE = 0,
+	EVENT_CLIP_RECORDING,			// units of the ring branch go to the writer
+	EVENT_CLIP_CLOSING,				// end-of-stream sent, waiting for the writer's EOS
+} EventClipState;
+
+// Pre-event ring and event clip writer of one camera. The ring branch probe, the notifier and the
+// main loop meet under lock
+typedef struct {
+	int cam_idx;
+	GMutex lock;
+	PreEventRing ring;				// GstBuffer of every access unit, last event_buf_time sec from a keyframe
+	GstPad *pad;					// sink pad of event_ring_%d
+	gulong probe_id;
+	GstElement *writer;				// appsrc ! muxer ! filesink of the open clip, NULL when idle
+	GstElement *src;
+	int state;
+	gint64 clip_start;				// ring timestamp of the first unit of the clip, 0 in the file
+	gint64 clip_end;				// the clip is closed with the first unit at or after it
+	guint bus_watch_id;
+	guint timeout_id;
+	char location[512];
+} EventRecorder;
+
+void get_event_ring_branch(const char *tee_name, int cam_idx, const char *codec, char *str, int len);
+gboolean setup_event_recorder(GstElement *pipeline, int num_cams, const char *codec);
+void free_event_recorder();
+int is_event_recording();
 int trigger_event_record(int cam_idx, char* http_str_path_out);
 int get_udp_port(UDPClientProcess process, CameraDevice device, StreamChoice stream_choice, int stream_cnt);
 
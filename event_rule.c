@@ -0,0 +1,309 @@
+#include <string.h>
+#include "g_log.h"
+#include "analytics_core.h"
+#include "event_rule.h"
+
+
+static const char *predicate_names[NUM_RULE_PREDICATES] = {"none", "motion", "heat_vote", "over_temp"};
+
+static EventRuleTable g_event_rules;        //last table given to set_event_rules(), under g_event_rules_lock
+static GMutex g_event_rules_lock;
+static gint g_event_rules_version = 0;      //version of g_event_rules, read without the lock
+
+
+// Events of the build before the table, the device setting keys (heat_time, flip_threshold, ...) tune them
+void init_event_rules(EventRuleTable *table)
+{
+  EventRule heat = {"heat", CLASS_HEAT_COW, 0.8, 15, 0, RULE_PREDICATE_HEAT_VOTE, 0, CLASS_HEAT_COW};
+  EventRule flip = {"flip", CLASS_FLIP_COW, 0.8, 15, 0, RULE_PREDICATE_MOTION, 0, CLASS_FLIP_COW};
+  EventRule labor_sign = {"labor_sign", CLASS_LABOR_SIGN_COW, 0.8, 15, 0, RULE_PREDICATE_NONE, 0, CLASS_LABOR_SIGN_COW};
+  EventRule over_temp = {"over_temp", EVENT_RULE_ANY_CLASS, 0.0, 15, 0, RULE_PREDICATE_OVER_TEMP, TEMP_EVENT_TIME_GAP, CLASS_OVER_TEMP};
+
+  memset(table, 0, sizeof(*table));
+  for (int i = 0; i < NUM_CLASSES; i++) {
+    table->class_confidence[i] = 0.8;
+    table->class_rule[i] = EVENT_RULE_NONE;
+  }
+  table->class_confidence[CLASS_NORMAL_COW] = THRESHOLD_NORMAL;
+  table->class_confidence[CLASS_NORMAL_COW_SITTING] = THRESHOLD_NORMAL;
+  table->temp_rule = EVENT_RULE_NONE;
+
+  add_event_rule(table, &heat);
+  add_event_rule(table, &flip);
+  add_event_rule(table, &labor_sign);
+  add_event_rule(table, &over_temp);
+}
+
+
+static EventHistory get_history_mask(int ticks)
+{
+  return (ticks >= EVENT_HISTORY_BITS) ? ~(EventHistory)0 : ((EventHistory)1 << ticks) - 1;
+}
+
+static void set_history_masks(EventRule *rule)
+{
+  rule->window_mask = get_history_mask(rule->duration + rule->tolerance);
+  rule->hold_mask = get_history_mask(rule->tolerance + 1);
+}
+
+
+// Append one rule, FALSE when it does not fit the table or another rule already covers its objects
+gboolean add_event_rule(EventRuleTable *table, const EventRule *rule)
+{
+  if (table->num_rules >= MAX_EVENT_RULES) {
+    glog_error("event rule %s : more than %d rules\n", rule->name, MAX_EVENT_RULES);
+    return FALSE;
+  }
+  if (rule->predicate < 0 || rule->predicate >= NUM_RULE_PREDICATES || rule->duration < 1 || rule->cooldown < 0 ||
+      rule->tolerance < 0 || rule->duration + rule->tolerance > EVENT_HISTORY_BITS) {
+    glog_error("event rule %s : predicate=%d duration=%d tolerance=%d cooldown=%d\n", rule->name, rule->predicate, rule->duration, rule->tolerance, rule->cooldown);
+    return FALSE;
+  }
+  if (rule->event_id < 1 || rule->event_id > MAX_EVENT_ID || rule->event_id == CLASS_NORMAL_COW_SITTING) {    //the notifier drops the normal classes
+    glog_error("event rule %s : event_id=%d\n", rule->name, rule->event_id);
+    return FALSE;
+  }
+
+  if (rule->predicate == RULE_PREDICATE_OVER_TEMP) {
+    if (table->temp_rule != EVENT_RULE_NONE || rule->class_id < EVENT_RULE_ANY_CLASS || rule->class_id >= NUM_CLASSES) {
+      glog_error("event rule %s : one over temp rule, class_id=%d\n", rule->name, rule->class_id);
+      return FALSE;
+    }
+    table->temp_rule = table->num_rules;
+  }
+  else {
+    if (rule->class_id < 0 || rule->class_id >= NUM_CLASSES || table->class_rule[rule->class_id] != EVENT_RULE_NONE) {
+      glog_error("event rule %s : one detection rule per class, class_id=%d\n", rule->name, rule->class_id);
+      return FALSE;
+    }
+    table->class_rule[rule->class_id] = table->num_rules;
+  }
+  table->rules[table->num_rules] = *rule;
+  set_history_masks(&table->rules[table->num_rules++]);
+
+  return TRUE;
+}
+
+
+// Legacy keys of the device setting : confidence in %, duration in seconds, 0 keeps the current value.
+// CLASS_OVER_TEMP stands for the over temp rule (over_temp_time). FALSE for an unknown class or a duration
+// that does not fit in the history, nothing of the class is changed then
+gboolean set_class_event_rule(EventRuleTable *table, int class_id, int confidence, int duration)
+{
+  int rule_idx;
+
+  if (class_id < 0 || class_id >= NUM_CLASSES)
+    return FALSE;
+  rule_idx = (class_id == CLASS_OVER_TEMP) ? table->temp_rule : table->class_rule[class_id];
+  if (rule_idx != EVENT_RULE_NONE && duration > EVENT_HISTORY_BITS - table->rules[rule_idx].tolerance) {
+    glog_error("event rule %s : duration=%d over %d seconds, refused\n", table->rules[rule_idx].name, duration, 
+      EVENT_HISTORY_BITS - table->rules[rule_idx].tolerance);
+    return FALSE;
+  }
+  if (confidence > 0)
+    table->class_confidence[class_id] = (float)confidence / (float)100.0;
+  if (rule_idx == EVENT_RULE_NONE)
+    return TRUE;
+
+  EventRule *rule = &table->rules[rule_idx];
+  if (confidence > 0 && class_id != CLASS_OVER_TEMP)
+    rule->confidence = table->class_confidence[class_id];
+  if (duration > 0) {
+    rule->duration = duration;
+    set_history_masks(rule);
+  }
+
+  return TRUE;
+}
+
+
+static int get_predicate(const char *name)
+{
+  for (int i = 0; i < NUM_RULE_PREDICATES; i++) {
+    if (g_strcmp0(name, predicate_names[i]) == 0)
+      return i;
+  }
+  return -1;
+}
+
+
+// "event_rules" of the device setting, replaces the rules of table and keeps its class confidences.
+// Table is untouched when one rule is wrong
+//   {"name": "flip", "class_id": 2, "confidence": 80, "duration": 15, "tolerance": 2, "predicate": "motion", "cooldown": 0, "event_id": 2}
+// Only class_id (over temp : predicate) and duration are required, confidence is in %
+gboolean parse_event_rules(JsonArray *array, EventRuleTable *table)
+{
+  EventRuleTable parsed = *table;
+  guint array_size = json_array_get_length(array);
+
+  parsed.num_rules = 0;
+  parsed.temp_rule = EVENT_RULE_NONE;
+  for (int i = 0; i < NUM_CLASSES; i++)
+    parsed.class_rule[i] = EVENT_RULE_NONE;
+
+  for (guint i = 0; i < array_size; i++) {
+    JsonObject *object = json_array_get_object_element(array, i);
+    EventRule rule = {{0}};
+
+    if (object == NULL || !json_object_has_member(object, "duration")) {
+      glog_error("event_rules[%u] : no duration\n", i);
+      return FALSE;
+    }
+    if (json_object_has_member(object, "name"))
+      g_strlcpy(rule.name, json_object_get_string_member(object, "name"), sizeof(rule.name));
+    else
+      g_snprintf(rule.name, sizeof(rule.name), "rule_%u", i);
+
+    rule.predicate = RULE_PREDICATE_NONE;
+    if (json_object_has_member(object, "predicate")) {
+      rule.predicate = get_predicate(json_object_get_string_member(object, "predicate"));
+      if (rule.predicate < 0) {
+        glog_error("event rule %s : unknown predicate\n", rule.name);
+        return FALSE;
+      }
+    }
+
+    if (json_object_has_member(object, "class_id"))
+      rule.class_id = json_object_get_int_member(object, "class_id");
+    else if (rule.predicate == RULE_PREDICATE_OVER_TEMP)
+      rule.class_id = EVENT_RULE_ANY_CLASS;
+    else {
+      glog_error("event rule %s : no class_id\n", rule.name);
+      return FALSE;
+    }
+
+    if (json_object_has_member(object, "confidence"))
+      rule.confidence = (float)json_object_get_int_member(object, "confidence") / (float)100.0;
+    else if (rule.class_id >= 0 && rule.class_id < NUM_CLASSES)
+      rule.confidence = parsed.class_confidence[rule.class_id];
+
+    rule.duration = json_object_get_int_member(object, "duration");
+    if (json_object_has_member(object, "tolerance"))
+      rule.tolerance = json_object_get_int_member(object, "tolerance");
+    if (json_object_has_member(object, "cooldown"))
+      rule.cooldown = json_object_get_int_member(object, "cooldown");
+    if (json_object_has_member(object, "event_id"))
+      rule.event_id = json_object_get_int_member(object, "event_id");
+    else
+      rule.event_id = (rule.predicate == RULE_PREDICATE_OVER_TEMP) ? CLASS_OVER_TEMP : rule.class_id;
+
+    if (!add_event_rule(&parsed, &rule))
+      return FALSE;
+  }
+
+  *table = parsed;
+
+  return TRUE;
+}
+
+
+// "event_rules" of a json file, e.g. a device setting given to analytics_replay
+gboolean load_event_rules_file(const char *file_name, EventRuleTable *table)
+{
+  JsonParser *parser = json_parser_new();
+  GError *error = NULL;
+  JsonNode *root;
+  gboolean ret = FALSE;
+
+  json_parser_load_from_file(parser, file_name, &error);
+  if (error) {
+    glog_error("Unable to parse file '%s': %s\n", file_name, error->message);
+    g_error_free(error);
+    g_object_unref(parser);
+    return FALSE;
+  }
+
+  root = json_parser_get_root(parser);
+  if (root && JSON_NODE_HOLDS_OBJECT(root) && json_object_has_member(json_node_get_object(root), "event_rules"))
+    ret = parse_event_rules(json_object_get_array_member(json_node_get_object(root), "event_rules"), table);
+  else
+    glog_error("no event_rules in '%s'\n", file_name);
+  g_object_unref(parser);
+
+  return ret;
+}
+
+
+// Rules as the "event_rules" array of the device setting, to be freed with g_free()
+gchar *format_event_rules(const EventRuleTable *table)
+{
+  GString *str = g_string_new("[\n");
+
+  for (int i = 0; i < table->num_rules; i++) {
+    const EventRule *rule = &table->rules[i];
+    g_string_append_printf(str, "{\"name\": \"%s\", \"class_id\": %d, \"confidence\": %d, \"duration\": %d, \"tolerance\": %d, "
+      "\"predicate\": \"%s\", \"cooldown\": %d, \"event_id\": %d}%s\n",
+      rule->name, rule->class_id, (int)(rule->confidence * 100.0 + 0.5), rule->duration, rule->tolerance,
+      predicate_names[rule->predicate], rule->cooldown, rule->event_id, (i < table->num_rules - 1) ? "," : "");
+  }
+  g_string_append(str, "]");
+
+  return g_string_free(str, FALSE);
+}
+
+
+void log_event_rules(const EventRuleTable *table)
+{
+  for (int i = 0; i < NUM_CLASSES; i++)
+    glog_trace("class_id=%d confidence=%.2f rule=%d\n", i, table->class_confidence[i], table->class_rule[i]);
+  for (int i = 0; i < table->num_rules; i++) {
+    const EventRule *rule = &table->rules[i];
+    glog_trace("event rule %s : class_id=%d confidence=%.2f duration=%d tolerance=%d predicate=%s cooldown=%d event_id=%d\n",
+      rule->name, rule->class_id, rule->confidence, rule->duration, rule->tolerance, predicate_names[rule->predicate], rule->cooldown, rule->event_id);
+  }
+}
+
+
+// Publish a table, the analytics threads pick it up with their next record. Same rules keep the version
+void set_event_rules(const EventRuleTable *table)
+{
+  EventRuleTable next = *table;
+
+  g_mutex_lock(&g_event_rules_lock);
+  next.version = g_event_rules.version;
+  if (g_event_rules.version == 0 || memcmp(&next, &g_event_rules, sizeof(next)) != 0) {
+    next.version = g_event_rules.version + 1;
+    g_event_rules = next;
+    g_atomic_int_set(&g_event_rules_version, next.version);
+    glog_trace("event rules version=%d rules=%d\n", next.version, next.num_rules);
+  }
+  g_mutex_unlock(&g_event_rules_lock);
+}
+
+
+// Copy the published table into the caller's own when it changed, TRUE when it did
+gboolean refresh_event_rules(EventRuleTable *table)
+{
+  int version = g_atomic_int_get(&g_event_rules_version);
+
+  if (version == 0 || version == table->version)
+    return FALSE;
+  g_mutex_lock(&g_event_rules_lock);
+  *table = g_event_rules;
+  g_mutex_unlock(&g_event_rules_lock);
+
+  return TRUE;
+}
+
+
+// Detection rule a detection counts for, NULL when its class raises nothing or it is under the confidence
+const EventRule *get_class_event_rule(const EventRuleTable *table, int class_id, float confidence)
+{
+  if (class_id < 0 || class_id >= NUM_CLASSES || table->class_rule[class_id] == EVENT_RULE_NONE)
+    return NULL;
+
+  const EventRule *rule = &table->rules[(int)table->class_rule[class_id]];
+  if (confidence < rule->confidence)
+    return NULL;
+
+  return rule;
+}
+
+
+// Event class of one detection, normal when no rule counts it
+int get_event_class(const EventRuleTable *table, int class_id, float confidence)
+{
+  if (get_class_event_rule(table, class_id, confidence) == NULL)
+    return CLASS_NORMAL_COW;
+  return class_id;
+}
@@ -0,0 +1,117 @@
+#ifndef __EVENT_RULE_H__
+#define __EVENT_RULE_H__
+
+// Events raised by the analytics core, one rule per event instead of per-class branches in the code.
+// The table comes from "event_rules" of the device setting json and is swapped at run time by
+// set_event_rules(), each thread using it keeps a copy that refresh_event_rules() updates between records.
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+#define CLASSES_NUM                           5
+
+#if CLASSES_NUM == 5
+enum
+{
+  CLASS_NORMAL_COW = 0,
+  CLASS_HEAT_COW,
+  CLASS_FLIP_COW,
+  CLASS_LABOR_SIGN_COW,
+  CLASS_NORMAL_COW_SITTING,
+  CLASS_OVER_TEMP,
+  NUM_CLASSES
+};
+
+#elif CLASSES_NUM == 2
+#elif CLASSES_NUM == 3
+enum
+{
+  CLASS_NORMAL_COW = 0,
+  CLASS_FLIP_COW = 1,
+  CLASS_NORMAL_COW_SITTING = 2,
+  CLASS_HEAT_COW = 3,             //don't care
+  CLASS_LABOR_SIGN_COW = 4,       //don't care
+  CLASS_OVER_TEMP = 5,            //don't care
+  NUM_CLASSES = 6                 //this should be 6
+};
+
+#else
+#endif
+
+#define MAX_EVENT_RULES           16
+#define EVENT_RULE_NAME_LEN       16
+#define EVENT_RULE_ANY_CLASS      (-1)            //rule watches every object whatever its class
+#define EVENT_RULE_NONE           (-1)
+#define MAX_EVENT_ID              9               //ids are sent to the server as one digit
+#define EVENT_HISTORY_BITS        64              //duration + tolerance of a rule fits in the history
+
+typedef enum {
+  RULE_PREDICATE_NONE = 0,
+  RULE_PREDICATE_MOTION,          // optical flow inside the bbox confirmed it (opt_flow_apply)
+  RULE_PREDICATE_HEAT_VOTE,       // secondary classifier agreed during the window (resnet50_apply)
+  RULE_PREDICATE_OVER_TEMP,       // bbox temperature over the average of the objects by temp_diff_threshold
+  NUM_RULE_PREDICATES
+} EventPredicate;
+
+// Last ticks of one object for one kind of rule, bit 0 is the last tick, set when the object counted
+typedef guint64 EventHistory;
+
+// One event. Detection rules count the seconds their class was detected, the over temp rule counts
+// the seconds the object stayed hot, both fire once duration of the last duration + tolerance seconds counted
+typedef struct {
+  char name[EVENT_RULE_NAME_LEN];
+  int class_id;                   // detector class, EVENT_RULE_ANY_CLASS for the over temp rule only
+  float confidence;               // detections under it do not count
+  int duration;                   // seconds
+  int tolerance;                  // seconds the object may miss inside the window, e.g. hidden by another cow
+  int predicate;                  // EventPredicate, checked when the duration is reached
+  int cooldown;                   // seconds the object stays quiet for this rule after any of its events
+  int event_id;                   // class id handed to the notifier
+  EventHistory window_mask;       // last duration + tolerance ticks, set by add_event_rule()
+  EventHistory hold_mask;         // last tolerance + 1 ticks, a count goes on while one of them is set
+} EventRule;
+
+// Compiled table : every object is checked against at most its class rule and the over temp rule
+typedef struct {
+  int version;                    // set by set_event_rules(), 0 for a table never published
+  int num_rules;
+  EventRule rules[MAX_EVENT_RULES];
+  float class_confidence[NUM_CLASSES];    // detections under it are not drawn, defaults of the rule confidence
+  signed char class_rule[NUM_CLASSES];    // index in rules[] of the detection rule of a class, EVENT_RULE_NONE
+  signed char temp_rule;                  // index of the over temp rule, EVENT_RULE_NONE
+} EventRuleTable;
+
+
+void init_event_rules(EventRuleTable *table);
+gboolean add_event_rule(EventRuleTable *table, const EventRule *rule);
+gboolean set_class_event_rule(EventRuleTable *table, int class_id, int confidence, int duration);
+gboolean parse_event_rules(JsonArray *array, EventRuleTable *table);
+gboolean load_event_rules_file(const char *file_name, EventRuleTable *table);
+gchar *format_event_rules(const EventRuleTable *table);
+void log_event_rules(const EventRuleTable *table);
+
+void set_event_rules(const EventRuleTable *table);
+gboolean refresh_event_rules(EventRuleTable *table);
+
+const EventRule *get_class_event_rule(const EventRuleTable *table, int class_id, float confidence);
+int get_event_class(const EventRuleTable *table, int class_id, float confidence);
+
+
+// One tick more in the history, hit when the object counted for the rule
+static inline EventHistory push_event_history(EventHistory history, int hit)
+{
+  return (history << 1) | (EventHistory)(hit != 0);
+}
+
+// Duration of the rule reached : duration ticks of its window counted
+static inline gboolean is_event_rule_met(const EventRule *rule, EventHistory history)
+{
+  return __builtin_popcountll(history & rule->window_mask) >= rule->duration;
+}
+
+// The count of the rule goes on, the object missed no more than its tolerance since it last counted
+static inline gboolean is_event_history_live(const EventRule *rule, EventHistory history)
+{
+  return (history & rule->hold_mask) != 0;
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include <string.h>
+#include <math.h>
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "g_log.h"
+#include "flow_integral.h"
+
+
+// Magnitude of count flow vectors, in the raw units of NvOFFlowVector
+void compute_flow_magnitude(const FlowVector *vectors, int count, float *magnitude)
+{
+  int i = 0;
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+  for (; i + 8 <= count; i += 8) {
+    int16x8x2_t v = vld2q_s16((const int16_t *)(vectors + i));
+    float32x4_t x_lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v.val[0])));
+    float32x4_t x_hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(v.val[0])));
+    float32x4_t y_lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v.val[1])));
+    float32x4_t y_hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(v.val[1])));
+    vst1q_f32(magnitude + i, vsqrtq_f32(vmlaq_f32(vmulq_f32(x_lo, x_lo), y_lo, y_lo)));
+    vst1q_f32(magnitude + i + 4, vsqrtq_f32(vmlaq_f32(vmulq_f32(x_hi, x_hi), y_hi, y_hi)));
+  }
+#endif
+
+  for (; i < count; i++) {
+    float x = vectors[i].flowx, y = vectors[i].flowy;
+    magnitude[i] = sqrtf((x * x) + (y * y));
+  }
+}
+
+
+// Build the integral image of the rows x cols flow grid of the frame, once per frame. Returns -1 when there is no grid
+int build_flow_integral(FlowIntegral *fi, const FlowVector *flow_vectors, int rows, int cols)
+{
+  fi->valid = 0;
+  if (!flow_vectors || rows <= 0 || cols <= 0)
+    return -1;
+
+  int stride = cols + 1;
+  int cells = stride * (rows + 1);
+
+  if (cells > fi->capacity) {
+    fi->sum = g_realloc(fi->sum, sizeof(double) * cells);
+    fi->capacity = cells;
+  }
+  if (cols > fi->magnitude_capacity) {
+    fi->magnitude = g_realloc(fi->magnitude, sizeof(float) * cols);
+    fi->magnitude_capacity = cols;
+  }
+  fi->rows = rows;
+  fi->cols = cols;
+
+  memset(fi->sum, 0, sizeof(double) * stride);
+  for (int row = 0; row < rows; row++) {
+    double *sum_prev = &fi->sum[row * stride];
+    double *sum_row = &fi->sum[(row + 1) * stride];
+    double row_sum = 0.0;
+
+    compute_flow_magnitude(flow_vectors + (row * cols), cols, fi->magnitude);
+    sum_row[0] = 0.0;
+    for (int col = 0; col < cols; col++) {
+      row_sum += fi->magnitude[col];
+      sum_row[col + 1] = sum_prev[col + 1] + row_sum;
+    }
+  }
+
+  fi->valid = 1;
+  return 0;
+}
+
+
+// Mean magnitude of the flow vectors covering the bbox, clipped to the flow grid. Returns 0 when nothing was covered
+double get_flow_integral_avg(FlowIntegral *fi, int x, int y, int width, int height, int *count)
+{
+  int stride = fi->cols + 1;
+
+  *count = 0;
+  if (!fi->valid)
+    return 0.0;
+
+  // row comes from y and col from x
+  int col0 = CLAMP(x / OPT_FLOW_GRID_SIZE, 0, fi->cols);
+  int row0 = CLAMP(y / OPT_FLOW_GRID_SIZE, 0, fi->rows);
+  int col1 = CLAMP((x + width) / OPT_FLOW_GRID_SIZE, 0, fi->cols);
+  int row1 = CLAMP((y + height) / OPT_FLOW_GRID_SIZE, 0, fi->rows);
+  if (col1 <= col0 || row1 <= row0)
+    return 0.0;
+
+  *count = (row1 - row0) * (col1 - col0);
+  double sum = fi->sum[row1 * stride + col1] - fi->sum[row0 * stride + col1]
+             - fi->sum[row1 * stride + col0] + fi->sum[row0 * stride + col0];
+
+  return sum / (double)*count;
+}
+
+
+void free_flow_integral(FlowIntegral *fi)
+{
+  g_free(fi->sum);
+  g_free(fi->magnitude);
+  memset(fi, 0, sizeof(FlowIntegral));
+}
@@ -0,0 +1,31 @@
+#ifndef __FLOW_INTEGRAL_H__
+#define __FLOW_INTEGRAL_H__
+
+#include <glib.h>
+
+#define OPT_FLOW_GRID_SIZE        4               //pixels covered by one flow vector (nvof 4x4 grid)
+
+// One vector of the flow grid, same layout as NvOFFlowVector of the optical flow meta
+typedef struct {
+  short flowx;
+  short flowy;
+} FlowVector;
+
+// Summed-area table of the flow magnitudes of one frame, rows x cols of the nvof grid
+typedef struct {
+  int rows;               // flow grid rows (frame height / OPT_FLOW_GRID_SIZE)
+  int cols;               // flow grid columns (frame width / OPT_FLOW_GRID_SIZE)
+  int capacity;           // allocated cells of sum[]
+  int valid;              // set when the table matches the current frame
+  double *sum;            // integral of magnitudes, (rows+1)*(cols+1)
+  float *magnitude;       // magnitudes of one grid row
+  int magnitude_capacity;
+} FlowIntegral;
+
+
+void compute_flow_magnitude(const FlowVector *vectors, int count, float *magnitude);
+int build_flow_integral(FlowIntegral *fi, const FlowVector *vectors, int rows, int cols);
+double get_flow_integral_avg(FlowIntegral *fi, int x, int y, int width, int height, int *count);
+void free_flow_integral(FlowIntegral *fi);
+
+#endif
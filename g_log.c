@@ -9,12 +9,14 @@
 #include <unistd.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <dirent.h>
 #include <pthread.h>
 #include <json-glib/json-glib.h>
 
 static const char* glog_text[GLOG_MAX] = {"TR", "ER", "CR"};
 static char g_program_name[64] ={}; 
 static pthread_mutex_t g_log_mutex;
+static int g_log_level = GLOG_TRACE;      //messages below this level are dropped
 
 #define MAX_BUF_SIZE 1024
 #define LOG_DIR "./logs/"
@@ -186,10 +188,20 @@ void manage_log_file()
 }
 
 
+// Lowest level printed, GLOG_ERROR keeps the traces out of the tools that print their own results
+void set_glog_level(int level)
+{
+	g_log_level = level;
+}
+
+
 void glog(int level, int file_append, const char *file, int line, const char *fmt, ...)
 {
 	static int first = 1;
 
+	if (level < g_log_level)
+		return;
+
 	if (first) {
 		first = 0;
 		pthread_mutex_init(&g_log_mutex, NULL);
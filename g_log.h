@@ -15,6 +15,7 @@ enum {
 };
 
 void glog(int level, int file_append, const char *file, int line, const char *fmt, ...);
+void set_glog_level(int level);
 
 #define glog_trace(...) glog(GLOG_TRACE, 0, __FILE__, __LINE__,  __VA_ARGS__)
 #define glog_error(...) glog(GLOG_ERROR, 0, __FILE__, __LINE__, __VA_ARGS__)
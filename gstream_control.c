@@ -41,7 +41,6 @@ extern void terminate_program();
 #if MINDULE_INCLUDE
 #define RANCH_SETTING_FILE    "ranch_setting.json"
 extern RanchSetting g_ranch_setting;
-extern int g_frame_count[];
 
 void get_ranch_setting_path(char *fname);
 #endif
@@ -509,8 +508,7 @@ gboolean process_message_cmd(gJSONObj* jsonObj)
        g_setting.analysis_status = 0;
     }
     
-    g_frame_count[RGB_CAM] = 0;
-    g_frame_count[THERMAL_CAM] = 0;
+    reset_analytics_clocks();
     
     update_setting(g_config.device_setting_path, &g_setting);
   } else if(json_object_has_member(object, "color_palette")){
@@ -532,6 +530,9 @@ gboolean process_message_cmd(gJSONObj* jsonObj)
     execute_process(process_cmd, FALSE);
 
     g_setting.color_pallet = palette_id[0] - '0';
+#if THERMAL_TEMP_INCLUDE
+    set_temp_palette(g_setting.color_pallet);
+#endif
     update_setting(g_config.device_setting_path, &g_setting);
   } else if(json_object_has_member(object, "send_event")){          //LJH, this is from test page
     glog_trace("send_event\n");
@@ -542,7 +543,7 @@ gboolean process_message_cmd(gJSONObj* jsonObj)
     }
     trigger_event_record(0, g_curlinfo.video_url);
     // printf("notification_request [%s] \n", g_curlinfo.video_url);
-    notification_request(g_config.camera_id, "1", &g_curlinfo);
+    notification_request(g_config.camera_id, "1", &g_curlinfo, NULL, 0);
   } else if(json_object_has_member(object, "del_ptz_pos")){
     glog_trace("del_ptz_pos\n");
     const gchar* str_id;
@@ -831,9 +832,6 @@ gboolean apply_setting()
   }
 
   set_camera_dn_mode(g_setting.camera_dn_mode);
-
-  //event buffer start   
-  start_event_buf_process(RGB_CAM);
   
   return TRUE;
 }
\ No newline at end of file
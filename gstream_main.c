@@ -145,7 +145,7 @@ static gboolean start_pipeline (void)
   GstStateChangeReturn ret;
   GError *error = NULL;
 
-  char str_pipeline[8192*2] = {0,};
+  GString *str_pipeline = g_string_new(NULL);      //grows with g_config.device_cnt
   char str_video[4096];
 
   for( int i = 0 ; i< g_config.device_cnt;i++){
@@ -156,7 +156,7 @@ static gboolean start_pipeline (void)
       "%s  " "tee name=video_enc_tee1_%d " 
       "%s  " "tee name=video_enc_tee2_%d " , 
         g_config.video_src[i],  g_config.snapshot_enc[i], g_config.snapshot_path, i, g_config.video_infer[i],  g_config.video_enc[i], i, g_config.video_enc2[i], i); 
-    strcat(str_pipeline, str_video);
+    g_string_append(str_pipeline, str_video);
   }
 
   if(strstr(g_config.video_enc[0], "vp8")){
@@ -185,19 +185,25 @@ static gboolean start_pipeline (void)
         else if(i == (g_config.max_stream_cnt + 1))
             udp_port = get_udp_port(EVENT_RECORDER, device, stream, 0);
         
-        if (stream == MAIN_STREAM)          
+        if (i == (g_config.max_stream_cnt + 1) && stream == (StreamChoice)g_config.event_record_enc_index) {
+          char tee_name[32];                  //event clips come from the in-process pre-event ring
+          snprintf(tee_name, sizeof(tee_name), "video_enc_tee%d_%d", stream + 1, device);
+          get_event_ring_branch(tee_name, device, g_codec_name, str_video, sizeof(str_video));
+        }
+        else if (stream == MAIN_STREAM)          
           snprintf(str_video, sizeof(str_video), " video_enc_tee1_%d. ! queue ! udpsink host=127.0.0.1  port=%d", device, udp_port);
         else if (stream == SECOND_STREAM)          
           snprintf(str_video, sizeof(str_video), " video_enc_tee2_%d. ! queue ! udpsink host=127.0.0.1  port=%d", device, udp_port);
 
-        strcat(str_pipeline, str_video);
+        g_string_append(str_pipeline, str_video);
         glog_trace("str_video=%s\n", str_video);                    
       }
     }
   }
 
-  glog_trace("%lu  %s\n", strlen(str_pipeline), str_pipeline);
-  g_pipeline = gst_parse_launch (str_pipeline, &error);
+  glog_trace("%lu  %s\n", str_pipeline->len, str_pipeline->str);
+  g_pipeline = gst_parse_launch (str_pipeline->str, &error);
+  g_string_free(str_pipeline, TRUE);
   if (error) {
     glog_error ("Failed to parse launch: %s\n", error->message);
     g_error_free (error);
@@ -206,6 +212,7 @@ static gboolean start_pipeline (void)
 
   // setup OSD  and event detection.
   setup_nv_analysis();
+  setup_event_recorder(g_pipeline, g_config.device_cnt, g_codec_name);
 
   glog_trace ("Starting pipeline, not transmitting yet\n");
   ret = gst_element_set_state (GST_ELEMENT (g_pipeline), GST_STATE_PLAYING);
@@ -702,6 +709,7 @@ static gboolean timer_check_callback(gpointer user_data)
 
   manage_log_file();
   check_ptz_stop_command();
+  reload_analysis_setting(g_config.device_setting_path, &g_setting);
   elapsed_sec++;
   if (elapsed_sec == 15) {
     init_auto_pan();
@@ -723,7 +731,6 @@ static gboolean timer_check_callback(gpointer user_data)
    }
  }
 #endif
-  dec_temp_event_time_gap();
 
   return G_SOURCE_CONTINUE;
 }
@@ -783,6 +790,12 @@ static gboolean connect_check_callback(gpointer user_data)
   glog_trace("g_app_state=%d g_wait_reply_cnt=%d sender_num=%d CPU=%d GPU=%d g_source_cam_index=%d\n", 
     g_app_state, g_wait_reply_cnt, sender_num, get_temp(0) , get_temp(1), g_source_cam_idx);
 
+  int outbox_depth, outbox_age;
+  get_notification_backlog(&outbox_depth, &outbox_age);
+  if (outbox_depth > 0) {
+    glog_trace("outbox depth=%d oldest=%ds\n", outbox_depth, outbox_age);
+  }
+
   internet_state = get_internet_state(internet_state, conn);
   if (internet_state == INTERNET_RECONNECTED) {
     if (g_app_state != 2000) {
@@ -873,15 +886,29 @@ main (int argc, char *argv[])
   if (!check_plugins ())
     return -1;
 
+  //before load_config(), it already asks for the global ip
+  if (!init_curl_client()) {
+    glog_error ("fail start http client\n");
+    return -1;
+  }
+
   if (!load_config(g_config_name, &g_config, &g_curlinfo)){
     glog_error ("fail load config : %s\n", g_config_name);
     return -1;
   }
 
+  //events left by the last run are sent again
+  if (!start_notification_outbox(g_config.outbox_path, &g_curlinfo)) {
+    glog_error ("fail open outbox : %s, notifications are not kept\n", g_config.outbox_path);
+  }
+
   if (!load_device_setting(g_config.device_setting_path, &g_setting)){
     glog_error ("fail load device_setting : %s\n", g_config.device_setting_path);
     return -1;
   }
+#if THERMAL_TEMP_INCLUDE
+  init_temp_palette_lut(g_setting.color_pallet, g_config.thermal_palettes);
+#endif
 
 #if MINDULE_INCLUDE
   if (is_rest_server()) {
@@ -987,10 +1014,12 @@ main (int argc, char *argv[])
 
   if(g_config.status_timer_interval > 0) kill_heartbit();
 
+  free_event_recorder();
   gst_object_unref (g_pipeline);
   free_config (&g_config);
   
   endup_nv_analysis();
+  free_curl_client();
     
   pthread_mutex_destroy(&g_send_mutex);
   pthread_mutex_destroy(&g_process_msg_mutex);
@@ -59,6 +59,5 @@ extern gboolean cleanup_and_retry_connect (const gchar * msg, enum AppState stat
 extern void send_camera_info_to_server();
 extern int is_process_running(const char *process_name);
 extern int get_temp(int index);
-extern void dec_temp_event_time_gap();
 
 #endif
@@ -0,0 +1,572 @@
+#include <string.h>
+#include "g_log.h"
+#include "http_client.h"
+
+typedef struct {
+  GMutex lock;
+  GCond cond;
+  gboolean done;
+  CURLcode result;
+  long status;
+  char *response;
+} HttpWaiter;
+
+
+static size_t write_http_response(void *buffer, size_t size, size_t nmemb, void *userp)
+{
+  HttpRequest *request = (HttpRequest *)userp;
+  size_t len = size * nmemb;
+
+  request->response = g_realloc(request->response, request->response_len + len + 1);
+  memcpy(request->response + request->response_len, buffer, len);
+  request->response_len += len;
+  request->response[request->response_len] = 0;
+
+  return len;
+}
+
+
+HttpRequest *new_http_request(const char *url, HttpDoneFunc done, gpointer user_data)
+{
+  HttpRequest *request;
+  CURL *curl = curl_easy_init();
+
+  if (curl == NULL) {
+    glog_error("curl_easy_init failed\n");
+    return NULL;
+  }
+
+  request = g_new0(HttpRequest, 1);
+  request->curl = curl;
+  request->timeout_ms = HTTP_TIMEOUT_MS;
+  request->connect_timeout_ms = HTTP_CONNECT_TIMEOUT_MS;
+  request->done = done;
+  request->user_data = user_data;
+  curl_easy_setopt(curl, CURLOPT_URL, url);
+
+  return request;
+}
+
+
+void free_http_request(HttpRequest *request)
+{
+  if (request == NULL)
+    return;
+  curl_easy_cleanup(request->curl);               //before the form and headers it points to
+  curl_mime_free(request->form);
+  curl_slist_free_all(request->headers);
+  g_free(request->body);
+  g_free(request->response);
+  g_free(request);
+}
+
+
+void add_http_header(HttpRequest *request, const char *header)
+{
+  request->headers = curl_slist_append(request->headers, header);
+}
+
+
+// POST with the given body, copied
+void set_http_body(HttpRequest *request, const char *body)
+{
+  g_free(request->body);
+  request->body = g_strdup(body);
+}
+
+
+// multipart POST, the data is copied when the part is added
+void add_http_form_data(HttpRequest *request, const char *name, const char *data)
+{
+  curl_mimepart *part;
+
+  if (request->form == NULL)
+    request->form = curl_mime_init(request->curl);
+  part = curl_mime_addpart(request->form);
+  curl_mime_name(part, name);
+  curl_mime_data(part, data, CURL_ZERO_TERMINATED);
+}
+
+
+// multipart POST, the file is read when the request is sent
+void add_http_form_file(HttpRequest *request, const char *name, const char *path)
+{
+  curl_mimepart *part;
+
+  if (request->form == NULL)
+    request->form = curl_mime_init(request->curl);
+  part = curl_mime_addpart(request->form);
+  curl_mime_name(part, name);
+  if (curl_mime_filedata(part, path) != CURLE_OK)
+    glog_error("can not attach %s as %s\n", path, name);
+}
+
+
+// multipart POST of a file kept in memory, the data is copied so the caller can free it at once
+void add_http_form_buffer(HttpRequest *request, const char *name, const void *data, size_t size,
+                          const char *filename, const char *type)
+{
+  curl_mimepart *part;
+
+  if (request->form == NULL)
+    request->form = curl_mime_init(request->curl);
+  part = curl_mime_addpart(request->form);
+  curl_mime_name(part, name);
+  curl_mime_data(part, (const char *)data, size);
+  curl_mime_filename(part, filename);
+  curl_mime_type(part, type);
+}
+
+
+void set_http_timeout(HttpRequest *request, long timeout_ms, long connect_timeout_ms)
+{
+  request->timeout_ms = timeout_ms;
+  request->connect_timeout_ms = connect_timeout_ms;
+}
+
+
+// Client thread : the options are set here so the setters above stay free of order
+static void start_http_request(HttpClient *client, HttpRequest *request)
+{
+  CURL *curl = request->curl;
+
+  curl_easy_setopt(curl, CURLOPT_PRIVATE, request);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);                        //timeouts without SIGALRM, we are not the main thread
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, request->timeout_ms);
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, request->connect_timeout_ms);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, (long)HTTP_KEEPALIVE_IDLE);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, (long)HTTP_KEEPALIVE_IDLE);
+  curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, (long)HTTP_DNS_CACHE_TIMEOUT);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_http_response);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, request);
+  if (request->headers)
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, request->headers);
+  if (request->form)
+    curl_easy_setopt(curl, CURLOPT_MIMEPOST, request->form);
+  else if (request->body)
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request->body);
+
+  if (curl_multi_add_handle(client->multi, curl) != CURLM_OK) {
+    request->result = CURLE_FAILED_INIT;
+    g_atomic_int_inc(&client->failed);
+    if (request->done)
+      request->done(request, request->user_data);
+    free_http_request(request);
+    return;
+  }
+  request->next = client->active;
+  client->active = request;
+}
+
+
+static void end_http_request(HttpClient *client, HttpRequest *request, CURLcode result)
+{
+  HttpRequest **link = &client->active;
+
+  while (*link && *link != request)
+    link = &(*link)->next;
+  if (*link)
+    *link = request->next;
+  curl_multi_remove_handle(client->multi, request->curl);
+
+  request->result = result;
+  request->elapsed = g_get_monotonic_time() - request->submit_time;
+  curl_easy_getinfo(request->curl, CURLINFO_RESPONSE_CODE, &request->status);
+  curl_easy_getinfo(request->curl, CURLINFO_NUM_CONNECTS, &request->new_connects);
+  g_atomic_int_add(&client->connects, (gint)request->new_connects);
+  if (result != CURLE_OK) {
+    g_atomic_int_inc(&client->failed);
+    glog_error("request failed after %" G_GINT64_FORMAT "ms: %s\n", request->elapsed / 1000, curl_easy_strerror(result));
+  }
+
+  if (request->done)
+    request->done(request, request->user_data);
+  free_http_request(request);
+}
+
+
+static HttpRequest *take_pending_requests(HttpClient *client)
+{
+  HttpRequest *requests;
+
+  g_mutex_lock(&client->lock);
+  requests = client->pending;
+  client->pending = client->pending_tail = NULL;
+  g_mutex_unlock(&client->lock);
+
+  return requests;
+}
+
+
+// Stopped : whatever is left ends as aborted so its owner still gets the callback
+static void abort_http_requests(HttpClient *client)
+{
+  HttpRequest *request, *next;
+
+  for (request = take_pending_requests(client); request; request = next) {
+    next = request->next;
+    request->result = CURLE_ABORTED_BY_CALLBACK;
+    g_atomic_int_inc(&client->failed);
+    if (request->done)
+      request->done(request, request->user_data);
+    free_http_request(request);
+  }
+  while (client->active)
+    end_http_request(client, client->active, CURLE_ABORTED_BY_CALLBACK);
+}
+
+
+static void *run_http_client(void *arg)
+{
+  HttpClient *client = (HttpClient *)arg;
+  HttpRequest *request, *next;
+  CURLMsg *msg;
+  int still_running, msgs_left;
+
+  for (;;) {
+    if (!g_atomic_int_get(&client->running) && (client->active == NULL ||
+        g_get_monotonic_time() - client->stop_time > HTTP_STOP_GRACE_MS * 1000))
+      break;
+    for (request = take_pending_requests(client); request; request = next) {
+      next = request->next;
+      start_http_request(client, request);
+    }
+
+    curl_multi_perform(client->multi, &still_running);
+    while ((msg = curl_multi_info_read(client->multi, &msgs_left)) != NULL) {
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&request);
+      end_http_request(client, request, msg->data.result);
+    }
+
+    curl_multi_poll(client->multi, NULL, 0, g_atomic_int_get(&client->running) ? HTTP_POLL_MS : HTTP_POLL_MS / 10, NULL);     //woken early by curl_multi_wakeup()
+  }
+
+  abort_http_requests(client);
+
+  return 0;
+}
+
+
+gboolean init_http_client(HttpClient *client)
+{
+  memset(client, 0, sizeof(*client));
+  if (curl_global_init(CURL_GLOBAL_ALL) != CURLE_OK) {
+    glog_error("curl_global_init failed\n");
+    return FALSE;
+  }
+
+  client->multi = curl_multi_init();
+  if (client->multi == NULL) {
+    glog_error("curl_multi_init failed\n");
+    curl_global_cleanup();
+    return FALSE;
+  }
+  curl_multi_setopt(client->multi, CURLMOPT_MAXCONNECTS, (long)HTTP_MAX_CONNECTS);
+  curl_multi_setopt(client->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)HTTP_MAX_CONNECTS);       //bursts wait for a cached connection
+  g_mutex_init(&client->lock);
+
+  client->running = 1;
+  if (pthread_create(&client->tid, NULL, run_http_client, client) != 0) {
+    glog_error("can not start the http client thread\n");
+    client->running = 0;
+    g_mutex_clear(&client->lock);
+    curl_multi_cleanup(client->multi);
+    client->multi = NULL;
+    curl_global_cleanup();
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+// Requests still in flight after HTTP_STOP_GRACE_MS end with CURLE_ABORTED_BY_CALLBACK
+void free_http_client(HttpClient *client)
+{
+  if (client->multi == NULL)
+    return;
+
+  client->stop_time = g_get_monotonic_time();
+  g_atomic_int_set(&client->running, 0);
+  curl_multi_wakeup(client->multi);
+  pthread_join(client->tid, NULL);
+  abort_http_requests(client);                    //submitted while the thread was stopping
+
+  glog_trace("http client requests=%d failed=%d connects=%d\n", g_atomic_int_get(&client->requests),
+    g_atomic_int_get(&client->failed), g_atomic_int_get(&client->connects));
+  curl_multi_cleanup(client->multi);
+  client->multi = NULL;
+  g_mutex_clear(&client->lock);
+  curl_global_cleanup();
+}
+
+
+// Any thread : hand the request to the client thread, never waits for the network.
+// The client owns the request from here, even when FALSE is returned (client not running)
+gboolean submit_http_request(HttpClient *client, HttpRequest *request)
+{
+  if (request == NULL)
+    return FALSE;
+  if (client->multi == NULL || !g_atomic_int_get(&client->running)) {
+    glog_error("http client is not running\n");
+    free_http_request(request);
+    return FALSE;
+  }
+
+  request->submit_time = g_get_monotonic_time();
+  request->next = NULL;
+  g_mutex_lock(&client->lock);
+  if (client->pending_tail)
+    client->pending_tail->next = request;
+  else
+    client->pending = request;
+  client->pending_tail = request;
+  g_mutex_unlock(&client->lock);
+  g_atomic_int_inc(&client->requests);
+  curl_multi_wakeup(client->multi);
+
+  return TRUE;
+}
+
+
+static void on_http_waited(HttpRequest *request, gpointer user_data)
+{
+  HttpWaiter *waiter = (HttpWaiter *)user_data;
+
+  g_mutex_lock(&waiter->lock);
+  waiter->result = request->result;
+  waiter->status = request->status;
+  waiter->response = request->response;
+  request->response = NULL;                       //handed to the waiter
+  waiter->done = TRUE;
+  g_cond_signal(&waiter->cond);
+  g_mutex_unlock(&waiter->lock);
+}
+
+
+// Blocking form of submit_http_request() for the callers that need the answer (login, global ip), the
+// request still goes through the shared connections. Never call it from a done callback.
+// The response is NUL terminated, g_free() it
+gboolean perform_http_request(HttpClient *client, HttpRequest *request, long *status, char **response)
+{
+  HttpWaiter waiter;
+
+  if (request == NULL)
+    return FALSE;
+  if (client->multi && pthread_equal(pthread_self(), client->tid)) {
+    glog_error("perform_http_request called on the http client thread\n");
+    free_http_request(request);
+    return FALSE;
+  }
+
+  memset(&waiter, 0, sizeof(waiter));
+  g_mutex_init(&waiter.lock);
+  g_cond_init(&waiter.cond);
+  request->done = on_http_waited;
+  request->user_data = &waiter;
+
+  if (submit_http_request(client, request)) {
+    g_mutex_lock(&waiter.lock);
+    while (!waiter.done)
+      g_cond_wait(&waiter.cond, &waiter.lock);
+    g_mutex_unlock(&waiter.lock);
+  }
+  else {
+    waiter.result = CURLE_FAILED_INIT;
+  }
+  g_cond_clear(&waiter.cond);
+  g_mutex_clear(&waiter.lock);
+
+  if (status)
+    *status = waiter.status;
+  if (response)
+    *response = waiter.response;
+  else
+    g_free(waiter.response);
+
+  return waiter.result == CURLE_OK;
+}
+
+
+#ifdef TEST_HTTP_CLIENT
+// Local stand-in of the server on 127.0.0.1 : keep-alive HTTP/1.1, "/slow" answers after 2 sec, "/late" after 0.3 sec.
+// Checks connection reuse, bursts, per-request timeouts and shutdown with requests in flight
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "test_check.h"
+
+#define TEST_BURST          16
+
+static int test_port;
+static gint test_accepted = 0;
+static gint test_done = 0;
+static gint test_ok = 0;
+static gint test_timeouts = 0;
+static gint test_aborted = 0;
+static gint64 test_fast_elapsed = 0;
+
+static void *serve_connection(void *arg)
+{
+  int fd = GPOINTER_TO_INT(arg);
+  char buf[8192], reply[512], path[64];
+  int len = 0, n;
+
+  for (;;) {
+    char *end;
+    while ((end = g_strstr_len(buf, len, "\r\n\r\n")) == NULL) {
+      if (len >= (int)sizeof(buf) - 1 || (n = read(fd, buf + len, sizeof(buf) - 1 - len)) <= 0) {
+        close(fd);
+        return 0;
+      }
+      len += n;
+      buf[len] = 0;
+    }
+    int header_len = end + 4 - buf;
+    int body_len = 0;
+    char *field = strstr(buf, "Content-Length:");
+    if (field && field < end)
+      body_len = atoi(field + 15);
+    sscanf(buf, "%*s %63s", path);
+    while (len < header_len + body_len && len < (int)sizeof(buf) - 1 && (n = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0)
+      len += n;
+    if (strcmp(path, "/slow") == 0)
+      sleep(2);
+    else if (strcmp(path, "/late") == 0)
+      usleep(300000);
+
+    char body[128];
+    int size = snprintf(body, sizeof(body), "ok %s %d", path, body_len);
+    n = snprintf(reply, sizeof(reply), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\nConnection: keep-alive\r\n\r\n%s", size, body);
+    if (send(fd, reply, n, MSG_NOSIGNAL) != n) {
+      close(fd);
+      return 0;
+    }
+    n = MIN(len, header_len + body_len);
+    memmove(buf, buf + n, len - n);
+    len -= n;
+    buf[len] = 0;
+  }
+}
+
+static void *run_server(void *arg)
+{
+  int listen_fd = GPOINTER_TO_INT(arg);
+
+  for (;;) {
+    pthread_t tid;
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0)
+      return 0;
+    g_atomic_int_inc(&test_accepted);
+    pthread_create(&tid, NULL, serve_connection, GINT_TO_POINTER(fd));
+    pthread_detach(tid);
+  }
+}
+
+static int start_server(void)
+{
+  struct sockaddr_in addr = {0};
+  socklen_t addr_len = sizeof(addr);
+  pthread_t tid;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0)
+    return -1;
+  getsockname(fd, (struct sockaddr *)&addr, &addr_len);
+  pthread_create(&tid, NULL, run_server, GINT_TO_POINTER(fd));
+
+  return ntohs(addr.sin_port);
+}
+
+static void on_test_done(HttpRequest *request, gpointer user_data)
+{
+  if (request->result == CURLE_OK && request->status == 200 && strncmp(request->response, "ok ", 3) == 0)
+    g_atomic_int_inc(&test_ok);
+  else if (request->result == CURLE_OPERATION_TIMEDOUT)
+    g_atomic_int_inc(&test_timeouts);
+  else if (request->result == CURLE_ABORTED_BY_CALLBACK)
+    g_atomic_int_inc(&test_aborted);
+  if (user_data)
+    test_fast_elapsed = request->elapsed;
+  g_atomic_int_inc(&test_done);
+}
+
+static gboolean wait_test_done(int count, int timeout_ms)
+{
+  for (int i = 0; i < timeout_ms / 10 && g_atomic_int_get(&test_done) < count; i++)
+    usleep(10000);
+  return g_atomic_int_get(&test_done) >= count;
+}
+
+static HttpRequest *new_test_request(const char *path, HttpDoneFunc done, gpointer user_data)
+{
+  char url[128];
+
+  snprintf(url, sizeof(url), "http://127.0.0.1:%d%s", test_port, path);
+  return new_http_request(url, done, user_data);
+}
+
+int main(int argc, char *argv[])
+{
+  HttpClient client;
+  HttpRequest *request;
+  int failed = 0, reused = 0;
+  long status;
+  char *response;
+
+  test_port = start_server();
+  if (test_port < 0 || !init_http_client(&client)) {
+    printf("FAILED to start\n");
+    return 1;
+  }
+
+  for (int i = 0; i < 10; i++) {
+    request = new_test_request("/login", NULL, NULL);
+    set_http_body(request, "{\"phone\":\"0\",\"password\":\"0\"}");
+    if (perform_http_request(&client, request, &status, &response) && status == 200 && strcmp(response, "ok /login 28") == 0)
+      reused++;
+    g_free(response);
+  }
+  failed += check(reused == 10, "blocking requests answered from memory");
+  failed += check(g_atomic_int_get(&test_accepted) == 1, "one connection for 10 requests");
+
+  for (int i = 0; i < TEST_BURST; i++) {
+    request = new_test_request("/api/notification/create/", on_test_done, NULL);
+    add_http_form_data(request, "camera", "ITC100A");
+    add_http_form_data(request, "notificationCategory", "3");
+    add_http_form_buffer(request, "image", "\xff\xd8\xff\xd9", 4, "thumbnail.jpg", "image/jpeg");
+    submit_http_request(&client, request);
+  }
+  failed += check(wait_test_done(TEST_BURST, 5000) && test_ok == TEST_BURST, "burst of multipart posts");
+  failed += check(g_atomic_int_get(&test_accepted) <= HTTP_MAX_CONNECTS, "burst within the connection limit");
+
+  request = new_test_request("/slow", on_test_done, NULL);
+  set_http_timeout(request, 300, HTTP_CONNECT_TIMEOUT_MS);
+  submit_http_request(&client, request);
+  submit_http_request(&client, new_test_request("/fast", on_test_done, GINT_TO_POINTER(1)));
+  failed += check(wait_test_done(TEST_BURST + 2, 1000) && test_timeouts == 1, "slow request timed out");
+  failed += check(test_ok == TEST_BURST + 1 && test_fast_elapsed < 300000, "fast request not held by the slow one");
+
+  submit_http_request(&client, new_test_request("/slow", on_test_done, NULL));
+  submit_http_request(&client, new_test_request("/late", on_test_done, NULL));
+  usleep(100000);
+  free_http_client(&client);
+  failed += check(test_ok == TEST_BURST + 2, "request in flight finished within the grace time");
+  failed += check(test_done == TEST_BURST + 4 && test_aborted == 1, "request over the grace time aborted");
+  failed += check(!submit_http_request(&client, new_test_request("/fast", on_test_done, NULL)), "submit refused once stopped");
+
+  printf("accepted=%d fast=%" G_GINT64_FORMAT "us\n", g_atomic_int_get(&test_accepted), test_fast_elapsed);
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+
+  return failed ? 1 : 0;
+}
+#endif
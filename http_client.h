@@ -0,0 +1,76 @@
+#ifndef __HTTP_CLIENT_H__
+#define __HTTP_CLIENT_H__
+
+// One long lived curl multi handle on its own thread. The multi handle owns the connection and DNS caches,
+// so every request to the server reuses the same keep-alive connection instead of a new lookup and handshake.
+#include <glib.h>
+#include <pthread.h>
+#include <curl/curl.h>
+
+#define HTTP_TIMEOUT_MS             10000           //whole request, default of new_http_request()
+#define HTTP_CONNECT_TIMEOUT_MS     5000
+#define HTTP_MAX_CONNECTS           4               //connections kept open in the multi handle cache, and per host
+#define HTTP_KEEPALIVE_IDLE         30              //sec, TCP keep-alive probes of the idle cached connections
+#define HTTP_DNS_CACHE_TIMEOUT      600             //sec
+#define HTTP_POLL_MS                1000            //longest sleep of the client thread, submit wakes it at once
+#define HTTP_STOP_GRACE_MS          1000            //free_http_client() lets the requests in flight finish this long
+
+typedef struct _HttpRequest HttpRequest;
+
+// Called on the client thread once the request is over, the request is freed when it returns
+typedef void (*HttpDoneFunc)(HttpRequest *request, gpointer user_data);
+
+struct _HttpRequest {
+  CURL *curl;
+  struct curl_slist *headers;
+  curl_mime *form;
+  char *body;                     // POSTFIELDS, owned
+  long timeout_ms;
+  long connect_timeout_ms;
+  HttpDoneFunc done;
+  gpointer user_data;
+
+  // result, valid in done()
+  CURLcode result;                // CURLE_ABORTED_BY_CALLBACK when the client stopped before the request ended
+  long status;                    // HTTP status, 0 without a response
+  char *response;                 // body of the response, always NUL terminated
+  size_t response_len;
+  gint64 submit_time;             // g_get_monotonic_time() of submit_http_request()
+  gint64 elapsed;                 // usec from submit to done
+  long new_connects;              // connections opened for the request, 0 when a cached one was reused
+
+  HttpRequest *next;
+};
+
+typedef struct {
+  CURLM *multi;
+  pthread_t tid;
+  gint running;
+  gint64 stop_time;               // free_http_client(), the requests in flight get HTTP_STOP_GRACE_MS from it
+  GMutex lock;                    // pending list
+  HttpRequest *pending;           // submitted, not yet handed to the multi handle
+  HttpRequest *pending_tail;
+  HttpRequest *active;            // requests in the multi handle, client thread only
+  gint requests;                  // counters, read by anyone
+  gint failed;
+  gint connects;
+} HttpClient;
+
+
+gboolean init_http_client(HttpClient *client);
+void free_http_client(HttpClient *client);
+
+HttpRequest *new_http_request(const char *url, HttpDoneFunc done, gpointer user_data);
+void free_http_request(HttpRequest *request);
+void add_http_header(HttpRequest *request, const char *header);
+void set_http_body(HttpRequest *request, const char *body);
+void add_http_form_data(HttpRequest *request, const char *name, const char *data);
+void add_http_form_file(HttpRequest *request, const char *name, const char *path);
+void add_http_form_buffer(HttpRequest *request, const char *name, const void *data, size_t size,
+                          const char *filename, const char *type);
+void set_http_timeout(HttpRequest *request, long timeout_ms, long connect_timeout_ms);
+
+gboolean submit_http_request(HttpClient *client, HttpRequest *request);
+gboolean perform_http_request(HttpClient *client, HttpRequest *request, long *status, char **response);
+
+#endif
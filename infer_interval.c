@@ -0,0 +1,34 @@
+#include "infer_interval.h"
+
+
+void init_infer_interval(InferInterval *ctl, int interval)
+{
+  ctl->interval = interval;
+  ctl->quiet_ticks = 0;
+}
+
+
+// Interval of the next tick from the activity of the last one. Moving objects or pending events bring
+// min_interval back at once, a quiet scene doubles the interval every hold_ticks up to max_interval.
+// A moving PTZ goes to max_interval, the tracker carries the objects until the new view settles
+int update_infer_interval(InferInterval *ctl, const InferIntervalConfig *config, gboolean active, gboolean ptz_moving)
+{
+  if (config->max_interval <= config->min_interval) {
+    init_infer_interval(ctl, config->min_interval);
+    return ctl->interval;
+  }
+
+  if (ptz_moving) {
+    ctl->interval = config->max_interval;
+    ctl->quiet_ticks = 0;
+  }
+  else if (active) {
+    init_infer_interval(ctl, config->min_interval);
+  }
+  else if (++ctl->quiet_ticks >= MAX(config->hold_ticks, 1)) {
+    ctl->interval = CLAMP(ctl->interval * 2 + 1, config->min_interval, config->max_interval);     //0 1 3 7 15 ...
+    ctl->quiet_ticks = 0;
+  }
+
+  return ctl->interval;
+}
@@ -0,0 +1,27 @@
+#ifndef __INFER_INTERVAL_H__
+#define __INFER_INTERVAL_H__
+
+#include <glib.h>
+
+#define INFER_INTERVAL_HOLD_DEFAULT       5       //quiet ticks before each stretch of the interval
+#define INFER_MOTION_THRESHOLD_DEFAULT    8       //pixels a bbox center moves in one tick to count as moving
+
+// Bounds of the nvinfer "interval" of one camera : min_interval (nv_interval) while something happens,
+// up to max_interval (nv_interval_max) on a static scene. max_interval <= min_interval keeps min_interval
+typedef struct {
+  int min_interval;
+  int max_interval;
+  int hold_ticks;           // quiet ticks before each stretch, the hysteresis against a cow twitching
+} InferIntervalConfig;
+
+// Controller of one camera, driven once per analytics tick by its worker
+typedef struct {
+  int interval;             // interval for the next tick
+  int quiet_ticks;          // quiet ticks since the last change
+} InferInterval;
+
+
+void init_infer_interval(InferInterval *ctl, int interval);
+int update_infer_interval(InferInterval *ctl, const InferIntervalConfig *config, gboolean active, gboolean ptz_moving);
+
+#endif
@@ -0,0 +1,239 @@
+// Per-camera analytics cost as the camera count grows, with the threading of nvds_process.c : every camera has
+// a producer thread standing for its OSD probe (slot lookup, FrameRecord copy, slot expiry on tick frames) and
+// an analytics worker draining its AnalyticsRing into process_frame_record(). Frames are synthetic, no pipeline.
+//
+//   multi_cam_bench [max_cams] [frames] [objs]
+//
+// Prints one "key=value" line per camera count. worker_ns_per_frame is the process_frame_record() time of one
+// camera, it should stay flat while 2 * cams <= cores. realtime_x is how many times faster than BENCH_FPS every
+// camera ran. A producer that finds its ring full waits for the worker instead of dropping, ring_full counts it.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "g_log.h"
+#include "analytics_core.h"
+#include "infer_interval.h"
+
+#define BENCH_FPS                 15              //nominal source fps of the barn cameras
+#define BENCH_MAX_CAMS            8               //MAX_DEVICE_CNT of config.h
+#define BENCH_CHURN_FRAMES        (BENCH_FPS * 10)   //a tenth of the tracker ids are replaced this often
+
+typedef struct {
+  int cam_idx;
+  int frames;
+  int objs;
+  guint64 id_base;          // tracker ids of this camera start here
+  guint64 churn;            // rounds of replaced tracker ids
+  ObjSlotMap slots;         // probe side
+  AnalyticsRing ring;
+  gint done;                // producer wrote its last frame
+  long ring_full;           // times the producer found the ring full
+  gint64 worker_ns;         // time spent in process_frame_record()
+  int records;
+  gint64 start_ns;          // producer started its first frame
+  double wall_ns;           // first frame produced to last frame processed
+} BenchCam;
+
+static pthread_barrier_t g_start_barrier;
+static gint g_events[BENCH_MAX_CAMS];
+static AnalyticsSetting g_bench_setting;      //every camera gets a copy and runs its own event rules
+
+
+static inline gint64 get_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (gint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static void on_event(int cam_idx, int obj_id, int class_id)
+{
+  g_atomic_int_inc(&g_events[cam_idx]);
+}
+
+
+// Same work as the object loop of osd_sink_pad_buffer_probe() and expire_obj_slots() on tick frames
+static void fill_record(BenchCam *cam, FrameRecord *rec, int frame, int tick)
+{
+  ObjSlotMap *map = &cam->slots;
+
+  if (frame > 0 && frame % BENCH_CHURN_FRAMES == 0)
+    cam->churn++;
+
+  rec->pts = (guint64)frame * G_GUINT64_CONSTANT(1000000000) / BENCH_FPS;
+  rec->tick = tick;
+  rec->reset = 0;
+  rec->inferred = 1;
+  rec->tick_frames = BENCH_FPS;
+  rec->tick_inferred_frames = BENCH_FPS;
+  rec->num_objs = 0;
+  rec->num_expired = 0;
+  for (int n = 0; n < cam->objs; n++) {
+    guint64 object_id = cam->id_base + n + ((n < cam->objs / 10) ? cam->churn * NUM_OBJS : 0);    //first tenth leaves and comes back with new ids
+    int slot = acquire_obj_slot(map, object_id);
+    if (slot < 0 || rec->num_objs >= ANALYTICS_RECORD_OBJS)
+      continue;
+    ObjRecord *obj = &rec->objs[rec->num_objs++];
+    obj->slot = (short)slot;
+    obj->generation = map->slots[slot].generation;
+    obj->class_id = (n % 8 == 0) ? CLASS_HEAT_COW : CLASS_NORMAL_COW;
+    obj->confidence = 0.9f;
+    obj->x = (short)((n % 16) * 80 + (frame & 7));
+    obj->y = (short)((n / 16) * 60);
+    obj->width = 80;
+    obj->height = 60;
+    obj->temp = ANALYTICS_NO_VALUE;
+    obj->flow = ANALYTICS_NO_VALUE;
+    obj->heat_vote = 0;
+  }
+
+  if (!tick)
+    return;
+  map->tick++;
+  for (int i = map->active_count - 1; i >= 0; i--) {
+    int obj_id = map->active[i];
+    if (map->tick - map->slots[obj_id].last_tick > OBJ_SLOT_EXPIRE_SEC) {
+      release_obj_slot(map, obj_id);
+      rec->expired[rec->num_expired++] = (short)obj_id;
+    }
+  }
+}
+
+
+static void *producer_thread(void *arg)
+{
+  BenchCam *cam = (BenchCam *)arg;
+  FrameRecord *rec;
+
+  pthread_barrier_wait(&g_start_barrier);
+  cam->start_ns = get_ns();
+  for (int frame = 0; frame < cam->frames; frame++) {
+    while ((rec = get_ring_write_record(&cam->ring)) == NULL) {
+      cam->ring_full++;
+      sched_yield();
+    }
+    fill_record(cam, rec, frame, (frame % BENCH_FPS) == (BENCH_FPS - 1));
+    commit_ring_write(&cam->ring);
+  }
+  g_atomic_int_set(&cam->done, 1);
+  wake_ring_reader(&cam->ring);
+
+  return NULL;
+}
+
+
+// Same loop as analytics_worker()
+static void *worker_thread(void *arg)
+{
+  BenchCam *cam = (BenchCam *)arg;
+  AnalyticsState *state = get_analytics_state(cam->cam_idx);
+  FrameRecord *rec;
+
+  while (cam->records < cam->frames) {
+    rec = wait_ring_read_record(&cam->ring);
+    if (rec == NULL) {
+      if (g_atomic_int_get(&cam->done) && g_atomic_int_get(&cam->ring.head) == g_atomic_int_get(&cam->ring.tail))
+        break;
+      continue;
+    }
+    gint64 start = get_ns();
+    process_frame_record(state, rec);
+    cam->worker_ns += get_ns() - start;
+    cam->records++;
+    release_ring_read(&cam->ring);
+  }
+  cam->wall_ns = (double)(get_ns() - cam->start_ns);
+
+  return NULL;
+}
+
+
+static void run(int num_cams, int frames, int objs)
+{
+  BenchCam *cams = g_new0(BenchCam, num_cams);
+  pthread_t *producers = g_new0(pthread_t, num_cams);
+  pthread_t *workers = g_new0(pthread_t, num_cams);
+  double worker_sum = 0.0, worker_max = 0.0, wall_max = 0.0;
+  long ring_full = 0;
+  int events = 0;
+
+  //allocated per run like setup_nv_analysis() does for g_config.device_cnt
+  init_analytics_core(num_cams);
+  for (int i = 0; i < num_cams; i++) {
+    BenchCam *cam = &cams[i];
+    cam->cam_idx = i;
+    cam->frames = frames;
+    cam->objs = objs;
+    cam->id_base = (guint64)i << 32;
+    get_analytics_state(i)->setting = g_bench_setting;
+    get_analytics_state(i)->setting.source_cam_idx = i;
+    init_obj_slot_map(&cam->slots);
+    init_analytics_ring(&cam->ring, ANALYTICS_RING_DEPTH);
+    g_atomic_int_set(&g_events[i], 0);
+  }
+
+  pthread_barrier_init(&g_start_barrier, NULL, num_cams);
+  for (int i = 0; i < num_cams; i++) {
+    pthread_create(&workers[i], NULL, worker_thread, &cams[i]);
+    pthread_create(&producers[i], NULL, producer_thread, &cams[i]);
+  }
+  for (int i = 0; i < num_cams; i++) {
+    BenchCam *cam = &cams[i];
+    pthread_join(producers[i], NULL);
+    pthread_join(workers[i], NULL);
+    double worker_ns = (double)cam->worker_ns / MAX(cam->records, 1);
+    worker_sum += worker_ns;
+    worker_max = MAX(worker_max, worker_ns);
+    wall_max = MAX(wall_max, cam->wall_ns);
+    ring_full += cam->ring_full;
+    events += g_atomic_int_get(&g_events[i]);
+    free_analytics_ring(&cam->ring);
+  }
+  pthread_barrier_destroy(&g_start_barrier);
+
+  printf("cams=%d objs=%d frames=%d worker_ns_per_frame_avg=%.1f worker_ns_per_frame_max=%.1f realtime_x=%.0f ring_full=%ld events=%d\n",
+         num_cams, objs, frames, worker_sum / num_cams, worker_max,
+         ((double)frames * G_GINT64_CONSTANT(1000000000) / BENCH_FPS) / MAX(wall_max, 1.0), ring_full, events);
+
+  free_analytics_core();
+  g_free(workers);
+  g_free(producers);
+  g_free(cams);
+}
+
+
+int main(int argc, char *argv[])
+{
+  int max_cams = (argc > 1) ? atoi(argv[1]) : BENCH_MAX_CAMS;
+  int frames = (argc > 2) ? atoi(argv[2]) : BENCH_FPS * 600;
+  int objs = (argc > 3) ? atoi(argv[3]) : 64;
+
+  if (max_cams < 1 || max_cams > BENCH_MAX_CAMS || frames < 1 || objs < 1 || objs > ANALYTICS_RECORD_OBJS) {
+    fprintf(stderr, "usage: %s [max_cams <= %d] [frames] [objs <= %d]\n", argv[0], BENCH_MAX_CAMS, ANALYTICS_RECORD_OBJS);
+    return 1;
+  }
+  set_glog_level(GLOG_ERROR);       //only errors of the core, the output stays one line per camera count
+
+  AnalyticsSetting *setting = &g_bench_setting;
+  setting->temp_apply = 0;
+  setting->opt_flow_apply = 0;
+  setting->resnet50_apply = 0;
+  setting->threshold_upper_temp = THRESHOLD_UPPER_TEMP_DEFAULT;
+  setting->threshold_under_temp = THRESHOLD_UNDER_TEMP_DEFAULT;
+  setting->motion_threshold = INFER_MOTION_THRESHOLD_DEFAULT;
+  setting->preset_memory_time = PRESET_MEMORY_TIME_DEFAULT;
+  set_analytics_event_func(on_event);
+
+  printf("cores=%ld sizeof_obj_store=%zu\n", sysconf(_SC_NPROCESSORS_ONLN), sizeof(ObjStore));
+  for (int num_cams = 1; num_cams <= max_cams; num_cams++)
+    run(num_cams, frames, objs);
+
+  return 0;
+}
@@ -29,39 +29,26 @@
 #include "nvds_utils.h"
 
 
-int g_cam_index = 0;
-int g_noti_cam_idx = 0;
 int g_top = 0, g_left = 0, g_width = 0, g_height = 0;
 int g_move_to_center_running = 0;
-int g_frame_count[2];
 static pthread_t g_tid;
-pthread_mutex_t g_notifier_mutex;
-int g_event_class_id = CLASS_NORMAL_COW;
+static EventQueue g_event_queue;            //analytics workers and socket_comm -> notifier
+static gint g_notifier_exit = 0;
 int g_notifier_running = 0;
 #if 0
 Timer timers[MAX_PTZ_PRESET];
 #endif
 
-ObjMonitor obj_info[NUM_CAMS][NUM_OBJS];
+// The core and the projection can not see ptz_control.h, their preset tables are sized by hand
+G_STATIC_ASSERT(ANALYTICS_MAX_PRESETS == MAX_PTZ_PRESET);
+G_STATIC_ASSERT(PROJECTION_MAX_PRESETS == MAX_PTZ_PRESET);
 
-int threshold_event_duration[NUM_CLASSES] = 
-{ 
-  0,          //NORMAL
-  15,         //HEAT
-  15,         //FLIP
-  15,         //LABOR SIGN
-  0,          //NORMAL_SITTING
-};         
-
-
-float threshold_confidence[NUM_CLASSES] = 
-{ 
-  0.2,        //NORMAL
-  0.8,        //HEAT
-  0.8,        //FLIP
-  0.8,        //LABOR SIGN
-  0.2,        //NORMAL_SITTING
-};         
+ObjSlotMap *g_obj_slots = NULL;             //tracker object_id -> obj_store[cam] index
+static AnalyticsCtx *g_analytics_ctx = NULL;
+#if THERMAL_TEMP_INCLUDE
+static ThermalProjection g_projection;              //"thermal_calibration_path" of config.json, read only once loaded
+static ProjectionMailbox g_projection_mailbox;      //RGB probe -> thermal probe
+#endif
 
 
 void set_tracker_analysis(gboolean OnOff)
@@ -84,28 +71,84 @@ void set_tracker_analysis(gboolean OnOff)
 }
 
 
+static GMutex g_infer_interval_lock;        //nvinfer "interval" of the cameras, set_process_analysis() and the workers' controllers
+static gboolean g_analysis_on = FALSE;      //under g_infer_interval_lock, the controllers leave nvinfer alone while off
+
+
+static gboolean set_nvinfer_interval(int cam_idx, gint interval)
+{
+  char element_name[32];
+  GstElement *nvinfer;
+
+  sprintf(element_name, "nvinfer_%d", cam_idx+1);
+  nvinfer = gst_bin_get_by_name (GST_BIN (g_pipeline), element_name);
+  if (nvinfer == NULL){
+    glog_trace ("Fail get %s element\n", element_name);
+    return FALSE;
+  }
+  g_object_set(G_OBJECT(nvinfer), "interval", interval, NULL);
+  g_clear_object (&nvinfer);
+
+  return TRUE;
+}
+
+
+// nvinfer interval of a camera with the analysis on. On a calibrated preset the thermal camera takes the
+// RGB detections and only runs its own every validate_interval frames
+static gint get_analysis_interval(int cam_idx, gint interval)
+{
+#if THERMAL_TEMP_INCLUDE
+  if (cam_idx == THERMAL_CAM && get_preset_homography(&g_projection, g_preset_index))
+    return g_projection.validate_interval;
+#endif
+  return interval;
+}
+
+
+// Worker : nvinfer interval of the camera for the next tick. Short while objects move or an event is being
+// counted, stretched on a static scene or while the PTZ moves (nv_interval_max, nv_interval_hold)
+static void update_nvinfer_interval(AnalyticsCtx *ctx)
+{
+  InferIntervalConfig config = { g_setting.nv_interval, g_setting.nv_interval_max, g_setting.nv_interval_hold };
+  AnalyticsState *state = ctx->state;
+
+  if (g_atomic_int_compare_and_exchange(&ctx->interval_reset, 1, 0))
+    init_infer_interval(&ctx->infer_interval, config.min_interval);
+  int interval = update_infer_interval(&ctx->infer_interval, &config, state->moving_objs > 0 || state->pending_objs > 0,
+                                       state->setting.ptz_move_speed > 0);
+  interval = get_analysis_interval(ctx->cam_idx, interval);
+
+  g_mutex_lock(&g_infer_interval_lock);
+  if (g_analysis_on && interval != ctx->applied_interval && set_nvinfer_interval(ctx->cam_idx, interval)) {
+    glog_trace("cam_idx=%d nvinfer interval %d -> %d moving=%d pending=%d\n", ctx->cam_idx, ctx->applied_interval, interval, 
+      state->moving_objs, state->pending_objs);
+    ctx->applied_interval = interval;
+  }
+  g_mutex_unlock(&g_infer_interval_lock);
+}
+
+
 void set_process_analysis(gboolean OnOff)
 {
   glog_trace("set_process_analysis analysis_status[%d] OnOff[%d] nv_interval[%d]\n", 
     g_setting.analysis_status, OnOff, g_setting.nv_interval);
 
   if (OnOff == 0)
-    check_events_for_notification(0, 1);        //first parameter is don't care
+    reset_analytics_objects();
 
+  g_mutex_lock(&g_infer_interval_lock);
+  g_analysis_on = OnOff ? TRUE : FALSE;
   for(int cam_idx = 0; cam_idx < g_config.device_cnt; cam_idx++) {
     char element_name[32];
-    GstElement *nvinfer;
-    sprintf(element_name, "nvinfer_%d", cam_idx+1);
-    nvinfer = gst_bin_get_by_name (GST_BIN (g_pipeline), element_name);
-    if (nvinfer == NULL){
-      glog_trace ("Fail get %s element\n", element_name);
+    gint interval = OnOff ? get_analysis_interval(cam_idx, g_setting.nv_interval) : G_MAXINT;
+
+    if (!set_nvinfer_interval(cam_idx, interval))
       continue;
+    if (g_analytics_ctx && cam_idx < g_num_cams) {
+      g_analytics_ctx[cam_idx].applied_interval = interval;
+      g_atomic_int_set(&g_analytics_ctx[cam_idx].interval_reset, 1);    //restart from nv_interval, the new view is not known yet
     }
 
-    gint interval = OnOff ? g_setting.nv_interval : G_MAXINT;
-    g_object_set(G_OBJECT(nvinfer), "interval", interval, NULL);
-    g_clear_object (&nvinfer);
-
     GstElement *dspostproc;
     sprintf(element_name, "dspostproc_%d", cam_idx+1);
     dspostproc = gst_bin_get_by_name (GST_BIN (g_pipeline), element_name);
@@ -118,6 +161,7 @@ void set_process_analysis(gboolean OnOff)
     g_object_set(G_OBJECT(dspostproc), "reset-object", rest_val, NULL);
     g_clear_object (&dspostproc);
   } 
+  g_mutex_unlock(&g_infer_interval_lock);
 }
 
 
@@ -145,32 +189,27 @@ int is_process_running(const char *process_name)
 
 void wait_recording_finish()
 {
-  const char *process_name = "webrtc_event_recorder";     
-
-  while(1) {
-    int result = is_process_running(process_name);
-    if (result == 1) 
-      sleep(1);
-    else
-      break;
+  while(is_event_recording()) {
+    sleep(1);
   }
-  glog_trace("%s ended\n", process_name);
+  glog_trace("event clip ended\n");
 }
 
 
-int send_notification_to_server(int class_id)
+int send_notification_to_server(const NotifyEvent *event)
 {
   char event_id[2] = {0};
+  int class_id = event->class_id;
   int cam_idx = RGB_CAM;
 
   event_id[0] = class_id + '0'; 
   glog_trace("try sending class_id=%d, enable_event_notify=%d\n", class_id, g_setting.enable_event_notify);
   if(g_setting.enable_event_notify) {
     if (g_curlinfo.position[0] == 0) {
-      cam_idx = g_noti_cam_idx;       //eventually this will be same with g_source_cam_idx
-      glog_trace("g_noti_cam_idx=%d,g_source_cam_idx=%d\n", g_noti_cam_idx, g_source_cam_idx);
-      if (g_noti_cam_idx != g_source_cam_idx){
-        glog_trace("g_noti_cam_idx=%d and g_source_cam_idx=%d are different, so return\n", g_noti_cam_idx, g_source_cam_idx);
+      cam_idx = event->cam_idx;                         //eventually this will be same with g_source_cam_idx
+      glog_trace("event cam_idx=%d,g_source_cam_idx=%d\n", cam_idx, g_source_cam_idx);
+      if (cam_idx != g_source_cam_idx){
+        glog_trace("event cam_idx=%d and g_source_cam_idx=%d are different, so return\n", cam_idx, g_source_cam_idx);
         return FALSE;
       }
     }
@@ -182,7 +221,13 @@ int send_notification_to_server(int class_id)
     if (trigger_event_record(cam_idx, g_curlinfo.video_url) == TRUE) {
 #if NOTI_BLOCK_FOR_TEST     
 #else	    
-      notification_request(g_config.camera_id, event_id, &g_curlinfo); 
+      unsigned char *thumbnail = NULL;
+      unsigned long thumbnail_size = 0;
+      AnalyticsCtx *ctx = get_analytics_ctx(event->cam_idx);
+      if (ctx && !take_thumbnail(&ctx->thumbnails, event->thumbnail_seq, THUMBNAIL_WAIT_MS, &thumbnail, &thumbnail_size) && event->thumbnail_seq)
+        glog_trace("no thumbnail for cam_idx=%d obj_id=%d, full snapshot sent\n", event->cam_idx, get_obj_handle_slot(event->obj));
+      notification_request(g_config.camera_id, event_id, &g_curlinfo, thumbnail, (int)thumbnail_size); 
+      free(thumbnail);
 #endif
       glog_trace("notification_request cam_idx=%d,class_id=%d,position=%s\n", cam_idx, class_id, g_curlinfo.position);
       g_curlinfo.position[0] = 0;
@@ -195,24 +240,42 @@ int send_notification_to_server(int class_id)
 }
 
 
+// Notifier : log the queue counters when events were lost, a growing drop count means the notifier falls behind
+static void log_event_queue(EventQueue *queue, const NotifyEvent *event)
+{
+  static gint logged_dropped = 0;
+  int dropped = g_atomic_int_get(&queue->dropped);
+  int popped = g_atomic_int_get(&queue->popped);
+
+  glog_trace("event cam_idx=%d obj_id=%d class_id=%d bbox=%d,%d,%dx%d waited=%" G_GINT64_FORMAT "ms\n", event->cam_idx, get_obj_handle_slot(event->obj), 
+    event->class_id, event->x, event->y, event->width, event->height, (g_get_monotonic_time() - event->time) / 1000);
+  if (dropped == logged_dropped)
+    return;
+  glog_error("event queue pushed=%d popped=%d dropped=%d high_water=%d/%u latency avg=%" G_GINT64_FORMAT "ms max=%" G_GINT64_FORMAT "ms\n",
+    g_atomic_int_get(&queue->pushed), popped, dropped, g_atomic_int_get(&queue->high_water), queue->mask + 1,
+    popped ? queue->latency_total / popped / 1000 : 0, queue->latency_max / 1000);
+  logged_dropped = dropped;
+}
+
+
+// Notifier : sends the queued events one after the other, each one waits for its recording
 void *process_notification(void *arg)
 {
-  while(1) {
-    pthread_mutex_lock(&g_notifier_mutex);             //block and wait pthread_mutex_lock()
+  NotifyEvent event;
 
-    if(g_event_class_id == EVENT_EXIT) {
-      break;
-    }
-    else if(g_event_class_id != CLASS_NORMAL_COW && g_event_class_id != CLASS_NORMAL_COW_SITTING) {
-      g_notifier_running = 1;
-      glog_trace("g_notifier_running = %d\n", g_notifier_running);
-      if (send_notification_to_server(g_event_class_id) == TRUE) {
+  while(!g_atomic_int_get(&g_notifier_exit)) {
+    if (!pop_event_queue(&g_event_queue, &event))
+      continue;
+    log_event_queue(&g_event_queue, &event);
+    if(event.class_id != CLASS_NORMAL_COW && event.class_id != CLASS_NORMAL_COW_SITTING) {
+      g_atomic_int_set(&g_notifier_running, 1);
+      glog_trace("g_notifier_running = %d\n", 1);
+      if (send_notification_to_server(&event) == TRUE) {
         sleep(1);
         wait_recording_finish();
       }
-      g_event_class_id = CLASS_NORMAL_COW;
-      g_notifier_running = 0;
-      glog_trace("g_notifier_running = %d\n", g_notifier_running);
+      g_atomic_int_set(&g_notifier_running, 0);
+      glog_trace("g_notifier_running = %d\n", 0);
     }
   }
 
@@ -222,129 +285,39 @@ void *process_notification(void *arg)
 
 int is_notifier_running() 
 {
-  return g_notifier_running;
+  return g_atomic_int_get(&g_notifier_running);
 }
 
 
-void unlock_notification()
+// Queue an event for the notifier, never waits. Events that find the queue full are counted and lost
+void publish_event(int cam_idx, int class_id)
 {
-  if (!is_notifier_running()) {    
-      glog_trace("thread paused, unlock g_notifier_mutex, g_event_class_id=%d\n", g_event_class_id);
-      pthread_mutex_unlock(&g_notifier_mutex);                                 //unlock process_notification() thread to send event
-  } else {
-      glog_trace("thread is running\n");
-  }
-}
-
+  NotifyEvent event = {cam_idx, class_id, OBJ_HANDLE_NONE};
 
-void gather_event(int class_id, int obj_id, int cam_idx)
-{
-  if (obj_id < 0)
-    return;
-  if (class_id != CLASS_NORMAL_COW && class_id != CLASS_NORMAL_COW_SITTING) {
-    obj_info[cam_idx][obj_id].detected_frame_count++;
-    obj_info[cam_idx][obj_id].class_id = class_id;
-  }
+  if (!push_event_queue(&g_event_queue, &event))
+    glog_error("event queue full, cam_idx=%d class_id=%d lost\n", cam_idx, class_id);
 }
 
 
-void init_opt_flow(int cam_idx, int obj_id, int is_total)
+// Worker : receiver of the analytics core events, the object is the worker's own so its bbox is read here
+static void notify_analytics_event(int cam_idx, int obj_id, int class_id)
 {
-  if (g_setting.opt_flow_apply == 0) {
-    return;
-  }
-
-  obj_info[cam_idx][obj_id].opt_flow_check_count = 0;
-  obj_info[cam_idx][obj_id].move_size_avg = 0.0;
-  obj_info[cam_idx][obj_id].do_opt_flow = 0;
-  if (is_total) {
-    obj_info[cam_idx][obj_id].opt_flow_detected_count = 0;
-    obj_info[cam_idx][obj_id].prev_x = 0;
-    obj_info[cam_idx][obj_id].prev_y = 0;
-    obj_info[cam_idx][obj_id].prev_width = 0;
-    obj_info[cam_idx][obj_id].prev_height = 0;
-    obj_info[cam_idx][obj_id].x = 0;
-    obj_info[cam_idx][obj_id].y = 0;
-    obj_info[cam_idx][obj_id].width = 0;
-    obj_info[cam_idx][obj_id].height = 0;
-  }
-}
-
-
-#if RESNET_50
-void check_heat_count(int cam_idx, int obj_id)
-{
-  glog_trace("obj_info[%d][%d].heat_count=%d\n", cam_idx, obj_id, obj_info[cam_idx][obj_id].heat_count);
-  if (obj_info[cam_idx][obj_id].heat_count < HEAT_COUNT_THRESHOLD) {
-    obj_info[cam_idx][obj_id].notification_flag = 0;
-  }
-  obj_info[cam_idx][obj_id].heat_count = 0;
-}
-#endif
-
-
-void check_events_for_notification(int cam_idx, int init)
-{
-  if (init) {
-    for (int i = 0; i < NUM_CAMS; i++) {
-      for (int j = 0; j < NUM_OBJS; j++) {
-        obj_info[i][j].detected_frame_count = 0;
-        obj_info[i][j].duration = 0;
-        obj_info[i][j].temp_duration = 0;
-        obj_info[i][j].class_id = CLASS_NORMAL_COW;
-#if RESNET_50        
-        obj_info[i][j].heat_count = 0;
-#endif  
-        init_opt_flow(i, j, 1);
-      }
-    }
-    return;
-  }
-
-  for (int obj_id = 0; obj_id < NUM_OBJS; obj_id++) {
-    if (obj_info[cam_idx][obj_id].detected_frame_count >= (PER_CAM_SEC_FRAME - 1)) {    //if detection continued one second
-      // glog_trace("cam_idx=%d, obj_id=%d detected_frame_count=%d duration=%d\n", cam_idx, obj_id, obj_info[cam_idx][obj_id].detected_frame_count, obj_info[cam_idx][obj_id].duration);
-      obj_info[cam_idx][obj_id].duration++;
-      if (obj_info[cam_idx][obj_id].duration >= threshold_event_duration[obj_info[cam_idx][obj_id].class_id]) {   //if duration lasted more than designated time
-        obj_info[cam_idx][obj_id].duration = 0;
-        // check_for_zoomin(g_total_rect_size, detect_count);      //LJH, in progress
-        obj_info[cam_idx][obj_id].notification_flag = 1;                                          //send notification later
-#if RESNET_50
-        if (g_setting.resnet50_apply) {
-          if (obj_info[cam_idx][obj_id].class_id == CLASS_HEAT_COW) {
-            check_heat_count(cam_idx, obj_id);          //LJH, if heat count is zero, notification is cancelled
-          }
-        }
-#endif
-        glog_trace("[%d][%d].class_id=%d\n", cam_idx, obj_id, obj_info[cam_idx][obj_id].class_id);
-      }
-      
-      if (g_setting.opt_flow_apply) {
-        if (obj_info[cam_idx][obj_id].class_id == CLASS_FLIP_COW) {                     //if event was flip do optical flow analysis
-          obj_info[cam_idx][obj_id].do_opt_flow = 1;                                    //if detected frame count lasted equal or more than one second then do optical flow analysis
-        }
-        else {
-          init_opt_flow(cam_idx, obj_id, 0);
-        }
-      }
-    }
-    else {                        //if detection not continued for one second
-      obj_info[cam_idx][obj_id].duration = 0;
-      init_opt_flow(cam_idx, obj_id, 1);
-    }
-    obj_info[cam_idx][obj_id].detected_frame_count = 0;
+  NotifyEvent event = {cam_idx, class_id, OBJ_HANDLE_NONE};
+
+  if (obj_id >= 0) {
+    event.obj = OBJ_INFO_HANDLE(cam_idx, obj_id);
+    event.x = (short)OBJ_INFO(cam_idx, obj_id, x);
+    event.y = (short)OBJ_INFO(cam_idx, obj_id, y);
+    event.width = (short)OBJ_INFO(cam_idx, obj_id, width);
+    event.height = (short)OBJ_INFO(cam_idx, obj_id, height);
+    if (g_setting.enable_event_notify && class_id != CLASS_NORMAL_COW && class_id != CLASS_NORMAL_COW_SITTING)
+      event.thumbnail_seq = request_thumbnail(&g_analytics_ctx[cam_idx].thumbnails, event.obj, event.x, event.y, event.width, event.height);
   }
+  if (!push_event_queue(&g_event_queue, &event))
+    glog_error("event queue full, cam_idx=%d obj_id=%d class_id=%d lost\n", cam_idx, obj_id, class_id);
 }
 
 
-int get_opt_flow_result(int cam_idx, int obj_id)
-{
-  glog_trace("[%d][%d].confi=%.2f opt_flow_detected_count ==> %d\n", cam_idx, obj_id, obj_info[cam_idx][obj_id].confidence, obj_info[cam_idx][obj_id].opt_flow_detected_count);
-  if (obj_info[cam_idx][obj_id].opt_flow_detected_count >= THRESHOLD_OVER_OPTICAL_FLOW_COUNT)
-    return 1;
-  return 0;
-}
-
 #if 0     
 #define NOTICATION_TIME_GAP           60       
 
@@ -368,415 +341,317 @@ int get_time_gap_result(int preset)               //need to apply to objects
 }
 #endif
 
-void trigger_notification(int cam_idx)
-{
-  for (int obj_id = 0; obj_id < NUM_OBJS; obj_id++) {
-    if (obj_info[cam_idx][obj_id].notification_flag) {   
-      obj_info[cam_idx][obj_id].notification_flag = 0;
-      g_event_class_id = obj_info[cam_idx][obj_id].class_id;
-      glog_trace("[15SEC] notification_flag==1,cam_idx=%d,obj_id=%d,g_event_class_id=%d,g_preset_index=%d\n", cam_idx, obj_id, g_event_class_id, g_preset_index);
-#if OPTICAL_FLOW_INCLUDE           
-      if (g_setting.opt_flow_apply) {
-        if (g_event_class_id == CLASS_FLIP_COW) {
-          glog_trace("[15SEC] g_event_class_id==CLASS_FLIP_COW\n");
-          if (get_opt_flow_result(cam_idx, obj_id) == 0) {
-            glog_trace("[15SEC] get_opt_flow_result(cam_idx=%d,obj_id=%d) ==> 0\n", cam_idx, obj_id);
-            init_opt_flow(cam_idx, obj_id, 1);
-            continue;
-          }
-          init_opt_flow(cam_idx, obj_id, 1);
-          glog_trace("[15SEC] get_opt_flow_result(cam_idx=%d,obj_id=%d) ==> 1\n", cam_idx, obj_id);
-        }
-      }
-#endif
-      g_noti_cam_idx = g_cam_index;
-      unlock_notification(); 
-      glog_trace("[[[NOTIFICATION]]] [%d][%d].confi=%.2f,g_source_cam_idx=%d,g_noti_cam_idx=%d,g_event_class_id=%d unlock_notification()\n", cam_idx, obj_id, obj_info[cam_idx][obj_id].confidence, g_source_cam_idx, g_noti_cam_idx, g_event_class_id);
-      obj_info[cam_idx][obj_id].temp_event_time_gap = TEMP_EVENT_TIME_GAP;
-    }
-  }
-}
-
 
-void print_debug(NvDsObjectMeta * obj_meta)
+void print_debug(int cam_idx, NvDsObjectMeta * obj_meta)
 {
   glog_trace("obj_meta->class_id=%d confi=%f obj_label=%s top=%d left=%d width=%d height=%d x_offset=%d y_offset=%d display_text=%s font_size=%d cam_idx=%d obj_id=%ld\n", 
             obj_meta->class_id, obj_meta->confidence, obj_meta->obj_label, (int)obj_meta->rect_params.top, 
             (int)obj_meta->rect_params.left,  (int)obj_meta->rect_params.width, (int)obj_meta->rect_params.height,
             (int)obj_meta->text_params.x_offset, (int)obj_meta->text_params.y_offset, obj_meta->text_params.display_text, 
-            (int)obj_meta->text_params.font_params.font_size, g_cam_index, obj_meta->object_id);
+            (int)obj_meta->text_params.font_params.font_size, cam_idx, obj_meta->object_id);
 }
 
 
 #if OPTICAL_FLOW_INCLUDE
-
-int get_opt_flow_object(int cam_idx, int start_obj_id)
+int get_flip_color_over_threshold(int cam_idx, int obj_id)
 {
-  for (int obj_id = start_obj_id; obj_id < NUM_OBJS; obj_id++) {
-    if (obj_info[cam_idx][obj_id].do_opt_flow) {                    //if do_opt_flow is set, then it means that it is heat state
-      return obj_id;
+  if (g_setting.opt_flow_apply) {
+    if (OBJ_INFO(cam_idx, obj_id, opt_flow_detected_count) > 0){
+      return RED_COLOR;
     }
+    return YELLO_COLOR;
   }
 
-  return -1;
-}
-
-
-double update_average(double previous_average, int count, double new_value) 
-{
-    return ((previous_average * (count - 1)) + new_value) / count;
+  return RED_COLOR;
 }
 
 
-int get_correction_value(double diagonal)
+int get_heat_color_over_threshold(int cam_idx, int obj_id)
 {
-    int corr_value = 0;  // Initialize to a default value
-
-    // If diagonal is less than or equal to SMALL_BBOX_DIAGONAL, calculate the correction value
-    if (diagonal <= SMALL_BBOX_DIAGONAL) {
-        corr_value = (int)(((SMALL_BBOX_DIAGONAL - diagonal) / 10) + 1);
+  if (g_setting.resnet50_apply) {
+    if (OBJ_INFO(cam_idx, obj_id, heat_count) > 0){
+      return RED_COLOR;
     }
+    return YELLO_COLOR;
+  }
 
-    return corr_value;
+  return RED_COLOR;
 }
+#endif
 
 
-int get_move_distance(int cam_idx, int obj_id)
+// Probe : map the tracker id to its obj_store slot. Returns the slot, -1 when the object is not tracked
+int get_obj_slot(int cam_idx, NvDsObjectMeta *obj_meta)
 {
-  if (obj_info[cam_idx][obj_id].prev_x == 0 || obj_info[cam_idx][obj_id].prev_y == 0)
-    return 0;
+  if (obj_meta->object_id == UNTRACKED_OBJECT_ID)
+    return -1;
 
-  int x_dist = abs(obj_info[cam_idx][obj_id].prev_x - obj_info[cam_idx][obj_id].x);
-  int y_dist = abs(obj_info[cam_idx][obj_id].prev_y - obj_info[cam_idx][obj_id].y);
-
-  return (int)calculate_sqrt((double)x_dist, (double)y_dist);
+  return acquire_obj_slot(&g_obj_slots[cam_idx], (guint64)obj_meta->object_id);
 }
 
 
-int get_rect_size_change(int cam_idx, int obj_id)
+// Probe : copy the object into the frame record, NULL when the record is full
+ObjRecord *add_obj_record(AnalyticsRing *ring, FrameRecord *rec, NvDsObjectMeta *obj_meta, ObjHandle handle)
 {
-  if (obj_info[cam_idx][obj_id].prev_width == 0 || obj_info[cam_idx][obj_id].prev_height == 0)
-    return 0;
-
-  int width_change = abs(obj_info[cam_idx][obj_id].prev_width - obj_info[cam_idx][obj_id].width);
-  int height_change = abs(obj_info[cam_idx][obj_id].prev_height - obj_info[cam_idx][obj_id].height);
+  if (rec->num_objs >= ANALYTICS_RECORD_OBJS) {
+    g_atomic_int_inc(&ring->truncated);
+    return NULL;
+  }
 
-  return (int)calculate_sqrt((double)width_change, (double)height_change);
+  ObjRecord *obj = &rec->objs[rec->num_objs++];
+  obj->slot = (short)get_obj_handle_slot(handle);
+  obj->generation = get_obj_handle_generation(handle);
+  obj->class_id = (short)obj_meta->class_id;
+  obj->confidence = (float)obj_meta->confidence;
+  obj->x = (short)obj_meta->rect_params.left;
+  obj->y = (short)obj_meta->rect_params.top;
+  obj->width = (short)obj_meta->rect_params.width;
+  obj->height = (short)obj_meta->rect_params.height;
+  obj->temp = ANALYTICS_NO_VALUE;
+  obj->flow = ANALYTICS_NO_VALUE;
+  obj->heat_vote = 0;
+
+  return obj;
 }
 
 
-void set_prev_xy(int cam_idx, int obj_id)
+// Probe : release the slots of tracker ids that left the scene, called once per second for every camera.
+// The record tells the worker to clear them, after the tick so the last second still counts.
+void expire_obj_slots(int cam_idx, FrameRecord *rec)
 {
-  obj_info[cam_idx][obj_id].prev_x = obj_info[cam_idx][obj_id].x;
-  obj_info[cam_idx][obj_id].prev_y = obj_info[cam_idx][obj_id].y;
+  ObjSlotMap *map = &g_obj_slots[cam_idx];
+
+  map->tick++;
+  for (int i = map->active_count - 1; i >= 0; i--) {      //backwards, release swaps the last entry into i
+    int obj_id = map->active[i];
+    if (map->tick - map->slots[obj_id].last_tick > OBJ_SLOT_EXPIRE_SEC) {
+      release_obj_slot(map, obj_id);
+      rec->expired[rec->num_expired++] = (short)obj_id;
+    }
+  }
 }
 
 
-void set_prev_rect_size(int cam_idx, int obj_id)
+// Probe : copy the crops the worker asked for from this frame, before nvosd draws on it. The objects of
+// the record give the bbox of this frame, the surface is mapped only when a request is waiting
+static void serve_thumbnails_request(AnalyticsCtx *ctx, GstBuffer *buf, FrameRecord *rec)
 {
-  obj_info[cam_idx][obj_id].prev_width = obj_info[cam_idx][obj_id].width;
-  obj_info[cam_idx][obj_id].prev_height = obj_info[cam_idx][obj_id].height;
+  ThermalFrame frame;
+  static const ThermalPixels no_pixels = {0};
+
+  if (!map_thermal_frame(&frame, buf, 0)) {
+    serve_thumbnails(&ctx->thumbnails, &no_pixels, NULL, 0);          //fail them, the notifier sends the full snapshot
+    return;
+  }
+  serve_thumbnails(&ctx->thumbnails, &frame.pixels, rec ? rec->objs : NULL, rec ? rec->num_objs : 0);
+  unmap_thermal_frame(&frame);
 }
 
 
-int get_flip_color_over_threshold(int cam_idx, int obj_id)
+#if THERMAL_TEMP_INCLUDE
+// Probe : bbox temperature of every object of the tick frame. The surface is only valid here and nvosd draws on it next
+void sample_objs_temp(AnalyticsCtx *ctx, GstBuffer *buf, FrameRecord *rec)
 {
-  if (g_setting.opt_flow_apply) {
-    if (obj_info[cam_idx][obj_id].opt_flow_detected_count > 0){
-      return RED_COLOR;
-    }
-    return YELLO_COLOR;
-  }
+  ThermalFrame frame;
 
-  return RED_COLOR;
+  if (!map_thermal_frame(&frame, buf, 0)) {
+    ctx->temp_integral.valid = 0;
+    return;
+  }
+  build_temp_integral(&ctx->temp_integral, &frame.pixels, g_setting.threshold_under_temp, g_setting.threshold_upper_temp);   //one pass over the frame, then O(1) per object
+  unmap_thermal_frame(&frame);
+
+  for (int i = 0; i < rec->num_objs; i++) {
+    ObjRecord *obj = &rec->objs[i];
+    int count = 0;
+    float temp_avg = get_integral_temp_avg(&ctx->temp_integral, obj->x, obj->y, obj->width, obj->height, &count);
+    if (count > 0)
+      obj->temp = temp_avg;
+  }
 }
 
 
-int get_heat_color_over_threshold(int cam_idx, int obj_id)
+// RGB probe : tracked objects of the frame for the thermal probe, only with a thermal calibration
+static void publish_projection_objs(NvDsBatchMeta *batch_meta, gboolean inferred)
 {
-  if (g_setting.resnet50_apply) {
-    if (obj_info[cam_idx][obj_id].heat_count > 0){
-      return RED_COLOR;
+  ProjectionMailbox *mailbox = &g_projection_mailbox;
+  ProjectedObj objs[ANALYTICS_RECORD_OBJS];
+  int num_objs = 0;
+
+  for (NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+    NvDsFrameMeta *frame_meta = (NvDsFrameMeta *)l_frame->data;
+    for (NvDsMetaList *l_obj = frame_meta->obj_meta_list; l_obj != NULL && num_objs < ANALYTICS_RECORD_OBJS; l_obj = l_obj->next) {
+      NvDsObjectMeta *obj_meta = (NvDsObjectMeta *)l_obj->data;
+      if (obj_meta->object_id == UNTRACKED_OBJECT_ID)
+        continue;
+      ProjectedObj *obj = &objs[num_objs++];
+      obj->object_id = obj_meta->object_id;
+      obj->class_id = obj_meta->class_id;
+      obj->confidence = obj_meta->confidence;
+      obj->x = (int)obj_meta->rect_params.left;
+      obj->y = (int)obj_meta->rect_params.top;
+      obj->width = (int)obj_meta->rect_params.width;
+      obj->height = (int)obj_meta->rect_params.height;
+      g_strlcpy(obj->label, obj_meta->obj_label, sizeof(obj->label));
     }
-    return YELLO_COLOR;
   }
 
-  return RED_COLOR;
+  g_mutex_lock(&mailbox->lock);
+  memcpy(mailbox->objs, objs, num_objs * sizeof(ProjectedObj));
+  mailbox->num_objs = num_objs;
+  mailbox->time = g_get_monotonic_time();
+  if (inferred)
+    mailbox->inferred++;
+  g_mutex_unlock(&mailbox->lock);
 }
 
 
-void process_opt_flow(NvDsFrameMeta *frame_meta, int cam_idx, int obj_id, int cam_sec_interval)
+// Thermal probe : how well the projected bboxes cover the thermal detections of a validation frame
+static void check_projection(NvDsFrameMeta *frame_meta, const ProjectedObj *objs, int num_objs)
 {
-  if (obj_id < 0)
-    return;
-
-  int count = 0;
-  double move_size = 0.0, move_size_total = 0.0, move_size_avg = 0.0;
-  double diagonal = 0;
-  int row_start = 0, col_start = 0, row_num = 0, col_num = 0;
-  int cols = 0;
-  int corr_value = 0;
-  int bbox_move = 0, rect_size_change = 0;
-
-  for (NvDsMetaList *l_user = frame_meta->frame_user_meta_list; l_user != NULL; l_user = l_user->next) {                //LJH, added this loop
-      NvDsUserMeta *user_meta = (NvDsUserMeta *)(l_user->data);
-    // https://docs.nvidia.com/metropolis/deepstream/4.0/dev-guide/DeepStream_Development_Guide/baggage/structNvDsOpticalFlowMeta.html
-    if (user_meta->base_meta.meta_type == NVDS_OPTICAL_FLOW_META) {
-        NvDsOpticalFlowMeta *opt_flow_meta = (NvDsOpticalFlowMeta *)(user_meta->user_meta_data);
-        // Access motion vector data
-        //rows = opt_flow_meta->rows;
-        cols = opt_flow_meta->cols;
-        NvOFFlowVector *flow_vectors = (NvOFFlowVector *)(opt_flow_meta->data);
-        row_start = (obj_info[cam_idx][obj_id].x / 4) + 1;
-        col_start = (obj_info[cam_idx][obj_id].y / 4) + 1;
-        row_num = obj_info[cam_idx][obj_id].width / 4;
-        col_num = obj_info[cam_idx][obj_id].height / 4;
-        // printf("id=%d,rs=%d,cs=%d,rn=%d,cn=%d\n", obj_id, row_start, col_start, row_num, col_num);
-        // glog_trace("index=%d,id=%d,x=%d,y=%d,w=%d,h=%d\n", cam_idx, obj_id, obj_info[cam_idx][obj_id].x, obj_info[cam_idx][obj_id].y,
-            // obj_info[cam_idx][obj_id].width, obj_info[cam_idx][obj_id].height);
-		    diagonal = obj_info[cam_idx][obj_id].diagonal;
-
-        move_size_total = 0.0;
-		    count = 0;
-        // Process the motion vectors as needed
-        for (int row = row_start; row < (row_start + row_num); ++row) {
-            for (int col = col_start; col < (col_start + col_num); ++col) {
-                int index = row * cols + col;
-                NvOFFlowVector flow_vector = flow_vectors[index];              // https://docs.nvidia.com/metropolis/deepstream/dev-guide/text/DS_plugin_gst-nvof.html
-                move_size = calculate_sqrt(flow_vector.flowx, flow_vector.flowy);
-                move_size_total += move_size;
-                count++;
-            }
-        }
-        if (count > 0) {
-          move_size_avg = move_size_total / (double)count;
-          // glog_trace("count=%d, move_size_avg=%lf\n", count, move_size_avg);
-          obj_info[cam_idx][obj_id].opt_flow_check_count++;
-          obj_info[cam_idx][obj_id].move_size_avg = update_average(obj_info[cam_idx][obj_id].move_size_avg, 
-                                                    obj_info[cam_idx][obj_id].opt_flow_check_count, move_size_avg);
-          // glog_trace("[%d][%d].opt_flow_check_count=%d, move_size_avg=%lf diag=%.1f\n", 
-          //     cam_idx, obj_id, obj_info[cam_idx][obj_id].opt_flow_check_count, obj_info[cam_idx][obj_id].move_size_avg,
-          //     diagonal);
-        }
-        if (cam_sec_interval) {
-          bbox_move = get_move_distance(cam_idx, obj_id);
-          rect_size_change = get_rect_size_change(cam_idx, obj_id);
-          set_prev_xy(cam_idx, obj_id);
-          set_prev_rect_size(cam_idx, obj_id);
-
-          if (obj_info[cam_idx][obj_id].move_size_avg > 0) {
-            glog_trace("[SEC] [%d][%d].move_size_avg=%.1f,confi=%.2f,diag=%.1f\n", cam_idx, obj_id, 
-                  obj_info[cam_idx][obj_id].move_size_avg, obj_info[cam_idx][obj_id].confidence, diagonal);
-          }
-
-          if (bbox_move < THRESHOLD_BBOX_MOVE && rect_size_change < THRESHOLD_RECT_SIZE_CHANGE && g_move_speed == 0) {
-            corr_value = get_correction_value(diagonal);                //LJH, when rectangle is small the move size tend to increase
-            if (cam_idx == RGB_CAM) {                                   //LJH, RGB optical flow is more sensitive
-              corr_value += 9;
-            }
-            if (obj_info[cam_idx][obj_id].move_size_avg > (g_setting.opt_flow_threshold + corr_value)) {
-              obj_info[cam_idx][obj_id].opt_flow_detected_count++;
-              glog_trace("[%d][%d].opt_flow_detected_count ==> %d\n", cam_idx, obj_id, obj_info[cam_idx][obj_id].opt_flow_detected_count);
-            }
-          }
-          else {
-            glog_trace("[SEC] bbox_move=%d,rect_size_change=%d,g_move_speed=%d\n", bbox_move, rect_size_change, g_move_speed);
-          }
-          init_opt_flow(cam_idx, obj_id, 0);
-        }
+  int detected = 0, matched = 0;
+  double iou_sum = 0.0;
+
+  for (NvDsMetaList *l_obj = frame_meta->obj_meta_list; l_obj != NULL; l_obj = l_obj->next) {
+    NvDsObjectMeta *obj_meta = (NvDsObjectMeta *)l_obj->data;
+    double best = 0.0;
+    for (int i = 0; i < num_objs; i++) {
+      best = MAX(best, get_bbox_iou((int)obj_meta->rect_params.left, (int)obj_meta->rect_params.top, (int)obj_meta->rect_params.width,
+        (int)obj_meta->rect_params.height, objs[i].x, objs[i].y, objs[i].width, objs[i].height));
     }
+    detected++;
+    if (best > 0.0)
+      matched++;
+    iou_sum += best;
   }
-}
-
-#endif
-
-void set_obj_rect_id(int cam_idx, NvDsObjectMeta *obj_meta, int cam_sec_interval)
-{
-  static int x = 0, y = 0, width = 0, height = 0, rect_set = 0;
-
-  if (obj_meta->object_id < 0)
+  if (detected == 0)
     return;
-
-  if (cam_sec_interval) {
-    x = (int)obj_meta->rect_params.left;
-    y = (int)obj_meta->rect_params.top;
-    width = (int)obj_meta->rect_params.width;
-    height = (int)obj_meta->rect_params.height;
-    rect_set = 1;
-  }
-
-  if (rect_set) {
-    obj_info[cam_idx][obj_meta->object_id % NUM_OBJS].x =         x;
-    obj_info[cam_idx][obj_meta->object_id % NUM_OBJS].y =         y;
-    obj_info[cam_idx][obj_meta->object_id % NUM_OBJS].width =     width;
-    obj_info[cam_idx][obj_meta->object_id % NUM_OBJS].height =    height;
-  }
-  else {
-    obj_info[cam_idx][obj_meta->object_id % NUM_OBJS].x =         (int)obj_meta->rect_params.left;
-    obj_info[cam_idx][obj_meta->object_id % NUM_OBJS].y =         (int)obj_meta->rect_params.top;
-    obj_info[cam_idx][obj_meta->object_id % NUM_OBJS].width =     (int)obj_meta->rect_params.width;
-    obj_info[cam_idx][obj_meta->object_id % NUM_OBJS].height =    (int)obj_meta->rect_params.height;
-  }
-  
-  obj_info[cam_idx][obj_meta->object_id % NUM_OBJS].center_x = obj_info[cam_idx][obj_meta->object_id % NUM_OBJS].x + (obj_info[cam_idx][obj_meta->object_id % NUM_OBJS].width/2);
-  obj_info[cam_idx][obj_meta->object_id % NUM_OBJS].center_x = obj_info[cam_idx][obj_meta->object_id % NUM_OBJS].y + (obj_info[cam_idx][obj_meta->object_id % NUM_OBJS].height/2);
-
-  obj_info[cam_idx][obj_meta->object_id % NUM_OBJS].class_id =  (int)obj_meta->class_id;
-  obj_info[cam_idx][obj_meta->object_id % NUM_OBJS].diagonal =  calculate_sqrt((double)width, (double)height);
-  obj_info[cam_idx][obj_meta->object_id % NUM_OBJS].confidence = (float)obj_meta->confidence;
+  glog_trace("thermal projection check preset=%d detected=%d matched=%d projected=%d iou=%.2f\n", g_preset_index,
+    detected, matched, num_objs, iou_sum / detected);
 }
 
 
-#if THERMAL_TEMP_INCLUDE
-void get_pixel_color(NvBufSurface *surface, guint batch_idx, guint x, guint y, unsigned char *r, unsigned char *g, unsigned char *b, unsigned char *a)
+// Thermal probe : on a calibrated preset the thermal detections are replaced by the RGB ones projected into the
+// thermal frame, the records and the bboxes then go on as for detected objects. Returns the inferred flag of the
+// record, whether nvinfer ran on an RGB frame since the last projection
+static gboolean project_rgb_objs(AnalyticsCtx *ctx, NvDsBatchMeta *batch_meta, gboolean inferred)
 {
-  if (!surface) {
-      printf("Surface is NULL.\n");
-      return;
-  }
-
-  // Get the surface information for the batch
-  NvBufSurfaceParams *params = &surface->surfaceList[batch_idx];
-  // if (params->memType != NVBUF_MEM_CUDA_DEVICE) {
-  //      printf("Surface is not CUDA memory type.\n");
-  //      return;
-  // }
-
-  // Get the width, height, and color format of the surface
-  int width = params->width;
-  int height = params->height;
-  NvBufSurfaceColorFormat color_format = params->colorFormat;
-
-  // Check if the pixel coordinates are within the bounds
-  if (x >= width || y >= height) {
-      printf("Pixel coordinates are out of bounds.\n");
-      return;
+  const Homography *homography = get_preset_homography(&g_projection, g_preset_index);
+  ProjectionMailbox *mailbox = &g_projection_mailbox;
+  ProjectedObj objs[ANALYTICS_RECORD_OBJS];
+  int num_objs = 0, projected = 0;
+  gint64 time;
+
+  if (homography == NULL)
+    return inferred;
+
+  g_mutex_lock(&mailbox->lock);
+  time = mailbox->time;
+  if (time > 0 && g_get_monotonic_time() - time <= PROJECTION_STALE_USEC) {
+    num_objs = mailbox->num_objs;
+    memcpy(objs, mailbox->objs, num_objs * sizeof(ProjectedObj));
   }
-
-  // Access the pixel data directly
-  unsigned char *pixel_data = (unsigned char *)params->dataPtr;
-
-  // Define the pixel size based on the color format
-  int pixel_size = 0;
-
-  switch (color_format) {
-    case NVBUF_COLOR_FORMAT_RGBA:
-        pixel_size = 4;  // RGBA format (4 bytes per pixel)
-        break;
-    case NVBUF_COLOR_FORMAT_BGR:
-        pixel_size = 3;  // BGR format (3 bytes per pixel)
-        break;
-    case NVBUF_COLOR_FORMAT_NV12:
-        // For NV12, you'll need to handle both Y and UV planes separately.
-        printf("Pixel color extraction for NV12 is not implemented in this example.\n");
-        return;
-    default:
-        printf("Unsupported color format.\n");
-        return;
+  int rgb_inferred = mailbox->inferred;
+  g_mutex_unlock(&mailbox->lock);
+
+  for (int i = 0; i < num_objs; i++) {
+    ProjectedObj *obj = &objs[i];
+    if (project_bbox(homography, g_projection.frame_width, g_projection.frame_height, obj->x, obj->y, obj->width, obj->height,
+                     &obj->x, &obj->y, &obj->width, &obj->height))
+      objs[projected++] = *obj;
   }
 
-  // Compute the offset for the pixel at (x, y)
-  int pixel_offset = (y * width + x) * pixel_size;
-
-  *r = pixel_data[pixel_offset];     // Red value
-  *g = pixel_data[pixel_offset + 1]; // Green value
-  *b = pixel_data[pixel_offset + 2]; // Blue value
-  *a = (pixel_size == 4) ? pixel_data[pixel_offset + 3] : 255; // Alpha value (if RGBA)
-}
+  for (NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+    NvDsFrameMeta *frame_meta = (NvDsFrameMeta *)l_frame->data;
+    if (frame_meta->bInferDone)
+      check_projection(frame_meta, objs, projected);
 
+    NvDsMetaList *l_obj = frame_meta->obj_meta_list;
+    while (l_obj != NULL) {
+      NvDsObjectMeta *obj_meta = (NvDsObjectMeta *)l_obj->data;
+      l_obj = l_obj->next;
+      nvds_remove_obj_meta_from_frame(frame_meta, obj_meta);
+    }
 
-NvBufSurface *get_surface(GstBuffer *buf)
-{
-  NvBufSurface *surface = NULL;
-  GstMapInfo map_info;
-
-  // Map the buffer to access its memory
-  if (gst_buffer_map(buf, &map_info, GST_MAP_READ)) {
-      surface = (NvBufSurface *)map_info.data;  // Access NvBufSurface from mapped data
-      if (!surface) {
-          glog_error("Error: Unable to retrieve NvBufSurface\n");
-          gst_buffer_unmap(buf, &map_info);
-          return NULL;
-      }
+    for (int i = 0; i < projected; i++) {
+      NvDsObjectMeta *obj_meta = nvds_acquire_obj_meta_from_pool(batch_meta);
+      obj_meta->unique_component_id = 1;
+      obj_meta->object_id = objs[i].object_id;
+      obj_meta->class_id = objs[i].class_id;
+      obj_meta->confidence = objs[i].confidence;
+      obj_meta->rect_params.left = objs[i].x;
+      obj_meta->rect_params.top = objs[i].y;
+      obj_meta->rect_params.width = objs[i].width;
+      obj_meta->rect_params.height = objs[i].height;
+      obj_meta->rect_params.border_width = 1;
+      g_strlcpy(obj_meta->obj_label, objs[i].label, sizeof(obj_meta->obj_label));
+      obj_meta->text_params.display_text = g_strdup(objs[i].label);       //freed with the meta
+      obj_meta->text_params.x_offset = objs[i].x;
+      obj_meta->text_params.y_offset = MAX(objs[i].y - 10, 0);
+      obj_meta->text_params.font_params.font_name = "Serif";
+      obj_meta->text_params.font_params.font_size = 9;
+      obj_meta->text_params.font_params.font_color = (NvOSD_ColorParams){1.0, 1.0, 1.0, 1.0};
+      nvds_add_obj_meta_to_frame(frame_meta, obj_meta, NULL);
+    }
+    break;                //one frame per batch, the thermal camera has its own pipeline
   }
-  
-  return surface;
-}
-
 
-// Define a function to map RGBA color to temp
-float map_rgba_to_temp(unsigned char r, unsigned char g, unsigned char b)
-{
-  // Define temp range (e.g., 0°C to 100°C)
-  float min_temp = 0.0f;  // Minimum temp (for Blue)
-  float max_temp = 100.0f; // Maximum temp (for Red)
-  
-  // Map the 'Red' channel to temp (simple approach)
-  // Assuming the color range is from blue (low temp) to red (high temp)
-  float temp = (r / 255.0f) * (max_temp - min_temp) + min_temp;
+  gboolean projected_inferred = rgb_inferred != ctx->projection_inferred;
+  ctx->projection_inferred = rgb_inferred;
 
-  return temp;
+  return projected_inferred;
 }
+#endif
 
 
-// Function to get RGBA color and map it to temp
-float get_pixel_temp(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
-{
-  // Calculate the temp based on RGBA
-  float temp = map_rgba_to_temp(r, g, b);
+#if OPTICAL_FLOW_INCLUDE
+G_STATIC_ASSERT(sizeof(FlowVector) == sizeof(NvOFFlowVector));
 
-  // Print the temp value
-  // glog_trace("Pixel Temp.:%.2f°C\n", temp);
+// Optical flow meta of the frame, NULL when nvof attached none
+static NvDsOpticalFlowMeta *get_opt_flow_meta(NvDsFrameMeta *frame_meta)
+{
+  for (NvDsMetaList *l_user = frame_meta->frame_user_meta_list; l_user != NULL; l_user = l_user->next) {
+    NvDsUserMeta *user_meta = (NvDsUserMeta *)(l_user->data);
+    if (user_meta->base_meta.meta_type == NVDS_OPTICAL_FLOW_META)
+      return (NvDsOpticalFlowMeta *)(user_meta->user_meta_data);
+  }
 
-  return temp;
+  return NULL;
 }
 
 
-void get_bbox_temp(GstBuffer *buf, int obj_id)
+// Probe : average flow of the objects a motion rule watches on a tick frame, the flow meta is only valid here.
+// The worker flags the objects for a verdict at this tick and only then reads their flow, as it did per frame before the ring
+void sample_objs_flow(AnalyticsCtx *ctx, NvDsFrameMeta *frame_meta, FrameRecord *rec, int first)
 {
-  if (obj_id < 0)
-    return;
-
-  int count = 0;
-  float temp_total = 0.0, temp_avg = 0.0;
-  int x_start = 0, y_start = 0, width = 0, height = 0;
-  float pixel_temp = 0;
-  unsigned char r = 0, g = 0, b = 0, a = 0;
-  NvBufSurface *surface = get_surface(buf);
-  if (surface == NULL)
-    return;
-  
-  x_start = (obj_info[THERMAL_CAM][obj_id].x);
-  y_start = (obj_info[THERMAL_CAM][obj_id].y);
-  width = obj_info[THERMAL_CAM][obj_id].width;
-  height = obj_info[THERMAL_CAM][obj_id].height;
-  // glog_trace("id=%d,x=%d,y=%d,width=%d,height=%d\n", obj_id, x_start, y_start, width, height);
-  
-  temp_total = 0.0;
-  count = 0;
-  // Process the motion vectors as needed
-  for (int x = x_start; x < (x_start + width); ++x) {
-      if (x % XY_DIVISOR != 0) continue;
-      for (int y = y_start; y < (y_start + height); ++y) {
-          if (y % XY_DIVISOR != 0) continue;
-          get_pixel_color(surface, 0, x, y, &r, &g, &b, &a);
-          pixel_temp = get_pixel_temp(r, g, b, a);
-          if (pixel_temp < g_setting.threshold_under_temp || pixel_temp > g_setting.threshold_upper_temp)
-            continue;
-          temp_total += pixel_temp;
-          count++;
-      }
-  }
+  int built = 0;
 
+  for (int i = first; i < rec->num_objs; i++) {
+    ObjRecord *obj = &rec->objs[i];
+    const EventRule *rule = get_class_event_rule(&ctx->rules, obj->class_id, obj->confidence);
+    if (rule == NULL || rule->predicate != RULE_PREDICATE_MOTION)
+      continue;
+    if (!built) {
+      NvDsOpticalFlowMeta *opt_flow_meta = get_opt_flow_meta(frame_meta);
+      if (opt_flow_meta)
+        build_flow_integral(&ctx->flow_integral, (const FlowVector *)opt_flow_meta->data, opt_flow_meta->rows, opt_flow_meta->cols);   //one pass over the flow grid, then O(1) per object
+      else
+        ctx->flow_integral.valid = 0;
+      built = 1;
+    }
+    if (!ctx->flow_integral.valid)
+      return;
 
-  if (count > 0) {
-    temp_avg = temp_total / (float)count;
-    add_value_and_calculate_avg(&obj_info[THERMAL_CAM][obj_id], (int)temp_avg);
-    // glog_trace("obj_id=%d,count=%d,temp_avg=%.1f, bbox_temp=%d\n", obj_id, count, temp_avg, obj_info[THERMAL_CAM][obj_id].bbox_temp);
+    int count = 0;
+    double move_size_avg = get_flow_integral_avg(&ctx->flow_integral, obj->x, obj->y, obj->width, obj->height, &count);
+    if (count > 0)
+      obj->flow = (float)move_size_avg;
   }
 }
+#endif
 
 
+#if THERMAL_TEMP_INCLUDE
 #if 1
 // Function to update the display text for an object
 void update_display_text(NvDsObjectMeta *obj_meta, const char *text) 
@@ -790,57 +665,18 @@ void update_display_text(NvDsObjectMeta *obj_meta, const char *text)
 }
 #endif
 
-void temp_display_text(NvDsObjectMeta *obj_meta) 
+// Append the bbox temperature to the label, from the slot's cached text when neither changed
+void temp_display_text(AnalyticsCtx *ctx, NvDsObjectMeta *obj_meta, int obj_id) 
 {
-  char display_text[100] = "", append_text[100] = "";
-  if (obj_meta->object_id < 0)
-    return;
-  if (obj_info[THERMAL_CAM][obj_meta->object_id].bbox_temp < (g_setting.threshold_under_temp + g_setting.temp_diff_threshold))      //LJH, 20250410
+  if (obj_id < 0 || obj_meta->text_params.display_text == NULL)
     return;
-
-  strcpy(display_text, obj_meta->text_params.display_text);  
-  sprintf(append_text, "[%d°C]", obj_info[THERMAL_CAM][obj_meta->object_id].bbox_temp);
-  strcat(display_text, append_text);  
-  remove_newlines(display_text);
-  if (obj_meta->text_params.display_text) {
-    g_free(obj_meta->text_params.display_text);
-    obj_meta->text_params.display_text = g_strdup(display_text);
-  }
-}
-
-
-int objs_temp_avg = 0;
-int objs_temp_total = 0; 
-int objs_count = 0;
-
-void init_temp_avg()
-{
-  objs_temp_avg = 0;
-  objs_count = 0; 
-  objs_temp_total = 0;
-}
-
-
-void get_temp_total(NvDsObjectMeta *obj_meta) 
-{
-  if (obj_info[THERMAL_CAM][obj_meta->object_id].bbox_temp < g_setting.threshold_under_temp)
+  if (OBJ_INFO(THERMAL_CAM, obj_id, bbox_temp) < (g_setting.threshold_under_temp + g_setting.temp_diff_threshold))      //LJH, 20250410
     return;
 
-  objs_temp_total += obj_info[THERMAL_CAM][obj_meta->object_id].bbox_temp; 
-  objs_count++;
+  OsdLabel *label = &ctx->osd_labels[obj_id];
+  update_temp_label(label, obj_meta->text_params.display_text, OBJ_INFO(THERMAL_CAM, obj_id, bbox_temp));
+  set_osd_text(&obj_meta->text_params.display_text, label->text);
 }
-
-void get_temp_avg() 
-{
-  if (objs_count == 0 || objs_temp_total == 0) {
-    objs_temp_avg = 0;
-    return;
-  }
-
-  objs_temp_avg = objs_temp_total / objs_count; 
-  // glog_trace("objs_temp_total=%d objs_count=%d objs_temp_avg=%d\n", objs_temp_total, objs_count, objs_temp_avg);
-}
-
 #endif
 
 #if RESNET_50
@@ -873,109 +709,11 @@ static int pgie_probe_callback(NvDsObjectMeta *obj_meta)
 
 void remove_newline_text(NvDsObjectMeta *obj_meta) 
 {
-  char display_text[100] = "";
-
   if (obj_meta->object_id < 0)
     return;
-  if (obj_meta->text_params.display_text[0] == 0)
+  if (obj_meta->text_params.display_text == NULL || obj_meta->text_params.display_text[0] == 0)
     return;
-  strcpy(display_text, obj_meta->text_params.display_text);  
-  remove_newlines(display_text);
-  if (obj_meta->text_params.display_text) {
-    g_free(obj_meta->text_params.display_text);
-    obj_meta->text_params.display_text = g_strdup(display_text);
-  }
-}
-
-#if TEMP_NOTI
-int is_temp_duration()
-{
-  for (int obj_id = 0; obj_id < NUM_OBJS; obj_id++) {
-    if (obj_info[THERMAL_CAM][obj_id].class_id == CLASS_OVER_TEMP && obj_info[THERMAL_CAM][obj_id].temp_duration > 0)
-      return 1;
-  }
-
-  return 0;
-}
-
-
-void check_for_temp_notification()
-{
-  if (objs_temp_avg < g_setting.threshold_under_temp || objs_count == 0) {
-    init_temp_avg();
-    return;
-  }
-
-  for (int obj_id = 0; obj_id < NUM_OBJS; obj_id++) {
-    if (obj_info[THERMAL_CAM][obj_id].bbox_temp < g_setting.threshold_under_temp) {
-      obj_info[THERMAL_CAM][obj_id].temp_duration = 0;
-      obj_info[THERMAL_CAM][obj_id].class_id = CLASS_NORMAL_COW;
-      continue;
-    }
-
-    if (obj_info[THERMAL_CAM][obj_id].bbox_temp > (objs_temp_avg + g_setting.temp_diff_threshold)) {
-      obj_info[THERMAL_CAM][obj_id].temp_duration++;
-      glog_trace("objs_temp_avg=%d obj_id=%d bbox_temp=%d temp_duration=%d\n", objs_temp_avg, obj_id, obj_info[THERMAL_CAM][obj_id].bbox_temp, obj_info[THERMAL_CAM][obj_id].temp_duration);
-      if (obj_info[THERMAL_CAM][obj_id].temp_duration >= g_setting.over_temp_time) {   //if duration lasted more than designated time
-        obj_info[THERMAL_CAM][obj_id].temp_duration = 0;
-        if (obj_info[THERMAL_CAM][obj_id].temp_event_time_gap == 0){
-          obj_info[THERMAL_CAM][obj_id].class_id = CLASS_OVER_TEMP;
-          obj_info[THERMAL_CAM][obj_id].notification_flag = 1;                                          //send notification later
-          glog_trace("objs_temp_avg=%d obj_id=%d notification_flag=1\n", objs_temp_avg, obj_id);
-        }
-        else {
-          glog_trace("obj_info[THERMAL_CAM][%d].temp_event_time_gap=%d is less than TEMP_EVENT_TIME_GAP=%d\n", obj_id, obj_info[THERMAL_CAM][obj_id].temp_event_time_gap, TEMP_EVENT_TIME_GAP);
-        }
-      }
-    }
-    else {
-      obj_info[THERMAL_CAM][obj_id].temp_duration = 0;
-      obj_info[THERMAL_CAM][obj_id].class_id = CLASS_NORMAL_COW;
-    }
-  }
-
-  init_temp_avg();
-}
-
-#endif
-
-
-void simulate_get_temp_avg()
-{
-    for (int i = 0; i < NUM_OBJS; i++)
-      obj_info[THERMAL_CAM][i].bbox_temp = 0;
-
-    obj_info[THERMAL_CAM][1].bbox_temp = 20;
-    obj_info[THERMAL_CAM][2].bbox_temp = 21;
-    obj_info[THERMAL_CAM][3].bbox_temp = 38;
-    
-    objs_temp_avg = 0;
-    objs_temp_avg += obj_info[THERMAL_CAM][1].bbox_temp;
-    objs_temp_avg += obj_info[THERMAL_CAM][2].bbox_temp;
-    objs_temp_avg += obj_info[THERMAL_CAM][3].bbox_temp;
-
-    objs_temp_avg /= 3;
-    objs_count = 3;
-    // glog_trace("simulate objs_temp_avg=%d\n", objs_temp_avg);
-}
-
-
-void add_correction()
-{
-  if (g_setting.temp_correction == 0)
-    return;
-
-  for (int i = 0; i < NUM_OBJS; i++) {
-    if (obj_info[THERMAL_CAM][i].corrected == 1){
-      continue;
-	  }
-
-//    if ((obj_info[THERMAL_CAM][i].center_x < 320 || obj_info[THERMAL_CAM][i].center_x > 960) || obj_info[THERMAL_CAM][i].center_y < 180) 
-    {
-      obj_info[THERMAL_CAM][i].bbox_temp += g_setting.temp_correction;
-      obj_info[THERMAL_CAM][i].corrected = 1;
-    }
-  }
+  remove_newlines(obj_meta->text_params.display_text);        //only shrinks, done in place
 }
 
 
@@ -1021,17 +759,142 @@ void set_color(NvDsObjectMeta *obj_meta, int color, int set_text_blank)
 }
 
 
-void set_temp_bbox_color(NvDsObjectMeta *obj_meta)
+void set_temp_bbox_color(AnalyticsCtx *ctx, NvDsObjectMeta *obj_meta, int obj_id)
 {
-  if (obj_info[THERMAL_CAM][obj_meta->object_id].temp_duration > 0) {
+  if (obj_id < 0 || ctx->rules.temp_rule == EVENT_RULE_NONE)
+    return;
+  if (is_event_history_live(&ctx->rules.rules[(int)ctx->rules.temp_rule], OBJ_INFO(THERMAL_CAM, obj_id, temp_history))) {      //over temp being counted
     set_color(obj_meta, BLUE_COLOR, 0);
     // glog_trace("blue bbox obj_id=%d\n", obj_meta->object_id);
   }
 }
 
 
+// Worker : log the ring counters when they moved, a growing overflow means the worker falls behind the camera
+static void log_ring_state(AnalyticsCtx *ctx)
+{
+  int overflow = g_atomic_int_get(&ctx->ring.overflow);
+  int truncated = g_atomic_int_get(&ctx->ring.truncated);
+
+  if (overflow == ctx->logged_overflow && truncated == ctx->logged_truncated)
+    return;
+  glog_error("cam_idx=%d analytics ring overflow=%d truncated=%d high_water=%d/%u\n", ctx->cam_idx, 
+    overflow, truncated, g_atomic_int_get(&ctx->ring.high_water), ctx->ring.mask + 1);
+  ctx->logged_overflow = overflow;
+  ctx->logged_truncated = truncated;
+}
+
+
+// Worker : settings of the core into the camera's own copy, refreshed before each record. Fields are read one by
+// one from g_setting, a change made by the control thread meanwhile applies from the next record
+static void sync_analytics_setting(AnalyticsSetting *setting)
+{
+  setting->temp_apply = g_setting.temp_apply;
+  setting->opt_flow_apply = g_setting.opt_flow_apply;
+  setting->resnet50_apply = g_setting.resnet50_apply;
+  setting->opt_flow_threshold = g_setting.opt_flow_threshold;
+  setting->temp_diff_threshold = g_setting.temp_diff_threshold;
+  setting->temp_correction = g_setting.temp_correction;
+  setting->threshold_under_temp = g_setting.threshold_under_temp;
+  setting->threshold_upper_temp = g_setting.threshold_upper_temp;
+  setting->source_cam_idx = g_source_cam_idx;
+  setting->ptz_move_speed = g_move_speed;
+  setting->preset_index = g_preset_index;
+  setting->motion_threshold = g_setting.nv_motion_threshold;
+  setting->preset_memory_time = g_setting.preset_memory_time;
+}
+
+
+// Analytics thread of one camera, drains the ring the probe fills
+static void *analytics_worker(void *arg)
+{
+  AnalyticsCtx *ctx = (AnalyticsCtx *)arg;
+  FrameRecord *rec;
+
+  glog_trace("analytics worker cam_idx=%d start\n", ctx->cam_idx);
+  while (g_atomic_int_get(&ctx->worker_running)) {
+    rec = wait_ring_read_record(&ctx->ring);
+    if (rec == NULL)
+      continue;
+    sync_analytics_setting(&ctx->state->setting);
+    if (ctx->trace)
+      write_trace_record(ctx->trace, rec, ctx->cam_idx == ctx->state->setting.source_cam_idx);
+    process_frame_record(ctx->state, rec);
+    if (rec->tick) {
+      log_ring_state(ctx);
+      update_nvinfer_interval(ctx);
+    }
+    release_ring_read(&ctx->ring);
+  }
+  glog_trace("analytics worker cam_idx=%d end\n", ctx->cam_idx);
+
+  return NULL;
+}
+
+
+// Restart the per-second ticks of every camera, e.g. when the analysis is switched on or off
+void reset_analytics_clocks()
+{
+  for (int cam_idx = 0; cam_idx < g_num_cams; cam_idx++)
+    reset_analytics_clock(&g_analytics_ctx[cam_idx].clock);
+}
+
+
+// Drop every object of every camera, the probe clears its slots with the next frame and the worker follows
+void reset_analytics_objects()
+{
+  for (int cam_idx = 0; cam_idx < g_num_cams; cam_idx++)
+    g_atomic_int_set(&g_analytics_ctx[cam_idx].reset_pending, 1);
+}
+
+
+// Probe : nvinfer ran on a frame of the batch, FALSE for the frames nv_interval skips
+static gboolean is_batch_inferred(NvDsBatchMeta *batch_meta)
+{
+  for (NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+    if (((NvDsFrameMeta *)l_frame->data)->bInferDone)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+
+// Probe : header of this frame's record. A tick that lands on a dropped frame rides on the next record
+static FrameRecord *begin_frame_record(AnalyticsCtx *ctx, GstBuffer *buf, gboolean tick, gboolean inferred)
+{
+  FrameRecord *rec = get_ring_write_record(&ctx->ring);
+
+  if (rec == NULL) {
+    if (tick) {
+      ctx->pending_tick = 1;
+      ctx->pending_tick_frames = ctx->clock.tick_frames;
+      ctx->pending_tick_inferred_frames = ctx->clock.tick_inferred_frames;
+    }
+    return NULL;
+  }
+
+  rec->pts = GST_BUFFER_PTS(buf);
+  rec->tick = tick || ctx->pending_tick;
+  rec->tick_frames = tick ? ctx->clock.tick_frames : ctx->pending_tick_frames;
+  rec->tick_inferred_frames = tick ? ctx->clock.tick_inferred_frames : ctx->pending_tick_inferred_frames;
+  rec->inferred = inferred ? 1 : 0;
+  rec->reset = 0;
+  rec->num_objs = 0;
+  rec->num_expired = 0;
+  ctx->pending_tick = 0;
+  if (g_atomic_int_compare_and_exchange(&ctx->reset_pending, 1, 0)) {
+    init_obj_slot_map(&g_obj_slots[ctx->cam_idx]);
+    rec->reset = 1;
+  }
+
+  return rec;
+}
+
+
 /* osd_sink_pad_buffer_probe  will extract metadata received on OSD sink pad
- * and update params for drawing rectangle, object information etc. */
+ * and update params for drawing rectangle, object information etc. 
+ * Only the drawing is done here, the analytics run on the camera's worker from a copy of the metadata. */
 static GstPadProbeReturn osd_sink_pad_buffer_probe (GstPad * pad, GstPadProbeInfo * info, gpointer u_data)       //LJH, this function is called per frame 
 {
   GstBuffer *buf = (GstBuffer *) info->data;
@@ -1040,41 +903,37 @@ static GstPadProbeReturn osd_sink_pad_buffer_probe (GstPad * pad, GstPadProbeInf
   NvDsMetaList * l_obj = NULL;
   NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta(buf);
   
-  static float small_obj_diag[2] = {40.0, 40.0};
-  static float big_obj_diag[2] = {1000.0, 1000.0};
-  int cam_idx = *(int *)u_data;
-  int sec_interval[NUM_CAMS] = {0};           //common one second interval for RGB and Thermal
+  AnalyticsCtx *ctx = (AnalyticsCtx *)u_data;
+  int cam_idx = ctx->cam_idx;
 #if TRACK_PERSON_INCLUDE
   static PersonObj object[NUM_OBJS];
   init_objects(object);
-#else
-  int event_class_id = CLASS_NORMAL_COW;
-#endif
-#if OPTICAL_FLOW_INCLUDE
-  int start_obj_id = 0, obj_id = -1;
 #endif
+  int obj_slot = -1, heat_vote;
+  ObjRecord *obj;
+  const EventRule *rule;
 #if TEMP_NOTI_TEST
   cam_idx = THERMAL_CAM;
   g_source_cam_idx = cam_idx;
 #endif
-  static int do_temp_display = 0;
 
-  g_cam_index = cam_idx;
-  g_frame_count[cam_idx]++;
   // glog_trace("cam index = %d\n", cam_idx);  
-  if (g_frame_count[cam_idx] >= PER_CAM_SEC_FRAME) {
-    g_frame_count[cam_idx] = 0;
-    sec_interval[cam_idx] = 1; 
-  }
-
-#if TEMP_NOTI    
-  if (sec_interval[THERMAL_CAM]) {
-    init_temp_avg();
-  }
-#endif    
+  refresh_event_rules(&ctx->rules);
+  gboolean inferred = is_batch_inferred(batch_meta);                            //nv_interval frames in between only carry tracker output
+#if THERMAL_TEMP_INCLUDE
+  if (cam_idx == RGB_CAM && g_projection.num_presets > 0)
+    publish_projection_objs(batch_meta, inferred);
+  else if (cam_idx == THERMAL_CAM && g_projection.num_presets > 0)
+    inferred = project_rgb_objs(ctx, batch_meta, inferred);                     //calibrated preset : the RGB detections stand for the thermal ones
+#endif
+  gboolean tick = advance_analytics_clock(&ctx->clock, GST_BUFFER_PTS(buf), inferred);     //per-second work runs on the worker after this frame
+  FrameRecord *rec = begin_frame_record(ctx, buf, tick, inferred);              //NULL when the worker is a full ring behind, only drawing then
 
   for (l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
     NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) (l_frame->data);
+#if OPTICAL_FLOW_INCLUDE
+    int first_obj = rec ? rec->num_objs : 0;
+#endif
     for (l_obj = frame_meta->obj_meta_list; l_obj != NULL; l_obj = l_obj->next) {
       obj_meta = (NvDsObjectMeta *) (l_obj->data);
       obj_meta->rect_params.border_width = 1;
@@ -1083,16 +942,16 @@ static GstPadProbeReturn osd_sink_pad_buffer_probe (GstPad * pad, GstPadProbeInf
       if (cam_idx == THERMAL_CAM) {
         obj_meta->text_params.font_params.font_size = 9;
       }
-      set_obj_rect_id(cam_idx, obj_meta, sec_interval[cam_idx]);
+      obj_slot = get_obj_slot(cam_idx, obj_meta);
 
-      event_class_id = CLASS_NORMAL_COW;
+      heat_vote = 0;
 #if TRACK_PERSON_INCLUDE
       set_person_obj_state(object, obj_meta);
 #else
       if (obj_meta->class_id == CLASS_NORMAL_COW || obj_meta->class_id == CLASS_NORMAL_COW_SITTING) {
-        if (obj_meta->confidence >= threshold_confidence[obj_meta->class_id]) {
+        if (obj_meta->confidence >= ctx->rules.class_confidence[obj_meta->class_id]) {
           set_color(obj_meta, GREEN_COLOR, 0);
-          // print_debug(obj_meta);
+          // print_debug(cam_idx, obj_meta);
         }
         else {
           set_color(obj_meta, NO_BBOX, 0);
@@ -1102,24 +961,24 @@ static GstPadProbeReturn osd_sink_pad_buffer_probe (GstPad * pad, GstPadProbeInf
       }
       else if (obj_meta->class_id == CLASS_HEAT_COW || obj_meta->class_id == CLASS_FLIP_COW || obj_meta->class_id == CLASS_LABOR_SIGN_COW) {
         set_color(obj_meta, RED_COLOR, 0);
-        if (obj_meta->confidence >= threshold_confidence[obj_meta->class_id]) {
-          event_class_id = obj_meta->class_id;
+        rule = get_class_event_rule(&ctx->rules, obj_meta->class_id, obj_meta->confidence);
+        if (rule) {
 #if RESNET_50     
-          if (g_setting.resnet50_apply) {
-            if (event_class_id == CLASS_HEAT_COW && obj_meta->object_id >= 0) {
-              if (pgie_probe_callback(obj_meta) == CLASS_HEAT_COW) {
-                obj_info[cam_idx][obj_meta->object_id].heat_count++;
+          if (g_setting.resnet50_apply && inferred) {                   //the classifier only ran with the detector
+            if (rule->predicate == RULE_PREDICATE_HEAT_VOTE && obj_slot >= 0) {
+              if (pgie_probe_callback(obj_meta) == CLASS_HEAT_COW) {      //the secondary classifier meta is only valid here
+                heat_vote = 1;
               }
             }
           }
 #endif
-          if (event_class_id == CLASS_HEAT_COW) {
-            if (get_heat_color_over_threshold(cam_idx, obj_meta->object_id) == YELLO_COLOR) {
+          if (rule->predicate == RULE_PREDICATE_HEAT_VOTE) {
+            if (obj_slot >= 0 && get_heat_color_over_threshold(cam_idx, obj_slot) == YELLO_COLOR) {
               set_color(obj_meta, YELLO_COLOR, 0);
             }
           }
-          else if (event_class_id == CLASS_FLIP_COW) {
-            if (get_flip_color_over_threshold(cam_idx, obj_meta->object_id) == YELLO_COLOR) {
+          else if (rule->predicate == RULE_PREDICATE_MOTION) {
+            if (obj_slot >= 0 && get_flip_color_over_threshold(cam_idx, obj_slot) == YELLO_COLOR) {
               set_color(obj_meta, YELLO_COLOR, 0);
             }
           }
@@ -1133,76 +992,60 @@ static GstPadProbeReturn osd_sink_pad_buffer_probe (GstPad * pad, GstPadProbeInf
         }
         // glog_trace("abnormal id=%d class=%d text=%s confidence=%f\n", 
         // obj_meta->object_id, obj_meta->class_id, obj_meta->text_params.display_text, obj_meta->confidence);     //LJH, for test
-        // print_debug(obj_meta);
+        // print_debug(cam_idx, obj_meta);
       }
 #if THERMAL_TEMP_INCLUDE
       if (g_setting.temp_apply) {
-        if (cam_idx == THERMAL_CAM && obj_meta->object_id >= 0) {
-          if (sec_interval[THERMAL_CAM]) {
-            get_bbox_temp(buf, obj_meta->object_id);
-            if (obj_info[THERMAL_CAM][obj_meta->object_id].bbox_temp > g_setting.threshold_under_temp) {
-              // glog_trace("id=%d bbox_temp=%d\n", obj_meta->object_id, obj_info[THERMAL_CAM][obj_meta->object_id].bbox_temp);
-              add_correction();        
-  #if TEMP_NOTI
-              get_temp_total(obj_meta);          //get temperature total before getting average
-  #endif
-            }
-          }
-          if (g_setting.display_temp || do_temp_display) {
-            temp_display_text(obj_meta);
+        if (cam_idx == THERMAL_CAM && obj_slot >= 0) {
+          if (g_setting.display_temp || g_atomic_int_get(&ctx->state->do_temp_display)) {
+            temp_display_text(ctx, obj_meta, obj_slot);
           }
-          set_temp_bbox_color(obj_meta);     //if temperature is too high then set color      
+          set_temp_bbox_color(ctx, obj_meta, obj_slot);     //if temperature is too high then set color      
         }
       }
 #endif
       // glog_trace("obj_id=%d,class_id=%d\n", obj_meta->object_id, obj_meta->class_id);
+      double diagonal = calculate_sqrt(obj_meta->rect_params.width, obj_meta->rect_params.height);
       if (g_move_speed > 0) {             //if ptz is moving don't display bounding box
         set_color(obj_meta, NO_BBOX, 0);
       }
-      else if (obj_meta->object_id >= 0 && (obj_info[cam_idx][obj_meta->object_id].diagonal < small_obj_diag[cam_idx] || 
-            obj_info[cam_idx][obj_meta->object_id].diagonal > big_obj_diag[cam_idx])) {           //if bounding box is too small or too big don't display bounding box
+      else if (obj_slot >= 0 && (diagonal < ctx->small_obj_diag || diagonal > ctx->big_obj_diag)) {           //if bounding box is too small or too big don't display bounding box
         set_color(obj_meta, NO_BBOX, 0);
-        //glog_trace("small||big [%d][%d].diagonal=%f\n", cam_idx, obj_meta->object_id, obj_info[cam_idx][obj_meta->object_id].diagonal);
+        //glog_trace("small||big [%d][%d].diagonal=%f\n", cam_idx, obj_meta->object_id, diagonal);
       }
       remove_newline_text(obj_meta);
       //glog_trace("g_move_speed=%d id=%d text=%s\n", g_move_speed, obj_meta->object_id, obj_meta->text_params.display_text);     //LJH, for test
-      if (cam_idx == g_source_cam_idx) {            //if cam index is identifical to the set source cam
-        gather_event(event_class_id, obj_meta->object_id, cam_idx);
-      }
 #endif
+      if (rec && obj_slot >= 0) {
+        obj = add_obj_record(&ctx->ring, rec, obj_meta, get_obj_handle(&g_obj_slots[cam_idx], obj_slot));
+        if (obj)
+          obj->heat_vote = (unsigned char)heat_vote;
+      }
     }
 
-#if TEMP_NOTI_TEST
-    simulate_get_temp_avg();                       //LJH, for simulation
+#if OPTICAL_FLOW_INCLUDE    
+    if (rec && rec->tick && g_setting.opt_flow_apply && cam_idx == g_source_cam_idx) {     //if cam index is identifical to the set source cam
+      sample_objs_flow(ctx, frame_meta, rec, first_obj);           //if object is flip, its flow goes with the tick record
+    }
 #endif
+  }
 
-    if (cam_idx == g_source_cam_idx){              //if cam index is identifical to the set source cam
-      if (sec_interval[cam_idx]) {
-        check_events_for_notification(cam_idx, 0);    
-#if TEMP_NOTI
-        if (g_setting.temp_apply) {
-          if (cam_idx == THERMAL_CAM) {
-            get_temp_avg();                        //get average temperature for objects in the screen
-            check_for_temp_notification();
-            do_temp_display = is_temp_duration();   //if over temp state is being counted for notification
-          }
-        }
-#endif
-      }
-#if OPTICAL_FLOW_INCLUDE    
-      if (g_setting.opt_flow_apply) {
-        start_obj_id = 0;
-        while ((obj_id = get_opt_flow_object(cam_idx, start_obj_id)) != -1) {
-          process_opt_flow(frame_meta, cam_idx, obj_id, sec_interval[cam_idx]);     //if object is heat state, then check optical flow
-          start_obj_id = (obj_id + 1) % NUM_OBJS;
-        }
-      }
+  if (rec) {
+#if THERMAL_TEMP_INCLUDE
+    if (rec->tick && g_setting.temp_apply && cam_idx == THERMAL_CAM) {
+      sample_objs_temp(ctx, buf, rec);
+    }
 #endif
-      if (sec_interval[cam_idx]) {
-        trigger_notification(cam_idx);
-      }
+    if (rec->tick) {
+      expire_obj_slots(cam_idx, rec);
     }
   }
+  if (g_atomic_int_get(&ctx->thumbnails.requested)) {
+    serve_thumbnails_request(ctx, buf, rec);
+  }
+  if (rec) {
+    commit_ring_write(&ctx->ring);
+  }
 #if TRACK_PERSON_INCLUDE           
   object_state = track_object(object_state, object);
 #endif
@@ -1211,10 +1054,99 @@ static GstPadProbeReturn osd_sink_pad_buffer_probe (GstPad * pad, GstPadProbeInf
 }
 
 
+// Analytics core and probe context of every camera. With start_workers each camera gets its ring and
+// worker thread, without them the caller feeds process_frame_record() itself
+void init_analytics_state(int num_cams, gboolean start_workers)
+{
+  init_analytics_core(num_cams);
+
+#if THERMAL_TEMP_INCLUDE
+  init_thermal_projection(&g_projection);
+  if (g_config.thermal_calibration_path && num_cams > THERMAL_CAM)
+    load_thermal_projection(g_config.thermal_calibration_path, &g_projection);
+#endif
+
+  //one context per camera, each probe only touches its own entry
+  g_obj_slots = g_new0(ObjSlotMap, num_cams);
+  g_analytics_ctx = g_new0(AnalyticsCtx, num_cams);
+  for (int cam_idx = 0; cam_idx < num_cams; cam_idx++) {
+    AnalyticsCtx *ctx = &g_analytics_ctx[cam_idx];
+    init_obj_slot_map(&g_obj_slots[cam_idx]);
+#if THERMAL_TEMP_INCLUDE
+    for (int obj_id = 0; obj_id < NUM_OBJS; obj_id++) {
+      init_osd_label(&ctx->osd_labels[obj_id]);
+    }
+#endif
+    ctx->cam_idx = cam_idx;
+    ctx->state = get_analytics_state(cam_idx);
+    sync_analytics_setting(&ctx->state->setting);
+    ctx->small_obj_diag = SMALL_OBJ_DIAGONAL;
+    ctx->big_obj_diag = BIG_OBJ_DIAGONAL;
+    init_thumbnail_store(&ctx->thumbnails);
+    init_analytics_clock(&ctx->clock, cam_idx, ANALYTICS_TICK_PERIOD);     //the probe only reads the tick, the worker runs it
+    init_event_rules(&ctx->rules);
+    refresh_event_rules(&ctx->rules);
+    init_infer_interval(&ctx->infer_interval, g_setting.nv_interval);
+    ctx->applied_interval = g_setting.nv_interval;
+    if (!start_workers)
+      continue;
+    if (!init_analytics_ring(&ctx->ring, g_config.analytics_ring_depth))
+      continue;
+    if (g_config.analytics_trace_path)
+      ctx->trace = open_trace_writer(g_config.analytics_trace_path, cam_idx);
+    g_atomic_int_set(&ctx->worker_running, 1);
+    if (pthread_create(&ctx->worker, NULL, analytics_worker, ctx) != 0) {
+      glog_error("Fail create analytics worker cam_idx=%d\n", cam_idx);
+      g_atomic_int_set(&ctx->worker_running, 0);
+    }
+  }
+}
+
+
+void free_analytics_state()
+{
+  int num_cams = g_num_cams;
+
+  for (int cam_idx = 0; cam_idx < num_cams; cam_idx++) {
+    AnalyticsCtx *ctx = &g_analytics_ctx[cam_idx];
+    if (g_atomic_int_get(&ctx->worker_running)) {
+      g_atomic_int_set(&ctx->worker_running, 0);
+      wake_ring_reader(&ctx->ring);
+      pthread_join(ctx->worker, NULL);
+    }
+    free_analytics_ring(&ctx->ring);
+    if (ctx->trace) {
+      glog_trace("trace cam_idx=%d records=%" G_GUINT64_FORMAT " bytes=%" G_GUINT64_FORMAT "\n", cam_idx, ctx->trace->records, ctx->trace->bytes);
+      g_clear_pointer(&ctx->trace, close_trace);
+    }
+    free_thumbnail_store(&ctx->thumbnails);
+#if THERMAL_TEMP_INCLUDE
+    free_temp_integral(&ctx->temp_integral);
+#endif
+#if OPTICAL_FLOW_INCLUDE
+    free_flow_integral(&ctx->flow_integral);
+#endif
+  }
+  g_clear_pointer(&g_analytics_ctx, g_free);
+  g_clear_pointer(&g_obj_slots, g_free);
+  free_analytics_core();
+}
+
+
+AnalyticsCtx *get_analytics_ctx(int cam_idx)
+{
+  if (cam_idx < 0 || cam_idx >= g_num_cams)
+    return NULL;
+  return &g_analytics_ctx[cam_idx];
+}
+
+
 void setup_nv_analysis()
 {
   glog_trace("g_config.device_cnt=%d\n", g_config.device_cnt);
-  static int index1, index2;
+
+  set_analytics_event_func(notify_analytics_event);
+  init_analytics_state(g_config.device_cnt, TRUE);
 
   for(int cam_idx = 0 ; cam_idx < g_config.device_cnt ; cam_idx++){
     GstPad *osd_sink_pad = NULL;
@@ -1235,30 +1167,24 @@ void setup_nv_analysis()
     }
     else {
       g_print("osd_sink_pad_buffer_probe cam_idx=%d\n", cam_idx);
-      if (cam_idx == 0) {
-        index1 = cam_idx;
-        gst_pad_add_probe(osd_sink_pad, GST_PAD_PROBE_TYPE_BUFFER, osd_sink_pad_buffer_probe, &index1, NULL);   //RGB camera
-      }
-      else if (cam_idx == 1) {
-        index2 = cam_idx;
-        gst_pad_add_probe(osd_sink_pad, GST_PAD_PROBE_TYPE_BUFFER, osd_sink_pad_buffer_probe, &index2, NULL);   //Thermal camera
-      }
+      gst_pad_add_probe(osd_sink_pad, GST_PAD_PROBE_TYPE_BUFFER, osd_sink_pad_buffer_probe, &g_analytics_ctx[cam_idx], NULL);
     }
     gst_object_unref(osd_sink_pad);
   } 
   //start wait event thread .
-  pthread_mutex_init(&g_notifier_mutex, NULL);                  
-  pthread_create(&g_tid, NULL, process_notification, NULL);    
+  if (init_event_queue(&g_event_queue, EVENT_QUEUE_DEPTH))
+    pthread_create(&g_tid, NULL, process_notification, NULL);    
 }
 
 
 void endup_nv_analysis()
 {
   if(g_tid){
-    g_event_class_id = EVENT_EXIT;
-    pthread_mutex_unlock(&g_notifier_mutex);
+    g_atomic_int_set(&g_notifier_exit, 1);
+    wake_event_queue(&g_event_queue);
     
     pthread_join(g_tid, NULL);
+    free_event_queue(&g_event_queue);
   }
+  free_analytics_state();
 }
-
@@ -2,6 +2,7 @@
 #define __NVDS_PROCESS_H__
 
 #include <gst/gst.h>
+#include <pthread.h>
 #include "global_define.h"
 #include "device_setting.h"
 #include "curllib.h"
@@ -12,55 +13,27 @@
 #include "json_utils.h"
 #include "ptz_control.h"
 #include "event_recorder.h"
+#include "thermal_sampler.h"
+#include "obj_slot_map.h"
+#include "flow_integral.h"
+#include "analytics_clock.h"
+#include "analytics_ring.h"
+#include "osd_label.h"
+#include "analytics_trace.h"
+#include "analytics_core.h"
+#include "infer_interval.h"
+#include "thermal_projection.h"
+#include "event_queue.h"
+#include "thumbnail.h"
 #include "gstnvdsmeta.h"
 #include "gstream_main.h"
 
-#define EVENT_EXIT                            9999
 #define CENTER_X                              (1280/2)
 #define CENTER_Y                              (720/2)
-#define NUM_OBJS                              300
-#define PER_CAM_SEC_FRAME                     15
-#define BUFFER_SIZE                           4
-#define XY_DIVISOR                            4
-#define SMALL_BBOX_DIAGONAL                   (160.0)
-
-#define THRESHOLD_OVER_OPTICAL_FLOW_COUNT     2
-#define THRESHOLD_BBOX_MOVE                   30
-#define THRESHOLD_RECT_SIZE_CHANGE            30
-#define THRESHOLD_UNDER_TEMP_DEFAULT          15
-#define THRESHOLD_UPPER_TEMP_DEFAULT          50
-#define THRESHOLD_NORMAL                      (0.2)
-#define HEAT_COUNT_THRESHOLD                  1
-
-#define CLASSES_NUM                           5
-
-#if CLASSES_NUM == 5
-enum 
-{
-  CLASS_NORMAL_COW = 0, 
-  CLASS_HEAT_COW, 
-  CLASS_FLIP_COW, 
-  CLASS_LABOR_SIGN_COW, 
-  CLASS_NORMAL_COW_SITTING,
-  CLASS_OVER_TEMP,
-  NUM_CLASSES
-};
-
-#elif CLASSES_NUM == 2
-#elif CLASSES_NUM == 3
-enum 
-{
-  CLASS_NORMAL_COW = 0, 
-  CLASS_FLIP_COW = 1, 
-  CLASS_NORMAL_COW_SITTING = 2,
-  CLASS_HEAT_COW = 3,             //don't care
-  CLASS_LABOR_SIGN_COW = 4,       //don't care
-  CLASS_OVER_TEMP = 5,            //don't care
-  NUM_CLASSES = 6                 //this should be 6
-};
-
-#else
-#endif
+#define SMALL_OBJ_DIAGONAL                    (40.0)      //bbox is not drawn under this diagonal
+#define BIG_OBJ_DIAGONAL                      (1000.0)    //nor over this one
+#define PROJECTION_STALE_USEC                 (G_USEC_PER_SEC)      //RGB detections older than this are not projected
+#define PROJECTION_LABEL_LEN                  32
 
 enum 
 {
@@ -71,9 +44,6 @@ enum
 };
 
 
-#define TEMP_EVENT_TIME_GAP        300
-
-
 // Struct to hold information for each timer
 typedef struct {
   int call_count;         // Number of times the timer has been called
@@ -82,36 +52,66 @@ typedef struct {
 } Timer;
 
 
-// Structure to calculate the avg of the last 10 values
+// Probe and worker context of one camera, passed as the user data of its probe and its worker thread.
+// Nothing in here is touched by another camera, the probe and the worker only meet in the ring.
 typedef struct {
-  int buffer[BUFFER_SIZE];  // Circular buffer to store the last 10 values
-  int index;                // Current index where the next value will be inserted
-  int count;                // Number of values added (up to 10)
-  int sum;                  // Sum of the values in the buffer
-} AvgCalculator;
-
-
+  int cam_idx;
+  AnalyticsState *state;    // core state of the camera, fed by the worker
+  AnalyticsRing ring;       // probe -> worker, one FrameRecord per frame
+  pthread_t worker;
+  gint worker_running;
+  AnalyticsTrace *trace;    // records written by the worker, "analytics_trace_path" in config.json
+
+  // probe side
+  AnalyticsClock clock;
+  EventRuleTable rules;     // probe copy of the event rules, for the flow sampling and the bbox colors
+#if OPTICAL_FLOW_INCLUDE
+  FlowIntegral flow_integral;
+#endif
+#if THERMAL_TEMP_INCLUDE
+  TempIntegral temp_integral;
+  OsdLabel osd_labels[NUM_OBJS];      // temperature labels per slot, copied into the object meta
+#endif
+  float small_obj_diag;     // bboxes outside [small_obj_diag, big_obj_diag] are not drawn
+  float big_obj_diag;
+  int pending_tick;         // tick of a dropped frame, carried by the next record
+  int pending_tick_frames;
+  int pending_tick_inferred_frames;
+  int projection_inferred;  // thermal : inferred count of the RGB detections last projected
+
+  // worker side
+  int logged_overflow;      // ring counters at the last log line
+  int logged_truncated;
+  InferInterval infer_interval;       // nvinfer interval from the activity of the ticks
+
+  // shared
+  gint reset_pending;       // drop every object, set from the control thread, served by the probe, atomic
+  gint interval_reset;      // analysis switched on, the worker restarts its interval controller, atomic
+  int applied_interval;     // nvinfer "interval" of the camera, under g_infer_interval_lock
+  ThumbnailStore thumbnails;          // event crops : requested by the worker, encoded by the probe, taken by the notifier
+} AnalyticsCtx;
+
+
+// RGB detection handed to the thermal probe, bbox in RGB coordinates
 typedef struct {
-  int detected_frame_count;
-  int duration;
+  guint64 object_id;        // RGB tracker id, the thermal slots follow it
   int class_id;
   float confidence;
-  int notification_flag;
-
-  int do_opt_flow;
-  int x, y, width, height;
-  int center_x, center_y, corrected;
-  int prev_x, prev_y, prev_width, prev_height;
-  double diagonal;
-  double move_size_avg;
-  int opt_flow_check_count;
-  int bbox_temp;
-  int temp_duration;
-  int opt_flow_detected_count;
-  AvgCalculator temp_avg_calculator; // Embedded temp AvgCalculator structure for each object
-  int heat_count;
-  int temp_event_time_gap;
-} ObjMonitor;
+  int x;
+  int y;
+  int width;
+  int height;
+  char label[PROJECTION_LABEL_LEN];
+} ProjectedObj;
+
+// Last RGB frame, written by the RGB probe and read by the thermal probe under lock
+typedef struct {
+  GMutex lock;
+  gint64 time;              // g_get_monotonic_time() of the frame, 0 before the first
+  int inferred;             // RGB frames nvinfer ran on so far
+  int num_objs;
+  ProjectedObj objs[ANALYTICS_RECORD_OBJS];
+} ProjectionMailbox;
 
 
 typedef enum {
@@ -141,7 +141,6 @@ enum {
 };
 
 
-extern int g_event_class_id;
 extern CurlIinfoType g_curlinfo;
 extern GstElement *g_pipeline;
 extern WebRTCConfig g_config;
@@ -154,11 +153,8 @@ extern int g_top, g_left, g_width, g_height;
 extern int g_move_to_center_running;
 extern Timer timers[];
 extern gboolean move_and_stop_ptz(int direction, int ptz_speed, int ptz_delay);
-extern int g_frame_count[];
 extern enum AppState g_app_state;
 
-extern void add_value_and_calculate_avg(ObjMonitor* obj, int new_value);
-extern double calculate_sqrt(double width, double height);
 extern int check_process(int port);
 extern gboolean move_and_stop_ptz(int direction, int ptz_speed, int ptz_delay);
 extern void wait_ptz_stop();
@@ -172,7 +168,11 @@ extern void init_obj_info();
 void set_process_analysis(gboolean OnOff);
 void setup_nv_analysis();
 void endup_nv_analysis();
-void check_events_for_notification(int cam_idx, int init);
-int get_opt_flow_object(int cam_idx, int obj_id);
+void reset_analytics_clocks();
+void reset_analytics_objects();
+void publish_event(int cam_idx, int class_id);
+void init_analytics_state(int num_cams, gboolean start_workers);
+void free_analytics_state();
+AnalyticsCtx *get_analytics_ctx(int cam_idx);
 
 #endif
@@ -1,7 +1,5 @@
 #include "nvds_utils.h"
 
-noti_queue notification_queue;
-
 int get_error_pan(int left, int width)
 {
   int bbox_center_x = left + (width / 2);
@@ -179,84 +177,6 @@ bool check_time_gap(int timer_id)
 #endif
 
 
-// Function to initialize the AvgCalculator for each object
-void init_calculator(ObjMonitor* obj) 
-{
-    obj->temp_avg_calculator.index = 0;
-    obj->temp_avg_calculator.count = 0;
-    obj->temp_avg_calculator.sum = 0;
-
-    // Initialize buffer values to zero
-    for (int i = 0; i < BUFFER_SIZE; i++) {
-        obj->temp_avg_calculator.buffer[i] = 0;
-    }
-}
-
-// Function to add a new value for an object and calculate the avg
-void add_value_and_calculate_avg(ObjMonitor* obj, int new_value) 
-{
-    // Get reference to the AvgCalculator of the object
-    AvgCalculator* calculator = &obj->temp_avg_calculator;
-
-    // Remove the oldest value from the sum if the buffer is full
-    if (calculator->count == BUFFER_SIZE) {
-        calculator->sum -= calculator->buffer[calculator->index];
-    }
-
-    // Add the new value to the buffer and the sum
-    calculator->buffer[calculator->index] = new_value;
-    calculator->sum += new_value;
-
-    // Move the index forward in a circular manner
-    calculator->index = (calculator->index + 1) % BUFFER_SIZE;
-
-    // Update the count
-    if (calculator->count < BUFFER_SIZE) {
-        calculator->count++;
-    }
-
-    // Calculate and update the avg in the ObjMonitor structure
-    obj->bbox_temp = round((float)calculator->sum / (float)calculator->count);
-    obj->corrected = 0;
-}
-
-
-double my_sqrt(double num) 
-{
-  if (num < 0) {
-      printf("Error: Negative input. Square root of negative numbers is not defined in real numbers.\n");
-      return -1.0;
-  }
-  if (num == 0 || num == 1) {
-      return num;
-  }
-
-  double guess = num / 2.0; // Initial guess
-  double epsilon = 1e-6;    // Precision threshold
-
-  while ((guess * guess - num) > epsilon || (num - guess * guess) > epsilon) {
-      guess = (guess + num / guess) / 2.0; // Newton-Raphson formula
-  }
-
-  return guess;
-}
-
-
-void dec_temp_event_time_gap()
-{  
-  for (int obj_id = 0; obj_id < NUM_OBJS; obj_id++) {
-    if (obj_info[THERMAL_CAM][obj_id].temp_event_time_gap > 0) {
-      obj_info[THERMAL_CAM][obj_id].temp_event_time_gap--;
-    }
-  }
-}
-
-
-double calculate_sqrt(double width, double height) 
-{
-  return my_sqrt((width * width) + (height * height));
-}
-
 #if TRACK_PERSON_INCLUDE
 
 static int g_tracked_id = -1;
@@ -485,84 +405,6 @@ void remove_newlines(char *str)
 }
 
 
-// Function to initialize the notification queue
-void initialize_queue_noti(noti_queue *q) 
-{
-  q->front = -1;
-  q->rear = -1;
-}
-
-
-// Function to check if the notification queue is full
-int is_queue_full_noti(noti_queue *q) 
-{
-  return (q->rear == MAX_NOTI_ITEM_NUM - 1);
-}
-
-
-// Function to check if the notification queue is empty
-int is_queue_empty_noti(noti_queue *q) 
-{
-  return (q->front == -1 || q->front > q->rear);
-}
-
-
-// Function to add a notification item to the queue (enqueue)
-void enqueue_noti(noti_queue *q, char *cam_id, int cam_idx, int class_id, CurlIinfoType *curlinfo) 
-{
-  if (is_queue_full_noti(q)) {
-      glog_trace("noti_queue is full! Cannot enqueue cam_idx=%d, class_id=%d, video_url=%s\n", cam_idx, class_id, curlinfo->video_url);
-  } else {
-      if (q->front == -1) {
-          q->front = 0; // First item in the queue
-      }
-      q->rear++;
-      strcpy(q->items[q->rear].cam_id, cam_id);
-      q->items[q->rear].class_id = class_id;
-      q->items[q->rear].cam_idx = cam_idx;
-      memcpy(&q->items[q->rear].curlinfo, curlinfo, sizeof(CurlIinfoType));
-      glog_trace("Enqueued item: cam_idx=%d, class_id=%d, video_url=%s\n", cam_idx, class_id, curlinfo->video_url);
-  }
-}
-
-
-// Function to remove a notification item from the queue (dequeue)
-noti_item dequeue_noti(noti_queue *q) 
-{
-  noti_item empty_item;
-
-  if (is_queue_empty_noti(q)) {
-      printf("noti_queue is empty! Cannot dequeue\n");
-      memset(&empty_item, 0, sizeof(noti_item));
-      empty_item.cam_idx = -1;
-      empty_item.class_id = -1;
-      return empty_item;  // Return an empty item
-  } 
-  else {
-      noti_item dequeued_item = q->items[q->front];
-      q->front++;
-      if (q->front > q->rear) {
-          q->front = q->rear = -1; // Reset the queue when it's empty
-      }
-      printf("Dequeued item: cam_id=%s, cam_idx=%d, video_url=%s\n", dequeued_item.cam_id, dequeued_item.cam_idx, dequeued_item.curlinfo.video_url);
-      return dequeued_item;
-  }
-}
-
-
-// Function to display the notification items in the queue
-void display_noti(noti_queue *q) {
-  if (is_queue_empty_noti(q)) {
-      printf("noti_queue is empty!\n");
-  } else {
-      printf("noti_queue: \n");
-      for (int i = q->front; i <= q->rear; i++) {
-          printf("cam_idx=%d, video_url=%s\n", q->items[i].cam_idx, q->items[i].curlinfo.video_url);
-      }
-  }
-}
-
-
 int is_auto_pan_set()
 {
   if (strlen(g_setting.auto_ptz_seq) > 0)
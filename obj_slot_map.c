@@ -0,0 +1,93 @@
+#include <string.h>
+
+#include "g_log.h"
+#include "obj_slot_map.h"
+
+
+static inline int get_hash_index(guint64 object_id)
+{
+  return (int)((object_id * 0x9E3779B97F4A7C15ULL) >> 54) & (OBJ_SLOT_HASH_SIZE - 1);      //top 10 bits of fibonacci hashing
+}
+
+
+void init_obj_slot_map(ObjSlotMap *map)
+{
+  memset(map->hash, 0, sizeof(map->hash));
+  for (int i = 0; i < MAX_OBJ_SLOTS; i++) {
+    map->slots[i].object_id = 0;
+    map->slots[i].generation++;                 //handles taken before the reset become stale
+    map->slots[i].active_pos = -1;
+    map->slots[i].last_tick = 0;
+    map->free_slots[i] = MAX_OBJ_SLOTS - 1 - i;   //slot 0 is handed out first
+  }
+  map->free_count = MAX_OBJ_SLOTS;
+  map->active_count = 0;
+  map->tick = 0;
+}
+
+
+// Slot of object_id, mapped on first sight and marked as seen in the current tick. -1 when all slots are in use
+int acquire_obj_slot(ObjSlotMap *map, guint64 object_id)
+{
+  int h = get_hash_index(object_id);
+
+  for (; map->hash[h]; h = (h + 1) & (OBJ_SLOT_HASH_SIZE - 1)) {
+    int slot = map->hash[h] - 1;
+    if (map->slots[slot].object_id == object_id) {
+      map->slots[slot].last_tick = map->tick;
+      return slot;
+    }
+  }
+
+  if (map->free_count == 0) {
+    glog_error("no free object slot for object_id=%lu\n", (unsigned long)object_id);
+    return -1;
+  }
+
+  int slot = map->free_slots[--map->free_count];
+  map->slots[slot].object_id = object_id;
+  map->slots[slot].last_tick = map->tick;
+  map->slots[slot].active_pos = map->active_count;
+  map->active[map->active_count++] = slot;
+  map->hash[h] = slot + 1;
+
+  return slot;
+}
+
+
+void release_obj_slot(ObjSlotMap *map, int slot)
+{
+  ObjSlot *s = &map->slots[slot];
+  if (s->active_pos < 0)
+    return;
+
+  // Remove from the hash, shifting back the entries of the same chain (no tombstones)
+  int h = get_hash_index(s->object_id);
+  while (map->hash[h] != slot + 1)
+    h = (h + 1) & (OBJ_SLOT_HASH_SIZE - 1);
+  map->hash[h] = 0;
+  for (int next = (h + 1) & (OBJ_SLOT_HASH_SIZE - 1); map->hash[next]; next = (next + 1) & (OBJ_SLOT_HASH_SIZE - 1)) {
+    int home = get_hash_index(map->slots[map->hash[next] - 1].object_id);
+    if (((next - home) & (OBJ_SLOT_HASH_SIZE - 1)) >= ((next - h) & (OBJ_SLOT_HASH_SIZE - 1))) {
+      map->hash[h] = map->hash[next];
+      map->hash[next] = 0;
+      h = next;
+    }
+  }
+
+  // Swap-remove from the active list
+  int last = map->active[--map->active_count];
+  map->active[s->active_pos] = last;
+  map->slots[last].active_pos = s->active_pos;
+
+  s->active_pos = -1;
+  s->generation++;
+  map->free_slots[map->free_count++] = slot;
+}
+
+
+// Handle of a slot for another thread, see make_obj_handle()
+ObjHandle get_obj_handle(ObjSlotMap *map, int slot)
+{
+  return make_obj_handle(slot, map->slots[slot].generation);
+}
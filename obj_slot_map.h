@@ -0,0 +1,57 @@
+#ifndef __OBJ_SLOT_MAP_H__
+#define __OBJ_SLOT_MAP_H__
+
+#include <glib.h>
+
+#define MAX_OBJ_SLOTS             300             //dense slots per camera, size of obj_store[cam] columns
+#define OBJ_SLOT_HASH_SIZE        1024            //power of two, keeps the probe chains short at MAX_OBJ_SLOTS
+#define OBJ_SLOT_EXPIRE_SEC       5               //slot is released when its tracker id was not seen for this many ticks
+
+#define OBJ_HANDLE_NONE           ((ObjHandle)0xffffffff)       //events without an object
+
+// generation << 16 | slot. Slots go to other threads as handles, a slot released and given to another
+// tracker id meanwhile has another generation so the handle no longer matches it
+typedef guint32 ObjHandle;
+
+typedef struct {
+  guint64 object_id;      // tracker id owning the slot
+  guint16 generation;     // bumped on every release, invalidates old handles
+  int active_pos;         // index in active[], -1 when free
+  int last_tick;          // tick of the last acquire_obj_slot()
+} ObjSlot;
+
+// Tracker id -> dense slot map of one camera, only touched from that camera's probe
+typedef struct {
+  ObjSlot slots[MAX_OBJ_SLOTS];
+  short hash[OBJ_SLOT_HASH_SIZE];     // slot + 1, 0 when empty (linear probing)
+  int free_slots[MAX_OBJ_SLOTS];
+  int free_count;
+  int active[MAX_OBJ_SLOTS];          // live slots, unordered
+  int active_count;
+  int tick;                           // advanced once per second by the owner
+} ObjSlotMap;
+
+
+void init_obj_slot_map(ObjSlotMap *map);
+int acquire_obj_slot(ObjSlotMap *map, guint64 object_id);
+void release_obj_slot(ObjSlotMap *map, int slot);
+ObjHandle get_obj_handle(ObjSlotMap *map, int slot);
+
+
+static inline ObjHandle make_obj_handle(int slot, guint16 generation)
+{
+  return ((ObjHandle)generation << 16) | (guint16)slot;
+}
+
+// Slot of a handle, -1 for OBJ_HANDLE_NONE
+static inline int get_obj_handle_slot(ObjHandle handle)
+{
+  return handle == OBJ_HANDLE_NONE ? -1 : (int)(handle & 0xffff);
+}
+
+static inline guint16 get_obj_handle_generation(ObjHandle handle)
+{
+  return (guint16)(handle >> 16);
+}
+
+#endif
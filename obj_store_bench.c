@@ -0,0 +1,302 @@
+// Cache behaviour of the per-camera object store, AoS ObjMonitor (before) vs ObjStore columns (after).
+// Replays the probe access pattern on synthetic frames with NUM_OBJS live objects per camera.
+//
+//   obj_store_bench [frames]
+//
+// Prints one "key=value" line per layout. Cache misses come from perf_event_open(), -1 when not permitted or
+// when the machine exposes no PMU (containers, VMs). lines_per_frame is counted without hardware : the distinct
+// 64 byte lines the layout touches per frame, which is the L1D miss count after the 1 MB pollution pass.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "g_log.h"
+#include "analytics_core.h"
+
+#define BENCH_CAMS                2               //RGB and thermal
+#define PER_CAM_SEC_FRAME         15              //frames per analytics tick at the nominal 15 fps
+#define BENCH_POLLUTE_SIZE        (1024 * 1024)   //stands for the frame/meta traffic between two probe calls
+#define BENCH_WINDOW_MASK         ((EventHistory)0x7fff)   //15 seconds rule without tolerance
+
+// Layout of ObjMonitor before the split, kept here as the reference
+typedef struct {
+  int detected_frame_count;
+  int duration;
+  int class_id;
+  float confidence;
+  int notification_flag;
+
+  int do_opt_flow;
+  int x, y, width, height;
+  int center_x, center_y, corrected;
+  int prev_x, prev_y, prev_width, prev_height;
+  double diagonal;
+  double move_size_avg;
+  int opt_flow_check_count;
+  int bbox_temp;
+  int temp_duration;
+  int opt_flow_detected_count;
+  AvgCalculator temp_avg_calculator;
+  int heat_count;
+  int temp_event_time_gap;
+} ObjMonitor;
+
+static ObjMonitor obj_info[BENCH_CAMS][NUM_OBJS];
+static ObjStore bench_store[BENCH_CAMS];
+static int active[NUM_OBJS];
+static unsigned char pollute[BENCH_POLLUTE_SIZE];
+static volatile int sink;
+
+// Distinct cache lines of one frame, open addressing on the line address
+#define BENCH_LINE_SET            4096
+static uintptr_t line_set[BENCH_LINE_SET];
+static int line_count;
+#define MARK(field)               mark_line(&(field))
+
+
+static int open_counter(unsigned int type, unsigned long long config)
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+
+static long long read_counter(int fd)
+{
+  long long value = -1;
+
+  if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value))
+    return -1;
+  return value;
+}
+
+
+static void mark_line(const void *addr)
+{
+  uintptr_t line = ((uintptr_t)addr >> 6) + 1;
+  unsigned int h = (unsigned int)(line * 2654435761u) & (BENCH_LINE_SET - 1);
+
+  while (line_set[h] && line_set[h] != line)
+    h = (h + 1) & (BENCH_LINE_SET - 1);
+  if (!line_set[h]) {
+    line_set[h] = line;
+    line_count++;
+  }
+}
+
+
+// Same fields as frame_aos/tick_aos, frame_soa/tick_soa
+static void lines_aos(int cam, int tick)
+{
+  for (int n = 0; n < NUM_OBJS; n++) {
+    ObjMonitor *obj = &obj_info[cam][active[n]];
+    MARK(obj->x); MARK(obj->y); MARK(obj->width); MARK(obj->height);
+    MARK(obj->class_id); MARK(obj->confidence); MARK(obj->diagonal); MARK(obj->detected_frame_count); MARK(obj->do_opt_flow);
+    if (tick) {
+      MARK(obj->duration); MARK(obj->notification_flag); MARK(obj->bbox_temp);
+      MARK(obj->temp_event_time_gap); MARK(obj->temp_duration); MARK(obj->corrected);
+    }
+  }
+}
+
+
+static void lines_soa(int cam, int tick)
+{
+  for (int n = 0; n < NUM_OBJS; n++) {
+    int id = active[n];
+    MARK(OBJ_INFO(cam, id, x)); MARK(OBJ_INFO(cam, id, y)); MARK(OBJ_INFO(cam, id, width)); MARK(OBJ_INFO(cam, id, height));
+    MARK(OBJ_INFO(cam, id, class_id)); MARK(OBJ_INFO(cam, id, confidence)); MARK(OBJ_INFO(cam, id, diagonal));
+    MARK(OBJ_INFO(cam, id, detected_frame_count)); MARK(OBJ_INFO(cam, id, do_opt_flow));
+    if (tick) {
+      MARK(OBJ_INFO(cam, id, event_history)); MARK(OBJ_INFO(cam, id, notification_flag)); MARK(OBJ_INFO(cam, id, temp_history));
+      MARK(OBJ_INFO(cam, id, bbox_temp)); MARK(OBJ_INFO(cam, id, last_event_tick));
+    }
+  }
+}
+
+
+// Average lines of the cameras per frame, a tick every PER_CAM_SEC_FRAME frames
+static double count_lines(void (*lines_fn)(int, int))
+{
+  int total = 0;
+
+  for (int frame = 0; frame < PER_CAM_SEC_FRAME; frame++) {
+    memset(line_set, 0, sizeof(line_set));
+    line_count = 0;
+    for (int cam = 0; cam < BENCH_CAMS; cam++)
+      lines_fn(cam, frame == PER_CAM_SEC_FRAME - 1);
+    total += line_count;
+  }
+
+  return (double)total / PER_CAM_SEC_FRAME;
+}
+
+
+static void touch_pollute(int frame)
+{
+  for (int i = 0; i < BENCH_POLLUTE_SIZE; i += 64)
+    pollute[i] += (unsigned char)frame;
+}
+
+
+static void frame_aos(int cam, int frame)
+{
+  for (int n = 0; n < NUM_OBJS; n++) {
+    ObjMonitor *obj = &obj_info[cam][active[n]];
+    obj->x = n + frame; obj->y = n; obj->width = 80; obj->height = 60;
+    obj->class_id = n % NUM_CLASSES;
+    obj->confidence = 0.9f;
+    obj->diagonal = 100.0;
+    obj->detected_frame_count++;
+    sink += obj->diagonal < 40.0;
+  }
+  for (int n = 0; n < NUM_OBJS; n++)
+    sink += obj_info[cam][active[n]].do_opt_flow;
+}
+
+
+static void frame_soa(int cam, int frame)
+{
+  for (int n = 0; n < NUM_OBJS; n++) {
+    int id = active[n];
+    OBJ_INFO(cam, id, x) = n + frame; OBJ_INFO(cam, id, y) = n; OBJ_INFO(cam, id, width) = 80; OBJ_INFO(cam, id, height) = 60;
+    OBJ_INFO(cam, id, class_id) = n % NUM_CLASSES;
+    OBJ_INFO(cam, id, confidence) = 0.9f;
+    OBJ_INFO(cam, id, diagonal) = 100.0;
+    OBJ_INFO(cam, id, detected_frame_count)++;
+    sink += OBJ_INFO(cam, id, diagonal) < 40.0;
+  }
+  for (int n = 0; n < NUM_OBJS; n++)
+    sink += OBJ_INFO(cam, active[n], do_opt_flow);
+}
+
+
+static void tick_aos(int cam)
+{
+  for (int n = 0; n < NUM_OBJS; n++) {
+    ObjMonitor *obj = &obj_info[cam][active[n]];
+    if (obj->detected_frame_count >= PER_CAM_SEC_FRAME - 1) {
+      if (++obj->duration >= 15) {
+        obj->duration = 0;
+        obj->notification_flag = 1;
+      }
+    }
+    else {
+      obj->duration = 0;
+    }
+    obj->detected_frame_count = 0;
+  }
+  for (int n = 0; n < NUM_OBJS; n++) {
+    ObjMonitor *obj = &obj_info[cam][active[n]];
+    if (obj->bbox_temp > 30 && obj->temp_event_time_gap == 0)
+      obj->temp_duration++;
+    if (!obj->corrected)
+      obj->corrected = 1;
+  }
+  for (int n = 0; n < NUM_OBJS; n++) {
+    ObjMonitor *obj = &obj_info[cam][active[n]];
+    if (obj->notification_flag)
+      obj->notification_flag = 0;
+  }
+}
+
+
+static void tick_soa(int cam)
+{
+  for (int n = 0; n < NUM_OBJS; n++) {
+    int id = active[n];
+    EventHistory history = push_event_history(OBJ_INFO(cam, id, event_history), OBJ_INFO(cam, id, detected_frame_count) >= PER_CAM_SEC_FRAME - 1);
+    if (__builtin_popcountll(history & BENCH_WINDOW_MASK) >= 15) {
+      history = 0;
+      OBJ_INFO(cam, id, notification_flag) = 1;
+    }
+    OBJ_INFO(cam, id, event_history) = history;
+    OBJ_INFO(cam, id, detected_frame_count) = 0;
+  }
+  for (int n = 0; n < NUM_OBJS; n++) {
+    int id = active[n];
+    OBJ_INFO(cam, id, temp_history) = push_event_history(OBJ_INFO(cam, id, temp_history), 
+                                                         OBJ_INFO(cam, id, bbox_temp) > 30 && OBJ_INFO(cam, id, last_event_tick) < 0);
+  }
+  for (int n = 0; n < NUM_OBJS; n++) {
+    int id = active[n];
+    if (OBJ_INFO(cam, id, notification_flag))
+      OBJ_INFO(cam, id, notification_flag) = 0;
+  }
+}
+
+
+static void run(const char *layout, void (*frame_fn)(int, int), void (*tick_fn)(int), void (*lines_fn)(int, int), int frames)
+{
+  int fd_miss = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+  int fd_llc = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+  struct timespec start, end;
+  double store_ns = 0.0;
+  long long l1d_miss = 0, llc_miss = 0;
+
+  for (int frame = 0; frame < frames; frame++) {
+    touch_pollute(frame);
+
+    if (fd_miss >= 0) { ioctl(fd_miss, PERF_EVENT_IOC_ENABLE, 0); }
+    if (fd_llc >= 0) { ioctl(fd_llc, PERF_EVENT_IOC_ENABLE, 0); }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int cam = 0; cam < BENCH_CAMS; cam++) {
+      frame_fn(cam, frame);
+      if ((frame % PER_CAM_SEC_FRAME) == PER_CAM_SEC_FRAME - 1)
+        tick_fn(cam);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (fd_miss >= 0) { ioctl(fd_miss, PERF_EVENT_IOC_DISABLE, 0); }
+    if (fd_llc >= 0) { ioctl(fd_llc, PERF_EVENT_IOC_DISABLE, 0); }
+
+    store_ns += (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  }
+  l1d_miss = read_counter(fd_miss);
+  llc_miss = read_counter(fd_llc);
+  if (fd_miss >= 0) close(fd_miss);
+  if (fd_llc >= 0) close(fd_llc);
+
+  printf("layout=%s objs=%d frames=%d ns_per_frame=%.1f lines_per_frame=%.1f l1d_miss_per_frame=%.1f llc_miss_per_frame=%.1f\n",
+         layout, NUM_OBJS, frames, store_ns / frames, count_lines(lines_fn),
+         l1d_miss < 0 ? -1.0 : (double)l1d_miss / frames, llc_miss < 0 ? -1.0 : (double)llc_miss / frames);
+}
+
+
+int main(int argc, char *argv[])
+{
+  int frames = (argc > 1) ? atoi(argv[1]) : 15 * 600;
+
+  set_glog_level(GLOG_ERROR);       //only errors of the core, the output stays one line per layout
+  obj_store = bench_store;
+
+  // Live slots come in hash order from obj_slot_map, not sequentially
+  for (int i = 0; i < NUM_OBJS; i++)
+    active[i] = i;
+  srand(1);
+  for (int i = NUM_OBJS - 1; i > 0; i--) {
+    int j = rand() % (i + 1), t = active[i];
+    active[i] = active[j];
+    active[j] = t;
+  }
+  printf("sizeof_obj_monitor=%zu sizeof_obj_store=%zu\n", sizeof(ObjMonitor), sizeof(ObjStore));
+
+  run("aos", frame_aos, tick_aos, lines_aos, frames);
+  run("soa", frame_soa, tick_soa, lines_soa, frames);
+
+  return 0;
+}
@@ -0,0 +1,62 @@
+#include <string.h>
+#include <stdio.h>
+#include <malloc.h>
+#include "osd_label.h"
+
+
+void init_osd_label(OsdLabel *label)
+{
+  label->temp = OSD_LABEL_NO_TEMP;
+  label->base[0] = 0;
+  label->text[0] = 0;
+}
+
+
+// Compare src without its newlines to the base of the label
+static gboolean is_same_base(const OsdLabel *label, const char *src)
+{
+  const char *base = label->base;
+
+  for (; *src; src++) {
+    if (*src == '\n')
+      continue;
+    if (*base != *src)
+      return FALSE;
+    base++;
+  }
+  return *base == 0;
+}
+
+
+// Format "<label>[<temp>°C]" into label->text. Returns FALSE when the label and the temperature are
+// the ones of the last call, label->text is then reused as it is
+gboolean update_temp_label(OsdLabel *label, const char *src, int temp)
+{
+  char *dst = label->base;
+
+  if (temp == label->temp && is_same_base(label, src))
+    return FALSE;
+
+  for (; *src && dst < label->base + OSD_LABEL_LEN - 1; src++) {
+    if (*src != '\n')
+      *dst++ = *src;
+  }
+  *dst = 0;
+  label->temp = temp;
+  snprintf(label->text, OSD_LABEL_LEN, "%s[%d°C]", label->base, temp);
+
+  return TRUE;
+}
+
+
+// Write text into the display_text of an object meta. DeepStream g_free()s display_text with the meta,
+// so the string stays heap memory owned by the meta : it is overwritten in place when its block is
+// large enough (glib allocates through the system malloc), and only grown otherwise
+void set_osd_text(char **display_text, const char *text)
+{
+  size_t len = strlen(text);
+
+  if (*display_text == NULL || malloc_usable_size(*display_text) <= len)
+    *display_text = g_realloc(*display_text, len + 1);
+  memcpy(*display_text, text, len + 1);
+}
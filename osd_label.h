@@ -0,0 +1,21 @@
+#ifndef __OSD_LABEL_H__
+#define __OSD_LABEL_H__
+
+#include <glib.h>
+
+#define OSD_LABEL_LEN             64              //longest label kept per object, longer tracker labels are cut
+#define OSD_LABEL_NO_TEMP         G_MININT
+
+// Label of one object slot, reused across frames and only reformatted when its inputs change
+typedef struct {
+  int temp;                       // temperature in text[], OSD_LABEL_NO_TEMP before the first format
+  char base[OSD_LABEL_LEN];       // tracker label without newlines, as text[] was formatted from
+  char text[OSD_LABEL_LEN];       // base followed by the temperature
+} OsdLabel;
+
+
+void init_osd_label(OsdLabel *label);
+gboolean update_temp_label(OsdLabel *label, const char *src, int temp);
+void set_osd_text(char **display_text, const char *text);
+
+#endif
@@ -0,0 +1,126 @@
+// Allocator calls of the OSD label path, g_free/g_strdup per object (before) vs OsdLabel + in place copy (after).
+// Replays the label work of osd_sink_pad_buffer_probe() on synthetic object labels of the thermal camera,
+// every object shows its temperature and the temperature of an object moves every few seconds.
+//
+//   osd_label_bench [frames] [objs]
+//
+// Prints one "key=value" line per path. Allocator calls are counted by bench_alloc.c,
+// the labels the tracker allocates for each frame are created outside of the counted section.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench_alloc.h"
+#include "osd_label.h"
+
+#define BENCH_FPS                 15
+#define BENCH_TEMP_PERIOD         (BENCH_FPS * 3)     //frames between two temperature changes of an object
+
+static const char *class_names[] = { "normal", "heat", "flip", "labor", "sitting" };
+
+
+static void remove_newlines(char *str)
+{
+  char *src = str, *dst = str;
+
+  for (; *src; src++) {
+    if (*src != '\n')
+      *dst++ = *src;
+  }
+  *dst = 0;
+}
+
+
+// temp_display_text() and remove_newline_text() before OsdLabel, kept here as the reference
+static void old_label(char **display_text, int temp)
+{
+  char text[100] = "", append_text[100] = "";
+
+  strcpy(text, *display_text);
+  sprintf(append_text, "[%d°C]", temp);
+  strcat(text, append_text);
+  remove_newlines(text);
+  g_free(*display_text);
+  *display_text = g_strdup(text);
+
+  strcpy(text, *display_text);
+  remove_newlines(text);
+  g_free(*display_text);
+  *display_text = g_strdup(text);
+}
+
+
+static void new_label(OsdLabel *label, char **display_text, int temp)
+{
+  update_temp_label(label, *display_text, temp);
+  set_osd_text(display_text, label->text);
+  remove_newlines(*display_text);
+}
+
+
+static int get_temp(int obj, int frame)
+{
+  return 30 + (obj % 7) + (frame + obj * 5) / BENCH_TEMP_PERIOD % 3;
+}
+
+
+static void run(const char *name, int use_cache, int frames, int objs)
+{
+  char **texts = g_new0(char *, objs);
+  OsdLabel *labels = g_new0(OsdLabel, objs);
+  struct timespec start, end;
+  AllocCount count;
+  double ns = 0.0;
+  long check = 0;
+
+  reset_alloc_count();
+  for (int i = 0; i < objs; i++)
+    init_osd_label(&labels[i]);
+
+  for (int frame = 0; frame < frames; frame++) {
+    for (int i = 0; i < objs; i++)                                //labels of this frame's object meta
+      texts[i] = g_strdup_printf("%s %d\n", class_names[i % 5], i);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    start_alloc_count();
+    for (int i = 0; i < objs; i++) {
+      if (use_cache)
+        new_label(&labels[i], &texts[i], get_temp(i, frame));
+      else
+        old_label(&texts[i], get_temp(i, frame));
+    }
+    stop_alloc_count();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ns += (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+
+    for (int i = 0; i < objs; i++) {                              //meta released downstream
+      check += strlen(texts[i]);
+      g_free(texts[i]);
+    }
+  }
+
+  get_alloc_count(&count);
+  printf("path=%s frames=%d objs=%d alloc_calls=%ld free_calls=%ld alloc_per_obj=%.3f ns_per_obj=%.1f check=%ld\n",
+         name, frames, objs, count.alloc_calls, count.free_calls, (double)count.alloc_calls / ((double)frames * objs),
+         ns / ((double)frames * objs), check);
+
+  g_free(labels);
+  g_free(texts);
+}
+
+
+int main(int argc, char *argv[])
+{
+  int frames = (argc > 1) ? atoi(argv[1]) : BENCH_FPS * 60;
+  int objs = (argc > 2) ? atoi(argv[2]) : 64;
+
+  if (frames < 1 || objs < 1) {
+    fprintf(stderr, "usage: %s [frames] [objs]\n", argv[0]);
+    return 1;
+  }
+  run("before", 0, frames, objs);
+  run("after", 1, frames, objs);
+
+  return 0;
+}
@@ -0,0 +1,501 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "g_log.h"
+#include "outbox.h"
+
+#define OUTBOX_CRC_START          offsetof(OutboxRecord, event_id)
+
+
+static guint32 get_crc32(const void *data, size_t len)
+{
+  const unsigned char *p = (const unsigned char *)data;
+  guint32 crc = 0xffffffff;
+
+  for (size_t i = 0; i < len; i++) {
+    crc ^= p[i];
+    for (int k = 0; k < 8; k++)
+      crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+  }
+
+  return ~crc;
+}
+
+
+static guint32 get_record_crc(const OutboxRecord *record)
+{
+  return get_crc32((const char *)record + OUTBOX_CRC_START, sizeof(OutboxRecord) - OUTBOX_CRC_START);
+}
+
+
+// FNV-1a of the event key (the video url, unique per recording) and the event class
+guint64 get_outbox_event_id(const char *key, const char *evt)
+{
+  guint64 hash = 0xcbf29ce484222325ULL;
+
+  for (const char *p = key; *p; p++)
+    hash = (hash ^ (unsigned char)*p) * 0x100000001b3ULL;
+  hash = (hash ^ '/') * 0x100000001b3ULL;
+  for (const char *p = evt; *p; p++)
+    hash = (hash ^ (unsigned char)*p) * 0x100000001b3ULL;
+
+  return hash;
+}
+
+
+// Write back the pages of [data, data + len) before returning, the order of two syncs is the order on disk
+static void sync_outbox(const void *data, size_t len)
+{
+  long page = sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)data & ~(uintptr_t)(page - 1);
+
+  if (msync((void *)start, (uintptr_t)data + len - start, MS_SYNC) != 0)
+    glog_error("msync failed, %s\n", strerror(errno));
+}
+
+
+static void set_record_state(OutboxRecord *record, gint32 state)
+{
+  g_atomic_int_set(&record->state, state);
+  sync_outbox(&record->state, sizeof(record->state));
+}
+
+
+static gboolean copy_file(const char *src, const char *dst)
+{
+  char buf[16384];
+  ssize_t n = 0;
+  int in = open(src, O_RDONLY);
+  int out;
+
+  if (in < 0)
+    return FALSE;
+  out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0) {
+    close(in);
+    return FALSE;
+  }
+  while ((n = read(in, buf, sizeof(buf))) > 0) {
+    if (write(out, buf, n) != n) {
+      n = -1;
+      break;
+    }
+  }
+  if (n == 0 && fsync(out) != 0)
+    n = -1;
+  close(in);
+  close(out);
+  if (n < 0)
+    unlink(dst);
+
+  return n == 0;
+}
+
+
+static gboolean write_file(const char *path, const unsigned char *data, int size)
+{
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  gboolean ok;
+
+  if (fd < 0)
+    return FALSE;
+  ok = write(fd, data, size) == size && fsync(fd) == 0;
+  close(fd);
+  if (!ok)
+    unlink(path);
+
+  return ok;
+}
+
+
+static void remove_event_files(OutboxRecord *record)
+{
+  if (record->snapshot[0])
+    unlink(record->snapshot);
+  if (record->thumbnail[0])
+    unlink(record->thumbnail);
+}
+
+
+gboolean open_outbox(Outbox *outbox, const char *dir)
+{
+  size_t size = sizeof(OutboxHeader) + sizeof(OutboxRecord) * OUTBOX_SLOTS;
+  char path[512];
+  struct stat info;
+  void *map;
+
+  memset(outbox, 0, sizeof(*outbox));
+  outbox->fd = -1;
+  if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+    glog_error("can not make %s, %s\n", dir, strerror(errno));
+    return FALSE;
+  }
+  snprintf(path, sizeof(path), "%s/%s", dir, OUTBOX_FILE);
+  outbox->fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (outbox->fd < 0 || fstat(outbox->fd, &info) != 0 || ((size_t)info.st_size < size && ftruncate(outbox->fd, size) != 0)) {
+    glog_error("can not open %s, %s\n", path, strerror(errno));
+    if (outbox->fd >= 0)
+      close(outbox->fd);
+    outbox->fd = -1;
+    return FALSE;
+  }
+  map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, outbox->fd, 0);
+  if (map == MAP_FAILED) {
+    glog_error("can not map %s, %s\n", path, strerror(errno));
+    close(outbox->fd);
+    outbox->fd = -1;
+    return FALSE;
+  }
+
+  outbox->header = (OutboxHeader *)map;
+  outbox->records = (OutboxRecord *)(outbox->header + 1);
+  outbox->dir = g_strdup(dir);
+  g_mutex_init(&outbox->lock);
+
+  if (outbox->header->magic != OUTBOX_MAGIC || outbox->header->slots != OUTBOX_SLOTS ||
+      outbox->header->record_size != sizeof(OutboxRecord)) {
+    if (outbox->header->magic != 0)
+      glog_error("%s has another layout, started empty\n", path);
+    memset(map, 0, size);
+    outbox->header->slots = OUTBOX_SLOTS;
+    outbox->header->record_size = sizeof(OutboxRecord);
+    sync_outbox(map, size);
+    outbox->header->magic = OUTBOX_MAGIC;
+    sync_outbox(outbox->header, sizeof(OutboxHeader));
+  }
+
+  //records cut by a crash fail their crc and are forgotten, their event had not been accepted yet
+  for (int i = 0; i < OUTBOX_SLOTS; i++) {
+    OutboxRecord *record = &outbox->records[i];
+    if (record->state == OUTBOX_FREE)
+      continue;
+    if (record->magic != OUTBOX_MAGIC || record->crc != get_record_crc(record)) {
+      glog_error("outbox slot %d is corrupted, dropped\n", i);
+      set_record_state(record, OUTBOX_FREE);
+      continue;
+    }
+    if (record->state == OUTBOX_PENDING)
+      outbox->depth++;
+  }
+  glog_trace("outbox %s depth=%d\n", path, outbox->depth);
+
+  return TRUE;
+}
+
+
+void close_outbox(Outbox *outbox)
+{
+  if (outbox->header == NULL)
+    return;
+  munmap(outbox->header, sizeof(OutboxHeader) + sizeof(OutboxRecord) * OUTBOX_SLOTS);
+  close(outbox->fd);
+  g_mutex_clear(&outbox->lock);
+  g_free(outbox->dir);
+  outbox->header = NULL;
+  outbox->records = NULL;
+  outbox->dir = NULL;
+}
+
+
+// Slot for a new event : a free one, else the oldest sent one, else the oldest pending one is given up
+static int get_outbox_free_slot(Outbox *outbox)
+{
+  int sent = -1, pending = -1;
+
+  for (int i = 0; i < OUTBOX_SLOTS; i++) {
+    OutboxRecord *record = &outbox->records[i];
+    if (record->state == OUTBOX_FREE)
+      return i;
+    if (record->state == OUTBOX_SENT && (sent < 0 || record->created < outbox->records[sent].created))
+      sent = i;
+    else if (record->state == OUTBOX_PENDING && (pending < 0 || record->created < outbox->records[pending].created))
+      pending = i;
+  }
+  if (sent >= 0)
+    return sent;
+
+  glog_error("outbox full, event of %s class %s given up\n", outbox->records[pending].video_url, outbox->records[pending].evt);
+  remove_event_files(&outbox->records[pending]);
+  outbox->depth--;
+  outbox->dropped++;
+
+  return pending;
+}
+
+
+// Persist an event before it is sent. The snapshot is copied, the camera overwrites its file with the next
+// event, and the thumbnail is written next to it. FALSE when the same event is already in the outbox
+gboolean add_outbox_event(Outbox *outbox, const OutboxRecord *event, const char *snapshot_path,
+                          const unsigned char *thumbnail, int thumbnail_size)
+{
+  OutboxRecord *record;
+  int slot;
+
+  if (outbox->header == NULL)
+    return FALSE;
+
+  g_mutex_lock(&outbox->lock);
+  for (int i = 0; i < OUTBOX_SLOTS; i++) {
+    if (outbox->records[i].state != OUTBOX_FREE && outbox->records[i].event_id == event->event_id) {
+      outbox->duplicates++;
+      g_mutex_unlock(&outbox->lock);
+      glog_trace("event %016" G_GINT64_MODIFIER "x already in the outbox\n", event->event_id);
+      return FALSE;
+    }
+  }
+
+  slot = get_outbox_free_slot(outbox);
+  record = &outbox->records[slot];
+
+  //everything but the state first : a crash before the state is written leaves the slot as it was or unreadable
+  memcpy((char *)record + OUTBOX_CRC_START, (const char *)event + OUTBOX_CRC_START, sizeof(OutboxRecord) - OUTBOX_CRC_START);
+  record->snapshot[0] = 0;
+  if (snapshot_path && snapshot_path[0]) {
+    snprintf(record->snapshot, sizeof(record->snapshot), "%s/%016" G_GINT64_MODIFIER "x.jpg", outbox->dir, event->event_id);
+    if (!copy_file(snapshot_path, record->snapshot)) {
+      glog_error("can not keep the snapshot %s\n", snapshot_path);
+      record->snapshot[0] = 0;
+    }
+  }
+  record->thumbnail[0] = 0;
+  record->thumbnail_size = 0;
+  if (thumbnail && thumbnail_size > 0) {
+    snprintf(record->thumbnail, sizeof(record->thumbnail), "%s/%016" G_GINT64_MODIFIER "x.thumb.jpg", outbox->dir, event->event_id);
+    if (write_file(record->thumbnail, thumbnail, thumbnail_size))
+      record->thumbnail_size = thumbnail_size;
+    else {
+      glog_error("can not keep the thumbnail of %s\n", event->video_url);
+      record->thumbnail[0] = 0;
+    }
+  }
+  record->attempts = 0;
+  record->magic = OUTBOX_MAGIC;
+  record->crc = get_record_crc(record);
+  sync_outbox(record, sizeof(OutboxRecord));
+  set_record_state(record, OUTBOX_PENDING);
+  outbox->depth++;
+  g_mutex_unlock(&outbox->lock);
+
+  return TRUE;
+}
+
+
+// Oldest pending event when the retry delay of the last failure is over, its slot is given to ack_outbox_event().
+// -1 when there is nothing to send now
+int get_outbox_ready(Outbox *outbox, gint64 now, OutboxRecord *event)
+{
+  int slot = -1;
+
+  if (outbox->header == NULL)
+    return -1;
+
+  g_mutex_lock(&outbox->lock);
+  if (now >= outbox->retry_time) {
+    for (int i = 0; i < OUTBOX_SLOTS; i++) {
+      OutboxRecord *record = &outbox->records[i];
+      if (record->state == OUTBOX_PENDING && (slot < 0 || record->created < outbox->records[slot].created))
+        slot = i;
+    }
+    if (slot >= 0)
+      *event = outbox->records[slot];
+  }
+  g_mutex_unlock(&outbox->lock);
+
+  return slot;
+}
+
+
+// delivered : the server took the event (or refused it for good), its slot and files are released.
+// Otherwise the uplink is assumed down and nothing is sent for OUTBOX_RETRY_MIN * 2^failures sec
+void ack_outbox_event(Outbox *outbox, int slot, guint64 event_id, gboolean delivered, gint64 now)
+{
+  OutboxRecord *record;
+
+  if (outbox->header == NULL || slot < 0 || slot >= OUTBOX_SLOTS)
+    return;
+
+  g_mutex_lock(&outbox->lock);
+  record = &outbox->records[slot];
+  if (record->state != OUTBOX_PENDING || record->event_id != event_id) {
+    g_mutex_unlock(&outbox->lock);
+    return;                                       //given up for a newer event while it was being sent
+  }
+
+  if (delivered) {
+    set_record_state(record, OUTBOX_SENT);
+    remove_event_files(record);
+    outbox->depth--;
+    outbox->failures = 0;
+    outbox->retry_time = 0;
+  }
+  else {
+    gint64 delay = (gint64)OUTBOX_RETRY_MIN << MIN(outbox->failures, 16);
+    delay = MIN(delay, OUTBOX_RETRY_MAX) * G_USEC_PER_SEC;
+    delay += g_random_int_range(0, (gint32)(delay / 4 / 1000) + 1) * (gint64)1000;      //up to +25%, devices of a farm share the uplink
+    outbox->failures++;
+    outbox->retry_time = now + delay;
+    g_atomic_int_set(&record->attempts, record->attempts + 1);
+    sync_outbox(&record->attempts, sizeof(record->attempts));
+  }
+  g_mutex_unlock(&outbox->lock);
+}
+
+
+int get_outbox_depth(Outbox *outbox)
+{
+  int depth;
+
+  if (outbox->header == NULL)
+    return 0;
+  g_mutex_lock(&outbox->lock);
+  depth = outbox->depth;
+  g_mutex_unlock(&outbox->lock);
+
+  return depth;
+}
+
+
+// sec since the oldest pending event was raised, 0 when the outbox is empty
+int get_outbox_oldest_age(Outbox *outbox, gint64 real_now)
+{
+  gint64 oldest = 0;
+
+  if (outbox->header == NULL)
+    return 0;
+
+  g_mutex_lock(&outbox->lock);
+  for (int i = 0; i < OUTBOX_SLOTS; i++) {
+    OutboxRecord *record = &outbox->records[i];
+    if (record->state == OUTBOX_PENDING && (oldest == 0 || record->created < oldest))
+      oldest = record->created;
+  }
+  g_mutex_unlock(&outbox->lock);
+
+  return oldest ? (int)((real_now - oldest) / G_USEC_PER_SEC) : 0;
+}
+
+
+#ifdef TEST_OUTBOX
+// Outbox in a scratch directory : restart without close, retry delays, dedup, torn records and a full outbox
+#include <stdlib.h>
+#include "test_check.h"
+
+static void make_event(OutboxRecord *event, int n, const char *evt)
+{
+  memset(event, 0, sizeof(*event));
+  snprintf(event->video_url, sizeof(event->video_url), "http://127.0.0.1/data/EVENT_20260101/CAM0_%06d.webm", n);
+  g_strlcpy(event->evt, evt, sizeof(event->evt));
+  g_strlcpy(event->cam_id, "ITC100A", sizeof(event->cam_id));
+  event->event_id = get_outbox_event_id(event->video_url, evt);
+  event->created = (gint64)(1000 + n) * G_USEC_PER_SEC;
+}
+
+static gboolean same_file(const char *path, const unsigned char *data, int size)
+{
+  unsigned char buf[4096];
+  int fd = open(path, O_RDONLY);
+  int n;
+
+  if (fd < 0)
+    return FALSE;
+  n = read(fd, buf, sizeof(buf));
+  close(fd);
+
+  return n == size && !memcmp(buf, data, size);
+}
+
+int main(int argc, char *argv[])
+{
+  char dir[] = "/tmp/outbox_testXXXXXX";
+  char snapshot[600], path[600], thumbnail_path[600];
+  unsigned char thumbnail[2000];
+  Outbox outbox, restarted;
+  OutboxRecord event, ready;
+  int failed = 0, slot;
+  gint64 now = 1000000;
+
+  if (mkdtemp(dir) == NULL)
+    return 1;
+  snprintf(snapshot, sizeof(snapshot), "%s/cam0_snapshot.jpg", dir);
+  FILE *fp = fopen(snapshot, "w");
+  fputs("jpeg", fp);
+  fclose(fp);
+  for (int i = 0; i < (int)sizeof(thumbnail); i++)
+    thumbnail[i] = (unsigned char)(i * 7);
+
+  failed += check(open_outbox(&outbox, dir) && get_outbox_depth(&outbox) == 0, "new outbox is empty");
+  for (int i = 0; i < 3; i++) {
+    make_event(&event, i, "3");
+    add_outbox_event(&outbox, &event, snapshot, i == 0 ? thumbnail : NULL, i == 0 ? sizeof(thumbnail) : 0);
+  }
+  make_event(&event, 1, "3");
+  failed += check(!add_outbox_event(&outbox, &event, snapshot, NULL, 0) && get_outbox_depth(&outbox) == 3, "same event added once");
+  make_event(&event, 1, "4");
+  failed += check(add_outbox_event(&outbox, &event, snapshot, NULL, 0) && get_outbox_depth(&outbox) == 4, "other class of the same recording kept");
+  failed += check(get_outbox_oldest_age(&outbox, (gint64)1100 * G_USEC_PER_SEC) == 100, "oldest age");
+
+  //restart : the first mapping is never closed, as after a crash
+  failed += check(open_outbox(&restarted, dir) && get_outbox_depth(&restarted) == 4, "pending events survive a restart");
+  slot = get_outbox_ready(&restarted, now, &ready);
+  make_event(&event, 0, "3");
+  failed += check(slot >= 0 && ready.event_id == event.event_id && access(ready.snapshot, R_OK) == 0, "oldest first, with its snapshot");
+  failed += check(ready.thumbnail_size == sizeof(thumbnail) && same_file(ready.thumbnail, thumbnail, sizeof(thumbnail)), "thumbnail kept next to the record");
+
+  ack_outbox_event(&restarted, slot, ready.event_id, FALSE, now);
+  failed += check(get_outbox_ready(&restarted, now + OUTBOX_RETRY_MIN * G_USEC_PER_SEC - 1, &ready) < 0, "nothing sent before the retry delay");
+  now += OUTBOX_RETRY_MIN * G_USEC_PER_SEC * 5 / 4 + 1;
+  failed += check(get_outbox_ready(&restarted, now, &ready) == slot, "same event retried after the delay");
+  ack_outbox_event(&restarted, slot, ready.event_id, FALSE, now);
+  failed += check(get_outbox_ready(&restarted, now + OUTBOX_RETRY_MIN * 2 * G_USEC_PER_SEC - 1, &ready) < 0, "delay doubled");
+  for (int i = 0; i < 20; i++)
+    ack_outbox_event(&restarted, slot, ready.event_id, FALSE, now);
+  failed += check(get_outbox_ready(&restarted, now + OUTBOX_RETRY_MAX * G_USEC_PER_SEC * 5 / 4 + 1, &ready) == slot, "delay capped");
+
+  g_strlcpy(path, ready.snapshot, sizeof(path));
+  g_strlcpy(thumbnail_path, ready.thumbnail, sizeof(thumbnail_path));
+  ack_outbox_event(&restarted, slot, ready.event_id, TRUE, now);
+  failed += check(get_outbox_depth(&restarted) == 3 && access(path, F_OK) != 0 && access(thumbnail_path, F_OK) != 0,
+                  "delivered event, snapshot and thumbnail released");
+  failed += check(get_outbox_ready(&restarted, now, &ready) >= 0 && ready.event_id != event.event_id, "next event ready at once");
+  failed += check(!add_outbox_event(&restarted, &event, snapshot, NULL, 0), "delivered event not queued again");
+  close_outbox(&restarted);
+  close_outbox(&outbox);
+
+  //torn record : a byte of the event changed behind the crc
+  snprintf(path, sizeof(path), "%s/%s", dir, OUTBOX_FILE);
+  int fd = open(path, O_RDWR);
+  off_t offset = sizeof(OutboxHeader) + offsetof(OutboxRecord, video_url);
+  for (int i = 0; i < OUTBOX_SLOTS; i++, offset += sizeof(OutboxRecord)) {
+    gint32 state;
+    pread(fd, &state, sizeof(state), offset - offsetof(OutboxRecord, video_url) + offsetof(OutboxRecord, state));
+    if (state == OUTBOX_PENDING) {
+      pwrite(fd, "X", 1, offset);
+      break;
+    }
+  }
+  close(fd);
+  failed += check(open_outbox(&outbox, dir) && get_outbox_depth(&outbox) == 2, "torn record dropped on open");
+
+  for (int i = 100; i < 100 + OUTBOX_SLOTS + 10; i++) {
+    make_event(&event, i, "5");
+    add_outbox_event(&outbox, &event, NULL, NULL, 0);
+  }
+  failed += check(get_outbox_depth(&outbox) == OUTBOX_SLOTS && outbox.dropped == 12, "full outbox gives up its oldest events");
+  slot = get_outbox_ready(&outbox, now, &ready);
+  make_event(&event, 110, "5");                    //the 2 older events and 100..109 given up
+  failed += check(slot >= 0 && ready.event_id == event.event_id, "oldest kept event sent first");
+  close_outbox(&outbox);
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  snprintf(path, sizeof(path), "rm -rf %s", dir);
+  system(path);
+
+  return failed ? 1 : 0;
+}
+#endif
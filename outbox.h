@@ -0,0 +1,73 @@
+#ifndef __OUTBOX_H__
+#define __OUTBOX_H__
+
+// Notifications waiting for the server, kept on disk so an uplink outage or a restart does not lose them.
+// The outbox file is a fixed ring of OUTBOX_SLOTS records mapped in memory, the object thumbnail and the
+// full snapshot, when they go with the event, are kept as files next to it. Memory and disk stay bounded,
+// a full outbox replaces its oldest event.
+#include <glib.h>
+
+#define OUTBOX_FILE               "outbox.dat"
+#define OUTBOX_SLOTS              256
+#define OUTBOX_MAGIC              0x3258424f      //"OBX2"
+#define OUTBOX_RETRY_MIN          2               //sec, first retry after a failed send, doubled on each failure
+#define OUTBOX_RETRY_MAX          300             //sec
+
+enum {
+  OUTBOX_FREE = 0,
+  OUTBOX_PENDING,
+  OUTBOX_SENT,                    // delivered or given up, kept so a replayed event is recognized
+};
+
+// One slot of the file. The crc covers the event only, state and attempts are single words written
+// in place after it, so a torn write leaves either the old state or a record that fails its crc
+typedef struct {
+  guint32 magic;
+  guint32 crc;
+  gint32 state;
+  gint32 attempts;
+  guint64 event_id;               // same id twice is one event, see get_outbox_event_id()
+  gint64 created;                 // g_get_real_time()
+  gint32 cam_idx;
+  gint32 class_id;
+  char cam_id[64];
+  char evt[8];
+  char video_url[256];
+  char position[32];
+  char snapshot[256];             // copy of the snapshot owned by the outbox, empty when there was none
+  char thumbnail[256];            // JPEG of the object owned by the outbox, empty when there was none
+  gint32 thumbnail_size;
+} OutboxRecord;
+
+typedef struct {
+  guint32 magic;
+  guint32 slots;
+  guint32 record_size;
+  guint32 reserved;
+} OutboxHeader;
+
+typedef struct {
+  GMutex lock;
+  char *dir;
+  int fd;
+  OutboxHeader *header;           // mapping of the whole file
+  OutboxRecord *records;
+  gint64 retry_time;              // g_get_monotonic_time() before which nothing is sent, the uplink failed
+  int failures;                   // sends failed in a row, the retry delay doubles with each one
+  int depth;                      // pending events
+  int dropped;                    // pending events replaced by newer ones when full
+  int duplicates;                 // events refused because their id was already in the outbox
+} Outbox;
+
+
+guint64 get_outbox_event_id(const char *key, const char *evt);
+gboolean open_outbox(Outbox *outbox, const char *dir);
+void close_outbox(Outbox *outbox);
+gboolean add_outbox_event(Outbox *outbox, const OutboxRecord *event, const char *snapshot_path,
+                          const unsigned char *thumbnail, int thumbnail_size);
+int get_outbox_ready(Outbox *outbox, gint64 now, OutboxRecord *event);
+void ack_outbox_event(Outbox *outbox, int slot, guint64 event_id, gboolean delivered, gint64 now);
+int get_outbox_depth(Outbox *outbox);
+int get_outbox_oldest_age(Outbox *outbox, gint64 real_now);
+
+#endif
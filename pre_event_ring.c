@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <string.h>
+#include "g_log.h"
+#include "pre_event_ring.h"
+
+
+void init_pre_event_ring(PreEventRing *ring, int capacity, gsize max_bytes, gint64 preroll, GDestroyNotify free_data)
+{
+  guint size = 16;
+
+  while (size < (guint)capacity && size < PRE_EVENT_RING_UNITS * 4)
+    size <<= 1;
+
+  memset(ring, 0, sizeof(*ring));
+  ring->units = g_new0(PreEventUnit, size);
+  ring->mask = size - 1;
+  ring->max_bytes = max_bytes;
+  ring->preroll = preroll;
+  ring->free_data = free_data;
+}
+
+
+static void drop_oldest_unit(PreEventRing *ring)
+{
+  PreEventUnit *unit = &ring->units[ring->head];
+
+  if (ring->free_data && unit->data)
+    ring->free_data(unit->data);
+  ring->bytes -= unit->size;
+  memset(unit, 0, sizeof(*unit));
+  ring->head = (ring->head + 1) & ring->mask;
+  ring->count--;
+}
+
+
+// The oldest keyframe and the frames depending on it, the ring starts on the next keyframe afterwards
+static void drop_oldest_gop(PreEventRing *ring)
+{
+  do {
+    drop_oldest_unit(ring);
+  } while (ring->count > 0 && !ring->units[ring->head].keyframe);
+}
+
+
+// Index of the first keyframe after the oldest one, -1 when the ring holds a single GOP
+static int get_second_keyframe(PreEventRing *ring)
+{
+  for (guint i = 1; i < ring->count; i++) {
+    if (ring->units[(ring->head + i) & ring->mask].keyframe)
+      return (int)i;
+  }
+
+  return -1;
+}
+
+
+void clear_pre_event_ring(PreEventRing *ring)
+{
+  while (ring->count > 0)
+    drop_oldest_unit(ring);
+  ring->head = 0;
+}
+
+
+void free_pre_event_ring(PreEventRing *ring)
+{
+  if (ring->units == NULL)
+    return;
+  clear_pre_event_ring(ring);
+  g_clear_pointer(&ring->units, g_free);
+}
+
+
+// Take one access unit, data is the ring's from now on even when it is refused. FALSE when it was refused :
+// a delta unit with no keyframe to start from. Timestamps going back restart the ring (source restarted)
+gboolean push_pre_event_unit(PreEventRing *ring, gint64 pts, gboolean keyframe, gsize size, gpointer data)
+{
+  PreEventUnit *unit;
+  int second;
+
+  ring->pushed++;
+  if (ring->count > 0 && pts < get_pre_event_newest(ring)) {
+    glog_trace("pre-event ring pts went back %" G_GINT64_FORMAT " -> %" G_GINT64_FORMAT ", restarted\n", get_pre_event_newest(ring), pts);
+    clear_pre_event_ring(ring);
+  }
+  if (ring->count == 0 && !keyframe) {
+    ring->skipped++;
+    if (ring->free_data && data)
+      ring->free_data(data);
+    return FALSE;
+  }
+
+  //no room : the oldest GOP goes even if the pre-roll window still needs it
+  while (ring->count > 0 && (ring->count > ring->mask || ring->bytes + size > ring->max_bytes)) {
+    drop_oldest_gop(ring);
+    ring->short_trims++;
+  }
+  if (ring->count == 0 && !keyframe) {
+    ring->skipped++;
+    if (ring->free_data && data)
+      ring->free_data(data);
+    return FALSE;
+  }
+
+  unit = &ring->units[(ring->head + ring->count) & ring->mask];
+  unit->pts = pts;
+  unit->keyframe = keyframe;
+  unit->size = size;
+  unit->data = data;
+  ring->count++;
+  ring->bytes += size;
+
+  //a GOP is released once the next keyframe alone covers the pre-roll window
+  while ((second = get_second_keyframe(ring)) > 0 && ring->units[(ring->head + second) & ring->mask].pts <= pts - ring->preroll) {
+    drop_oldest_gop(ring);
+  }
+
+  return TRUE;
+}
+
+
+// First unit of a clip triggered at trigger_pts : the last keyframe at or before trigger_pts - preroll,
+// or the oldest keyframe when the ring does not reach back that far. -1 when the ring is empty
+int get_pre_event_start(PreEventRing *ring, gint64 trigger_pts)
+{
+  gint64 target = trigger_pts - ring->preroll;
+  int start = 0;
+
+  if (ring->count == 0)
+    return -1;
+  for (guint i = 1; i < ring->count; i++) {
+    PreEventUnit *unit = &ring->units[(ring->head + i) & ring->mask];
+    if (unit->pts > target)
+      break;
+    if (unit->keyframe)
+      start = (int)i;
+  }
+
+  return start;
+}
+
+
+// index from the oldest unit, 0 .. count - 1
+PreEventUnit *get_pre_event_unit(PreEventRing *ring, int index)
+{
+  if (index < 0 || (guint)index >= ring->count)
+    return NULL;
+  return &ring->units[(ring->head + index) & ring->mask];
+}
+
+
+// pts of the newest unit, -1 when the ring is empty
+gint64 get_pre_event_newest(PreEventRing *ring)
+{
+  if (ring->count == 0)
+    return -1;
+  return ring->units[(ring->head + ring->count - 1) & ring->mask].pts;
+}
+
+
+#ifdef TEST_PRE_EVENT_RING
+// 30 fps stream with a keyframe every 30 frames : GOP aligned start, exact pre-roll, byte and unit limits
+#include "test_check.h"
+
+#define TEST_FRAME                (G_GINT64_CONSTANT(1000000000) / 30)
+
+static int test_freed = 0;
+
+static void free_test_unit(gpointer data)
+{
+  test_freed++;
+}
+
+static void push_frames(PreEventRing *ring, int first, int count, int gop, gsize size)
+{
+  for (int n = first; n < first + count; n++)
+    push_pre_event_unit(ring, n * TEST_FRAME, n % gop == 0, size, GINT_TO_POINTER(n + 1));
+}
+
+int main(int argc, char *argv[])
+{
+  PreEventRing ring;
+  PreEventUnit *unit;
+  gint64 newest;
+  int failed = 0, start;
+
+  //3 s pre-roll
+  init_pre_event_ring(&ring, 1024, PRE_EVENT_RING_MAX_BYTES, 3 * G_GINT64_CONSTANT(1000000000), free_test_unit);
+  push_frames(&ring, 5, 25, 30, 1000);
+  failed += check(ring.count == 0 && ring.skipped == 25 && test_freed == 25, "no unit kept before the first keyframe");
+
+  push_frames(&ring, 30, 600, 30, 1000);
+  newest = get_pre_event_newest(&ring);
+  unit = get_pre_event_unit(&ring, 0);
+  failed += check(unit->keyframe && unit->pts <= newest - ring.preroll && unit->pts > newest - ring.preroll - 30 * TEST_FRAME,
+                  "ring starts on the keyframe covering the pre-roll");
+  failed += check(ring.count <= 3 * 30 + 30 && ring.bytes == ring.count * 1000, "ring holds the pre-roll plus one GOP at most");
+  failed += check(test_freed + (int)ring.count == 625, "every dropped unit released");
+
+  start = get_pre_event_start(&ring, newest);
+  unit = get_pre_event_unit(&ring, start);
+  failed += check(unit->keyframe && newest - unit->pts >= ring.preroll && newest - unit->pts < ring.preroll + 30 * TEST_FRAME,
+                  "clip starts on the last keyframe before trigger - pre-roll");
+  start = get_pre_event_start(&ring, newest - 31 * TEST_FRAME);
+  unit = get_pre_event_unit(&ring, start);
+  failed += check(start == 0 && unit->keyframe, "earlier trigger starts on the oldest keyframe");
+  push_frames(&ring, 630, 10, 30, 1000);
+  failed += check(get_pre_event_unit(&ring, get_pre_event_start(&ring, 639 * TEST_FRAME))->pts == 540 * TEST_FRAME,
+                  "pre-roll exact to the GOP, not to the last rotation");
+
+  //byte limit smaller than the window : whole GOPs dropped, counted as short
+  clear_pre_event_ring(&ring);
+  ring.max_bytes = 45 * 1000;
+  push_frames(&ring, 0, 200, 30, 1000);
+  unit = get_pre_event_unit(&ring, 0);
+  failed += check(unit->keyframe && ring.bytes <= ring.max_bytes && ring.short_trims > 0, "byte limit trims whole GOPs");
+
+  //source restarted
+  ring.max_bytes = PRE_EVENT_RING_MAX_BYTES;
+  push_frames(&ring, 0, 40, 30, 1000);
+  failed += check(ring.count == 40 && get_pre_event_unit(&ring, 0)->pts == 0, "pts going back restarts the ring");
+
+  //single GOP longer than the ring
+  free_pre_event_ring(&ring);
+  test_freed = 0;
+  init_pre_event_ring(&ring, 16, PRE_EVENT_RING_MAX_BYTES, 3 * G_GINT64_CONSTANT(1000000000), free_test_unit);
+  push_frames(&ring, 0, 100, 1000, 10);
+  failed += check(ring.count == 0 && ring.skipped > 0, "GOP larger than the ring dropped, waits for the next keyframe");
+  push_frames(&ring, 1000, 5, 1000, 10);
+  failed += check(ring.count == 5 && get_pre_event_unit(&ring, 0)->keyframe, "next keyframe starts again");
+  free_pre_event_ring(&ring);
+  failed += check(test_freed == (int)(ring.pushed), "all units released on free");
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+
+  return failed ? 1 : 0;
+}
+#endif
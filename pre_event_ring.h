@@ -0,0 +1,42 @@
+#ifndef __PRE_EVENT_RING_H__
+#define __PRE_EVENT_RING_H__
+
+// Encoded access units of the last seconds of one camera, so an event clip can start before its trigger.
+// The ring always starts on a keyframe and is trimmed a whole GOP at a time, it keeps the GOP that covers
+// the pre-roll window plus the frames after it. The caller serializes the calls.
+#include <glib.h>
+
+#define PRE_EVENT_RING_UNITS      2048            //access units kept at most, about a minute at 30 fps
+#define PRE_EVENT_RING_MAX_BYTES  (32 * 1024 * 1024)
+
+typedef struct {
+  gint64 pts;               // ns
+  gboolean keyframe;
+  gsize size;
+  gpointer data;            // owned by the ring, released with its free_data
+} PreEventUnit;
+
+typedef struct {
+  PreEventUnit *units;
+  guint mask;               // capacity - 1, capacity is a power of two
+  guint head;               // oldest unit, always a keyframe when count > 0
+  guint count;
+  gsize bytes;              // sum of the unit sizes
+  gsize max_bytes;
+  gint64 preroll;           // ns of footage wanted before a trigger
+  GDestroyNotify free_data;
+  guint64 pushed;           // units offered
+  guint64 skipped;          // units before the first keyframe, no clip can start on them
+  guint64 short_trims;      // GOPs dropped before they left the pre-roll window, the ring is too small
+} PreEventRing;
+
+
+void init_pre_event_ring(PreEventRing *ring, int capacity, gsize max_bytes, gint64 preroll, GDestroyNotify free_data);
+void free_pre_event_ring(PreEventRing *ring);
+void clear_pre_event_ring(PreEventRing *ring);
+gboolean push_pre_event_unit(PreEventRing *ring, gint64 pts, gboolean keyframe, gsize size, gpointer data);
+int get_pre_event_start(PreEventRing *ring, gint64 trigger_pts);
+PreEventUnit *get_pre_event_unit(PreEventRing *ring, int index);
+gint64 get_pre_event_newest(PreEventRing *ring);
+
+#endif
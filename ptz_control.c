@@ -414,7 +414,7 @@ void *process_auto_move_ptz(void *arg)
       }
 
       for(int i = 0; i < 15; i++){                    //LJH, add analysis lasting time when event recording is on process
-        if (g_notifier_running == 0)                  //LJH, if it is not recording
+        if (g_atomic_int_get(&g_notifier_running) == 0)  //LJH, if it is not recording
           break;
         sleep(1);
       }
@@ -265,8 +265,7 @@ void move_ptz_and_send_event(int index, char *pos_str, char *id_str)
     write_position(pos_str[0], index, id_str);
 
 #if (!MINDULE_BLOCK_NOTIFICATION)
-    g_event_class_id = CLASS_HEAT_COW;
-    unlock_notification();           //make sending event
+    publish_event(g_source_cam_idx, CLASS_HEAT_COW);           //make sending event
 #else
     glog_trace("blocked notification by MINDULE\n");
 #endif
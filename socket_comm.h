@@ -28,7 +28,6 @@ SOCKETINFO* init_socket_comm_client(int port);
 
 extern int move_ranch_pos(int index);
 extern void set_process_analysis(gboolean OnOff);
-extern void unlock_notification();
 extern void init_auto_pan();
 extern gboolean is_ptz_motion_stopped();
 extern int is_notifier_running();
@@ -36,7 +35,6 @@ extern int is_notifier_running();
 extern CurlIinfoType g_curlinfo;
 extern DeviceSetting g_setting;
 extern WebRTCConfig g_config;
-extern pthread_mutex_t g_notifier_mutex;
 
 int   send_data_socket_comm(SOCKETINFO* socket, const char* data, int len, int is_self);
 void  close_socket_comm(SOCKETINFO* socket);
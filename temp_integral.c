@@ -0,0 +1,340 @@
+#include <string.h>
+#include <stdio.h>
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "g_log.h"
+#include "temp_integral.h"
+
+
+// Smallest step that keeps the sample grid under THERMAL_MAX_SAMPLES
+int get_thermal_sample_step(int width, int height)
+{
+  int step = 1;
+
+  while (((width + step - 1) / step) * ((height + step - 1) / step) > THERMAL_MAX_SAMPLES)
+    step++;
+
+  return step;
+}
+
+
+// Palette colors from cold to hot, linearly interpolated into PALETTE_STEPS colors
+typedef struct {
+  unsigned char pos;      // 0(coldest) ~ 255(hottest)
+  unsigned char r, g, b;
+} PaletteStop;
+
+#define PALETTE_STEPS   256
+
+static const PaletteStop white_hot_stops[] = { {0, 0, 0, 0}, {255, 255, 255, 255} };
+static const PaletteStop black_hot_stops[] = { {0, 255, 255, 255}, {255, 0, 0, 0} };
+static const PaletteStop iron_stops[] = {
+  {0, 0, 0, 0}, {48, 32, 0, 140}, {112, 180, 0, 150}, {176, 255, 120, 0}, {224, 255, 220, 0}, {255, 255, 255, 255}
+};
+static const PaletteStop rainbow_stops[] = {
+  {0, 0, 0, 255}, {64, 0, 255, 255}, {128, 0, 255, 0}, {192, 255, 255, 0}, {255, 255, 0, 0}
+};
+
+static const struct {
+  const char *name;
+  const PaletteStop *stops;
+  int count;
+} palette_table[NUM_TEMP_PALETTES] = {
+  [TEMP_PALETTE_RED_CHANNEL] = { "red_channel", NULL, 0 },
+  [TEMP_PALETTE_WHITE_HOT]   = { "white_hot", white_hot_stops, G_N_ELEMENTS(white_hot_stops) },
+  [TEMP_PALETTE_BLACK_HOT]   = { "black_hot", black_hot_stops, G_N_ELEMENTS(black_hot_stops) },
+  [TEMP_PALETTE_IRON]        = { "iron", iron_stops, G_N_ELEMENTS(iron_stops) },
+  [TEMP_PALETTE_RAINBOW]     = { "rainbow", rainbow_stops, G_N_ELEMENTS(rainbow_stops) },
+};
+
+// RGB565 index -> temperature in 1/TEMP_LUT_SCALE °C, one table per palette
+static short *g_palette_lut[NUM_TEMP_PALETTES];
+static short *g_temp_lut = NULL;      //table of the current color_pallet, swapped atomically
+// Luma (0~255) -> temperature for the frames that carry only the Y plane of the rendered palette
+static short g_palette_luma_lut[NUM_TEMP_PALETTES][256];
+static short *g_luma_lut = NULL;      //luma table of the current color_pallet
+// cam_ctl palette id -> table, red channel for the ids config.json does not name
+static int g_palette_map[TEMP_PALETTE_IDS];
+
+
+static int get_palette_index(int color_pallet)
+{
+  if (color_pallet < 0 || color_pallet >= TEMP_PALETTE_IDS)
+    return TEMP_PALETTE_RED_CHANNEL;
+
+  return g_palette_map[color_pallet];
+}
+
+
+// Table of a config.json palette name, -1 when unknown
+int get_temp_palette_by_name(const char *name)
+{
+  for (int i = 0; i < NUM_TEMP_PALETTES; i++) {
+    if (name && strcmp(name, palette_table[i].name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+
+// Temperature of palette step i in 1/TEMP_LUT_SCALE °C
+static short get_step_temp(int i)
+{
+  return (TEMP_LUT_MIN * TEMP_LUT_SCALE)
+       + (i * (TEMP_LUT_MAX - TEMP_LUT_MIN) * TEMP_LUT_SCALE + (PALETTE_STEPS - 1) / 2) / (PALETTE_STEPS - 1);
+}
+
+
+static void build_palette_lut(int palette, short *lut, short *luma_lut)
+{
+  // Red channel as the probe read it before the palette tables : temp = r / 255 * 100, luma the same way
+  if (palette == TEMP_PALETTE_RED_CHANNEL) {
+    for (int idx = 0; idx < TEMP_LUT_SIZE; idx++) {
+      int r = (idx >> 11) & 0x1f;
+      lut[idx] = get_step_temp((r << 3) | (r >> 2));
+    }
+    for (int v = 0; v < 256; v++)
+      luma_lut[v] = get_step_temp(v);
+    return;
+  }
+
+  const PaletteStop *stops = palette_table[palette].stops;
+  int count = palette_table[palette].count;
+  int colors[PALETTE_STEPS][3];
+  int s = 0;
+
+  for (int i = 0; i < PALETTE_STEPS; i++) {
+    while (s + 2 < count && i > stops[s + 1].pos)
+      s++;
+    int span = stops[s + 1].pos - stops[s].pos;
+    int t = CLAMP(i - stops[s].pos, 0, span);
+    colors[i][0] = stops[s].r + ((stops[s + 1].r - stops[s].r) * t) / span;
+    colors[i][1] = stops[s].g + ((stops[s + 1].g - stops[s].g) * t) / span;
+    colors[i][2] = stops[s].b + ((stops[s + 1].b - stops[s].b) * t) / span;
+  }
+
+  // Nearest palette color of every RGB565 value decides its temperature
+  for (int idx = 0; idx < TEMP_LUT_SIZE; idx++) {
+    int r = (idx >> 11) & 0x1f, g = (idx >> 5) & 0x3f, b = idx & 0x1f;
+    r = (r << 3) | (r >> 2);
+    g = (g << 2) | (g >> 4);
+    b = (b << 3) | (b >> 2);
+
+    int best = 0, best_dist = G_MAXINT;
+    for (int i = 0; i < PALETTE_STEPS; i++) {
+      int dr = r - colors[i][0], dg = g - colors[i][1], db = b - colors[i][2];
+      int dist = (dr * dr) + (dg * dg) + (db * db);
+      if (dist < best_dist) {
+        best_dist = dist;
+        best = i;
+      }
+    }
+    lut[idx] = get_step_temp(best);
+  }
+
+  // Nearest palette luma (BT.601) decides the temperature of a luma value. Exact for white/black hot,
+  // iron is monotonic enough, rainbow colors sharing a luma resolve to the colder one
+  for (int v = 0; v < 256; v++) {
+    int best = 0, best_dist = G_MAXINT;
+    for (int i = 0; i < PALETTE_STEPS; i++) {
+      int dist = ABS(((77 * colors[i][0] + 150 * colors[i][1] + 29 * colors[i][2]) >> 8) - v);
+      if (dist < best_dist) {
+        best_dist = dist;
+        best = i;
+      }
+    }
+    luma_lut[v] = get_step_temp(best);
+  }
+}
+
+
+// Build the tables of every palette, called once after the settings are loaded.
+// palette_map : table of each cam_ctl id (TEMP_PALETTE_IDS entries, -1 for red channel), NULL for all red channel
+void init_temp_palette_lut(int color_pallet, const int *palette_map)
+{
+  for (int i = 0; i < TEMP_PALETTE_IDS; i++) {
+    int palette = palette_map ? palette_map[i] : TEMP_PALETTE_RED_CHANNEL;
+    g_palette_map[i] = (palette >= 0 && palette < NUM_TEMP_PALETTES) ? palette : TEMP_PALETTE_RED_CHANNEL;
+  }
+
+  for (int i = 0; i < NUM_TEMP_PALETTES; i++) {
+    if (!g_palette_lut[i]) {
+      g_palette_lut[i] = g_new(short, TEMP_LUT_SIZE);
+      build_palette_lut(i, g_palette_lut[i], g_palette_luma_lut[i]);
+    }
+  }
+  set_temp_palette(color_pallet);
+}
+
+
+// Swap the table used by the sampler, safe to call while the probe is running
+void set_temp_palette(int color_pallet)
+{
+  int palette = get_palette_index(color_pallet);
+
+  if (!g_palette_lut[palette]) {
+    glog_error("temperature LUT is not initialized\n");
+    return;
+  }
+  g_atomic_pointer_set(&g_luma_lut, g_palette_luma_lut[palette]);
+  g_atomic_pointer_set(&g_temp_lut, g_palette_lut[palette]);
+  glog_trace("temperature palette=%s (color_pallet=%d)\n", palette_table[palette].name, color_pallet);
+}
+
+
+// Convert a whole row into RGB565 indices, width entries. Luma is kept as is (0~255), for the luma table
+void extract_row_indices(const unsigned char *row, int width, int pixel_size, int channel, unsigned short *indices)
+{
+  int x = 0;
+
+  if (pixel_size == 1) {
+    for (; x < width; x++)
+      indices[x] = row[x];
+    return;
+  }
+
+#if defined(__ARM_NEON)
+  if (pixel_size == 4 || pixel_size == 3) {
+    for (; x + 16 <= width; x += 16) {
+      uint8x16_t r, g, b;
+      if (pixel_size == 4) {
+        uint8x16x4_t px = vld4q_u8(row + (x * 4));
+        r = px.val[channel]; g = px.val[1]; b = px.val[2 - channel];
+      }
+      else {
+        uint8x16x3_t px = vld3q_u8(row + (x * 3));
+        r = px.val[channel]; g = px.val[1]; b = px.val[2 - channel];
+      }
+      uint16x8_t lo = vshll_n_u8(vget_low_u8(r), 8);
+      uint16x8_t hi = vshll_n_u8(vget_high_u8(r), 8);
+      lo = vsriq_n_u16(lo, vshll_n_u8(vget_low_u8(g), 8), 5);
+      hi = vsriq_n_u16(hi, vshll_n_u8(vget_high_u8(g), 8), 5);
+      lo = vsriq_n_u16(lo, vshll_n_u8(vget_low_u8(b), 8), 11);
+      hi = vsriq_n_u16(hi, vshll_n_u8(vget_high_u8(b), 8), 11);
+      vst1q_u16(indices + x, lo);
+      vst1q_u16(indices + x + 8, hi);
+    }
+  }
+#endif
+
+  for (; x < width; x++) {
+    const unsigned char *px = row + (x * pixel_size);
+    indices[x] = ((px[channel] >> 3) << 11) | ((px[1] >> 2) << 5) | (px[2 - channel] >> 3);
+  }
+}
+
+
+// Temperature of one pixel from the current palette table
+float get_pixel_temp(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+  short *lut = g_atomic_pointer_get(&g_temp_lut);
+  if (!lut)
+    return 0.0f;
+
+  return (float)lut[((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3)] / TEMP_LUT_SCALE;
+}
+
+
+// Build the integral image of the sampled thermal frame, called once per thermal tick
+int build_temp_integral(TempIntegral *ti, const ThermalPixels *px, int under_temp, int upper_temp)
+{
+  ti->valid = 0;
+  if (!px->data)
+    return -1;
+
+  // Luma frames are the Y plane of the rendered palette, they go through its luma table
+  short *lut = (px->pixel_size == 1) ? g_atomic_pointer_get(&g_luma_lut) : g_atomic_pointer_get(&g_temp_lut);
+  if (!lut)
+    return -1;
+  int under = under_temp * TEMP_LUT_SCALE;
+  int upper = upper_temp * TEMP_LUT_SCALE;
+
+  int step = get_thermal_sample_step(px->width, px->height);
+  int grid_width = (px->width + step - 1) / step;
+  int grid_height = (px->height + step - 1) / step;
+  int stride = grid_width + 1;
+  int cells = stride * (grid_height + 1);
+
+  if (cells > ti->capacity) {
+    ti->sum = g_realloc(ti->sum, sizeof(gint64) * cells);
+    ti->count = g_realloc(ti->count, sizeof(int) * cells);
+    ti->capacity = cells;
+  }
+  if (px->width > ti->index_capacity) {
+    ti->indices = g_realloc(ti->indices, sizeof(unsigned short) * px->width);
+    ti->index_capacity = px->width;
+  }
+  ti->step = step;
+  ti->grid_width = grid_width;
+  ti->grid_height = grid_height;
+
+  memset(ti->sum, 0, sizeof(gint64) * stride);
+  memset(ti->count, 0, sizeof(int) * stride);
+
+  for (int gy = 0; gy < grid_height; gy++) {
+    gint64 *sum_prev = &ti->sum[gy * stride];
+    gint64 *sum_row = &ti->sum[(gy + 1) * stride];
+    int *count_prev = &ti->count[gy * stride];
+    int *count_row = &ti->count[(gy + 1) * stride];
+    gint64 row_sum = 0;
+    int row_count = 0;
+
+    extract_row_indices(px->data + ((gy * step) * px->pitch), px->width, px->pixel_size, px->channel, ti->indices);
+
+    sum_row[0] = 0;
+    count_row[0] = 0;
+    for (int gx = 0; gx < grid_width; gx++) {
+      int temp = lut[ti->indices[gx * step]];
+      if (temp >= under && temp <= upper) {
+        row_sum += temp;
+        row_count++;
+      }
+      sum_row[gx + 1] = sum_prev[gx + 1] + row_sum;
+      count_row[gx + 1] = count_prev[gx + 1] + row_count;
+    }
+  }
+
+  ti->valid = 1;
+  return 0;
+}
+
+
+// Mean of the in-range samples inside the bbox, clipped to the frame. Returns 0 when nothing was sampled
+float get_integral_temp_avg(TempIntegral *ti, int x, int y, int width, int height, int *count)
+{
+  int step = ti->step;
+  int stride = ti->grid_width + 1;
+
+  *count = 0;
+  if (!ti->valid)
+    return 0.0;
+
+  // Sampled pixels are the multiples of step inside [x, x + width) and [y, y + height)
+  int gx0 = CLAMP((x + step - 1) / step, 0, ti->grid_width);
+  int gy0 = CLAMP((y + step - 1) / step, 0, ti->grid_height);
+  int gx1 = CLAMP((x + width + step - 1) / step, 0, ti->grid_width);
+  int gy1 = CLAMP((y + height + step - 1) / step, 0, ti->grid_height);
+  if (gx1 <= gx0 || gy1 <= gy0)
+    return 0.0;
+
+  *count = ti->count[gy1 * stride + gx1] - ti->count[gy0 * stride + gx1]
+         - ti->count[gy1 * stride + gx0] + ti->count[gy0 * stride + gx0];
+  if (*count <= 0)
+    return 0.0;
+
+  gint64 sum = ti->sum[gy1 * stride + gx1] - ti->sum[gy0 * stride + gx1]
+             - ti->sum[gy1 * stride + gx0] + ti->sum[gy0 * stride + gx0];
+
+  return (float)((double)sum / (double)(*count * TEMP_LUT_SCALE));
+}
+
+
+void free_temp_integral(TempIntegral *ti)
+{
+  g_free(ti->sum);
+  g_free(ti->count);
+  g_free(ti->indices);
+  memset(ti, 0, sizeof(TempIntegral));
+}
@@ -0,0 +1,61 @@
+#ifndef __TEMP_INTEGRAL_H__
+#define __TEMP_INTEGRAL_H__
+
+#include <glib.h>
+
+#define THERMAL_MAX_SAMPLES       (320 * 240)     //upper bound of sampled pixels per frame, decides the sample step
+#define TEMP_LUT_SIZE             (1 << 16)       //one entry per RGB565 color
+#define TEMP_LUT_SCALE            10              //LUT values are in 0.1°C
+#define TEMP_LUT_MIN              0               //temperature of the coldest palette color (°C)
+#define TEMP_LUT_MAX              100             //temperature of the hottest palette color (°C)
+
+#define TEMP_PALETTE_IDS          10              //cam_ctl palette ids (color_pallet, '0'~'9')
+
+// Temperature tables. The camera protocol documents no palette list, so every cam_ctl id is read with the
+// red channel as before unless config.json "thermal_palettes" names the table of that id
+enum {
+  TEMP_PALETTE_RED_CHANNEL = 0,   // red (or luma) 0~255 -> TEMP_LUT_MIN~TEMP_LUT_MAX, linear
+  TEMP_PALETTE_WHITE_HOT,
+  TEMP_PALETTE_BLACK_HOT,
+  TEMP_PALETTE_IRON,
+  TEMP_PALETTE_RAINBOW,
+  NUM_TEMP_PALETTES
+};
+
+// Plane 0 of a thermal frame readable from CPU, filled by map_thermal_frame() or by a synthetic source
+typedef struct {
+  const unsigned char *data;  // plane 0 (RGB or luma)
+  int width;
+  int height;
+  int pitch;                // bytes per row of plane 0
+  int pixel_size;           // bytes per pixel of plane 0
+  int channel;              // byte offset of the red channel, blue is at (2 - channel)
+} ThermalPixels;
+
+// Summed-area table of the sampled thermal frame, rebuilt once per thermal tick
+typedef struct {
+  int step;               // pixel step between samples, chosen by get_thermal_sample_step()
+  int grid_width;         // number of sampled columns (width / step)
+  int grid_height;        // number of sampled rows (height / step)
+  int capacity;           // allocated cells of sum[] and count[]
+  int valid;              // set when the table matches the current tick
+  gint64 *sum;            // integral of in-range temperatures in 1/TEMP_LUT_SCALE °C, (grid_width+1)*(grid_height+1)
+  int *count;             // integral of in-range sample counts, same layout as sum[]
+  unsigned short *indices;  // one converted row of RGB565 indices, or of luma values
+  int index_capacity;
+} TempIntegral;
+
+
+int get_thermal_sample_step(int width, int height);
+void extract_row_indices(const unsigned char *row, int width, int pixel_size, int channel, unsigned short *indices);
+
+int get_temp_palette_by_name(const char *name);
+void init_temp_palette_lut(int color_pallet, const int *palette_map);
+void set_temp_palette(int color_pallet);
+float get_pixel_temp(unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+
+int build_temp_integral(TempIntegral *ti, const ThermalPixels *px, int under_temp, int upper_temp);
+float get_integral_temp_avg(TempIntegral *ti, int x, int y, int width, int height, int *count);
+void free_temp_integral(TempIntegral *ti);
+
+#endif
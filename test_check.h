@@ -0,0 +1,14 @@
+#ifndef __TEST_CHECK_H__
+#define __TEST_CHECK_H__
+
+// Self tests of the modules (#ifdef TEST_xxx main) : one "ok"/"FAIL" line per check, failures are summed by main
+#include <stdio.h>
+#include <glib.h>
+
+static inline int check(gboolean ok, const char *what)
+{
+  printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+  return ok ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,388 @@
+#include <math.h>
+#include <string.h>
+#include "g_log.h"
+#include "thermal_projection.h"
+
+
+// Points moved to their centroid and scaled to a mean distance of sqrt(2), keeps the normal equations
+// of fit_homography() well conditioned with pixel coordinates. FALSE when every point is the same
+static gboolean get_normalization(const ProjectionPoint *points, int num_points, double *cx, double *cy, double *scale)
+{
+  double sum_x = 0.0, sum_y = 0.0, dist = 0.0;
+
+  for (int i = 0; i < num_points; i++) {
+    sum_x += points[i].x;
+    sum_y += points[i].y;
+  }
+  *cx = sum_x / num_points;
+  *cy = sum_y / num_points;
+  for (int i = 0; i < num_points; i++)
+    dist += hypot(points[i].x - *cx, points[i].y - *cy);
+  dist /= num_points;
+  if (dist < 1e-6)
+    return FALSE;
+  *scale = G_SQRT2 / dist;
+
+  return TRUE;
+}
+
+
+// Gaussian elimination with partial pivoting, a is n x n row major and is destroyed. FALSE when singular
+static gboolean solve_linear(double *a, double *b, double *x, int n)
+{
+  for (int col = 0; col < n; col++) {
+    int pivot = col;
+    for (int row = col + 1; row < n; row++) {
+      if (fabs(a[row * n + col]) > fabs(a[pivot * n + col]))
+        pivot = row;
+    }
+    if (fabs(a[pivot * n + col]) < 1e-12)
+      return FALSE;
+    if (pivot != col) {
+      for (int k = 0; k < n; k++) {
+        double t = a[col * n + k];
+        a[col * n + k] = a[pivot * n + k];
+        a[pivot * n + k] = t;
+      }
+      double t = b[col];
+      b[col] = b[pivot];
+      b[pivot] = t;
+    }
+    for (int row = col + 1; row < n; row++) {
+      double f = a[row * n + col] / a[col * n + col];
+      for (int k = col; k < n; k++)
+        a[row * n + k] -= f * a[col * n + k];
+      b[row] -= f * b[col];
+    }
+  }
+  for (int row = n - 1; row >= 0; row--) {
+    double sum = b[row];
+    for (int k = row + 1; k < n; k++)
+      sum -= a[row * n + k] * x[k];
+    x[row] = sum / a[row * n + row];
+  }
+
+  return TRUE;
+}
+
+
+// Least squares homography src -> dst of at least PROJECTION_MIN_POINTS pairs, h[8] fixed to 1.
+// FALSE when the points do not decide one, e.g. three of four on a line
+gboolean fit_homography(const ProjectionPoint *src, const ProjectionPoint *dst, int num_points, Homography *homography)
+{
+  double scx, scy, ss, dcx, dcy, ds;
+  double ata[8 * 8] = {0}, atb[8] = {0}, hn[9];
+
+  if (num_points < PROJECTION_MIN_POINTS || num_points > PROJECTION_MAX_POINTS)
+    return FALSE;
+  if (!get_normalization(src, num_points, &scx, &scy, &ss) || !get_normalization(dst, num_points, &dcx, &dcy, &ds))
+    return FALSE;
+
+  for (int i = 0; i < num_points; i++) {
+    double x = (src[i].x - scx) * ss, y = (src[i].y - scy) * ss;
+    double u = (dst[i].x - dcx) * ds, v = (dst[i].y - dcy) * ds;
+    double rows[2][8] = {
+      {x, y, 1.0, 0.0, 0.0, 0.0, -u * x, -u * y},
+      {0.0, 0.0, 0.0, x, y, 1.0, -v * x, -v * y},
+    };
+    double rhs[2] = {u, v};
+
+    for (int r = 0; r < 2; r++) {
+      for (int j = 0; j < 8; j++) {
+        for (int k = 0; k < 8; k++)
+          ata[j * 8 + k] += rows[r][j] * rows[r][k];
+        atb[j] += rows[r][j] * rhs[r];
+      }
+    }
+  }
+  if (!solve_linear(ata, atb, hn, 8))
+    return FALSE;
+  hn[8] = 1.0;
+
+  // back to pixels : H = Tdst^-1 * Hn * Tsrc
+  double tsrc[9] = {ss, 0.0, -ss * scx, 0.0, ss, -ss * scy, 0.0, 0.0, 1.0};
+  double tdst_inv[9] = {1.0 / ds, 0.0, dcx, 0.0, 1.0 / ds, dcy, 0.0, 0.0, 1.0};
+  double t[9], h[9];
+  for (int r = 0; r < 3; r++) {
+    for (int c = 0; c < 3; c++) {
+      t[r * 3 + c] = hn[r * 3] * tsrc[c] + hn[r * 3 + 1] * tsrc[3 + c] + hn[r * 3 + 2] * tsrc[6 + c];
+    }
+  }
+  for (int r = 0; r < 3; r++) {
+    for (int c = 0; c < 3; c++) {
+      h[r * 3 + c] = tdst_inv[r * 3] * t[c] + tdst_inv[r * 3 + 1] * t[3 + c] + tdst_inv[r * 3 + 2] * t[6 + c];
+    }
+  }
+  if (fabs(h[8]) < 1e-12)
+    return FALSE;
+  for (int i = 0; i < 9; i++)
+    homography->h[i] = h[i] / h[8];
+
+  return TRUE;
+}
+
+
+// Rms distance in px between the projected src points and dst, G_MAXDOUBLE when one does not project
+double get_homography_error(const Homography *homography, const ProjectionPoint *src, const ProjectionPoint *dst, int num_points)
+{
+  double sum = 0.0;
+
+  for (int i = 0; i < num_points; i++) {
+    float px, py;
+    if (!project_point(homography, src[i].x, src[i].y, &px, &py))
+      return G_MAXDOUBLE;
+    sum += (px - dst[i].x) * (px - dst[i].x) + (py - dst[i].y) * (py - dst[i].y);
+  }
+
+  return num_points > 0 ? sqrt(sum / num_points) : 0.0;
+}
+
+
+// FALSE for a point on or behind the horizon of the homography
+gboolean project_point(const Homography *homography, float x, float y, float *px, float *py)
+{
+  const double *h = homography->h;
+  double w = h[6] * x + h[7] * y + h[8];
+
+  if (w < 1e-9)
+    return FALSE;
+  *px = (float)((h[0] * x + h[1] * y + h[2]) / w);
+  *py = (float)((h[3] * x + h[4] * y + h[5]) / w);
+
+  return TRUE;
+}
+
+
+// Bbox around the projected corners, clipped to the frame. FALSE when nothing of it is left in the frame
+gboolean project_bbox(const Homography *homography, int frame_width, int frame_height,
+                      int x, int y, int width, int height, int *px, int *py, int *pwidth, int *pheight)
+{
+  float corners[4][2] = {{x, y}, {x + width, y}, {x, y + height}, {x + width, y + height}};
+  float min_x = G_MAXFLOAT, min_y = G_MAXFLOAT, max_x = -G_MAXFLOAT, max_y = -G_MAXFLOAT;
+
+  for (int i = 0; i < 4; i++) {
+    float cx, cy;
+    if (!project_point(homography, corners[i][0], corners[i][1], &cx, &cy))
+      return FALSE;
+    min_x = MIN(min_x, cx);
+    min_y = MIN(min_y, cy);
+    max_x = MAX(max_x, cx);
+    max_y = MAX(max_y, cy);
+  }
+  min_x = CLAMP(min_x, 0.0f, (float)frame_width);
+  max_x = CLAMP(max_x, 0.0f, (float)frame_width);
+  min_y = CLAMP(min_y, 0.0f, (float)frame_height);
+  max_y = CLAMP(max_y, 0.0f, (float)frame_height);
+
+  *px = (int)lrintf(min_x);
+  *py = (int)lrintf(min_y);
+  *pwidth = (int)lrintf(max_x) - *px;
+  *pheight = (int)lrintf(max_y) - *py;
+
+  return *pwidth > 0 && *pheight > 0;
+}
+
+
+double get_bbox_iou(int x1, int y1, int w1, int h1, int x2, int y2, int w2, int h2)
+{
+  int iw = MIN(x1 + w1, x2 + w2) - MAX(x1, x2);
+  int ih = MIN(y1 + h1, y2 + h2) - MAX(y1, y2);
+
+  if (iw <= 0 || ih <= 0)
+    return 0.0;
+  double inter = (double)iw * ih;
+
+  return inter / ((double)w1 * h1 + (double)w2 * h2 - inter);
+}
+
+
+void init_thermal_projection(ThermalProjection *projection)
+{
+  memset(projection, 0, sizeof(*projection));
+  projection->validate_interval = G_MAXINT;
+  projection->frame_width = PROJECTION_FRAME_WIDTH;
+  projection->frame_height = PROJECTION_FRAME_HEIGHT;
+}
+
+
+// One preset of the calibration file, presets whose points do not fit are left uncalibrated
+//   {"preset": 0, "points": [[rgb_x, rgb_y, thermal_x, thermal_y], ...]}
+static gboolean parse_projection_preset(JsonObject *object, double max_error, ThermalProjection *projection)
+{
+  ProjectionPoint src[PROJECTION_MAX_POINTS], dst[PROJECTION_MAX_POINTS];
+  Homography homography;
+
+  if (object == NULL || !json_object_has_member(object, "preset") || !json_object_has_member(object, "points")) {
+    glog_error("thermal projection : preset without preset or points\n");
+    return FALSE;
+  }
+  int preset = json_object_get_int_member(object, "preset");
+  JsonArray *points = json_object_get_array_member(object, "points");
+  int num_points = points ? json_array_get_length(points) : 0;
+  if (preset < 0 || preset >= PROJECTION_MAX_PRESETS || num_points < PROJECTION_MIN_POINTS || num_points > PROJECTION_MAX_POINTS) {
+    glog_error("thermal projection : preset=%d points=%d\n", preset, num_points);
+    return FALSE;
+  }
+
+  for (int i = 0; i < num_points; i++) {
+    JsonArray *point = json_array_get_array_element(points, i);
+    if (point == NULL || json_array_get_length(point) != 4) {
+      glog_error("thermal projection : preset=%d points[%d] is not [rgb_x, rgb_y, thermal_x, thermal_y]\n", preset, i);
+      return FALSE;
+    }
+    src[i].x = (float)json_array_get_double_element(point, 0);
+    src[i].y = (float)json_array_get_double_element(point, 1);
+    dst[i].x = (float)json_array_get_double_element(point, 2);
+    dst[i].y = (float)json_array_get_double_element(point, 3);
+  }
+
+  if (!fit_homography(src, dst, num_points, &homography)) {
+    glog_error("thermal projection : preset=%d points do not fit a homography\n", preset);
+    return TRUE;
+  }
+  double error = get_homography_error(&homography, src, dst, num_points);
+  if (error > max_error) {
+    glog_error("thermal projection : preset=%d error=%.1f over %.1f px\n", preset, error, max_error);
+    return TRUE;
+  }
+
+  if (!projection->calibrated[preset])
+    projection->num_presets++;
+  projection->calibrated[preset] = TRUE;
+  projection->homography[preset] = homography;
+  projection->error[preset] = error;
+  glog_trace("thermal projection : preset=%d points=%d error=%.2f px\n", preset, num_points, error);
+
+  return TRUE;
+}
+
+
+// Calibration json, projection is untouched when it is malformed. A preset that does not fit is only logged
+//   {"validate_interval": 30, "frame_width": 1280, "frame_height": 720, "max_error": 4, "presets": [...]}
+// Without validate_interval the thermal nvinfer stays off on the calibrated presets
+gboolean parse_thermal_projection(JsonObject *object, ThermalProjection *projection)
+{
+  ThermalProjection parsed;
+  double max_error = PROJECTION_MAX_ERROR;
+
+  init_thermal_projection(&parsed);
+  if (json_object_has_member(object, "validate_interval") && json_object_get_int_member(object, "validate_interval") > 0)
+    parsed.validate_interval = json_object_get_int_member(object, "validate_interval");
+  if (json_object_has_member(object, "frame_width"))
+    parsed.frame_width = json_object_get_int_member(object, "frame_width");
+  if (json_object_has_member(object, "frame_height"))
+    parsed.frame_height = json_object_get_int_member(object, "frame_height");
+  if (json_object_has_member(object, "max_error"))
+    max_error = json_object_get_double_member(object, "max_error");
+
+  JsonArray *presets = json_object_get_array_member(object, "presets");
+  if (presets == NULL || parsed.frame_width <= 0 || parsed.frame_height <= 0) {
+    glog_error("thermal projection : no presets or frame=%dx%d\n", parsed.frame_width, parsed.frame_height);
+    return FALSE;
+  }
+  for (guint i = 0; i < json_array_get_length(presets); i++) {
+    if (!parse_projection_preset(json_array_get_object_element(presets, i), max_error, &parsed))
+      return FALSE;
+  }
+
+  *projection = parsed;
+
+  return TRUE;
+}
+
+
+gboolean load_thermal_projection(const char *file_name, ThermalProjection *projection)
+{
+  JsonParser *parser = json_parser_new();
+  GError *error = NULL;
+  JsonNode *root;
+  gboolean ret = FALSE;
+
+  json_parser_load_from_file(parser, file_name, &error);
+  if (error) {
+    glog_error("Unable to parse file '%s': %s\n", file_name, error->message);
+    g_error_free(error);
+    g_object_unref(parser);
+    return FALSE;
+  }
+
+  root = json_parser_get_root(parser);
+  if (root && JSON_NODE_HOLDS_OBJECT(root))
+    ret = parse_thermal_projection(json_node_get_object(root), projection);
+  else
+    glog_error("%s : not a json object\n", file_name);
+  g_object_unref(parser);
+
+  return ret;
+}
+
+
+// NULL when the preset has no calibration, the thermal camera runs its own detector there
+const Homography *get_preset_homography(const ThermalProjection *projection, int preset_index)
+{
+  if (preset_index < 0 || preset_index >= PROJECTION_MAX_PRESETS || !projection->calibrated[preset_index])
+    return NULL;
+
+  return &projection->homography[preset_index];
+}
+
+
+#ifdef TEST_PROJECTION
+#include "test_check.h"
+
+// Synthetic calibrations : a known homography is recovered from its points, with and without pixel noise
+int main(int argc, char *argv[])
+{
+  Homography truth = {{0.42, 0.03, 35.0, -0.02, 0.45, 20.0, 0.00002, 0.00001, 1.0}};
+  ProjectionPoint src[PROJECTION_MAX_POINTS], dst[PROJECTION_MAX_POINTS];
+  Homography fitted;
+  int failed = 0, n = 0;
+  float px, py, qx, qy;
+
+  for (int y = 60; y < 720; y += 200) {
+    for (int x = 80; x < 1280; x += 300) {
+      src[n].x = x;
+      src[n].y = y;
+      project_point(&truth, x, y, &dst[n].x, &dst[n].y);
+      n++;
+    }
+  }
+
+  failed += check(fit_homography(src, dst, n, &fitted), "fit exact points");
+  failed += check(get_homography_error(&fitted, src, dst, n) < 0.01, "exact points error under 0.01 px");
+  project_point(&truth, 640, 360, &px, &py);
+  project_point(&fitted, 640, 360, &qx, &qy);
+  failed += check(fabs(px - qx) < 0.01 && fabs(py - qy) < 0.01, "center projects as the truth");
+
+  ProjectionPoint quad_src[4] = {src[0], src[3], src[n - 4], src[n - 1]};      //corners of the grid
+  ProjectionPoint quad_dst[4] = {dst[0], dst[3], dst[n - 4], dst[n - 1]};
+  failed += check(fit_homography(quad_src, quad_dst, 4, &fitted) && get_homography_error(&fitted, src, dst, n) < 0.01, "fit 4 corners");
+
+  ProjectionPoint noisy[PROJECTION_MAX_POINTS];
+  g_random_set_seed(7);
+  for (int i = 0; i < n; i++) {
+    noisy[i].x = dst[i].x + g_random_int_range(-100, 101) / 100.0f;     //clicked within 1 px
+    noisy[i].y = dst[i].y + g_random_int_range(-100, 101) / 100.0f;
+  }
+  failed += check(fit_homography(src, noisy, n, &fitted) && get_homography_error(&fitted, src, noisy, n) < 1.0, "noisy points error under 1 px");
+  project_point(&fitted, 640, 360, &qx, &qy);
+  failed += check(fabs(px - qx) < 1.0 && fabs(py - qy) < 1.0, "noisy center within 1 px");
+
+  ProjectionPoint line[4] = {{0, 0}, {100, 100}, {200, 200}, {300, 300}};
+  failed += check(!fit_homography(line, dst, 4, &fitted), "collinear points refused");
+  failed += check(!fit_homography(src, dst, 3, &fitted), "3 points refused");
+
+  Homography shift = {{0.5, 0.0, 10.0, 0.0, 0.5, 20.0, 0.0, 0.0, 1.0}};
+  int bx, by, bw, bh;
+  failed += check(project_bbox(&shift, 640, 360, 100, 200, 300, 100, &bx, &by, &bw, &bh) &&
+                  bx == 60 && by == 120 && bw == 150 && bh == 50, "bbox scaled and shifted");
+  failed += check(project_bbox(&shift, 640, 360, 1200, 600, 200, 200, &bx, &by, &bw, &bh) && bx + bw == 640 && by + bh == 360,
+                  "bbox clipped to the frame");
+  failed += check(!project_bbox(&shift, 640, 360, 1400, 800, 100, 100, &bx, &by, &bw, &bh), "bbox out of the frame refused");
+  failed += check(fabs(get_bbox_iou(0, 0, 10, 10, 5, 0, 10, 10) - 1.0 / 3.0) < 1e-9, "iou of half overlapping boxes");
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+
+  return failed ? 1 : 0;
+}
+#endif
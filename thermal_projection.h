@@ -0,0 +1,51 @@
+#ifndef __THERMAL_PROJECTION_H__
+#define __THERMAL_PROJECTION_H__
+
+// RGB detections reused on the thermal camera. Both cameras look at the same pen from the same PTZ head,
+// a homography per preset fitted from calibration points maps RGB bboxes into the thermal frame, so only
+// the RGB nvinfer has to run. The calibration file is "thermal_calibration_path" of config.json.
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+#define PROJECTION_MAX_PRESETS          12              //MAX_PTZ_PRESET of ptz_control.h, checked in nvds_process.c
+#define PROJECTION_MIN_POINTS           4
+#define PROJECTION_MAX_POINTS           64
+#define PROJECTION_MAX_ERROR            4.0             //px, rms error of the calibration points over which a preset is refused
+#define PROJECTION_FRAME_WIDTH          1280            //thermal bboxes are clipped to the frame, streammux size
+#define PROJECTION_FRAME_HEIGHT         720
+
+typedef struct {
+  float x;
+  float y;
+} ProjectionPoint;
+
+// RGB -> thermal, row major, h[8] is 1
+typedef struct {
+  double h[9];
+} Homography;
+
+// Calibration of every preset, coordinates are the ones of the bboxes (streammux output) of each camera
+typedef struct {
+  int validate_interval;          // thermal nvinfer interval while projecting, its detections check the projection
+  int frame_width;                // thermal frame, projected bboxes are clipped to it
+  int frame_height;
+  int num_presets;                // presets with a fitted homography
+  gboolean calibrated[PROJECTION_MAX_PRESETS];
+  Homography homography[PROJECTION_MAX_PRESETS];
+  double error[PROJECTION_MAX_PRESETS];           // rms of the calibration points in px
+} ThermalProjection;
+
+
+gboolean fit_homography(const ProjectionPoint *src, const ProjectionPoint *dst, int num_points, Homography *homography);
+double get_homography_error(const Homography *homography, const ProjectionPoint *src, const ProjectionPoint *dst, int num_points);
+gboolean project_point(const Homography *homography, float x, float y, float *px, float *py);
+gboolean project_bbox(const Homography *homography, int frame_width, int frame_height,
+                      int x, int y, int width, int height, int *px, int *py, int *pwidth, int *pheight);
+double get_bbox_iou(int x1, int y1, int w1, int h1, int x2, int y2, int w2, int h2);
+
+void init_thermal_projection(ThermalProjection *projection);
+gboolean parse_thermal_projection(JsonObject *object, ThermalProjection *projection);
+gboolean load_thermal_projection(const char *file_name, ThermalProjection *projection);
+const Homography *get_preset_homography(const ThermalProjection *projection, int preset_index);
+
+#endif
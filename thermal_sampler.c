@@ -0,0 +1,97 @@
+#include <string.h>
+#include <stdio.h>
+
+#include "g_log.h"
+#include "thermal_sampler.h"
+
+
+// Get bytes per pixel and the byte offset of the red(or luma) channel of plane 0
+static int get_format_layout(NvBufSurfaceColorFormat color_format, int *pixel_size, int *channel)
+{
+  switch (color_format) {
+    case NVBUF_COLOR_FORMAT_RGBA:
+    case NVBUF_COLOR_FORMAT_RGBx:
+      *pixel_size = 4; *channel = 0;
+      break;
+    case NVBUF_COLOR_FORMAT_BGRA:
+    case NVBUF_COLOR_FORMAT_BGRx:
+      *pixel_size = 4; *channel = 2;
+      break;
+    case NVBUF_COLOR_FORMAT_RGB:
+      *pixel_size = 3; *channel = 0;
+      break;
+    case NVBUF_COLOR_FORMAT_BGR:
+      *pixel_size = 3; *channel = 2;
+      break;
+    case NVBUF_COLOR_FORMAT_NV12:
+    case NVBUF_COLOR_FORMAT_NV12_ER:
+    case NVBUF_COLOR_FORMAT_GRAY8:
+      *pixel_size = 1; *channel = 0;          //luma plane only
+      break;
+    default:
+      return -1;
+  }
+
+  return 0;
+}
+
+
+// Map the buffer and its NvBufSurface once for the frame, unmap_thermal_frame() must follow
+gboolean map_thermal_frame(ThermalFrame *frame, GstBuffer *buf, guint batch_idx)
+{
+  memset(frame, 0, sizeof(ThermalFrame));
+  if (!gst_buffer_map(buf, &frame->map_info, GST_MAP_READ)) {
+    glog_error("Unable to map thermal buffer\n");
+    return FALSE;
+  }
+  frame->buf = buf;
+  frame->batch_idx = batch_idx;
+  frame->surface = (NvBufSurface *)frame->map_info.data;
+  if (!frame->surface || batch_idx >= frame->surface->numFilled) {
+    glog_error("Unable to retrieve NvBufSurface\n");
+    unmap_thermal_frame(frame);
+    return FALSE;
+  }
+
+  NvBufSurfaceParams *params = &frame->surface->surfaceList[batch_idx];
+  if (get_format_layout(params->colorFormat, &frame->pixels.pixel_size, &frame->pixels.channel) != 0) {
+    glog_error("Unsupported color format %d for temperature\n", params->colorFormat);
+    unmap_thermal_frame(frame);
+    return FALSE;
+  }
+
+  if (NvBufSurfaceMap(frame->surface, batch_idx, 0, NVBUF_MAP_READ) == 0) {
+    frame->surface_mapped = 1;
+    NvBufSurfaceSyncForCpu(frame->surface, batch_idx, 0);
+    frame->pixels.data = (unsigned char *)params->mappedAddr.addr[0];
+  }
+  else if (frame->surface->memType != NVBUF_MEM_CUDA_DEVICE) {
+    frame->pixels.data = (unsigned char *)params->dataPtr + params->planeParams.offset[0];
+  }
+  if (!frame->pixels.data) {
+    glog_error("Thermal surface is not accessible from CPU, memType=%d\n", frame->surface->memType);
+    unmap_thermal_frame(frame);
+    return FALSE;
+  }
+
+  frame->pixels.width = params->planeParams.width[0] ? params->planeParams.width[0] : params->width;
+  frame->pixels.height = params->planeParams.height[0] ? params->planeParams.height[0] : params->height;
+  frame->pixels.pitch = params->planeParams.pitch[0] ? params->planeParams.pitch[0] : params->pitch;
+
+  return TRUE;
+}
+
+
+void unmap_thermal_frame(ThermalFrame *frame)
+{
+  if (frame->surface_mapped) {
+    NvBufSurfaceUnMap(frame->surface, frame->batch_idx, 0);
+    frame->surface_mapped = 0;
+  }
+  if (frame->buf) {
+    gst_buffer_unmap(frame->buf, &frame->map_info);
+    frame->buf = NULL;
+  }
+  frame->surface = NULL;
+  frame->pixels.data = NULL;
+}
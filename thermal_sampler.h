@@ -0,0 +1,22 @@
+#ifndef __THERMAL_SAMPLER_H__
+#define __THERMAL_SAMPLER_H__
+
+#include <gst/gst.h>
+#include <nvbufsurface.h>
+#include "temp_integral.h"
+
+// Thermal surface mapped for CPU access, valid between map_thermal_frame() and unmap_thermal_frame()
+typedef struct {
+  GstBuffer *buf;
+  GstMapInfo map_info;
+  NvBufSurface *surface;
+  guint batch_idx;
+  int surface_mapped;       // NvBufSurfaceMap() was called and must be undone
+  ThermalPixels pixels;     // plane 0, input of build_temp_integral()
+} ThermalFrame;
+
+
+gboolean map_thermal_frame(ThermalFrame *frame, GstBuffer *buf, guint batch_idx);
+void unmap_thermal_frame(ThermalFrame *frame);
+
+#endif
@@ -0,0 +1,517 @@
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jpeglib.h>
+#include "g_log.h"
+#include "thumbnail.h"
+
+// libjpeg calls exit() on errors by default, jump back to encode_jpeg() instead
+typedef struct {
+  struct jpeg_error_mgr pub;
+  jmp_buf jump;
+} JpegError;
+
+
+static void on_jpeg_error(j_common_ptr cinfo)
+{
+  JpegError *error = (JpegError *)cinfo->err;
+  char message[JMSG_LENGTH_MAX];
+
+  cinfo->err->format_message(cinfo, message);
+  glog_error("jpeg : %s\n", message);
+  longjmp(error->jump, 1);
+}
+
+
+static gboolean encode_jpeg(const unsigned char *image, int width, int height, int components, int quality,
+                            unsigned char **jpeg, unsigned long *jpeg_size)
+{
+  struct jpeg_compress_struct cinfo;
+  JpegError error;
+  unsigned char *buffer = NULL;
+  unsigned long size = 0;
+
+  cinfo.err = jpeg_std_error(&error.pub);
+  error.pub.error_exit = on_jpeg_error;
+  if (setjmp(error.jump)) {
+    jpeg_destroy_compress(&cinfo);
+    free(buffer);
+    return FALSE;
+  }
+
+  jpeg_create_compress(&cinfo);
+  jpeg_mem_dest(&cinfo, &buffer, &size);
+  cinfo.image_width = width;
+  cinfo.image_height = height;
+  cinfo.input_components = components;
+  cinfo.in_color_space = components == 3 ? JCS_RGB : JCS_GRAYSCALE;
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, quality, TRUE);
+  jpeg_start_compress(&cinfo, TRUE);
+  while (cinfo.next_scanline < cinfo.image_height) {
+    JSAMPROW row = (JSAMPROW)(image + (size_t)cinfo.next_scanline * width * components);
+    jpeg_write_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+
+  *jpeg = buffer;
+  *jpeg_size = size;
+
+  return TRUE;
+}
+
+
+// bbox plus THUMBNAIL_MARGIN on each side, clipped to the frame, scaled down to THUMBNAIL_MAX_SIZE by
+// averaging the source pixels of each output pixel. RGB frames give a color crop, luma only frames a gray one
+gboolean crop_thumbnail(const ThermalPixels *pixels, int x, int y, int width, int height, ThumbnailImage *image)
+{
+  int components = pixels->pixel_size >= 3 ? 3 : 1;
+  int left = x - width * THUMBNAIL_MARGIN / 100;
+  int top = y - height * THUMBNAIL_MARGIN / 100;
+  int right = x + width + width * THUMBNAIL_MARGIN / 100;
+  int bottom = y + height + height * THUMBNAIL_MARGIN / 100;
+  int crop_width, crop_height, out_width, out_height, longest;
+
+  if (pixels->data == NULL || width <= 0 || height <= 0)
+    return FALSE;
+  left = CLAMP(left, 0, pixels->width);
+  right = CLAMP(right, 0, pixels->width);
+  top = CLAMP(top, 0, pixels->height);
+  bottom = CLAMP(bottom, 0, pixels->height);
+  crop_width = right - left;
+  crop_height = bottom - top;
+  if (crop_width <= 0 || crop_height <= 0)
+    return FALSE;
+
+  longest = MAX(crop_width, crop_height);
+  out_width = crop_width;
+  out_height = crop_height;
+  if (longest > THUMBNAIL_MAX_SIZE) {
+    out_width = MAX(1, crop_width * THUMBNAIL_MAX_SIZE / longest);
+    out_height = MAX(1, crop_height * THUMBNAIL_MAX_SIZE / longest);
+  }
+
+  image->data = g_malloc((size_t)out_width * out_height * components);
+  image->width = out_width;
+  image->height = out_height;
+  image->components = components;
+  for (int oy = 0; oy < out_height; oy++) {
+    int y0 = top + oy * crop_height / out_height;
+    int y1 = MAX(y0 + 1, top + (oy + 1) * crop_height / out_height);
+    for (int ox = 0; ox < out_width; ox++) {
+      int x0 = left + ox * crop_width / out_width;
+      int x1 = MAX(x0 + 1, left + (ox + 1) * crop_width / out_width);
+      unsigned int sum[3] = {0, 0, 0}, count = (y1 - y0) * (x1 - x0);
+      for (int sy = y0; sy < y1; sy++) {
+        const unsigned char *p = pixels->data + (size_t)sy * pixels->pitch + (size_t)x0 * pixels->pixel_size;
+        for (int sx = x0; sx < x1; sx++, p += pixels->pixel_size) {
+          if (components == 3) {
+            sum[0] += p[pixels->channel];
+            sum[1] += p[1];
+            sum[2] += p[2 - pixels->channel];
+          }
+          else {
+            sum[0] += p[0];
+          }
+        }
+      }
+      unsigned char *out = image->data + ((size_t)oy * out_width + ox) * components;
+      for (int c = 0; c < components; c++)
+        out[c] = (unsigned char)(sum[c] / count);
+    }
+  }
+
+  return TRUE;
+}
+
+
+// The JPEG is malloc'ed, free() it
+gboolean encode_thumbnail_image(const ThumbnailImage *image, unsigned char **jpeg, unsigned long *jpeg_size)
+{
+  gboolean encoded;
+
+  //busy scenes compress badly, a lower quality keeps the payload bounded
+  encoded = encode_jpeg(image->data, image->width, image->height, image->components, THUMBNAIL_QUALITY, jpeg, jpeg_size);
+  for (int quality = THUMBNAIL_QUALITY - 20; encoded && *jpeg_size > THUMBNAIL_MAX_BYTES && quality >= 40; quality -= 20) {
+    free(*jpeg);
+    encoded = encode_jpeg(image->data, image->width, image->height, image->components, quality, jpeg, jpeg_size);
+  }
+
+  return encoded;
+}
+
+
+// crop_thumbnail() and encode_thumbnail_image() at once. The JPEG is malloc'ed, free() it
+gboolean encode_thumbnail(const ThermalPixels *pixels, int x, int y, int width, int height,
+                          unsigned char **jpeg, unsigned long *jpeg_size)
+{
+  ThumbnailImage image;
+  gboolean encoded;
+
+  if (!crop_thumbnail(pixels, x, y, width, height, &image))
+    return FALSE;
+  encoded = encode_thumbnail_image(&image, jpeg, jpeg_size);
+  g_free(image.data);
+
+  return encoded;
+}
+
+
+void init_thumbnail_store(ThumbnailStore *store)
+{
+  memset(store, 0, sizeof(*store));
+  g_mutex_init(&store->lock);
+  g_cond_init(&store->ready);
+  store->next_seq = 1;
+}
+
+
+void free_thumbnail_store(ThumbnailStore *store)
+{
+  for (int i = 0; i < THUMBNAIL_ENTRIES; i++)
+    g_free(store->entries[i].image.data);
+  g_cond_clear(&store->ready);
+  g_mutex_clear(&store->lock);
+}
+
+
+// Worker : ask the probe for a crop of the object, the returned sequence number goes with the event
+guint request_thumbnail(ThumbnailStore *store, ObjHandle obj, int x, int y, int width, int height)
+{
+  ThumbnailEntry *entry;
+  guint seq;
+
+  g_mutex_lock(&store->lock);
+  seq = store->next_seq++;
+  if (store->next_seq == 0)
+    store->next_seq = 1;
+  entry = &store->entries[seq % THUMBNAIL_ENTRIES];
+  if (entry->state == THUMBNAIL_REQUESTED)
+    g_atomic_int_add(&store->requested, -1);
+  g_clear_pointer(&entry->image.data, g_free);
+  entry->seq = seq;
+  entry->state = THUMBNAIL_REQUESTED;
+  entry->obj = obj;
+  entry->x = (short)x;
+  entry->y = (short)y;
+  entry->width = (short)width;
+  entry->height = (short)height;
+  g_atomic_int_inc(&store->requested);
+  g_mutex_unlock(&store->lock);
+
+  return seq;
+}
+
+
+// Probe : crop every request from the mapped frame, the object's bbox of this frame when it is in objs.
+// An object whose slot was released and given to another one since the request is not in objs any more.
+// Only the downscaled crop is made here, the lock is not held while it is, the notifier encodes it
+void serve_thumbnails(ThumbnailStore *store, const ThermalPixels *pixels, const ObjRecord *objs, int num_objs)
+{
+  ThumbnailEntry requests[THUMBNAIL_ENTRIES];
+  ThumbnailImage images[THUMBNAIL_ENTRIES];
+  gboolean cropped[THUMBNAIL_ENTRIES];
+  int count = 0;
+
+  g_mutex_lock(&store->lock);
+  for (int i = 0; i < THUMBNAIL_ENTRIES; i++) {
+    if (store->entries[i].state == THUMBNAIL_REQUESTED)
+      requests[count++] = store->entries[i];
+  }
+  g_mutex_unlock(&store->lock);
+
+  for (int i = 0; i < count; i++) {
+    ThumbnailEntry *request = &requests[i];
+    int x = request->x, y = request->y, width = request->width, height = request->height;
+    for (int k = 0; k < num_objs; k++) {
+      if (get_obj_record_handle(&objs[k]) == request->obj) {
+        x = objs[k].x;
+        y = objs[k].y;
+        width = objs[k].width;
+        height = objs[k].height;
+        break;
+      }
+    }
+    cropped[i] = crop_thumbnail(pixels, x, y, width, height, &images[i]);
+  }
+
+  //a request replaced by a newer one meanwhile keeps its new state
+  g_mutex_lock(&store->lock);
+  for (int i = 0; i < count; i++) {
+    ThumbnailEntry *entry = &store->entries[requests[i].seq % THUMBNAIL_ENTRIES];
+    if (entry->seq != requests[i].seq || entry->state != THUMBNAIL_REQUESTED) {
+      if (cropped[i])
+        g_free(images[i].data);
+      continue;
+    }
+    if (cropped[i])
+      entry->image = images[i];
+    entry->state = cropped[i] ? THUMBNAIL_READY : THUMBNAIL_FAILED;
+    g_atomic_int_add(&store->requested, -1);
+  }
+  g_cond_broadcast(&store->ready);
+  g_mutex_unlock(&store->lock);
+}
+
+
+// Notifier : the JPEG of the request seq, waits up to wait_ms for the probe and encodes the crop outside
+// the lock. FALSE when it failed, was replaced by newer requests or the probe did not run in time.
+// The JPEG is the caller's, free() it
+gboolean take_thumbnail(ThumbnailStore *store, guint seq, int wait_ms, unsigned char **jpeg, unsigned long *jpeg_size)
+{
+  ThumbnailEntry *entry = &store->entries[seq % THUMBNAIL_ENTRIES];
+  gint64 end_time = g_get_monotonic_time() + (gint64)wait_ms * 1000;
+  ThumbnailImage image = {NULL, 0, 0, 0};
+  gboolean taken;
+
+  if (seq == 0)
+    return FALSE;
+
+  g_mutex_lock(&store->lock);
+  while (entry->seq == seq && entry->state == THUMBNAIL_REQUESTED) {
+    if (!g_cond_wait_until(&store->ready, &store->lock, end_time))
+      break;
+  }
+  if (entry->seq == seq && entry->state == THUMBNAIL_READY) {
+    image = entry->image;
+    entry->image.data = NULL;
+    entry->state = THUMBNAIL_FREE;
+  }
+  g_mutex_unlock(&store->lock);
+
+  if (image.data == NULL)
+    return FALSE;
+  taken = encode_thumbnail_image(&image, jpeg, jpeg_size);
+  g_free(image.data);
+
+  return taken;
+}
+
+
+#ifdef TEST_THUMBNAIL
+// Crop and encode on synthetic frames, decoded back to check size and color. With arguments a raw frame
+// from a file is encoded instead : thumbnail_test frame.raw width height rgba|rgb|bgr|gray x y w h out.jpg
+#include <pthread.h>
+#include "test_check.h"
+
+static gboolean decode_jpeg(const unsigned char *jpeg, unsigned long jpeg_size, int *width, int *height,
+                            int *components, unsigned char center[3])
+{
+  struct jpeg_decompress_struct cinfo;
+  JpegError error;
+  unsigned char *row = NULL;
+
+  cinfo.err = jpeg_std_error(&error.pub);
+  error.pub.error_exit = on_jpeg_error;
+  if (setjmp(error.jump)) {
+    jpeg_destroy_decompress(&cinfo);
+    g_free(row);
+    return FALSE;
+  }
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo, (unsigned char *)jpeg, jpeg_size);
+  jpeg_read_header(&cinfo, TRUE);
+  jpeg_start_decompress(&cinfo);
+  *width = cinfo.output_width;
+  *height = cinfo.output_height;
+  *components = cinfo.output_components;
+  row = g_malloc((size_t)cinfo.output_width * cinfo.output_components);
+  while (cinfo.output_scanline < cinfo.output_height) {
+    gboolean middle = cinfo.output_scanline == cinfo.output_height / 2;
+    jpeg_read_scanlines(&cinfo, &row, 1);
+    if (middle)
+      memcpy(center, row + (cinfo.output_width / 2) * cinfo.output_components, cinfo.output_components);
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  g_free(row);
+
+  return TRUE;
+}
+
+// width x height frame of pixel_size bytes, gray noise with a colored box at (x, y, w, h)
+static unsigned char *make_frame(ThermalPixels *pixels, int width, int height, int pixel_size, int channel,
+                                 int x, int y, int w, int h)
+{
+  unsigned char *data = g_malloc((size_t)width * height * pixel_size);
+
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < width; col++) {
+      unsigned char *p = data + ((size_t)row * width + col) * pixel_size;
+      gboolean inside = col >= x && col < x + w && row >= y && row < y + h;
+      if (pixel_size == 1) {
+        p[0] = inside ? 220 : (unsigned char)(40 + g_random_int_range(0, 16));
+        continue;
+      }
+      p[channel] = inside ? 230 : (unsigned char)(40 + g_random_int_range(0, 16));   //red
+      p[1] = inside ? 40 : (unsigned char)(40 + g_random_int_range(0, 16));
+      p[2 - channel] = inside ? 30 : (unsigned char)(40 + g_random_int_range(0, 16)); //blue
+      if (pixel_size == 4)
+        p[3] = 255;
+    }
+  }
+  pixels->data = data;
+  pixels->width = width;
+  pixels->height = height;
+  pixels->pitch = width * pixel_size;
+  pixels->pixel_size = pixel_size;
+  pixels->channel = channel;
+
+  return data;
+}
+
+static int encode_file(char *argv[])
+{
+  int width = atoi(argv[2]), height = atoi(argv[3]);
+  int pixel_size = !strcmp(argv[4], "gray") ? 1 : !strcmp(argv[4], "rgba") ? 4 : 3;
+  size_t size = (size_t)width * height * pixel_size;
+  unsigned char *data = g_malloc(size), *jpeg;
+  unsigned long jpeg_size;
+  ThermalPixels pixels = {data, width, height, width * pixel_size, pixel_size, !strcmp(argv[4], "bgr") ? 2 : 0};
+  FILE *fp = fopen(argv[1], "rb");
+  gboolean ok = fp && fread(data, 1, size, fp) == size;
+
+  if (fp)
+    fclose(fp);
+  if (ok)
+    ok = encode_thumbnail(&pixels, atoi(argv[5]), atoi(argv[6]), atoi(argv[7]), atoi(argv[8]), &jpeg, &jpeg_size);
+  if (ok && (fp = fopen(argv[9], "wb")) != NULL) {
+    fwrite(jpeg, 1, jpeg_size, fp);
+    fclose(fp);
+    printf("%s : %lu bytes\n", argv[9], jpeg_size);
+    free(jpeg);
+  }
+  g_free(data);
+
+  return ok ? 0 : 1;
+}
+
+typedef struct {
+  ThumbnailStore *store;
+  ThermalPixels *pixels;
+  ObjRecord obj;
+} ProbeArg;
+
+static void *run_probe(void *arg)
+{
+  ProbeArg *probe = arg;
+
+  while (!g_atomic_int_get(&probe->store->requested))
+    g_usleep(1000);
+  g_usleep(20000);                       //a few frames later
+  serve_thumbnails(probe->store, probe->pixels, &probe->obj, 1);
+
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  ThermalPixels pixels;
+  ThumbnailStore store;
+  unsigned char *data, *jpeg, center[3];
+  unsigned long jpeg_size;
+  int failed = 0, width, height, components;
+  guint seq, old_seq;
+
+  if (argc == 10)
+    return encode_file(argv);
+
+  g_random_set_seed(7);
+
+  //1080p RGBA, 200x100 object : crop with margin, full frame not encoded
+  data = make_frame(&pixels, 1920, 1080, 4, 0, 800, 400, 200, 100);
+  failed += check(encode_thumbnail(&pixels, 800, 400, 200, 100, &jpeg, &jpeg_size), "rgba crop encoded");
+  failed += check(decode_jpeg(jpeg, jpeg_size, &width, &height, &components, center) &&
+                  width == 280 && height == 140 && components == 3, "bbox plus margin");
+  failed += check(center[0] > 200 && center[1] < 80 && center[2] < 80, "red object keeps its color");
+  failed += check(jpeg_size <= THUMBNAIL_MAX_BYTES, "small payload");
+  printf("     %lu bytes\n", jpeg_size);
+  free(jpeg);
+
+  //large object : longest side scaled to THUMBNAIL_MAX_SIZE
+  failed += check(encode_thumbnail(&pixels, 100, 100, 1500, 700, &jpeg, &jpeg_size) &&
+                  decode_jpeg(jpeg, jpeg_size, &width, &height, &components, center) &&
+                  width == THUMBNAIL_MAX_SIZE && height < THUMBNAIL_MAX_SIZE, "large crop scaled down");
+  free(jpeg);
+
+  //bbox at the corner : clipped to the frame
+  failed += check(encode_thumbnail(&pixels, 1880, 1050, 40, 30, &jpeg, &jpeg_size) &&
+                  decode_jpeg(jpeg, jpeg_size, &width, &height, &components, center) &&
+                  width == 48 && height == 36, "crop clipped to the frame");
+  free(jpeg);
+  failed += check(!encode_thumbnail(&pixels, 2000, 10, 40, 30, &jpeg, &jpeg_size), "bbox outside the frame refused");
+  g_free(data);
+
+  //BGR and luma frames
+  data = make_frame(&pixels, 640, 480, 3, 2, 100, 100, 64, 64);
+  failed += check(encode_thumbnail(&pixels, 100, 100, 64, 64, &jpeg, &jpeg_size) &&
+                  decode_jpeg(jpeg, jpeg_size, &width, &height, &components, center) &&
+                  center[0] > 200 && center[2] < 80, "bgr channel order");
+  free(jpeg);
+  g_free(data);
+  data = make_frame(&pixels, 640, 480, 1, 0, 100, 100, 64, 64);
+  failed += check(encode_thumbnail(&pixels, 100, 100, 64, 64, &jpeg, &jpeg_size) &&
+                  decode_jpeg(jpeg, jpeg_size, &width, &height, &components, center) &&
+                  components == 1 && center[0] > 200, "gray frame");
+  free(jpeg);
+  g_free(data);
+
+  //store : worker request, probe on another thread, notifier waits for it
+  data = make_frame(&pixels, 1280, 720, 4, 0, 500, 300, 120, 80);
+  init_thumbnail_store(&store);
+  ProbeArg probe = {&store, &pixels, {.slot = 3, .generation = 1, .x = 500, .y = 300, .width = 120, .height = 80}};
+  pthread_t tid;
+  seq = request_thumbnail(&store, make_obj_handle(3, 1), 480, 290, 120, 80);
+  pthread_create(&tid, NULL, run_probe, &probe);
+  jpeg = NULL;
+  jpeg_size = 0;
+  failed += check(take_thumbnail(&store, seq, THUMBNAIL_WAIT_MS, &jpeg, &jpeg_size) &&
+                  decode_jpeg(jpeg, jpeg_size, &width, &height, &components, center) &&
+                  center[0] > 200, "notifier gets the crop of the probe's frame");
+  free(jpeg);
+  pthread_join(tid, NULL);
+  jpeg = NULL;
+  jpeg_size = 0;
+  failed += check(!take_thumbnail(&store, seq, 0, &jpeg, &jpeg_size), "crop taken once");
+
+  seq = request_thumbnail(&store, make_obj_handle(9, 1), 500, 300, 120, 80);
+  jpeg = NULL;
+  jpeg_size = 0;
+  failed += check(!take_thumbnail(&store, seq, 10, &jpeg, &jpeg_size), "no probe, notifier gives up");
+  serve_thumbnails(&store, &pixels, NULL, 0);
+  jpeg = NULL;
+  jpeg_size = 0;
+  failed += check(take_thumbnail(&store, seq, 0, &jpeg, &jpeg_size), "object gone, bbox of the event used");
+  free(jpeg);
+
+  //slot 3 released and given to another cow elsewhere in the frame
+  ObjRecord reused = {.slot = 3, .generation = 2, .x = 100, .y = 100, .width = 120, .height = 80};
+  seq = request_thumbnail(&store, make_obj_handle(3, 1), 500, 300, 120, 80);
+  serve_thumbnails(&store, &pixels, &reused, 1);
+  jpeg = NULL;
+  jpeg_size = 0;
+  failed += check(take_thumbnail(&store, seq, 0, &jpeg, &jpeg_size) &&
+                  decode_jpeg(jpeg, jpeg_size, &width, &height, &components, center) &&
+                  center[0] > 200, "reused slot not cropped, bbox of the event used");
+  free(jpeg);
+
+  old_seq = request_thumbnail(&store, make_obj_handle(1, 1), 10, 10, 20, 20);
+  for (int i = 0; i < THUMBNAIL_ENTRIES; i++)
+    seq = request_thumbnail(&store, make_obj_handle(1, 1), 10, 10, 20, 20);
+  failed += check(store.requested == THUMBNAIL_ENTRIES, "replaced requests not counted");
+  serve_thumbnails(&store, &pixels, NULL, 0);
+  jpeg = NULL;
+  jpeg_size = 0;
+  failed += check(store.requested == 0 && !take_thumbnail(&store, old_seq, 0, &jpeg, &jpeg_size) &&
+                  take_thumbnail(&store, seq, 0, &jpeg, &jpeg_size), "oldest request replaced");
+  free(jpeg);
+  free_thumbnail_store(&store);
+  g_free(data);
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+
+  return failed ? 1 : 0;
+}
+#endif
@@ -0,0 +1,61 @@
+#ifndef __THUMBNAIL_H__
+#define __THUMBNAIL_H__
+
+// JPEG of the object that raised an event, cropped on the CPU from the frame the probe has mapped.
+// The worker asks for it when the event fires, the probe copies the downscaled crop on its next frame and
+// the notifier picks it up by the sequence number carried in the event and encodes it.
+#include <glib.h>
+#include "temp_integral.h"
+#include "analytics_ring.h"
+
+#define THUMBNAIL_MARGIN          20              //% of the bbox added on each side
+#define THUMBNAIL_MAX_SIZE        320             //px, longest side of the encoded crop
+#define THUMBNAIL_QUALITY         80
+#define THUMBNAIL_MAX_BYTES       24576           //a crop over this is encoded again at a lower quality
+#define THUMBNAIL_ENTRIES         8               //requests kept per camera, an older one is replaced
+#define THUMBNAIL_WAIT_MS         500             //longest wait of the notifier for the probe
+
+enum {
+  THUMBNAIL_FREE = 0,
+  THUMBNAIL_REQUESTED,
+  THUMBNAIL_READY,
+  THUMBNAIL_FAILED,
+};
+
+// Downscaled crop, RGB or luma
+typedef struct {
+  unsigned char *data;            // g_malloc'ed, width * height * components bytes
+  int width, height;
+  int components;
+} ThumbnailImage;
+
+typedef struct {
+  guint seq;                      // 0 is never used
+  int state;
+  ObjHandle obj;                  // the probe crops its bbox of the frame it maps while the slot holds it
+  short x, y, width, height;      // bbox when the event fired, used when the object is not in the frame
+  ThumbnailImage image;           // THUMBNAIL_READY
+} ThumbnailEntry;
+
+// One per camera : requests from the worker, cropped by the probe, taken and encoded by the notifier
+typedef struct {
+  GMutex lock;
+  GCond ready;
+  gint requested;                 // requests waiting for the probe, read without the lock on every frame
+  guint next_seq;
+  ThumbnailEntry entries[THUMBNAIL_ENTRIES];
+} ThumbnailStore;
+
+
+gboolean crop_thumbnail(const ThermalPixels *pixels, int x, int y, int width, int height, ThumbnailImage *image);
+gboolean encode_thumbnail_image(const ThumbnailImage *image, unsigned char **jpeg, unsigned long *jpeg_size);
+gboolean encode_thumbnail(const ThermalPixels *pixels, int x, int y, int width, int height,
+                          unsigned char **jpeg, unsigned long *jpeg_size);
+
+void init_thumbnail_store(ThumbnailStore *store);
+void free_thumbnail_store(ThumbnailStore *store);
+guint request_thumbnail(ThumbnailStore *store, ObjHandle obj, int x, int y, int width, int height);
+void serve_thumbnails(ThumbnailStore *store, const ThermalPixels *pixels, const ObjRecord *objs, int num_objs);
+gboolean take_thumbnail(ThumbnailStore *store, guint seq, int wait_ms, unsigned char **jpeg, unsigned long *jpeg_size);
+
+#endif
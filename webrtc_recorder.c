@@ -45,9 +45,6 @@ static GOptionEntry entries[] = {
 };
 
 
-static char g_filename[2][512];
-static char g_time[2][256];
-
 // Function to get the directory name from a file path
 void get_directory_name(const char *file_path, char *directory) 
 {
@@ -69,29 +66,31 @@ gchar* formatted_file_saving_handler(GstChildProxy *splitmux, guint fragment_id,
 {
   struct tm *local_time;
   time_t t;
-  int cam_idx = *(int *)user_data;
+  int cam_idx = GPOINTER_TO_INT(user_data);
+  char filename[512];
+  char str_time[256];
 
   t = time(NULL);
   local_time = localtime(&t);
 
   //make folder name
-  sprintf (g_time[cam_idx], "RECORD_%04d%02d%02d",  local_time->tm_year + 1900,local_time->tm_mon+1,local_time->tm_mday);
-  sprintf (g_filename[cam_idx], "%s/%s", g_location, g_time[cam_idx]);
+  sprintf (str_time, "RECORD_%04d%02d%02d",  local_time->tm_year + 1900,local_time->tm_mon+1,local_time->tm_mday);
+  sprintf (filename, "%s/%s", g_location, str_time);
   
   // date 폴더가 존재하는지 확인하고 없을 경우는 폴더를 생성함 
   struct stat info;
-  if (stat(g_filename[cam_idx], &info) != 0) { 
+  if (stat(filename, &info) != 0) { 
     // stat 함수가 실패하면 폴더가 존재하지 않는 것으로 간주
-    mkdir(g_filename[cam_idx], 0777);
+    mkdir(filename, 0777);
   }
   
-  sprintf (g_time[cam_idx], "RECORD_%04d%02d%02d/CAM%d_%02d%02d%02d", local_time->tm_year + 1900,local_time->tm_mon+1,local_time->tm_mday, 
+  sprintf (str_time, "RECORD_%04d%02d%02d/CAM%d_%02d%02d%02d", local_time->tm_year + 1900,local_time->tm_mon+1,local_time->tm_mday, 
     cam_idx, local_time->tm_hour, local_time->tm_min, local_time->tm_sec);
   
-  sprintf(g_filename[cam_idx], "%s/%s.webm", g_location, g_time[cam_idx]);
-  glog_trace("generate file  g_filename[%d]=%s\n", cam_idx, g_filename[cam_idx]);
+  sprintf(filename, "%s/%s.webm", g_location, str_time);
+  glog_trace("generate file  filename[%d]=%s\n", cam_idx, filename);
 
-  return g_strdup_printf("%s", g_filename[cam_idx]);
+  return g_strdup_printf("%s", filename);
 } 
 
 
@@ -106,31 +105,31 @@ start_pipeline (void)
    * inside the same pipeline. We start by connecting it to a fakesink so that
    * we can preroll early. */
 
-  char str_pipeline[2048] = {0,};
+  GString *str_pipeline = g_string_new(NULL);
   char str_video[512];
-  for( int i = 0 ; i < g_stream_cnt ;i++){     //g_stream_cnt == "device_cnt" in config.json == 2(==> RGB(5000), Thermal(5001))
+  for( int i = 0 ; i < g_stream_cnt ;i++){     //g_stream_cnt == "device_cnt" in config.json (==> RGB(5000), Thermal(5001), ...)
     snprintf(str_video, sizeof(str_video), 
       "udpsrc port=%d ! queue ! application/x-rtp,media=video,clock-rate=90000,encoding-name=%s, payload=96  ! %s ! \
         splitmuxsink location=%s max-size-time=%ld name=recorder%d muxer-factory=matroskamux async-finalize=true muxer-properties=\"properties,offset-to-zero=true\"  ",
         g_stream_base_port + i, g_codec_name, g_rtp_depay_name, g_location, g_duration*60000000000, i); 
-    strcat(str_pipeline, str_video);
+    g_string_append(str_pipeline, str_video);
   }
-  glog_trace("%lu  %s\n", strlen(str_pipeline), str_pipeline);
-  pipeline = gst_parse_launch (str_pipeline, &error);
+  glog_trace("%lu  %s\n", str_pipeline->len, str_pipeline->str);
+  pipeline = gst_parse_launch (str_pipeline->str, &error);
+  g_string_free(str_pipeline, TRUE);
   if (error) {
     glog_error ("Failed to parse launch: %s\n", error->message);
     g_error_free (error);
     goto err;
   }
 
-  static int cam_idx[2] =  {0,1}; 
   for( int i = 0 ; i< g_stream_cnt ;i++){
     char str_element_name[256];
     sprintf(str_element_name, "recorder%d", i);
     GstElement *recorder = gst_bin_get_by_name (GST_BIN (pipeline), str_element_name);
     g_assert_nonnull (recorder);
     if(recorder){
-      g_signal_connect_data( recorder, "format-location", G_CALLBACK (formatted_file_saving_handler), &cam_idx[i], NULL, 0);
+      g_signal_connect_data( recorder, "format-location", G_CALLBACK (formatted_file_saving_handler), GINT_TO_POINTER(i), NULL, 0);
     } else {
       return FALSE;
     }